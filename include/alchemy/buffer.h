@@ -19,6 +19,7 @@
 #define _XENOMAI_ALCHEMY_BUFFER_H
 
 #include <stdint.h>
+#include <sys/uio.h>
 #include <alchemy/timer.h>
 
 /**
@@ -129,6 +130,58 @@ ssize_t rt_buffer_read(RT_BUFFER *bf,
 				    alchemy_rel_timeout(timeout, &ts));
 }
 
+ssize_t rt_buffer_reserve_timed(RT_BUFFER *bf,
+				size_t size, struct iovec iov[2],
+				const struct timespec *abs_timeout);
+
+static inline
+ssize_t rt_buffer_reserve_until(RT_BUFFER *bf,
+				size_t size, struct iovec iov[2],
+				RTIME timeout)
+{
+	struct timespec ts;
+	return rt_buffer_reserve_timed(bf, size, iov,
+				       alchemy_abs_timeout(timeout, &ts));
+}
+
+static inline
+ssize_t rt_buffer_reserve(RT_BUFFER *bf,
+			  size_t size, struct iovec iov[2],
+			  RTIME timeout)
+{
+	struct timespec ts;
+	return rt_buffer_reserve_timed(bf, size, iov,
+				       alchemy_rel_timeout(timeout, &ts));
+}
+
+int rt_buffer_commit(RT_BUFFER *bf, size_t size);
+
+ssize_t rt_buffer_peek_timed(RT_BUFFER *bf,
+			     size_t size, struct iovec iov[2],
+			     const struct timespec *abs_timeout);
+
+static inline
+ssize_t rt_buffer_peek_until(RT_BUFFER *bf,
+			     size_t size, struct iovec iov[2],
+			     RTIME timeout)
+{
+	struct timespec ts;
+	return rt_buffer_peek_timed(bf, size, iov,
+				    alchemy_abs_timeout(timeout, &ts));
+}
+
+static inline
+ssize_t rt_buffer_peek(RT_BUFFER *bf,
+		       size_t size, struct iovec iov[2],
+		       RTIME timeout)
+{
+	struct timespec ts;
+	return rt_buffer_peek_timed(bf, size, iov,
+				    alchemy_rel_timeout(timeout, &ts));
+}
+
+int rt_buffer_release(RT_BUFFER *bf, size_t size);
+
 int rt_buffer_clear(RT_BUFFER *bf);
 
 int rt_buffer_inquire(RT_BUFFER *bf,
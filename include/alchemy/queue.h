@@ -29,6 +29,8 @@
 /** Creation flags. */
 #define Q_PRIO  0x1	/* Pend by task priority order. */
 #define Q_FIFO  0x0	/* Pend by FIFO order. */
+#define Q_SPSC  0x2	/* Single producer, single consumer. */
+#define Q_SLAB  0x4	/* Fixed-size message slots. */
 
 #define Q_UNLIMITED 0	/* No size limit. */
 
@@ -86,6 +88,33 @@ struct RT_QUEUE_INFO {
 
 typedef struct RT_QUEUE_INFO RT_QUEUE_INFO;
 
+/**
+ * @brief Queue slab status descriptor
+ * @anchor RT_QUEUE_SLAB_INFO
+ *
+ * This structure reports the usage of the fixed-size message slots
+ * of a real-time queue, returned by a call to
+ * rt_queue_inquire_slab().
+ */
+struct RT_QUEUE_SLAB_INFO {
+	/**
+	 * Number of fixed-size message slots (Q_SLAB), zero otherwise.
+	 */
+	unsigned int nslots;
+	/**
+	 * Number of message slots currently allocated.
+	 */
+	unsigned int usedslots;
+	/**
+	 * Number of message allocations which could not be served
+	 * from the slots since the queue was created, because all of
+	 * them were busy.
+	 */
+	unsigned long slabmisses;
+};
+
+typedef struct RT_QUEUE_SLAB_INFO RT_QUEUE_SLAB_INFO;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -157,6 +186,9 @@ int rt_queue_flush(RT_QUEUE *queue);
 int rt_queue_inquire(RT_QUEUE *queue,
 		     RT_QUEUE_INFO *info);
 
+int rt_queue_inquire_slab(RT_QUEUE *queue,
+			  RT_QUEUE_SLAB_INFO *info);
+
 int rt_queue_bind(RT_QUEUE *queue,
 		  const char *name,
 		  RTIME timeout);
@@ -19,10 +19,13 @@
 #ifndef _BOILERPLATE_HASH_H
 #define _BOILERPLATE_HASH_H
 
+#include <sys/types.h>
 #include <pthread.h>
 #include <boilerplate/list.h>
+#include <boilerplate/atomic.h>
 
 #define HASHSLOTS  (1<<8)
+#define HASHSLOTS_MAX  (1<<16)
 
 struct hashobj {
 	dref_type(const void *) key;
@@ -30,14 +33,40 @@ struct hashobj {
 	char static_key[16];
 #endif
 	size_t len;
+	unsigned int hash;
 	struct holder link;
 };
 
 struct hash_bucket {
 	struct listobj obj_list;
+	/* Odd while a writer is updating the list. */
+	unsigned int seq;
 };
 
+#define HASH_READERS  32
+
+struct hash_reader {
+	/* Owner thread, zero if the slot is free. */
+	atomic_t tid;
+	pid_t pid;
+	/* Epoch the owner entered in, zero outside its read section. */
+	unsigned int epoch;
+};
+
+struct hash_retired;
+
 struct hash_table {
+	/* Current bucket array, initially pointing at table[]. */
+	dref_type(struct hash_bucket *) buckets;
+	unsigned int mask;
+	unsigned int count;
+	/* Odd while the buckets are being rehashed. */
+	unsigned int seq;
+	/* Issued to lockless readers, never zero. */
+	unsigned int epoch;
+	struct hash_reader readers[HASH_READERS];
+	/* Memory some reader may still refer to, newest first. */
+	dref_type(struct hash_retired *) retired;
 	struct hash_bucket table[HASHSLOTS];
 	pthread_mutex_t lock;
 };
@@ -21,6 +21,7 @@
 
 #include <linux/string.h>
 #include <linux/rbtree.h>
+#include <linux/percpu.h>
 #include <cobalt/kernel/lock.h>
 #include <cobalt/kernel/list.h>
 #include <cobalt/uapi/kernel/types.h>
@@ -64,6 +65,10 @@ struct xnheap_pgentry {
 		u32 map;
 		u32 bsize;
 	};
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	/* Busy blocks of the page parked in a per-CPU magazine. */
+	u32 cached;
+#endif
 };
 
 /*
@@ -78,6 +83,26 @@ struct xnheap_range {
 	size_t size;
 };
 
+/*
+ * Per-CPU magazines cache a few free blocks of each bucketed size
+ * for the local CPU, so that most allocation and release requests
+ * do not have to grab the heap lock.
+ */
+#define XNHEAP_MAG_DEPTH	8
+
+struct xnheap_magazine {
+	int nrblocks;
+	void *blocks[XNHEAP_MAG_DEPTH];
+};
+
+struct xnheap_pcpu {
+	struct xnheap_magazine mags[XNHEAP_MAX_BUCKETS];
+	size_t cached_size;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long flushes;
+};
+
 struct xnheap {
 	void *membase;
 	struct rb_root addr_tree;
@@ -89,6 +114,9 @@ struct xnheap {
 	char name[XNOBJECT_NAME_LEN];
 	DECLARE_XNLOCK(lock);
 	struct list_head next;
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	struct xnheap_pcpu __percpu *pcpu;
+#endif
 };
 
 extern struct xnheap cobalt_heap;
@@ -96,6 +124,26 @@ extern struct xnheap cobalt_heap;
 #define xnmalloc(size)     xnheap_alloc(&cobalt_heap, size)
 #define xnfree(ptr)        xnheap_free(&cobalt_heap, ptr)
 
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+
+int xnheap_enable_magazines(struct xnheap *heap);
+
+size_t xnheap_get_cached(const struct xnheap *heap);
+
+#else /* !CONFIG_XENO_OPT_HEAP_MAGAZINES */
+
+static inline int xnheap_enable_magazines(struct xnheap *heap)
+{
+	return 0;
+}
+
+static inline size_t xnheap_get_cached(const struct xnheap *heap)
+{
+	return 0;
+}
+
+#endif /* !CONFIG_XENO_OPT_HEAP_MAGAZINES */
+
 static inline void *xnheap_get_membase(const struct xnheap *heap)
 {
 	return heap->membase;
@@ -110,13 +158,13 @@ size_t xnheap_get_size(const struct xnheap *heap)
 static inline
 size_t xnheap_get_used(const struct xnheap *heap)
 {
-	return heap->used_size;
+	return heap->used_size - xnheap_get_cached(heap);
 }
 
 static inline
 size_t xnheap_get_free(const struct xnheap *heap)
 {
-	return heap->usable_size - heap->used_size;
+	return heap->usable_size - xnheap_get_used(heap);
 }
 
 int xnheap_init(struct xnheap *heap,
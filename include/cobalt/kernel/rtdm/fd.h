@@ -34,6 +34,8 @@ struct _rtdm_setsockopt_args;
 struct xnselector;
 struct cobalt_ppd;
 struct rtdm_device;
+struct mmsghdr;
+struct timespec64;
 
 /**
  * @file
@@ -165,6 +167,61 @@ ssize_t rtdm_recvmsg_handler(struct rtdm_fd *fd, struct user_msghdr *msg, int fl
  */
 ssize_t rtdm_sendmsg_handler(struct rtdm_fd *fd, const struct user_msghdr *msg, int flags);
 
+/**
+ * Batch receive handler
+ *
+ * When present, this optional handler is called for serving
+ * recvmmsg() requests, instead of the receive message handler being
+ * invoked once per datagram.
+ *
+ * @param[in] fd File descriptor
+ * @param[in,out] mmsgvec Vector of message descriptors as passed by
+ * the user, automatically mirrored to safe kernel memory in case of
+ * user mode call. The handler should update the msg_len field of each
+ * descriptor it fills.
+ * @param[in] vlen Number of descriptors in @a mmsgvec
+ * @param[in] flags Message flags as passed by the user
+ * @param[in] timeout Timeout bounding the whole batch as passed by the
+ * user, or NULL if none was given, in which case the receive timeout
+ * of the file descriptor applies. A null timeout is converted to
+ * MSG_DONTWAIT by the RTDM core before calling this handler.
+ *
+ * @return On success, the number of messages received, which may be
+ * less than @a vlen if the timeout elapsed, or if MSG_WAITFORONE was
+ * given. If some messages were received before an error occurred,
+ * their count should be returned. Otherwise, a negative error code is
+ * returned.
+ *
+ * @see @c recvmmsg() in Linux manual page.
+ */
+int rtdm_recvmmsg_handler(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			  unsigned int vlen, int flags,
+			  const struct timespec64 *timeout);
+
+/**
+ * Batch transmit handler
+ *
+ * When present, this optional handler is called for serving
+ * sendmmsg() requests, instead of the transmit message handler being
+ * invoked once per datagram.
+ *
+ * @param[in] fd File descriptor
+ * @param[in,out] mmsgvec Vector of message descriptors as passed by
+ * the user, automatically mirrored to safe kernel memory in case of
+ * user mode call. The handler should update the msg_len field of each
+ * descriptor it sends.
+ * @param[in] vlen Number of descriptors in @a mmsgvec
+ * @param[in] flags Message flags as passed by the user
+ *
+ * @return On success, the number of messages transmitted. If some
+ * messages were sent before an error occurred, their count should be
+ * returned. Otherwise, a negative error code is returned.
+ *
+ * @see @c sendmmsg() in Linux manual page.
+ */
+int rtdm_sendmmsg_handler(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			  unsigned int vlen, int flags);
+
 /**
  * Select handler
  *
@@ -280,6 +337,13 @@ struct rtdm_fd_ops {
 	/** See rtdm_sendmsg_handler(). */
 	ssize_t (*sendmsg_nrt)(struct rtdm_fd *fd,
 			       const struct user_msghdr *msg, int flags);
+	/** See rtdm_recvmmsg_handler(). */
+	int (*recvmmsg_rt)(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			   unsigned int vlen, int flags,
+			   const struct timespec64 *timeout);
+	/** See rtdm_sendmmsg_handler(). */
+	int (*sendmmsg_rt)(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			   unsigned int vlen, int flags);
 	/** See rtdm_select_handler(). */
 	int (*select)(struct rtdm_fd *fd,
 		      struct xnselector *selector,
@@ -300,7 +364,7 @@ struct rtdm_fd {
 	unsigned int magic;
 	struct rtdm_fd_ops *ops;
 	struct cobalt_ppd *owner;
-	unsigned int refs;
+	atomic_t refs;
 	int ufd;
 	int minor;
 	int oflags;
@@ -45,8 +45,7 @@
 #define XNSCHED_FIFO_MAX_PRIO	256
 
 #if XNSCHED_CORE_NR_PRIO > XNSCHED_CLASS_WEIGHT_FACTOR ||	\
-  (defined(CONFIG_XENO_OPT_SCALABLE_SCHED) &&			\
-   XNSCHED_CORE_NR_PRIO > XNSCHED_MLQ_LEVELS)
+  XNSCHED_CORE_NR_PRIO > XNSCHED_MLQ_LEVELS
 #error "XNSCHED_MLQ_LEVELS is too low"
 #endif
 
@@ -52,7 +52,7 @@ struct xnsched_tp_schedule {
 struct xnsched_tp {
 	struct xnsched_tpslot {
 		/** Per-partition runqueue. */
-		xnsched_queue_t runnable;
+		XNSCHED_MLQ(runnable, XNSCHED_TP_MAX_PRIO + 1);
 	} partitions[CONFIG_XENO_OPT_SCHED_TP_NRPART];
 	/** Idle slot for passive windows. */
 	struct xnsched_tpslot idle;
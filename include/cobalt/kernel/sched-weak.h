@@ -36,15 +36,15 @@
 	(XNSCHED_WEAK_MAX_PRIO - XNSCHED_WEAK_MIN_PRIO + 1)
 
 #if XNSCHED_WEAK_NR_PRIO > XNSCHED_CLASS_WEIGHT_FACTOR ||	\
-	(defined(CONFIG_XENO_OPT_SCALABLE_SCHED) &&		\
-	 XNSCHED_WEAK_NR_PRIO > XNSCHED_MLQ_LEVELS)
+	XNSCHED_WEAK_NR_PRIO > XNSCHED_MLQ_LEVELS
 #error "WEAK class has too many priority levels"
 #endif
 
 extern struct xnsched_class xnsched_class_weak;
 
 struct xnsched_weak {
-	xnsched_queue_t runnable;	/*!< Runnable thread queue. */
+	/*!< Runnable thread queue. */
+	XNSCHED_MLQ(runnable, XNSCHED_WEAK_NR_PRIO);
 };
 
 static inline int xnsched_weak_init_thread(struct xnthread *thread)
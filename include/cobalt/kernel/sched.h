@@ -54,11 +54,18 @@
 #define XNTSTOP		0x00000800
 
 struct xnsched_rt {
-	xnsched_queue_t runnable;	/*!< Runnable thread queue. */
+	/*!< Runnable thread queue, spanning XNSCHED_CORE_NR_PRIO levels. */
+	XNSCHED_MLQ(runnable, XNSCHED_MLQ_LEVELS);
 };
 
 /*!
  * \brief Scheduling information structure.
+ *
+ * The run queues and the scheduler state are serialized by nklock,
+ * like the thread and wait queue state they are updated along with,
+ * so waking up a thread on any CPU still grabs the big lock. There is
+ * no per-CPU scheduler lock; only the host tick is processed without
+ * nklock (see struct xntimerdata).
  */
 
 struct xnsched {
@@ -19,6 +19,9 @@
 #ifndef _COBALT_KERNEL_SCHEDQUEUE_H
 #define _COBALT_KERNEL_SCHEDQUEUE_H
 
+#include <linux/bitops.h>
+#include <linux/cache.h>
+#include <linux/stddef.h>
 #include <cobalt/kernel/list.h>
 
 /**
@@ -28,27 +31,47 @@
 
 #define XNSCHED_CLASS_WEIGHT_FACTOR	1024
 
-#ifdef CONFIG_XENO_OPT_SCALABLE_SCHED
-
-#include <linux/bitmap.h>
-
 /*
  * Multi-level priority queue, suitable for handling the runnable
  * thread queue of the core scheduling class with O(1) property. We
  * only manage a descending queuing order, i.e. highest numbered
  * priorities come first.
+ *
+ * Non-empty levels are tracked by a two-level bitmap: bit #n of
+ * @summary tells whether word #n of @prio_map has any bit set, so
+ * that finding the highest priority level only takes two
+ * __ffs() operations. The bitmap words share the leading cache
+ * line of the queue with @summary.
+ *
+ * A queue handles up to XNSCHED_MLQ_LEVELS levels. The list heads
+ * trail the queue header, sized for the priority range of the
+ * scheduling class owning the queue (see XNSCHED_MLQ()).
  */
 #define XNSCHED_MLQ_LEVELS  260	/* i.e. XNSCHED_CORE_NR_PRIO */
+#define XNSCHED_MLQ_WORDS   BITS_TO_LONGS(XNSCHED_MLQ_LEVELS)
 
 struct xnsched_mlq {
-	int elems;
-	DECLARE_BITMAP(prio_map, XNSCHED_MLQ_LEVELS);
-	struct list_head heads[XNSCHED_MLQ_LEVELS];
-};
+	unsigned long summary;
+	unsigned long prio_map[XNSCHED_MLQ_WORDS];
+	int levels;
+	struct list_head heads[];
+} ____cacheline_aligned;
+
+/*
+ * Declare the queue @__name with room for the list heads of its
+ * @__levels priority levels, the same count should be passed to
+ * xnsched_initq().
+ */
+#define XNSCHED_MLQ(__name, __levels)					\
+	union {								\
+		struct xnsched_mlq __name;				\
+		u8 __name ## _bytes[offsetof(struct xnsched_mlq, heads) +	\
+				    sizeof(struct list_head) * (__levels)]; \
+	}
 
 struct xnthread;
 
-void xnsched_initq(struct xnsched_mlq *q);
+void xnsched_initq(struct xnsched_mlq *q, int levels);
 
 void xnsched_addq(struct xnsched_mlq *q,
 		  struct xnthread *thread);
@@ -63,43 +86,20 @@ struct xnthread *xnsched_getq(struct xnsched_mlq *q);
 
 static inline int xnsched_emptyq_p(struct xnsched_mlq *q)
 {
-	return q->elems == 0;
+	return q->summary == 0;
 }
 
+/* Queue must not be empty. */
 static inline int xnsched_weightq(struct xnsched_mlq *q)
 {
-	return find_first_bit(q->prio_map, XNSCHED_MLQ_LEVELS);
+	int word = __ffs(q->summary);
+
+	return word * BITS_PER_LONG + __ffs(q->prio_map[word]);
 }
 
 typedef struct xnsched_mlq xnsched_queue_t;
 
-#else /* ! CONFIG_XENO_OPT_SCALABLE_SCHED */
-
-typedef struct list_head xnsched_queue_t;
-
-#define xnsched_initq(__q)			INIT_LIST_HEAD(__q)
-#define xnsched_emptyq_p(__q)			list_empty(__q)
-#define xnsched_addq(__q, __t)			list_add_prilf(__t, __q, cprio, rlink)
-#define xnsched_addq_tail(__q, __t)		list_add_priff(__t, __q, cprio, rlink)
-#define xnsched_delq(__q, __t)			(void)(__q), list_del(&(__t)->rlink)
-#define xnsched_getq(__q)							\
-	({									\
-		struct xnthread *__t = NULL;					\
-		if (!list_empty(__q))						\
-			__t = list_get_entry(__q, struct xnthread, rlink);	\
-		__t;								\
-	})
-#define xnsched_weightq(__q)						\
-	({								\
-		struct xnthread *__t;					\
-		__t = list_first_entry(__q, struct xnthread, rlink);	\
-		__t->cprio;						\
-	})
-	
-
-#endif /* !CONFIG_XENO_OPT_SCALABLE_SCHED */
-
-struct xnthread *xnsched_findq(xnsched_queue_t *q, int prio);
+struct xnthread *xnsched_findq(struct xnsched_mlq *q, int prio);
 
 /** @} */
 
@@ -40,6 +40,8 @@ struct xnselector {
 	} fds [XNSELECT_MAX_TYPES];
 	struct list_head destroy_link;
 	struct list_head bindings; /* only used by xnselector_destroy */
+	struct list_head ready; /* bindings with pending events */
+	bool evmode;
 };
 
 #define __NFDBITS__	(8 * sizeof(unsigned long))
@@ -94,6 +96,7 @@ struct xnselect_binding {
 	unsigned int bit_index;
 	struct list_head link;  /* link in selected fds list. */
 	struct list_head slink; /* link in selector list */
+	struct list_head rlink; /* link in selector ready list */
 };
 
 void xnselect_init(struct xnselect *select_block);
@@ -130,6 +133,11 @@ void xnselect_destroy(struct xnselect *select_block);
 
 int xnselector_init(struct xnselector *selector);
 
+void xnselector_set_evmode(struct xnselector *selector);
+
+void xnselector_unbind(struct xnselector *selector,
+		       unsigned int type, unsigned int index);
+
 int xnselect(struct xnselector *selector,
 	     fd_set *out_fds[XNSELECT_MAX_TYPES],
 	     fd_set *in_fds[XNSELECT_MAX_TYPES],
@@ -23,6 +23,7 @@
 #include <cobalt/kernel/clock.h>
 #include <cobalt/kernel/stat.h>
 #include <cobalt/kernel/list.h>
+#include <cobalt/kernel/lock.h>
 #include <cobalt/kernel/assert.h>
 #include <cobalt/kernel/ancillaries.h>
 #include <asm/xenomai/wrappers.h>
@@ -152,7 +153,7 @@ typedef struct {
 	xntimerh_t *head;
 } xntimerq_t;
 
-#define xntimerq_init(q)			\
+#define xntimerq_init(q, now)			\
 	({					\
 		xntimerq_t *_q = (q);		\
 		_q->root = RB_ROOT;		\
@@ -187,6 +188,107 @@ typedef struct { } xntimerq_it_t;
 #define xntimerq_it_begin(q,i)	((void) (i), xntimerq_head(q))
 #define xntimerq_it_next(q,i,h) ((void) (i), xntimerq_next((q),(h)))
 
+#elif defined(CONFIG_XENO_OPT_TIMER_WHEEL)
+
+#include <linux/rbtree.h>
+
+/*
+ * Hierarchical timing wheel. Outstanding timers are hashed to
+ * per-level slot lists in O(1), level N slots spanning 2^(N *
+ * XNTIMERQ_WHEEL_BITS) units of 2^XNTIMERQ_WHEEL_SHIFT clock
+ * ticks. Timers due no later than the current wheel unit are kept
+ * in a small date-ordered tree (the near bucket) which provides the
+ * exact queue head. Slot contents are cascaded down to the near
+ * bucket lazily, when the latter runs empty.
+ */
+#define XNTIMERQ_WHEEL_SHIFT	16
+#define XNTIMERQ_WHEEL_BITS	6
+#define XNTIMERQ_WHEEL_SIZE	(1 << XNTIMERQ_WHEEL_BITS)
+#define XNTIMERQ_WHEEL_MASK	(XNTIMERQ_WHEEL_SIZE - 1)
+#define XNTIMERQ_WHEEL_LEVELS	4
+#define XNTIMERQ_WHEEL_SLOTS	(XNTIMERQ_WHEEL_SIZE * XNTIMERQ_WHEEL_LEVELS)
+#define XNTIMERQ_NEAR		-1
+
+typedef struct {
+	unsigned long long date;
+	int prio;
+	/* XNTIMERQ_NEAR, or wheel slot index. */
+	int slot;
+	union {
+		struct rb_node node;
+		struct hlist_node link;
+	};
+} xntimerh_t;
+
+#define xntimerh_date(h) ((h)->date)
+#define xntimerh_prio(h) ((h)->prio)
+#define xntimerh_init(h) do { } while (0)
+
+typedef struct {
+	struct rb_root near;
+	xntimerh_t *head;
+	/* Current wheel time, in wheel units. */
+	unsigned long long clk;
+	int nr_wheel;
+	u64 map[XNTIMERQ_WHEEL_LEVELS];
+	struct hlist_head slots[XNTIMERQ_WHEEL_SLOTS];
+} xntimerq_t;
+
+void xntimerq_init(xntimerq_t *q, xnticks_t now);
+
+#define xntimerq_destroy(q) do { } while (0)
+#define xntimerq_empty(q) ((q)->head == NULL && (q)->nr_wheel == 0)
+
+xntimerh_t *xntimerq_pull(xntimerq_t *q);
+
+static inline xntimerh_t *xntimerq_head(xntimerq_t *q)
+{
+	if (likely(q->head))
+		return q->head;
+
+	return q->nr_wheel ? xntimerq_pull(q) : NULL;
+}
+
+xntimerh_t *xntimerq_second(xntimerq_t *q, xntimerh_t *h);
+
+void xntimerq_insert(xntimerq_t *q, xntimerh_t *holder);
+
+static inline void xntimerq_remove(xntimerq_t *q, xntimerh_t *holder)
+{
+	struct rb_node *node;
+	int slot = holder->slot;
+
+	if (slot == XNTIMERQ_NEAR) {
+		if (holder == q->head) {
+			node = rb_next(&holder->node);
+			q->head = node ? rb_entry(node, xntimerh_t, node) : NULL;
+		}
+		rb_erase(&holder->node, &q->near);
+		return;
+	}
+
+	hlist_del(&holder->link);
+	if (hlist_empty(&q->slots[slot]))
+		q->map[slot / XNTIMERQ_WHEEL_SIZE] &=
+			~(1ULL << (slot & XNTIMERQ_WHEEL_MASK));
+	q->nr_wheel--;
+}
+
+/*
+ * Iteration visits the near bucket in date order first, then the
+ * wheel slots in no particular order.
+ */
+typedef struct { } xntimerq_it_t;
+
+xntimerh_t *xntimerq_it_next(xntimerq_t *q, xntimerq_it_t *it,
+			     xntimerh_t *h);
+
+static inline
+xntimerh_t *xntimerq_it_begin(xntimerq_t *q, xntimerq_it_t *it)
+{
+	return q->head ?: xntimerq_it_next(q, it, NULL);
+}
+
 #else /* CONFIG_XENO_OPT_TIMER_LIST */
 
 typedef struct xntlholder xntimerh_t;
@@ -197,7 +299,7 @@ typedef struct xntlholder xntimerh_t;
 
 typedef struct list_head xntimerq_t;
 
-#define xntimerq_init(q)        xntlist_init(q)
+#define xntimerq_init(q, now)   xntlist_init(q)
 #define xntimerq_destroy(q)     do { } while (0)
 #define xntimerq_empty(q)       xntlist_empty(q)
 #define xntimerq_head(q)        xntlist_head(q)
@@ -214,8 +316,22 @@ typedef struct { } xntimerq_it_t;
 
 struct xnsched;
 
+/*
+ * Per-CPU timer queue. Timers are queued to the CPU which receives
+ * the clock events, under nklock, which still serializes all timer
+ * operations. @lock only covers the host tick: any code walking or
+ * updating the queue of a CPU must hold it as well, except when
+ * running on that CPU with nklock held, so that the owner CPU may
+ * expire and re-arm its host tick emulation timer holding @lock
+ * only (see xnclock_tick_host()). This is no per-CPU scheduler lock.
+ */
 struct xntimerdata {
 	xntimerq_t q;
+	DECLARE_XNLOCK(lock);
+	/** Shots not reprogrammed thanks to a timer slack. */
+	xnstat_counter_t nrskipped;
+	/** Timers fired early from the shot of another timer. */
+	xnstat_counter_t nrcoalesced;
 };
 
 static inline struct xntimerdata *
@@ -249,6 +365,8 @@ struct xntimer {
 	xnticks_t start_date;
 	/** Date of next periodic release point (timer ticks). */
 	xnticks_t pexpect_ticks;
+	/** Coalescing window (clock ticks, 0 == exact). */
+	xnticks_t slack;
 	/** Sched structure to which the timer is attached. */
 	struct xnsched *sched;
 	/** Timeout handler. */
@@ -302,13 +420,12 @@ static inline struct xnsched *xntimer_sched(struct xntimer *timer)
 #define xntimer_sched(t)	xnsched_current()
 #endif /* !CONFIG_SMP */
 
+#define xntimer_percpu_timerdata(__timer)				\
+	xnclock_percpu_timerdata(xntimer_clock(__timer),		\
+				 xnsched_cpu((__timer)->sched))
+
 #define xntimer_percpu_queue(__timer)					\
-	({								\
-		struct xntimerdata *tmd;				\
-		int cpu = xnsched_cpu((__timer)->sched);		\
-		tmd = xnclock_percpu_timerdata(xntimer_clock(__timer), cpu); \
-		&tmd->q;						\
-	})
+	(&xntimer_percpu_timerdata(__timer)->q)
 
 static inline unsigned long xntimer_gravity(struct xntimer *timer)
 {
@@ -328,7 +445,7 @@ static inline void xntimer_update_date(struct xntimer *timer)
 	xntimerh_date(&timer->aplink) = timer->start_date
 		+ xnclock_ns_to_ticks(xntimer_clock(timer),
 			timer->periodic_ticks * timer->interval_ns)
-		- xntimer_gravity(timer);
+		- xntimer_gravity(timer) + timer->slack;
 }
 
 static inline xnticks_t xntimer_pexpect(struct xntimer *timer)
@@ -373,6 +490,9 @@ void __xntimer_init(struct xntimer *timer,
 void xntimer_set_gravity(struct xntimer *timer,
 			 int gravity);
 
+void xntimer_set_slack(struct xntimer *timer,
+		       xnticks_t slack_ns);
+
 #ifdef CONFIG_XENO_OPT_STATS
 
 #define xntimer_init(__timer, __clock, __handler, __sched, __flags)	\
@@ -450,7 +570,17 @@ static inline xnticks_t xntimer_interval(struct xntimer *timer)
 static inline xnticks_t xntimer_expiry(struct xntimer *timer)
 {
 	/* Real expiry date in ticks without anticipation (no gravity) */
-	return xntimerh_date(&timer->aplink) + xntimer_gravity(timer);
+	return xntimerh_date(&timer->aplink) + xntimer_gravity(timer)
+		- timer->slack;
+}
+
+/*
+ * A timer is queued by the latest date it may fire at. Any clock shot
+ * past its soft date may fire it earlier, coalescing expiries.
+ */
+static inline xnticks_t xntimer_soft_date(struct xntimer *timer)
+{
+	return xntimerh_date(&timer->aplink) - timer->slack;
 }
 
 int xntimer_start(struct xntimer *timer,
@@ -458,6 +588,11 @@ int xntimer_start(struct xntimer *timer,
 		xnticks_t interval,
 		xntmode_t mode);
 
+int xntimer_start_local(struct xntimer *timer,
+			xnticks_t value,
+			xnticks_t interval,
+			xntmode_t mode);
+
 void __xntimer_stop(struct xntimer *timer);
 
 xnticks_t xntimer_get_date(struct xntimer *timer);
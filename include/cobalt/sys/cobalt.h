@@ -33,6 +33,7 @@
 #include <cobalt/uapi/mutex.h>
 #include <cobalt/uapi/event.h>
 #include <cobalt/uapi/monitor.h>
+#include <cobalt/uapi/mqueue.h>
 #include <cobalt/uapi/thread.h>
 #include <cobalt/uapi/cond.h>
 #include <cobalt/uapi/sem.h>
@@ -25,6 +25,7 @@ struct cobalt_event_state {
 	__u32 flags;
 #define COBALT_EVENT_PENDED  0x1
 	__u32 nwaiters;
+	__u32 waitbits;	/* Bits sleepers are waiting for. */
 };
 
 struct cobalt_event;
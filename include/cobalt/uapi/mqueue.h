@@ -0,0 +1,67 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COBALT_UAPI_MQUEUE_H
+#define _COBALT_UAPI_MQUEUE_H
+
+#include <cobalt/uapi/kernel/types.h>
+#include <cobalt/uapi/monitor.h>
+
+/*
+ * Creation flag, passed in mq_attr.mq_flags along with O_CREAT:
+ * messages are stored into a ring living in the shared memory heap,
+ * which senders and receivers access directly from userland.
+ */
+#define COBALT_MQ_SHARED	0x40000000
+
+#define COBALT_MQ_NIL		((__u32)-1)
+
+struct cobalt_mq_slot {
+	__u32 next;
+	__u32 prio;
+	__u32 len;
+	__u32 __pad;
+	/* Message data follows. */
+};
+
+/*
+ * Header of a shared message ring. All fields but @flags are
+ * serialized by the monitor gate. @flags is only updated by the
+ * kernel, telling senders and receivers which queue transitions
+ * must be reported with sc_cobalt_mq_kick.
+ */
+struct cobalt_mq_state {
+	struct cobalt_monitor_shadow monitor;
+	__u32 flags;
+#define COBALT_MQ_NOTIFY	0x1
+#define COBALT_MQ_SELECT	0x2
+	__u32 maxmsg;
+	__u32 msgsize;
+	__u32 slotsize;
+	__u32 nrqueued;
+	__u32 nrsenders;
+	__u32 nrreceivers;
+	__u32 free;
+	__u32 head;
+	__u32 tail;
+	__u32 slots;	/* Offset of the slot array from the header. */
+};
+
+struct cobalt_mq_map {
+	__u32 state_offset;
+	__u32 oflags;
+};
+
+#endif /* !_COBALT_UAPI_MQUEUE_H */
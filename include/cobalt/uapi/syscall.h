@@ -141,6 +141,11 @@
 #define sc_cobalt_timerfd_settime64		118
 #define sc_cobalt_timerfd_gettime64		119
 #define sc_cobalt_pselect64			120
+#define sc_cobalt_epoll_create			121
+#define sc_cobalt_epoll_ctl			122
+#define sc_cobalt_epoll_wait			123
+#define sc_cobalt_mq_map			124
+#define sc_cobalt_mq_kick			125
 
 #define __NR_COBALT_SYSCALLS			128 /* Power of 2 */
 
@@ -52,4 +52,26 @@
  */
 #define TFD_WAKEUP	(1 << 2)
 
+/*
+ * Timer slack
+ *
+ * or'ing TIMER_SLACK_NP(usecs) to the flags passed to timer_settime
+ * or timerfd_settime allows the timer to fire up to @usecs
+ * microseconds late, so that its expiry may be coalesced with other
+ * timers into a single clock shot. Up to ~8s can be given.
+ */
+#define __COBALT_TIMER_SLACK		(1 << 3)
+#define __COBALT_TIMER_SLACK_SHIFT	8
+#define __COBALT_TIMER_SLACK_MAX	0x7fffff
+#define __COBALT_TIMER_SLACK_MASK	\
+	(__COBALT_TIMER_SLACK | (__COBALT_TIMER_SLACK_MAX << __COBALT_TIMER_SLACK_SHIFT))
+#define TIMER_SLACK_NP(__usecs)		\
+	(__COBALT_TIMER_SLACK |		\
+	 (((__usecs) & __COBALT_TIMER_SLACK_MAX) << __COBALT_TIMER_SLACK_SHIFT))
+#define TFD_TIMER_SLACK(__usecs)	TIMER_SLACK_NP(__usecs)
+#define __COBALT_TIMER_SLACK_NS(__flags)				\
+	((__flags) & __COBALT_TIMER_SLACK ?				\
+	 (((__flags) >> __COBALT_TIMER_SLACK_SHIFT) &			\
+	  __COBALT_TIMER_SLACK_MAX) * 1000ULL : 0)
+
 #endif /* !_COBALT_UAPI_TIME_H */
@@ -19,6 +19,7 @@
 #define _COPPERPLATE_REGISTRY_OBSTACK_H
 
 #include <copperplate/registry.h>
+#include <copperplate/registry-snapshot.h>
 
 #ifdef CONFIG_XENO_REGISTRY
 
@@ -54,6 +55,19 @@ struct fsobstack_syncops {
 
 struct syncobj;
 
+struct fssnapshot {
+	struct regsnap_header *hdr;
+	size_t len;
+};
+
+struct fssnapshot_syncops {
+	int class;
+	size_t state_size;
+	void (*collect_state)(void *state, struct fsobj *fsobj);
+	void (*collect_waiter)(struct regsnap_waiter *w,
+			       struct threadobj *thobj);
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -87,6 +101,19 @@ ssize_t fsobj_obstack_read(struct fsobj *fsobj,
 
 int fsobj_obstack_release(struct fsobj *fsobj, void *priv);
 
+int fssnapshot_alloc(struct fssnapshot *s, int class,
+		     size_t state_size, int nwaiters);
+
+void fssnapshot_finish(struct fssnapshot *s, int nwaiters);
+
+int fssnapshot_grab_syncobj(struct fssnapshot *s,
+			    struct fsobj *fsobj,
+			    struct syncobj *sobj,
+			    const struct fssnapshot_syncops *ops);
+
+ssize_t fssnapshot_pull(struct fssnapshot *s,
+			char *buf, size_t size, off_t offset);
+
 #ifdef __cplusplus
 }
 #endif
@@ -109,6 +136,22 @@ static inline void fsobstack_finish(struct fsobstack *o)
 	o->data = obstack_finish(&o->obstack);
 }
 
+static inline void *fssnapshot_state(struct fssnapshot *s)
+{
+	return (void *)s->hdr + s->hdr->state_offset;
+}
+
+static inline struct regsnap_waiter *fssnapshot_waiters(struct fssnapshot *s)
+{
+	return (void *)s->hdr + s->hdr->waiter_offset;
+}
+
+static inline void fssnapshot_destroy(struct fssnapshot *s)
+{
+	free(s->hdr);
+	s->hdr = NULL;
+}
+
 static inline
 void registry_init_file_obstack(struct fsobj *fsobj, 
 				const struct registry_operations *ops)
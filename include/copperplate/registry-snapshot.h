@@ -0,0 +1,110 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+#ifndef _COPPERPLATE_REGISTRY_SNAPSHOT_H
+#define _COPPERPLATE_REGISTRY_SNAPSHOT_H
+
+#include <stdint.h>
+
+/*
+ * Binary snapshot of a registry object, as read from the "<file>.bin"
+ * sibling of any registry file which supports it. A snapshot is a
+ * header, followed by the class-specific state at state_offset, then
+ * by nwaiters entries of waiter_size bytes each at waiter_offset.
+ *
+ * Readers must check the magic and version fields, and use the
+ * offset and size fields from the header instead of sizeof(), so
+ * that trailing members may be added to the state and waiter
+ * structs without bumping the version.
+ */
+#define REGSNAP_MAGIC		0x786e7362	/* "xnsb" */
+#define REGSNAP_VERSION		1
+
+#define REGSNAP_SUFFIX		".bin"
+
+enum regsnap_class {
+	REGSNAP_ALCHEMY_SEM = 1,
+	REGSNAP_ALCHEMY_EVENT,
+	REGSNAP_ALCHEMY_QUEUE,
+	REGSNAP_ALCHEMY_HEAP,
+	REGSNAP_ALCHEMY_BUFFER,
+};
+
+struct regsnap_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t class;
+	uint32_t size;
+	uint32_t state_offset;
+	uint32_t state_size;
+	uint32_t waiter_offset;
+	uint32_t waiter_size;
+	uint32_t nwaiters;
+	/* CLOCK_COPPERPLATE date of the snapshot, in nanoseconds. */
+	uint64_t date;
+};
+
+#define REGSNAP_NAME_LEN	32
+
+/* Waiting on the drain side of the object (e.g. buffer output). */
+#define REGSNAP_WAIT_DRAIN	0x1
+
+struct regsnap_waiter {
+	char name[REGSNAP_NAME_LEN];
+	int32_t pid;
+	/* -1 if unknown. */
+	int32_t prio;
+	uint32_t flags;
+	uint32_t __pad;
+	/* Pending request size, heap waiters only. */
+	uint64_t reqsz;
+};
+
+struct regsnap_alchemy_sem {
+	int32_t value;
+	uint32_t __pad;
+};
+
+struct regsnap_alchemy_event {
+	uint32_t value;
+	uint32_t __pad;
+};
+
+struct regsnap_alchemy_queue {
+	uint64_t totalmem;
+	uint64_t usedmem;
+	uint64_t limit;
+	uint32_t mcount;
+	/* Q_* creation mode. */
+	uint32_t mode;
+};
+
+struct regsnap_alchemy_heap {
+	uint64_t totalmem;
+	uint64_t usedmem;
+	/* H_* creation mode. */
+	uint32_t mode;
+	uint32_t __pad;
+};
+
+struct regsnap_alchemy_buffer {
+	uint64_t bufsz;
+	uint64_t fillsz;
+	/* B_* creation mode. */
+	uint32_t mode;
+	uint32_t __pad;
+};
+
+#endif /* _COPPERPLATE_REGISTRY_SNAPSHOT_H */
@@ -27,6 +27,7 @@
 #include <boilerplate/obstack.h>
 
 struct fsobj;
+struct fssnapshot;
 
 #define REGISTRY_SHARED  1
 #define REGISTRY_ANON    2
@@ -42,6 +43,8 @@ struct registry_operations {
 	ssize_t (*write)(struct fsobj *fsobj,
 			 const char *buf, size_t size, off_t offset,
 			 void *priv);
+	int (*snapshot)(struct fsobj *fsobj,
+			struct fssnapshot *snap);
 };
 
 struct regfs_dir;
@@ -56,7 +56,7 @@ struct syncobj_corespec {
 
 struct syncobj_corespec {
 	pthread_mutex_t lock;
-	pthread_cond_t drain_sync;
+	clockid_t clk_id;
 };
 
 #endif /* CONFIG_XENO_MERCURY */
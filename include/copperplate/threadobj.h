@@ -102,12 +102,21 @@ threadobj_get_window(struct threadobj_corespec *corespec)
 #include <sys/time.h>
 
 struct threadobj_corespec {
-	pthread_cond_t grant_sync;
+	/** Futex word the thread parks on in syncobj waits. */
+	int wait_word;
+	/** Monitor released for parking. */
+	int wait_parked;
 	int policy_unlocked;
 	struct sched_param_ex schedparam_unlocked;
 	timer_t rr_timer;
 	/** Timeout reported by sysregd. */
 	struct timespec timeout;
+	/** Next periodic release point. */
+	struct timespec periodic_date;
+	/** Periodic interval, zero for a one-shot release. */
+	struct timespec periodic_period;
+	/** Bumped each time the periodic timeline is reprogrammed. */
+	unsigned int periodic_gen;
 #ifdef CONFIG_XENO_WORKAROUND_CONDVAR_PI
 	int policy_unboosted;
 	struct sched_param_ex schedparam_unboosted;
@@ -28,6 +28,7 @@ struct copperplate_setup_data {
 	int shared_registry;
 	size_t mem_pool;
 	gid_t session_gid;
+	int timer_servers;
 };
 
 #ifdef __cplusplus
@@ -93,6 +94,16 @@ static inline read_config_tunable(session_gid, gid_t)
 	return __copperplate_setup_data.session_gid;
 }
 
+static inline define_config_tunable(timer_servers, int, nr)
+{
+	__copperplate_setup_data.timer_servers = nr;
+}
+
+static inline read_config_tunable(timer_servers, int)
+{
+	return __copperplate_setup_data.timer_servers;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,6 +40,8 @@
 #ifndef _RTDM_UAPI_NET_H
 #define _RTDM_UAPI_NET_H
 
+#include <linux/types.h>
+
 /* sub-classes: RTDM_CLASS_NETWORK */
 #define RTDM_SUBCLASS_RTNET     0
 
@@ -56,6 +58,16 @@
  * Use RTNET_RTIOC_TIMEOUT with any negative timeout value instead. */
 #define RTNET_RTIOC_EXTPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x14, unsigned int)
 #define RTNET_RTIOC_SHRPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x15, unsigned int)
+/* Pin the socket's outgoing traffic to a hardware TX queue of the
+ * device, or pass SOCK_TXQUEUE_AUTO to select the queue by priority. */
+#define RTNET_RTIOC_TXQUEUE     _IOW(RTIOC_TYPE_NETWORK, 0x16, int)
+/* Memory-mapped rings of packet sockets, see struct rtnet_packet_ring_req */
+#define RTNET_RTIOC_PACKET_RING _IOWR(RTIOC_TYPE_NETWORK, 0x17, \
+				      struct rtnet_packet_ring_req)
+/* Send all TX slots marked RTNET_PACKET_TX_SEND_REQUEST, in order */
+#define RTNET_RTIOC_PACKET_KICK _IO(RTIOC_TYPE_NETWORK, 0x18)
+/* Wait for the RX slot of the given index to be handed to the user */
+#define RTNET_RTIOC_PACKET_WAIT _IOW(RTIOC_TYPE_NETWORK, 0x19, unsigned int)
 
 /* socket transmission priorities */
 #define SOCK_MAX_PRIO           0
@@ -69,7 +81,64 @@
 #define SOCK_DEF_NRT_CHANNEL    1           /* default non-rt xmit channel */
 #define SOCK_USER_CHANNEL       2           /* first user-defined channel  */
 
+/* argument for RTNET_RTIOC_TXQUEUE */
+#define SOCK_TXQUEUE_AUTO       -1
+
 /* argument construction for RTNET_RTIOC_XMITPARAMS */
 #define SOCK_XMIT_PARAMS(priority, channel) ((priority) | ((channel) << 16))
 
+/*
+ * Memory-mapped packet socket rings.
+ *
+ * RTNET_RTIOC_PACKET_RING sets up frame_size-byte slots, rx_frames
+ * of them for reception then tx_frames for transmission, and returns
+ * their offsets in the area to mmap() from the socket, of map_len
+ * bytes. The ring cannot be resized. TX slots are only available on
+ * SOCK_RAW sockets bound to an interface, and carry whole frames
+ * including the link-layer header.
+ *
+ * Each slot starts with a struct rtnet_packet_slot, the frame data
+ * follows at RTNET_PACKET_SLOT_HDRLEN. Ownership of a slot is passed
+ * by writing its status word, after the slot contents with a write
+ * barrier in between.
+ */
+struct rtnet_packet_ring_req {
+	__u32 frame_size;	/* multiple of RTNET_PACKET_SLOT_ALIGN */
+	__u32 rx_frames;
+	__u32 tx_frames;
+	__u32 rx_offset;	/* returned */
+	__u32 tx_offset;	/* returned */
+	__u32 map_len;		/* returned */
+};
+
+/* Ring header, at the beginning of the mapping. */
+struct rtnet_packet_ring_hdr {
+	__u32 rx_drops;		/* frames dropped for lack of free RX slot */
+	__u32 __reserved[15];
+};
+
+struct rtnet_packet_slot {
+	__u32 status;
+	__u32 len;		/* frame length */
+	__u64 tstamp;		/* RX: arrival date, in nanoseconds */
+	__s32 ifindex;		/* RX: receiving interface */
+	__u16 protocol;		/* RX: protocol, in network order */
+	__u8 pkttype;		/* RX: PACKET_* type */
+	__u8 __pad;
+	__u32 __reserved[2];
+};
+
+#define RTNET_PACKET_SLOT_ALIGN		64
+#define RTNET_PACKET_SLOT_HDRLEN	sizeof(struct rtnet_packet_slot)
+
+/* RX slot status */
+#define RTNET_PACKET_RX_KERNEL		0x0	/* free for reception */
+#define RTNET_PACKET_RX_USER		0x1	/* holds a received frame */
+#define RTNET_PACKET_RX_TRUNC		0x2	/* frame truncated to the slot */
+
+/* TX slot status */
+#define RTNET_PACKET_TX_AVAILABLE	0x0	/* free for the user */
+#define RTNET_PACKET_TX_SEND_REQUEST	0x1	/* to be sent on next kick */
+#define RTNET_PACKET_TX_WRONG_FORMAT	0x2	/* rejected, to be reset */
+
 #endif  /* !_RTDM_UAPI_NET_H */
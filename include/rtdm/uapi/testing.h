@@ -61,6 +61,35 @@ typedef struct rttst_tmbench_config {
 	int freeze_max;
 } rttst_tmbench_config_t;
 
+#define RTTST_TMQUEUE_MAX_TIMERS	100000
+
+struct rttst_tmqueue_parms {
+	__u32 nrtimers;
+	__u32 loops;
+	__s64 insert_avg_ns;
+	__s64 insert_max_ns;
+	__s64 remove_avg_ns;
+	__s64 remove_max_ns;
+	/* Expiry check: armed timers which did not fire, */
+	__u32 missed;
+	/* timers which fired before an earlier one, */
+	__u32 misordered;
+	/* stopped timers which fired nevertheless. */
+	__u32 stray;
+	__u32 pad;
+};
+
+#define RTTST_SCHEDQ_MAX_THREADS	10000
+
+struct rttst_schedq_parms {
+	__u32 nrthreads;
+	__u32 loops;
+	__s64 pick_avg_ns;
+	__s64 pick_max_ns;
+	__s64 requeue_avg_ns;
+	__s64 requeue_max_ns;
+};
+
 struct rttst_swtest_task {
 	unsigned int index;
 	unsigned int flags;
@@ -104,6 +133,7 @@ struct rttst_swtest_error {
 #define RTTST_HEAPCHECK_SHUFFLE    2
 #define RTTST_HEAPCHECK_PATTERN    4
 #define RTTST_HEAPCHECK_HOT        8
+#define RTTST_HEAPCHECK_MAGAZINES  16
 
 struct rttst_heap_parms {
 	__u64 heap_size;
@@ -126,11 +156,34 @@ struct rttst_heap_stats {
 	int flags;
 };
 
+struct rttst_heap_smp_parms {
+	__u64 heap_size;
+	__u64 block_size;
+	int flags;
+	int nrcpus;
+	int loops;
+	int nrblocks;
+	__s64 alloc_avg_ns;
+	__s64 free_avg_ns;
+	__u64 ops_per_sec;
+};
+
 struct rttst_heap_stathdr {
 	int nrstats;
 	struct rttst_heap_stats *buf;
 };
 
+#define RTTST_CSUMBENCH_MAX_LEN		65536
+
+struct rttst_csum_parms {
+	__u32 variant;		/* index of the copy and checksum routine */
+	__u32 len;		/* bytes per copy */
+	__u32 offset;		/* misalignment of the buffers, below 8 */
+	__u32 loops;
+	char name[16];		/* returned */
+	__u64 avg_ns;		/* returned, per copy */
+};
+
 #define RTIOC_TYPE_TESTING		RTDM_CLASS_TESTING
 
 /*!
@@ -146,6 +199,8 @@ struct rttst_heap_stathdr {
 #define RTDM_SUBCLASS_RTDMTEST		3
 /** subclase name: "heapcheck" */
 #define RTDM_SUBCLASS_HEAPCHECK		4
+/** subclase name: "csumbench" */
+#define RTDM_SUBCLASS_CSUMBENCH		5
 /** @} */
 
 /*!
@@ -161,6 +216,9 @@ struct rttst_heap_stathdr {
 #define RTTST_RTIOC_TMBENCH_STOP \
 	_IOWR(RTIOC_TYPE_TESTING, 0x11, struct rttst_overall_bench_res)
 
+#define RTTST_RTIOC_TMBENCH_QUEUE \
+	_IOWR(RTIOC_TYPE_TESTING, 0x12, struct rttst_tmqueue_parms)
+
 #define RTTST_RTIOC_SWTEST_SET_TASKS_COUNT \
 	_IOW(RTIOC_TYPE_TESTING, 0x30, __u32)
 
@@ -188,6 +246,9 @@ struct rttst_heap_stathdr {
 #define RTTST_RTIOC_SWTEST_SET_PAUSE \
 	_IOW(RTIOC_TYPE_TESTING, 0x38, __u32)
 
+#define RTTST_RTIOC_SWTEST_PICK_BENCH \
+	_IOWR(RTIOC_TYPE_TESTING, 0x39, struct rttst_schedq_parms)
+
 #define RTTST_RTIOC_RTDM_DEFER_CLOSE \
 	_IOW(RTIOC_TYPE_TESTING, 0x40, __u32)
 
@@ -206,6 +267,12 @@ struct rttst_heap_stathdr {
 #define RTTST_RTIOC_HEAP_STAT_COLLECT \
 	_IOR(RTIOC_TYPE_TESTING, 0x45, int)
 
+#define RTTST_RTIOC_HEAP_CHECK_SMP \
+	_IOWR(RTIOC_TYPE_TESTING, 0x46, struct rttst_heap_smp_parms)
+
+#define RTTST_RTIOC_CSUM_BENCH \
+	_IOWR(RTIOC_TYPE_TESTING, 0x50, struct rttst_csum_parms)
+
 /** @} */
 
 #endif /* !_RTDM_UAPI_TESTING_H */
@@ -11,6 +11,6 @@
 #define _COBALT_ASM_UAPI_ABIREVISION_H
 
 /* The ABI revision level we use on this arch. */
-#define XENOMAI_ABI_REV   20UL
+#define XENOMAI_ABI_REV   21UL
 
 #endif /* !_COBALT_ASM_UAPI_ABIREVISION_H */
@@ -228,6 +228,7 @@ enqueue:
 void xnclock_apply_offset(struct xnclock *clock, xnsticks_t delta_ns)
 {
 	struct xntimer *timer, *tmp;
+	struct xntimerdata *tmd;
 	struct list_head adjq;
 	struct xnsched *sched;
 	xnsticks_t delta;
@@ -250,7 +251,10 @@ void xnclock_apply_offset(struct xnclock *clock, xnsticks_t delta_ns)
 
 	for_each_online_cpu(cpu) {
 		sched = xnsched_struct(cpu);
-		q = &xnclock_percpu_timerdata(clock, cpu)->q;
+		tmd = xnclock_percpu_timerdata(clock, cpu);
+		q = &tmd->q;
+
+		xnlock_get(&tmd->lock);
 
 		for (h = xntimerq_it_begin(q, &it); h;
 		     h = xntimerq_it_next(q, &it, h)) {
@@ -259,8 +263,10 @@ void xnclock_apply_offset(struct xnclock *clock, xnsticks_t delta_ns)
 				list_add_tail(&timer->adjlink, &adjq);
 		}
 
-		if (list_empty(&adjq))
+		if (list_empty(&adjq)) {
+			xnlock_put(&tmd->lock);
 			continue;
+		}
 
 		list_for_each_entry_safe(timer, tmp, &adjq, adjlink) {
 			list_del(&timer->adjlink);
@@ -268,6 +274,8 @@ void xnclock_apply_offset(struct xnclock *clock, xnsticks_t delta_ns)
 			adjust_timer(timer, q, delta);
 		}
 
+		xnlock_put(&tmd->lock);
+
 		if (sched != xnsched_current())
 			xnclock_remote_shot(clock, sched);
 		else
@@ -419,13 +427,42 @@ static void cleanup_timerlist_proc(struct xnclock *clock)
 	xnvfile_destroy_snapshot(&clock->timer_vfile);
 }
 
+static int coalescing_vfile_show(struct xnvfile_regular_iterator *it,
+				 void *data)
+{
+	struct xntimerdata *tmd;
+	int cpu;
+
+	xnvfile_printf(it, "%-3s  %-10s  %s\n", "CPU", "SKIPPED", "COALESCED");
+
+	for_each_online_cpu(cpu) {
+		tmd = xnclock_percpu_timerdata(&nkclock, cpu);
+		xnvfile_printf(it, "%-3u  %-10lu  %lu\n", cpu,
+			       xnstat_counter_get(&tmd->nrskipped),
+			       xnstat_counter_get(&tmd->nrcoalesced));
+	}
+
+	return 0;
+}
+
+static struct xnvfile_regular_ops coalescing_vfile_ops = {
+	.show = coalescing_vfile_show,
+};
+
+static struct xnvfile_regular coalescing_vfile = {
+	.ops = &coalescing_vfile_ops,
+};
+
 static void init_timerlist_root(void)
 {
 	xnvfile_init_dir("timer", &timerlist_vfroot, &cobalt_vfroot);
+	xnvfile_init_regular("coalescing", &coalescing_vfile,
+			     &timerlist_vfroot);
 }
 
 static void cleanup_timerlist_root(void)
 {
+	xnvfile_destroy_regular(&coalescing_vfile);
 	xnvfile_destroy_dir(&timerlist_vfroot);
 }
 
@@ -617,7 +654,8 @@ int xnclock_register(struct xnclock *clock, const cpumask_t *affinity)
 	 */
 	for_each_online_cpu(cpu) {
 		tmd = xnclock_percpu_timerdata(clock, cpu);
-		xntimerq_init(&tmd->q);
+		xntimerq_init(&tmd->q, xnclock_read_raw(clock));
+		xnlock_init(&tmd->lock);
 	}
 
 #ifdef CONFIG_XENO_OPT_STATS
@@ -681,6 +719,7 @@ EXPORT_SYMBOL_GPL(xnclock_deregister);
 void xnclock_tick(struct xnclock *clock)
 {
 	struct xnsched *sched = xnsched_current();
+	struct xntimerdata *tmd;
 	struct xntimer *timer;
 	xnsticks_t delta;
 	xntimerq_t *tmq;
@@ -698,10 +737,12 @@ void xnclock_tick(struct xnclock *clock)
 	if (IS_ENABLED(CONFIG_XENO_OPT_EXTCLOCK) &&
 	    clock != &nkclock &&
 	    !cpumask_test_cpu(xnsched_cpu(sched), &clock->affinity))
-		tmq = &xnclock_percpu_timerdata(clock, 0)->q;
+		tmd = xnclock_percpu_timerdata(clock, 0);
 	else
 #endif
-		tmq = &xnclock_this_timerdata(clock)->q;
+		tmd = xnclock_this_timerdata(clock);
+
+	tmq = &tmd->q;
 
 	/*
 	 * Optimisation: any local timer reprogramming triggered by
@@ -714,8 +755,16 @@ void xnclock_tick(struct xnclock *clock)
 	while ((h = xntimerq_head(tmq)) != NULL) {
 		timer = container_of(h, struct xntimer, aplink);
 		delta = (xnsticks_t)(xntimerh_date(&timer->aplink) - now);
-		if (delta > 0)
-			break;
+		if (delta > 0) {
+			/*
+			 * Timers are queued by their latest firing
+			 * date. Fire the next one early if we are
+			 * within its slack already, saving a shot.
+			 */
+			if (delta > (xnsticks_t)timer->slack)
+				break;
+			xnstat_counter_inc(&tmd->nrcoalesced);
+		}
 
 		trace_cobalt_timer_expire(timer);
 
@@ -770,6 +819,74 @@ void xnclock_tick(struct xnclock *clock)
 }
 EXPORT_SYMBOL_GPL(xnclock_tick);
 
+/**
+ * @fn bool xnclock_tick_host(struct xnclock *clock)
+ * @brief Process a core clock tick due to the host timer only.
+ *
+ * Most core clock ticks only carry the host tick on CPUs running
+ * real-time activities which do not depend on timers. This routine
+ * handles this case holding the timer queue lock of the current CPU
+ * only, so that such ticks do not have to grab nklock.
+ *
+ * @param clock The core clock for which a new event was received.
+ *
+ * @return true if the tick was fully processed, false if some other
+ * timer has elapsed, in which case xnclock_tick() must be called
+ * under nklock.
+ *
+ * @coretags{coreirq-only}
+ */
+bool xnclock_tick_host(struct xnclock *clock)
+{
+	struct xnsched *sched = xnsched_current();
+	struct xntimer *timer = &sched->htimer, *next;
+	struct xntimerdata *tmd;
+	bool done = false;
+	xnticks_t now;
+	xntimerh_t *h;
+
+	tmd = xnclock_this_timerdata(clock);
+	xnlock_get(&tmd->lock);
+
+	h = xntimerq_head(&tmd->q);
+	if (h != &timer->aplink)
+		goto out;
+
+	now = xnclock_read_raw(clock);
+	if ((xnsticks_t)(xntimerh_date(h) - now) > 0)
+		goto out;
+
+	/* Bail out if the next timer is due, even early (slack). */
+	h = xntimerq_second(&tmd->q, h);
+	if (h) {
+		next = container_of(h, struct xntimer, aplink);
+		if ((xnsticks_t)(xntimer_soft_date(next) - now) <= 0)
+			goto out;
+	}
+
+	trace_cobalt_timer_expire(timer);
+
+	xntimer_dequeue(timer, &tmd->q);
+	xntimer_account_fired(timer);
+	sched->lflags |= XNHTICK;
+	sched->lflags &= ~XNHDEFER;
+
+	if (timer->status & XNTIMER_PERIODIC) {
+		do {
+			timer->periodic_ticks++;
+			xntimer_update_date(timer);
+		} while (xntimerh_date(&timer->aplink) < now);
+		xntimer_enqueue(timer, &tmd->q);
+	}
+
+	xnclock_program_shot(clock, sched);
+	done = true;
+out:
+	xnlock_put(&tmd->lock);
+
+	return done;
+}
+
 static int set_core_clock_gravity(struct xnclock *clock,
 				  const struct xnclock_gravity *p)
 {
@@ -23,9 +23,11 @@ void xnintr_core_clock_handler(void)
 {
 	struct xnsched *sched;
 
-	xnlock_get(&nklock);
-	xnclock_tick(&nkclock);
-	xnlock_put(&nklock);
+	if (!xnclock_tick_host(&nkclock)) {
+		xnlock_get(&nklock);
+		xnclock_tick(&nkclock);
+		xnlock_put(&nklock);
+	}
 
 	/*
 	 * If the core clock interrupt preempted a real-time thread,
@@ -73,10 +73,15 @@ static int proxy_set_next_ktime(ktime_t expires,
 	if (delta < 0)
 		delta = 0;
 
-	xnlock_get_irqsave(&nklock, flags);
+	/*
+	 * The host timer is private to the current CPU, no need to
+	 * grab nklock for re-arming it (see xnclock_tick_host()).
+	 */
+	splhigh(flags);
 	sched = xnsched_current();
-	ret = xntimer_start(&sched->htimer, delta, XN_INFINITE, XN_RELATIVE);
-	xnlock_put_irqrestore(&nklock, flags);
+	ret = xntimer_start_local(&sched->htimer, delta,
+				  XN_INFINITE, XN_RELATIVE);
+	splexit(flags);
 
 	return ret ? -ETIME : 0;
 }
@@ -63,6 +63,11 @@ struct vfile_priv {
 struct vfile_data {
 	size_t all_mem;
 	size_t free_mem;
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long flushes;
+#endif
 	char name[XNOBJECT_NAME_LEN];
 };
 
@@ -106,6 +111,20 @@ static int vfile_next(struct xnvfile_snapshot_iterator *it, void *data)
 	p->all_mem = xnheap_get_size(heap);
 	p->free_mem = xnheap_get_free(heap);
 	knamecpy(p->name, heap->name);
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	p->hits = p->misses = p->flushes = 0;
+	if (heap->pcpu) {
+		struct xnheap_pcpu *pcpu;
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			pcpu = per_cpu_ptr(heap->pcpu, cpu);
+			p->hits += pcpu->hits;
+			p->misses += pcpu->misses;
+			p->flushes += pcpu->flushes;
+		}
+	}
+#endif
 
 	return 1;
 }
@@ -114,6 +133,20 @@ static int vfile_show(struct xnvfile_snapshot_iterator *it, void *data)
 {
 	struct vfile_data *p = data;
 
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	if (p == NULL)
+		xnvfile_printf(it, "%9s %9s %10s %10s %10s  %s\n",
+			       "TOTAL", "FREE", "HITS", "MISSES", "FLUSHES",
+			       "NAME");
+	else
+		xnvfile_printf(it, "%9zu %9zu %10lu %10lu %10lu  %s\n",
+			       p->all_mem,
+			       p->free_mem,
+			       p->hits,
+			       p->misses,
+			       p->flushes,
+			       p->name);
+#else
 	if (p == NULL)
 		xnvfile_printf(it, "%9s %9s  %s\n",
 			       "TOTAL", "FREE", "NAME");
@@ -122,6 +155,7 @@ static int vfile_show(struct xnvfile_snapshot_iterator *it, void *data)
 			       p->all_mem,
 			       p->free_mem,
 			       p->name);
+#endif
 	return 0;
 }
 
@@ -513,6 +547,313 @@ static void *add_free_range(struct xnheap *heap,
 	return pagenr_to_addr(heap, pg);
 }
 
+/* Heap locked, bsize < XNHEAP_PAGE_SIZE. */
+static void *alloc_bucket_block(struct xnheap *heap,
+				size_t bsize, int log2size)
+{
+	int ilog, pg, b;
+	void *block;
+
+	ilog = log2size - XNHEAP_MIN_LOG2;
+	XENO_WARN_ON(MEMORY, ilog < 0 || ilog >= XNHEAP_MAX_BUCKETS);
+	pg = heap->buckets[ilog];
+	/*
+	 * Find a block in the heading page if any. If there is none,
+	 * there won't be any down the list: add a new page right
+	 * away.
+	 */
+	if (pg < 0 || heap->pagemap[pg].map == -1U)
+		return add_free_range(heap, bsize, log2size);
+
+	b = ffs(~heap->pagemap[pg].map) - 1;
+	/*
+	 * Got one block from the heading per-bucket page, tag it as
+	 * busy in the per-page allocation map.
+	 */
+	heap->pagemap[pg].map |= (1U << b);
+	heap->used_size += bsize;
+	block = heap->membase +
+		(pg << XNHEAP_PAGE_SHIFT) +
+		(b << log2size);
+	if (heap->pagemap[pg].map == -1U)
+		move_page_back(heap, pg, log2size);
+
+	return block;
+}
+
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+
+static inline bool block_is_cached(struct xnheap *heap, int pg, int n)
+{
+	return (READ_ONCE(heap->pagemap[pg].cached) & (1U << n)) != 0;
+}
+
+#else
+
+static inline bool block_is_cached(struct xnheap *heap, int pg, int n)
+{
+	return false;
+}
+
+#endif
+
+/* Heap locked. */
+static bool release_block(struct xnheap *heap, void *block)
+{
+	unsigned long pgoff, boff;
+	int log2size, pg, n;
+	size_t bsize;
+	u32 oldmap;
+
+	/* Compute the heading page number in the page map. */
+	pgoff = block - heap->membase;
+	pg = pgoff >> XNHEAP_PAGE_SHIFT;
+
+	if (!page_is_valid(heap, pg))
+		return false;
+	
+	switch (heap->pagemap[pg].type) {
+	case page_list:
+		bsize = heap->pagemap[pg].bsize;
+		XENO_WARN_ON(MEMORY, (bsize & (XNHEAP_PAGE_SIZE - 1)) != 0);
+		release_page_range(heap, pagenr_to_addr(heap, pg), bsize);
+		break;
+
+	default:
+		log2size = heap->pagemap[pg].type;
+		bsize = (1 << log2size);
+		XENO_WARN_ON(MEMORY, bsize >= XNHEAP_PAGE_SIZE);
+		boff = pgoff & ~XNHEAP_PAGE_MASK;
+		if ((boff & (bsize - 1)) != 0) /* Not at block start? */
+			return false;
+
+		n = boff >> log2size; /* Block position in page. */
+		oldmap = heap->pagemap[pg].map;
+		/* Reject releasing a free or cached block twice. */
+		if ((oldmap & (1U << n)) == 0 ||
+		    block_is_cached(heap, pg, n))
+			return false;
+		heap->pagemap[pg].map &= ~(1U << n);
+
+		/*
+		 * If the page the block was sitting on is fully idle,
+		 * return it to the pool. Otherwise, check whether
+		 * that page is transitioning from fully busy to
+		 * partially busy state, in which case it should move
+		 * toward the front of the per-bucket page list.
+		 */
+		if (heap->pagemap[pg].map == ~gen_block_mask(log2size)) {
+			remove_page(heap, pg, log2size);
+			release_page_range(heap, pagenr_to_addr(heap, pg),
+					   XNHEAP_PAGE_SIZE);
+		} else if (oldmap == -1U)
+			move_page_front(heap, pg, log2size);
+	}
+
+	heap->used_size -= bsize;
+
+	return true;
+}
+
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+
+/*
+ * Blocks parked in a magazine are still accounted as busy by the
+ * heap allocator proper, the per-CPU cached_size counters tell
+ * how much of that memory is actually free for use. A request may
+ * fail while other CPUs still hold free blocks of the proper size
+ * in their magazines, which is bounded to XNHEAP_MAG_DEPTH blocks
+ * per bucket and CPU.
+ *
+ * The page entry also tracks which of its busy blocks are cached,
+ * so that releasing one of them twice is caught instead of handing
+ * the same block to two callers later on. Magazines from different
+ * CPUs may update the same entry locklessly.
+ */
+static inline void cache_block_bit(struct xnheap *heap, void *block,
+				   int log2size, bool on)
+{
+	unsigned long pgoff = block - heap->membase;
+	int pg = pgoff >> XNHEAP_PAGE_SHIFT;
+	u32 bit, old, new, *map;
+
+	bit = 1U << ((pgoff & ~XNHEAP_PAGE_MASK) >> log2size);
+	map = &heap->pagemap[pg].cached;
+	do {
+		old = READ_ONCE(*map);
+		new = on ? old | bit : old & ~bit;
+	} while (cmpxchg(map, old, new) != old);
+}
+
+/* Returns false if the block was cached already. */
+static inline bool test_and_cache_block(struct xnheap *heap, int pg, int n)
+{
+	u32 bit = 1U << n, old, *map = &heap->pagemap[pg].cached;
+
+	do {
+		old = READ_ONCE(*map);
+		if (old & bit)
+			return false;
+	} while (cmpxchg(map, old, old | bit) != old);
+
+	return true;
+}
+
+static void *alloc_cached(struct xnheap *heap, size_t bsize, int log2size)
+{
+	int ilog = log2size - XNHEAP_MIN_LOG2;
+	struct xnheap_magazine *mag;
+	struct xnheap_pcpu *pcpu;
+	void *block;
+	spl_t s;
+
+	splhigh(s);
+
+	pcpu = raw_cpu_ptr(heap->pcpu);
+	mag = pcpu->mags + ilog;
+	if (likely(mag->nrblocks > 0)) {
+		pcpu->hits++;
+		goto out;
+	}
+
+	/*
+	 * Refill half of the magazine in a single pass under the
+	 * heap lock, leaving room for blocks released locally.
+	 */
+	pcpu->misses++;
+	xnlock_get(&heap->lock);
+	while (mag->nrblocks < XNHEAP_MAG_DEPTH / 2) {
+		block = alloc_bucket_block(heap, bsize, log2size);
+		if (block == NULL)
+			break;
+		cache_block_bit(heap, block, log2size, true);
+		mag->blocks[mag->nrblocks++] = block;
+		pcpu->cached_size += bsize;
+	}
+	xnlock_put(&heap->lock);
+
+	if (mag->nrblocks == 0) {
+		splexit(s);
+		return NULL;
+	}
+out:
+	block = mag->blocks[--mag->nrblocks];
+	cache_block_bit(heap, block, log2size, false);
+	pcpu->cached_size -= bsize;
+
+	splexit(s);
+
+	return block;
+}
+
+static bool free_cached(struct xnheap *heap, void *block)
+{
+	struct xnheap_magazine *mag;
+	struct xnheap_pcpu *pcpu;
+	unsigned long pgoff;
+	int log2size, pg, n;
+	size_t bsize;
+	spl_t s;
+
+	/*
+	 * The page entry of a busy block is stable, we may read it
+	 * locklessly. Leave multi-page blocks, blocks which are not
+	 * busy or already cached, and anything looking odd to the
+	 * slow path, which rejects double releases.
+	 */
+	pgoff = block - heap->membase;
+	pg = pgoff >> XNHEAP_PAGE_SHIFT;
+	if (!page_is_valid(heap, pg) ||
+	    heap->pagemap[pg].type == page_list)
+		return false;
+
+	log2size = heap->pagemap[pg].type;
+	if (log2size < XNHEAP_MIN_LOG2 || log2size >= XNHEAP_PAGE_SHIFT)
+		return false;
+
+	bsize = (1 << log2size);
+	if ((pgoff & (bsize - 1)) != 0)
+		return false;
+
+	n = (pgoff & ~XNHEAP_PAGE_MASK) >> log2size;
+	if ((READ_ONCE(heap->pagemap[pg].map) & (1U << n)) == 0 ||
+	    !test_and_cache_block(heap, pg, n))
+		return false;
+
+	splhigh(s);
+
+	pcpu = raw_cpu_ptr(heap->pcpu);
+	mag = pcpu->mags + log2size - XNHEAP_MIN_LOG2;
+	if (unlikely(mag->nrblocks == XNHEAP_MAG_DEPTH)) {
+		/*
+		 * Magazine is full: flush its bottom half, i.e. the
+		 * least recently released blocks, back to the heap.
+		 */
+		pcpu->flushes++;
+		xnlock_get(&heap->lock);
+		for (n = 0; n < XNHEAP_MAG_DEPTH / 2; n++) {
+			cache_block_bit(heap, mag->blocks[n], log2size, false);
+			release_block(heap, mag->blocks[n]);
+		}
+		xnlock_put(&heap->lock);
+		memmove(mag->blocks, mag->blocks + XNHEAP_MAG_DEPTH / 2,
+			sizeof(void *) * (XNHEAP_MAG_DEPTH / 2));
+		mag->nrblocks -= XNHEAP_MAG_DEPTH / 2;
+		pcpu->cached_size -= bsize * (XNHEAP_MAG_DEPTH / 2);
+	}
+
+	mag->blocks[mag->nrblocks++] = block;
+	pcpu->cached_size += bsize;
+
+	splexit(s);
+
+	return true;
+}
+
+/**
+ * @fn int xnheap_enable_magazines(struct xnheap *heap)
+ * @brief Enable per-CPU magazines on a memory heap.
+ *
+ * Once enabled, allocation and release requests for bucketed
+ * sizes (i.e. smaller than XNHEAP_PAGE_SIZE) are served from a
+ * per-CPU cache of free blocks first, only grabbing the heap lock
+ * to refill or flush that cache in batches. This should be called
+ * right after xnheap_init(), before the heap is used.
+ *
+ * @param heap The heap descriptor.
+ *
+ * @return 0 is returned upon success, or -ENOMEM if the per-CPU
+ * storage cannot be allocated.
+ *
+ * @coretags{secondary-only}
+ */
+int xnheap_enable_magazines(struct xnheap *heap)
+{
+	secondary_mode_only();
+
+	heap->pcpu = alloc_percpu(struct xnheap_pcpu);
+
+	return heap->pcpu ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL_GPL(xnheap_enable_magazines);
+
+size_t xnheap_get_cached(const struct xnheap *heap)
+{
+	size_t cached = 0;
+	int cpu;
+
+	if (heap->pcpu == NULL)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		cached += per_cpu_ptr(heap->pcpu, cpu)->cached_size;
+
+	return cached;
+}
+EXPORT_SYMBOL_GPL(xnheap_get_cached);
+
+#endif /* CONFIG_XENO_OPT_HEAP_MAGAZINES */
+
 /**
  * @fn void *xnheap_alloc(struct xnheap *heap, size_t size)
  * @brief Allocate a memory block from a memory heap.
@@ -531,8 +872,8 @@ static void *add_free_range(struct xnheap *heap,
  */
 void *xnheap_alloc(struct xnheap *heap, size_t size)
 {
-	int log2size, ilog, pg, b = -1;
 	size_t bsize;
+	int log2size;
 	void *block;
 	spl_t s;
 
@@ -551,6 +892,11 @@ void *xnheap_alloc(struct xnheap *heap, size_t size)
 		} else
 			bsize = ALIGN(size, XNHEAP_PAGE_SIZE);
 	}
+
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	if (heap->pcpu && bsize < XNHEAP_PAGE_SIZE)
+		return alloc_cached(heap, bsize, log2size);
+#endif
 	
 	/*
 	 * Allocate entire pages directly from the pool whenever the
@@ -569,33 +915,8 @@ void *xnheap_alloc(struct xnheap *heap, size_t size)
 	if (bsize >= XNHEAP_PAGE_SIZE)
 		/* Add a range of contiguous free pages. */
 		block = add_free_range(heap, bsize, 0);
-	else {
-		ilog = log2size - XNHEAP_MIN_LOG2;
-		XENO_WARN_ON(MEMORY, ilog < 0 || ilog >= XNHEAP_MAX_BUCKETS);
-		pg = heap->buckets[ilog];
-		/*
-		 * Find a block in the heading page if any. If there
-		 * is none, there won't be any down the list: add a
-		 * new page right away.
-		 */
-		if (pg < 0 || heap->pagemap[pg].map == -1U)
-			block = add_free_range(heap, bsize, log2size);
-		else {
-			b = ffs(~heap->pagemap[pg].map) - 1;
-			/*
-			 * Got one block from the heading per-bucket
-			 * page, tag it as busy in the per-page
-			 * allocation map.
-			 */
-			heap->pagemap[pg].map |= (1U << b);
-			heap->used_size += bsize;
-			block = heap->membase +
-				(pg << XNHEAP_PAGE_SHIFT) +
-				(b << log2size);
-			if (heap->pagemap[pg].map == -1U)
-				move_page_back(heap, pg, log2size);
-		}
-	}
+	else
+		block = alloc_bucket_block(heap, bsize, log2size);
 
 	xnlock_put_irqrestore(&heap->lock, s);
 
@@ -617,64 +938,19 @@ EXPORT_SYMBOL_GPL(xnheap_alloc);
  */
 void xnheap_free(struct xnheap *heap, void *block)
 {
-	unsigned long pgoff, boff;
-	int log2size, pg, n;
-	size_t bsize;
-	u32 oldmap;
+	bool valid;
 	spl_t s;
 
-	xnlock_get_irqsave(&heap->lock, s);
-
-	/* Compute the heading page number in the page map. */
-	pgoff = block - heap->membase;
-	pg = pgoff >> XNHEAP_PAGE_SHIFT;
-
-	if (!page_is_valid(heap, pg))
-		goto bad;
-	
-	switch (heap->pagemap[pg].type) {
-	case page_list:
-		bsize = heap->pagemap[pg].bsize;
-		XENO_WARN_ON(MEMORY, (bsize & (XNHEAP_PAGE_SIZE - 1)) != 0);
-		release_page_range(heap, pagenr_to_addr(heap, pg), bsize);
-		break;
-
-	default:
-		log2size = heap->pagemap[pg].type;
-		bsize = (1 << log2size);
-		XENO_WARN_ON(MEMORY, bsize >= XNHEAP_PAGE_SIZE);
-		boff = pgoff & ~XNHEAP_PAGE_MASK;
-		if ((boff & (bsize - 1)) != 0) /* Not at block start? */
-			goto bad;
-
-		n = boff >> log2size; /* Block position in page. */
-		oldmap = heap->pagemap[pg].map;
-		heap->pagemap[pg].map &= ~(1U << n);
-
-		/*
-		 * If the page the block was sitting on is fully idle,
-		 * return it to the pool. Otherwise, check whether
-		 * that page is transitioning from fully busy to
-		 * partially busy state, in which case it should move
-		 * toward the front of the per-bucket page list.
-		 */
-		if (heap->pagemap[pg].map == ~gen_block_mask(log2size)) {
-			remove_page(heap, pg, log2size);
-			release_page_range(heap, pagenr_to_addr(heap, pg),
-					   XNHEAP_PAGE_SIZE);
-		} else if (oldmap == -1U)
-			move_page_front(heap, pg, log2size);
-	}
-
-	heap->used_size -= bsize;
-
-	xnlock_put_irqrestore(&heap->lock, s);
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	if (heap->pcpu && free_cached(heap, block))
+		return;
+#endif
 
-	return;
-bad:
+	xnlock_get_irqsave(&heap->lock, s);
+	valid = release_block(heap, block);
 	xnlock_put_irqrestore(&heap->lock, s);
 
-	XENO_WARN(MEMORY, 1, "invalid block %p in heap %s",
+	XENO_WARN(MEMORY, !valid, "invalid block %p in heap %s",
 		  block, heap->name);
 }
 EXPORT_SYMBOL_GPL(xnheap_free);
@@ -758,6 +1034,9 @@ int xnheap_init(struct xnheap *heap, void *membase, size_t size)
 	heap->membase = membase;
 	heap->usable_size = size;
 	heap->used_size = 0;
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	heap->pcpu = NULL;
+#endif
 		      
 	/*
 	 * The free page pool is maintained as a set of ranges of
@@ -805,6 +1084,10 @@ void xnheap_destroy(struct xnheap *heap)
 	nrheaps--;
 	xnvfile_touch_tag(&vfile_tag);
 	xnlock_put_irqrestore(&nklock, s);
+#ifdef CONFIG_XENO_OPT_HEAP_MAGAZINES
+	free_percpu(heap->pcpu);
+	heap->pcpu = NULL;
+#endif
 	vfree(heap->pagemap);
 }
 EXPORT_SYMBOL_GPL(xnheap_destroy);
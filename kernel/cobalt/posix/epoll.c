@@ -0,0 +1,462 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/eventpoll.h>
+#include <linux/err.h>
+#include <linux/log2.h>
+#include <cobalt/kernel/time.h>
+#include <cobalt/kernel/select.h>
+#include <rtdm/fd.h>
+#include "internal.h"
+#include "clock.h"
+#include "epoll.h"
+
+/*
+ * Event-based I/O multiplexing over RTDM file descriptors.
+ *
+ * Each poll set owns an xnselector running in event mode, so that
+ * waiting for events only walks the bindings which are actually
+ * ready, regardless of the number of descriptors in the set. Only
+ * level-triggered notifications are supported: a descriptor is
+ * reported for as long as its driver leaves the event pending.
+ * Reported bindings are moved to the tail of the ready list, so that
+ * all ready descriptors get their turn when there are more of them
+ * than the caller can collect at once.
+ */
+
+#define COBALT_EPOLL_BATCH	32
+#define COBALT_EPOLL_MINITEMS	64
+
+#define COBALT_EPOLL_EVENTS	(EPOLLIN | EPOLLOUT | EPOLLPRI)
+#define COBALT_EPOLL_CTL_EVENTS	(COBALT_EPOLL_EVENTS | EPOLLERR | EPOLLHUP)
+
+#define EPI_INUSE	0x1
+#define EPI_BUSY	0x2
+
+struct cobalt_epoll_item {
+	__u64 data;
+	__poll_t events;
+	unsigned short state;
+	short slot;
+};
+
+struct cobalt_epoll {
+	struct rtdm_fd fd;
+	struct xnselector *selector;
+	/* Indexed by descriptor, grown on demand under nklock. */
+	struct cobalt_epoll_item *items;
+	int nitems;
+};
+
+static const __poll_t type_events[XNSELECT_MAX_TYPES] = {
+	[XNSELECT_READ] = EPOLLIN,
+	[XNSELECT_WRITE] = EPOLLOUT,
+	[XNSELECT_EXCEPT] = EPOLLPRI,
+};
+
+static void epoll_close(struct rtdm_fd *fd)
+{
+	struct cobalt_epoll *ep = container_of(fd, struct cobalt_epoll, fd);
+
+	xnselector_destroy(ep->selector); /* Drops all bindings. */
+	if (ep->items)
+		xnfree(ep->items);
+	xnfree(ep);
+}
+
+static struct rtdm_fd_ops epoll_ops = {
+	.close = epoll_close,
+};
+
+COBALT_SYSCALL(epoll_create, lostage, (int flags))
+{
+	struct cobalt_epoll *ep;
+	int ret, ufd;
+
+	if (flags & ~EPOLL_CLOEXEC)
+		return -EINVAL;
+
+	ep = xnmalloc(sizeof(*ep));
+	if (ep == NULL)
+		return -ENOMEM;
+
+	ep->selector = xnmalloc(sizeof(*ep->selector));
+	if (ep->selector == NULL) {
+		ret = -ENOMEM;
+		goto fail_selector;
+	}
+
+	xnselector_init(ep->selector);
+	xnselector_set_evmode(ep->selector);
+
+	ep->items = NULL;
+	ep->nitems = 0;
+
+	ufd = __rtdm_anon_getfd("[cobalt-epoll]",
+				O_RDWR | (flags & EPOLL_CLOEXEC));
+	if (ufd < 0) {
+		ret = ufd;
+		goto fail_getfd;
+	}
+
+	ep->fd.oflags = 0;
+	ret = rtdm_fd_enter(&ep->fd, ufd, COBALT_EPOLL_MAGIC, &epoll_ops);
+	if (ret < 0)
+		goto fail;
+
+	ret = rtdm_fd_register(&ep->fd, ufd);
+	if (ret < 0)
+		goto fail;
+
+	return ufd;
+fail:
+	__rtdm_anon_putfd(ufd);
+fail_getfd:
+	xnselector_destroy(ep->selector);
+fail_selector:
+	xnfree(ep);
+
+	return ret;
+}
+
+static inline struct cobalt_epoll *epoll_get(int ufd)
+{
+	struct rtdm_fd *fd;
+
+	fd = rtdm_fd_get(ufd, COBALT_EPOLL_MAGIC);
+	if (IS_ERR(fd)) {
+		int err = PTR_ERR(fd);
+		if (err == -EBADF && cobalt_current_process() == NULL)
+			err = -EPERM;
+		return ERR_PTR(err);
+	}
+
+	return container_of(fd, struct cobalt_epoll, fd);
+}
+
+static inline void epoll_put(struct cobalt_epoll *ep)
+{
+	rtdm_fd_put(&ep->fd);
+}
+
+/* nklock held, irqs off. */
+static bool epoll_item_bound(struct cobalt_epoll *ep, int ufd)
+{
+	struct cobalt_epoll_item *item = ep->items + ufd;
+	unsigned int type;
+
+	/*
+	 * Closing a descriptor drops its bindings, leaving a stale
+	 * item behind which we may recycle.
+	 */
+	for (type = 0; type < XNSELECT_MAX_TYPES; type++)
+		if ((item->events & type_events[type]) &&
+		    __FD_ISSET__(ufd, &ep->selector->fds[type].expected))
+			return true;
+
+	return false;
+}
+
+static void epoll_unbind(struct cobalt_epoll *ep, int ufd, __poll_t events)
+{
+	unsigned int type;
+
+	for (type = 0; type < XNSELECT_MAX_TYPES; type++)
+		if (events & type_events[type])
+			xnselector_unbind(ep->selector, type, ufd);
+}
+
+/* Make room for @ufd in the item array. */
+static int epoll_grow(struct cobalt_epoll *ep, int ufd)
+{
+	struct cobalt_epoll_item *items, *old;
+	int nitems, n;
+	spl_t s;
+
+	nitems = max_t(int, roundup_pow_of_two(ufd + 1),
+		       COBALT_EPOLL_MINITEMS);
+	items = xnmalloc(nitems * sizeof(*items));
+	if (items == NULL)
+		return -ENOMEM;
+
+	for (n = 0; n < nitems; n++) {
+		items[n].events = 0;
+		items[n].state = 0;
+		items[n].slot = -1;
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (ep->nitems < nitems) {
+		if (ep->nitems > 0)
+			memcpy(items, ep->items,
+			       ep->nitems * sizeof(*items));
+		old = ep->items;
+		ep->items = items;
+		ep->nitems = nitems;
+	} else
+		old = items;	/* Lost a race with another grower. */
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	if (old)
+		xnfree(old);
+
+	return 0;
+}
+
+static int epoll_bind(struct cobalt_epoll *ep, int ufd, __poll_t events)
+{
+	__poll_t done = 0;
+	unsigned int type;
+	int ret;
+
+	for (type = 0; type < XNSELECT_MAX_TYPES; type++) {
+		if (!(events & type_events[type]))
+			continue;
+		ret = rtdm_fd_select(ufd, ep->selector, type);
+		if (ret) {
+			epoll_unbind(ep, ufd, done);
+			return ret == -EADV ? -EPERM : ret;
+		}
+		done |= type_events[type];
+	}
+
+	return 0;
+}
+
+int __cobalt_epoll_ctl(int epfd, int op, int ufd,
+		       const struct epoll_event *ev)
+{
+	struct cobalt_epoll_item *item;
+	__poll_t events = 0, old;
+	struct cobalt_epoll *ep;
+	__u64 data = 0;
+	int ret = 0;
+	spl_t s;
+
+	if ((unsigned int)ufd >= __FD_SETSIZE || ufd == epfd)
+		return -EINVAL;
+
+	if (op != EPOLL_CTL_DEL) {
+		if (ev->events & ~COBALT_EPOLL_CTL_EVENTS)
+			return -EINVAL;
+		events = ev->events & COBALT_EPOLL_EVENTS;
+		data = ev->data;
+	}
+
+	ep = epoll_get(epfd);
+	if (IS_ERR(ep))
+		return PTR_ERR(ep);
+
+	if (op == EPOLL_CTL_ADD && ufd >= READ_ONCE(ep->nitems)) {
+		ret = epoll_grow(ep, ufd);
+		if (ret)
+			goto put;
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+
+	/*
+	 * The item array may move whenever nklock is dropped, always
+	 * reload the item pointer after relocking.
+	 */
+	if (ufd >= ep->nitems) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	item = ep->items + ufd;
+
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (item->state & EPI_BUSY ||
+		    (item->state & EPI_INUSE && epoll_item_bound(ep, ufd))) {
+			ret = -EEXIST;
+			goto out;
+		}
+		old = item->state ? item->events : 0;
+		item->state = EPI_INUSE | EPI_BUSY;
+		item->events = 0;
+		xnlock_put_irqrestore(&nklock, s);
+		epoll_unbind(ep, ufd, old); /* Leftovers from a stale item. */
+		ret = epoll_bind(ep, ufd, events);
+		xnlock_get_irqsave(&nklock, s);
+		item = ep->items + ufd;
+		if (ret) {
+			item->state = 0;
+			break;
+		}
+		item->events = events;
+		item->data = data;
+		item->state = EPI_INUSE;
+		break;
+	case EPOLL_CTL_MOD:
+		if (item->state != EPI_INUSE || !epoll_item_bound(ep, ufd)) {
+			ret = -ENOENT;
+			goto out;
+		}
+		old = item->events;
+		item->state |= EPI_BUSY;
+		xnlock_put_irqrestore(&nklock, s);
+		ret = epoll_bind(ep, ufd, events & ~old);
+		if (ret == 0)
+			epoll_unbind(ep, ufd, old & ~events);
+		xnlock_get_irqsave(&nklock, s);
+		item = ep->items + ufd;
+		if (ret == 0) {
+			item->events = events;
+			item->data = data;
+		}
+		item->state = EPI_INUSE;
+		break;
+	case EPOLL_CTL_DEL:
+		if (item->state != EPI_INUSE) {
+			ret = -ENOENT;
+			goto out;
+		}
+		old = item->events;
+		item->state |= EPI_BUSY;
+		xnlock_put_irqrestore(&nklock, s);
+		epoll_unbind(ep, ufd, old);
+		xnlock_get_irqsave(&nklock, s);
+		item = ep->items + ufd;
+		item->events = 0;
+		item->state = 0;
+		break;
+	default:
+		ret = -EINVAL;
+	}
+out:
+	xnlock_put_irqrestore(&nklock, s);
+put:
+	epoll_put(ep);
+
+	return ret;
+}
+
+COBALT_SYSCALL(epoll_ctl, primary,
+	       (int epfd, int op, int fd, struct epoll_event __user *u_ev))
+{
+	struct epoll_event ev;
+
+	if (op != EPOLL_CTL_DEL &&
+	    cobalt_copy_from_user(&ev, u_ev, sizeof(ev)))
+		return -EFAULT;
+
+	return __cobalt_epoll_ctl(epfd, op, fd, &ev);
+}
+
+/* nklock held, irqs off. */
+static int epoll_collect(struct cobalt_epoll *ep,
+			 struct epoll_event *evbuf, int maxevents)
+{
+	struct xnselector *selector = ep->selector;
+	struct xnselect_binding *binding, *tmp;
+	struct cobalt_epoll_item *item;
+	short fds[COBALT_EPOLL_BATCH];
+	int count = 0, n;
+	LIST_HEAD(done);
+	__poll_t mask;
+
+	list_for_each_entry_safe(binding, tmp, &selector->ready, rlink) {
+		item = ep->items + binding->bit_index;
+		mask = item->events & type_events[binding->type];
+		if (mask == 0)
+			continue;
+		if (item->slot >= 0) {
+			evbuf[item->slot].events |= mask;
+		} else {
+			if (count >= maxevents)
+				continue;
+			item->slot = count;
+			fds[count] = binding->bit_index;
+			evbuf[count].events = mask;
+			evbuf[count].data = item->data;
+			count++;
+		}
+		list_move_tail(&binding->rlink, &done);
+	}
+
+	list_splice_tail(&done, &selector->ready);
+
+	for (n = 0; n < count; n++)
+		ep->items[fds[n]].slot = -1;
+
+	return count;
+}
+
+int __cobalt_epoll_wait(int epfd, struct epoll_event __user *u_events,
+			int maxevents, const struct timespec64 *to)
+{
+	struct epoll_event evbuf[COBALT_EPOLL_BATCH];
+	xnticks_t timeout = XN_INFINITE;
+	xntmode_t tmode = XN_RELATIVE;
+	struct cobalt_epoll *ep;
+	int ret, info;
+	spl_t s;
+
+	if (maxevents <= 0)
+		return -EINVAL;
+
+	if (maxevents > COBALT_EPOLL_BATCH)
+		maxevents = COBALT_EPOLL_BATCH;
+
+	if (to) {
+		if (!timespec64_valid(to))
+			return -EINVAL;
+		if (to->tv_sec || to->tv_nsec) {
+			timeout = clock_get_ticks(CLOCK_MONOTONIC) + ts2ns(to);
+			tmode = XN_ABSOLUTE;
+		} else
+			timeout = XN_NONBLOCK;
+	}
+
+	ep = epoll_get(epfd);
+	if (IS_ERR(ep))
+		return PTR_ERR(ep);
+
+	xnlock_get_irqsave(&nklock, s);
+
+	for (;;) {
+		ret = epoll_collect(ep, evbuf, maxevents);
+		if (ret || timeout == XN_NONBLOCK)
+			break;
+		info = xnsynch_sleep_on(&ep->selector->synchbase,
+					timeout, tmode);
+		if (info & XNRMID) {
+			ret = -EBADF;
+			break;
+		}
+		if (info & (XNBREAK | XNTIMEO)) {
+			ret = epoll_collect(ep, evbuf, maxevents);
+			if (ret == 0 && (info & XNBREAK))
+				ret = -EINTR;
+			break;
+		}
+	}
+
+	xnlock_put_irqrestore(&nklock, s);
+
+	epoll_put(ep);
+
+	if (ret > 0 &&
+	    cobalt_copy_to_user(u_events, evbuf, ret * sizeof(evbuf[0])))
+		return -EFAULT;
+
+	return ret;
+}
+
+COBALT_SYSCALL(epoll_wait, primary,
+	       (int epfd, struct epoll_event __user *u_events,
+		int maxevents, const struct __kernel_timespec __user *u_ts))
+{
+	struct timespec64 ts64, *to = NULL;
+
+	if (u_ts) {
+		if (cobalt_get_timespec64(&ts64, u_ts))
+			return -EFAULT;
+		to = &ts64;
+	}
+
+	return __cobalt_epoll_wait(epfd, u_events, maxevents, to);
+}
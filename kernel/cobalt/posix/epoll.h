@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _COBALT_POSIX_EPOLL_H
+#define _COBALT_POSIX_EPOLL_H
+
+#include <linux/time.h>
+#include <linux/eventpoll.h>
+#include <xenomai/posix/syscall.h>
+
+int __cobalt_epoll_ctl(int epfd, int op, int fd,
+		       const struct epoll_event *ev);
+
+int __cobalt_epoll_wait(int epfd, struct epoll_event __user *u_events,
+			int maxevents, const struct timespec64 *to);
+
+COBALT_SYSCALL_DECL(epoll_create, (int flags));
+
+COBALT_SYSCALL_DECL(epoll_ctl,
+		    (int epfd, int op, int fd,
+		     struct epoll_event __user *u_ev));
+
+COBALT_SYSCALL_DECL(epoll_wait,
+		    (int epfd, struct epoll_event __user *u_events,
+		     int maxevents,
+		     const struct __kernel_timespec __user *u_ts));
+
+#endif /* !_COBALT_POSIX_EPOLL_H */
@@ -87,6 +87,7 @@ COBALT_SYSCALL(event_init, current,
 	state->value = value;
 	state->flags = 0;
 	state->nwaiters = 0;
+	state->waitbits = 0;
 	stateoff = cobalt_umm_offset(umm, state);
 	XENO_BUG_ON(COBALT, stateoff != (__u32)stateoff);
 
@@ -102,6 +103,29 @@ COBALT_SYSCALL(event_init, current,
 	return cobalt_copy_to_user(u_event, &shadow, sizeof(*u_event));
 }
 
+/*
+ * nklock held, irqs off. Publish the bits sleepers are waiting for,
+ * so that userland may post other bits without issuing any syscall.
+ */
+static void event_update_waiters(struct cobalt_event *event)
+{
+	struct cobalt_event_state *state = event->state;
+	struct xnthread_wait_context *wc;
+	struct event_wait_context *ewc;
+	unsigned int waitbits = 0;
+	struct xnthread *p;
+
+	xnsynch_for_each_sleeper(p, &event->synch) {
+		wc = xnthread_get_wait_context(p);
+		ewc = container_of(wc, struct event_wait_context, wc);
+		waitbits |= ewc->value;
+	}
+
+	state->waitbits = waitbits;
+	if (waitbits == 0)
+		state->flags &= ~COBALT_EVENT_PENDED;
+}
+
 int __cobalt_event_wait(struct cobalt_event_shadow __user *u_event,
 			unsigned int bits,
 			unsigned int __user *u_bits_r,
@@ -152,7 +176,13 @@ int __cobalt_event_wait(struct cobalt_event_shadow __user *u_event,
 		goto out;
 	}
 
+	/*
+	 * Pairs with the barrier implied by cobalt_event_post()
+	 * updating the value before checking for waiters.
+	 */
 	state->flags |= COBALT_EVENT_PENDED;
+	state->waitbits |= bits;
+	smp_mb();
 	rbits = state->value & bits;
 	testval = mode & COBALT_EVENT_ANY ? rbits : bits;
 	if (rbits && rbits == testval)
@@ -178,8 +208,7 @@ int __cobalt_event_wait(struct cobalt_event_shadow __user *u_event,
 	} else
 		rbits = ewc.value;
 done:
-	if (!xnsynch_pended_p(&event->synch))
-		state->flags &= ~COBALT_EVENT_PENDED;
+	event_update_waiters(event);
 out:
 	xnlock_put_irqrestore(&nklock, s);
 
@@ -271,6 +300,7 @@ COBALT_SYSCALL(event_sync, current,
 		}
 	}
 
+	event_update_waiters(event);
 	xnsched_run();
 out:
 	xnlock_put_irqrestore(&nklock, s);
@@ -49,17 +49,14 @@
  * Implementation-wise, the monitor logic is shared with the Cobalt
  * thread object.
  */
-COBALT_SYSCALL(monitor_init, current,
-	       (struct cobalt_monitor_shadow __user *u_mon,
-		clockid_t clk_id, int flags))
+int __cobalt_monitor_init(struct cobalt_monitor_shadow *shadow,
+			  clockid_t clk_id, int flags)
 {
-	struct cobalt_monitor_shadow shadow;
 	struct cobalt_monitor_state *state;
 	struct cobalt_monitor *mon;
 	int pshared, tmode, ret;
 	struct cobalt_umm *umm;
 	unsigned long stateoff;
-	spl_t s;
 
 	tmode = clock_flag(TIMER_ABSTIME, clk_id);
 	if (tmode < 0)
@@ -90,18 +87,42 @@ COBALT_SYSCALL(monitor_init, current,
 	mon->flags = flags;
 	mon->tmode = tmode;
 	INIT_LIST_HEAD(&mon->waiters);
-
-	xnlock_get_irqsave(&nklock, s);
-	cobalt_add_resource(&mon->resnode, monitor, pshared);
+	/*
+	 * Not tracked as a process resource yet, the caller decides
+	 * about this.
+	 */
+	INIT_LIST_HEAD(&mon->resnode.next);
+	mon->resnode.owner = NULL;
 	mon->magic = COBALT_MONITOR_MAGIC;
-	xnlock_put_irqrestore(&nklock, s);
 
 	state->flags = 0;
 	stateoff = cobalt_umm_offset(umm, state);
 	XENO_BUG_ON(COBALT, stateoff != (__u32)stateoff);
-	shadow.flags = flags;
-	shadow.handle = mon->resnode.handle;
-	shadow.state_offset = (__u32)stateoff;
+	shadow->flags = flags;
+	shadow->handle = mon->resnode.handle;
+	shadow->state_offset = (__u32)stateoff;
+
+	return 0;
+}
+
+COBALT_SYSCALL(monitor_init, current,
+	       (struct cobalt_monitor_shadow __user *u_mon,
+		clockid_t clk_id, int flags))
+{
+	struct cobalt_monitor_shadow shadow;
+	struct cobalt_monitor *mon;
+	int ret;
+	spl_t s;
+
+	ret = __cobalt_monitor_init(&shadow, clk_id, flags);
+	if (ret)
+		return ret;
+
+	xnlock_get_irqsave(&nklock, s);
+	mon = xnregistry_lookup(shadow.handle, NULL);
+	cobalt_add_resource(&mon->resnode, monitor,
+			    (flags & COBALT_MONITOR_SHARED) != 0);
+	xnlock_put_irqrestore(&nklock, s);
 
 	return cobalt_copy_to_user(u_mon, &shadow, sizeof(*u_mon));
 }
@@ -143,6 +164,27 @@ COBALT_SYSCALL(monitor_enter, primary,
 	return ret;
 }
 
+/*
+ * nklock held, irqs off. Tell userland which kind of waiters are
+ * sleeping, so that signaling a condition nobody waits for does not
+ * trigger any syscall.
+ */
+static void monitor_update_pended(struct cobalt_monitor *mon)
+{
+	struct cobalt_monitor_state *state = mon->state;
+	__u32 flags;
+
+	flags = state->flags & ~(COBALT_MONITOR_PENDED|
+				 COBALT_MONITOR_PENDED_GRANT|
+				 COBALT_MONITOR_PENDED_DRAIN);
+	if (!list_empty(&mon->waiters))
+		flags |= COBALT_MONITOR_PENDED|COBALT_MONITOR_PENDED_GRANT;
+	if (xnsynch_pended_p(&mon->drain))
+		flags |= COBALT_MONITOR_PENDED|COBALT_MONITOR_PENDED_DRAIN;
+
+	state->flags = flags;
+}
+
 /* nklock held, irqs off */
 static void monitor_wakeup(struct cobalt_monitor *mon)
 {
@@ -199,8 +241,7 @@ drain:
 			xnsynch_wakeup_one_sleeper(&mon->drain);
 	}
 
-	if (list_empty(&mon->waiters) && !xnsynch_pended_p(&mon->drain))
-		state->flags &= ~COBALT_MONITOR_PENDED;
+	monitor_update_pended(mon);
 }
 
 int __cobalt_monitor_wait(struct cobalt_monitor_shadow __user *u_mon,
@@ -262,6 +303,10 @@ int __cobalt_monitor_wait(struct cobalt_monitor_shadow __user *u_mon,
 	 * wakeup call when dropping the gate lock.
 	 */
 	state->flags |= COBALT_MONITOR_PENDED;
+	if (event & COBALT_MONITOR_WAITDRAIN)
+		state->flags |= COBALT_MONITOR_PENDED_DRAIN;
+	else
+		state->flags |= COBALT_MONITOR_PENDED_GRANT;
 
 	tmode = ts ? mon->tmode : XN_RELATIVE;
 
@@ -274,8 +319,20 @@ int __cobalt_monitor_wait(struct cobalt_monitor_shadow __user *u_mon,
 		    !list_empty(&curr->monitor_link))
 			list_del_init(&curr->monitor_link);
 
-		if (list_empty(&mon->waiters) && !xnsynch_pended_p(&mon->drain))
-			state->flags &= ~COBALT_MONITOR_PENDED;
+		/*
+		 * The monitor may have been deleted while we were
+		 * waking up, in which case its memory and the shared
+		 * state are gone already: revalidate before touching
+		 * them.
+		 */
+		mon = xnregistry_lookup(handle, NULL);
+		if ((info & XNRMID) ||
+		    mon == NULL || mon->magic != COBALT_MONITOR_MAGIC) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		monitor_update_pended(mon);
 
 		if (info & XNBREAK) {
 			opret = -EINTR;
@@ -438,6 +495,36 @@ COBALT_SYSCALL(monitor_destroy, primary,
 	return ret;
 }
 
+/*
+ * Destroy a monitor which is not tracked as a process resource,
+ * regardless of its gate owner. Threads sleeping on the monitor are
+ * unblocked, then fail re-entering it.
+ */
+void __cobalt_monitor_destroy(xnhandle_t handle)
+{
+	struct cobalt_thread *thread, *tmp;
+	struct cobalt_monitor *mon;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	mon = xnregistry_lookup(handle, NULL);
+	if (mon == NULL || mon->magic != COBALT_MONITOR_MAGIC) {
+		xnlock_put_irqrestore(&nklock, s);
+		return;
+	}
+
+	list_for_each_entry_safe(thread, tmp, &mon->waiters, monitor_link) {
+		xnsynch_wakeup_this_sleeper(&thread->monitor_synch,
+					    &thread->threadbase);
+		list_del_init(&thread->monitor_link);
+	}
+
+	cobalt_monitor_reclaim(&mon->resnode, s); /* drops lock */
+
+	xnsched_run();
+}
+
 void cobalt_monitor_reclaim(struct cobalt_resnode *node, spl_t s)
 {
 	struct cobalt_monitor *mon;
@@ -38,6 +38,11 @@ struct cobalt_monitor {
 	struct cobalt_resnode resnode;
 };
 
+int __cobalt_monitor_init(struct cobalt_monitor_shadow *shadow,
+			  clockid_t clk_id, int flags);
+
+void __cobalt_monitor_destroy(xnhandle_t handle);
+
 int __cobalt_monitor_wait(struct cobalt_monitor_shadow __user *u_mon,
 			  int event, const struct timespec64 *ts,
 			  int __user *u_ret);
@@ -28,6 +28,7 @@
 #include "timer.h"
 #include "mqueue.h"
 #include "clock.h"
+#include "monitor.h"
 #include <trace/events/cobalt-posix.h>
 #include <cobalt/kernel/time.h>
 
@@ -47,6 +48,8 @@ struct cobalt_mq {
 	struct list_head queued;
 	struct list_head avail;
 	int nrqueued;
+	/* Shared message ring, only with COBALT_MQ_SHARED. */
+	struct cobalt_mq_state *shared;
 
 	/* mq_notify */
 	struct siginfo si;
@@ -133,10 +136,73 @@ static inline void mq_msg_free(struct cobalt_mq *mq, struct cobalt_msg * msg)
 	list_add(&msg->link, &mq->avail); /* For earliest re-use of the block. */
 }
 
+/*
+ * A shared queue stores its messages into a ring allocated from the
+ * shared memory heap, which is mapped into every Cobalt process.
+ * Senders and receivers link and unlink messages directly from
+ * userland under the protection of a monitor embedded into the ring
+ * header, so that no syscall is issued unless some thread has to be
+ * woken up. Since the kernel never touches the ring contents, the
+ * regular send and receive services are not available to such
+ * queues.
+ */
+static int mq_init_shared(struct cobalt_mq *mq, const struct mq_attr *attr)
+{
+	struct cobalt_mq_state *state;
+	struct cobalt_mq_slot *slot;
+	size_t slotsize, hdrsize;
+	struct cobalt_umm *umm;
+	unsigned long memsize;
+	int ret, i;
+
+	hdrsize = ALIGN(sizeof(*state), sizeof(unsigned long long));
+	slotsize = ALIGN(sizeof(*slot) + attr->mq_msgsize,
+			 sizeof(unsigned long long));
+	memsize = hdrsize + slotsize * attr->mq_maxmsg;
+	if (memsize != (__u32)memsize)
+		return -ENOSPC;
+
+	umm = &cobalt_ppd_get(1)->umm;
+	state = cobalt_umm_alloc(umm, memsize);
+	if (state == NULL)
+		return -ENOSPC;
+
+	ret = __cobalt_monitor_init(&state->monitor, CLOCK_REALTIME,
+				    COBALT_MONITOR_SHARED);
+	if (ret) {
+		cobalt_umm_free(umm, state);
+		return ret == -EAGAIN ? -ENOSPC : ret;
+	}
+
+	state->flags = 0;
+	state->maxmsg = attr->mq_maxmsg;
+	state->msgsize = attr->mq_msgsize;
+	state->slotsize = slotsize;
+	state->nrqueued = 0;
+	state->nrsenders = 0;
+	state->nrreceivers = 0;
+	state->head = COBALT_MQ_NIL;
+	state->tail = COBALT_MQ_NIL;
+	state->slots = hdrsize;
+	state->free = 0;
+	for (i = 0; i < attr->mq_maxmsg; i++) {
+		slot = (void *)state + hdrsize + i * slotsize;
+		slot->next = i + 1 < attr->mq_maxmsg ? i + 1 : COBALT_MQ_NIL;
+	}
+
+	mq->shared = state;
+	mq->memsize = memsize;
+	mq->mem = NULL;
+	INIT_LIST_HEAD(&mq->avail);
+
+	return 0;
+}
+
 static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 {
 	unsigned i, msgsize, memsize;
 	char *mem;
+	int ret;
 
 	if (attr == NULL)
 		attr = &default_attr;
@@ -149,6 +215,14 @@ static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 			return -EINVAL;
 	}
 
+	mq->shared = NULL;
+	if (attr->mq_flags & COBALT_MQ_SHARED) {
+		ret = mq_init_shared(mq, attr);
+		if (ret)
+			return ret;
+		goto init;
+	}
+
 	msgsize = attr->mq_msgsize + sizeof(struct cobalt_msg);
 
 	/* Align msgsize on natural boundary. */
@@ -166,10 +240,6 @@ static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 		return -ENOSPC;
 
 	mq->memsize = memsize;
-	INIT_LIST_HEAD(&mq->queued);
-	mq->nrqueued = 0;
-	xnsynch_init(&mq->receivers, XNSYNCH_PRIO, NULL);
-	xnsynch_init(&mq->senders, XNSYNCH_PRIO, NULL);
 	mq->mem = mem;
 
 	/* Fill the pool. */
@@ -178,8 +248,13 @@ static inline int mq_init(struct cobalt_mq *mq, const struct mq_attr *attr)
 		struct cobalt_msg *msg = (struct cobalt_msg *) (mem + i * msgsize);
 		mq_msg_free(mq, msg);
 	}
-
+init:
+	INIT_LIST_HEAD(&mq->queued);
+	mq->nrqueued = 0;
+	xnsynch_init(&mq->receivers, XNSYNCH_PRIO, NULL);
+	xnsynch_init(&mq->senders, XNSYNCH_PRIO, NULL);
 	mq->attr = *attr;
+	mq->attr.mq_flags = 0;
 	mq->target = NULL;
 	xnselect_init(&mq->read_select);
 	xnselect_init(&mq->write_select);
@@ -203,7 +278,11 @@ static inline void mq_destroy(struct cobalt_mq *mq)
 	xnselect_destroy(&mq->read_select); /* Reschedules. */
 	xnselect_destroy(&mq->write_select); /* Ditto. */
 	xnregistry_remove(mq->handle);
-	xnheap_vfree(mq->mem);
+	if (mq->shared) {
+		__cobalt_monitor_destroy(mq->shared->monitor.handle);
+		cobalt_umm_free(&cobalt_ppd_get(1)->umm, mq->shared);
+	} else
+		xnheap_vfree(mq->mem);
 	kfree(mq);
 }
 
@@ -237,6 +316,22 @@ static void mqd_close(struct rtdm_fd *fd)
 	mq_unref(mq);
 }
 
+static inline bool mq_readable(struct cobalt_mq *mq)
+{
+	if (mq->shared)
+		return READ_ONCE(mq->shared->nrqueued) > 0;
+
+	return !list_empty(&mq->queued);
+}
+
+static inline bool mq_writable(struct cobalt_mq *mq)
+{
+	if (mq->shared)
+		return READ_ONCE(mq->shared->nrqueued) < mq->attr.mq_maxmsg;
+
+	return !list_empty(&mq->avail);
+}
+
 static int
 mqd_select(struct rtdm_fd *fd, struct xnselector *selector,
 	   unsigned type, unsigned index)
@@ -257,6 +352,15 @@ mqd_select(struct rtdm_fd *fd, struct xnselector *selector,
 	xnlock_get_irqsave(&nklock, s);
 	mq = mqd->mq;
 
+	/*
+	 * Have userland report the queue state transitions from now
+	 * on, before sampling the current state.
+	 */
+	if (mq->shared) {
+		mq->shared->flags |= COBALT_MQ_SELECT;
+		smp_mb();
+	}
+
 	switch(type) {
 	case XNSELECT_READ:
 		err = -EBADF;
@@ -265,7 +369,7 @@ mqd_select(struct rtdm_fd *fd, struct xnselector *selector,
 
 		err = xnselect_bind(&mq->read_select, binding,
 				selector, type, index,
-				!list_empty(&mq->queued));
+				mq_readable(mq));
 		if (err)
 			goto unlock_and_error;
 		break;
@@ -277,7 +381,7 @@ mqd_select(struct rtdm_fd *fd, struct xnselector *selector,
 
 		err = xnselect_bind(&mq->write_select, binding,
 				selector, type, index,
-				!list_empty(&mq->avail));
+				mq_writable(mq));
 		if (err)
 			goto unlock_and_error;
 		break;
@@ -583,12 +687,25 @@ static void mq_release_msg(struct cobalt_mq *mq, struct cobalt_msg *msg)
 	}
 }
 
+/* nklock held, irqs off. */
+static void mq_notify_target(struct cobalt_mq *mq)
+{
+	struct cobalt_sigpending *sigp;
+
+	sigp = cobalt_signal_alloc();
+	if (sigp) {
+		cobalt_copy_siginfo(SI_MESGQ, &sigp->si, &mq->si);
+		if (cobalt_signal_send(mq->target, sigp, 0) <= 0)
+			cobalt_signal_free(sigp);
+	}
+	mq->target = NULL;
+}
+
 static int
 mq_finish_send(struct cobalt_mqd *mqd, struct cobalt_msg *msg)
 {
 	struct cobalt_mqwait_context *mwc;
 	struct xnthread_wait_context *wc;
-	struct cobalt_sigpending *sigp;
 	struct xnthread *thread;
 	struct cobalt_mq *mq;
 	spl_t s;
@@ -614,15 +731,8 @@ mq_finish_send(struct cobalt_mqd *mqd, struct cobalt_msg *msg)
 		 */
 		if (list_is_singular(&mq->queued)) {
 			xnselect_signal(&mq->read_select, 1);
-			if (mq->target) {
-				sigp = cobalt_signal_alloc();
-				if (sigp) {
-					cobalt_copy_siginfo(SI_MESGQ, &sigp->si, &mq->si);
-					if (cobalt_signal_send(mq->target, sigp, 0) <= 0)
-						cobalt_signal_free(sigp);
-				}
-				mq->target = NULL;
-			}
+			if (mq->target)
+				mq_notify_target(mq);
 		}
 	}
 	xnsched_run();
@@ -710,7 +820,10 @@ static inline int mq_getattr(struct cobalt_mqd *mqd, struct mq_attr *attr)
 	*attr = mq->attr;
 	xnlock_get_irqsave(&nklock, s);
 	attr->mq_flags = rtdm_fd_flags(&mqd->fd);
-	attr->mq_curmsgs = mq->nrqueued;
+	if (mq->shared)
+		attr->mq_curmsgs = READ_ONCE(mq->shared->nrqueued);
+	else
+		attr->mq_curmsgs = mq->nrqueued;
 	xnlock_put_irqrestore(&nklock, s);
 
 	return 0;
@@ -739,10 +852,12 @@ mq_notify(struct cobalt_mqd *mqd, unsigned index, const struct sigevent *evp)
 		goto unlock_and_error;
 	}
 
-	if (evp == NULL || evp->sigev_notify == SIGEV_NONE)
+	if (evp == NULL || evp->sigev_notify == SIGEV_NONE) {
 		/* Here, mq->target == cobalt_current_thread() or NULL. */
 		mq->target = NULL;
-	else {
+		if (mq->shared)
+			mq->shared->flags &= ~COBALT_MQ_NOTIFY;
+	} else {
 		mq->target = thread;
 		mq->target_qd = index;
 		mq->si.si_signo = evp->sigev_signo;
@@ -757,6 +872,9 @@ mq_notify(struct cobalt_mqd *mqd, unsigned index, const struct sigevent *evp)
 		 */
 		mq->si.si_pid = task_pid_nr(current);
 		mq->si.si_uid = get_current_uuid();
+		/* Senders must report the next arrival. */
+		if (mq->shared)
+			mq->shared->flags |= COBALT_MQ_NOTIFY;
 	}
 
 	xnlock_put_irqrestore(&nklock, s);
@@ -943,6 +1061,11 @@ int __cobalt_mq_timedsend(mqd_t uqd, const void __user *u_buf, size_t len,
 	if (IS_ERR(mqd))
 		return PTR_ERR(mqd);
 
+	if (mqd->mq->shared) {
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+
 	if (prio >= COBALT_MSGPRIOMAX) {
 		ret = -EINVAL;
 		goto out;
@@ -1006,6 +1129,11 @@ int __cobalt_mq_timedreceive(mqd_t uqd, void __user *u_buf,
 	if (IS_ERR(mqd))
 		return PTR_ERR(mqd);
 
+	if (mqd->mq->shared) {
+		ret = -EOPNOTSUPP;
+		goto fail;
+	}
+
 	if (*lenp > 0 && !access_ok(u_buf, *lenp)) {
 		ret = -EFAULT;
 		goto fail;
@@ -1086,3 +1214,73 @@ COBALT_SYSCALL(mq_timedreceive64, primary,
 
 	return ret ?: cobalt_copy_to_user(u_len, &len, sizeof(*u_len));
 }
+
+COBALT_SYSCALL(mq_map, current,
+	       (mqd_t uqd, struct cobalt_mq_map __user *u_map))
+{
+	struct cobalt_mq_map map;
+	struct cobalt_mqd *mqd;
+	struct cobalt_mq *mq;
+
+	mqd = cobalt_mqd_get(uqd);
+	if (IS_ERR(mqd))
+		return PTR_ERR(mqd);
+
+	mq = mqd->mq;
+	if (mq->shared == NULL) {
+		cobalt_mqd_put(mqd);
+		return -EINVAL;
+	}
+
+	map.state_offset = cobalt_umm_offset(&cobalt_ppd_get(1)->umm,
+					     mq->shared);
+	map.oflags = rtdm_fd_flags(&mqd->fd);
+	cobalt_mqd_put(mqd);
+
+	return cobalt_copy_to_user(u_map, &map, sizeof(map));
+}
+
+/*
+ * Userland reports a state transition of a shared queue which the
+ * kernel asked to be told about, i.e. the arrival of a message for
+ * mq_notify(), or the queue becoming readable/writable or not for
+ * select().
+ */
+COBALT_SYSCALL(mq_kick, primary, (mqd_t uqd))
+{
+	struct cobalt_mq_state *state;
+	struct cobalt_mqd *mqd;
+	struct cobalt_mq *mq;
+	int ret = 0;
+	spl_t s;
+
+	mqd = cobalt_mqd_get(uqd);
+	if (IS_ERR(mqd))
+		return PTR_ERR(mqd);
+
+	mq = mqd->mq;
+	state = mq->shared;
+	if (state == NULL) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (state->flags & COBALT_MQ_SELECT) {
+		xnselect_signal(&mq->read_select, mq_readable(mq));
+		xnselect_signal(&mq->write_select, mq_writable(mq));
+	}
+
+	if (mq->target && mq_readable(mq)) {
+		mq_notify_target(mq);
+		state->flags &= ~COBALT_MQ_NOTIFY;
+	}
+
+	xnsched_run();
+	xnlock_put_irqrestore(&nklock, s);
+out:
+	cobalt_mqd_put(mqd);
+
+	return ret;
+}
@@ -22,6 +22,7 @@
 #include <linux/types.h>
 #include <linux/fcntl.h>
 #include <xenomai/posix/syscall.h>
+#include <cobalt/uapi/mqueue.h>
 
 struct mq_attr {
 	long mq_flags;
@@ -86,4 +87,9 @@ COBALT_SYSCALL_DECL(mq_timedreceive64,
 COBALT_SYSCALL_DECL(mq_notify,
 		    (mqd_t fd, const struct sigevent *__user evp));
 
+COBALT_SYSCALL_DECL(mq_map,
+		    (mqd_t uqd, struct cobalt_mq_map __user *u_map));
+
+COBALT_SYSCALL_DECL(mq_kick, (mqd_t uqd));
+
 #endif /* !_COBALT_POSIX_MQUEUE_H */
@@ -41,6 +41,7 @@
 #include "clock.h"
 #include "event.h"
 #include "timerfd.h"
+#include "epoll.h"
 #include "io.h"
 #include "corectl.h"
 #include "../debug.h"
@@ -287,7 +287,8 @@ static void cobalt_timer_gettimeout(struct cobalt_timer *__restrict__ timer,
 }
 
 int __cobalt_timer_setval(struct xntimer *__restrict__ timer, int clock_flag,
-			  const struct itimerspec64 *__restrict__ value)
+			  const struct itimerspec64 *__restrict__ value,
+			  xnticks_t slack)
 {
 	xnticks_t start, period;
 
@@ -303,6 +304,8 @@ int __cobalt_timer_setval(struct xntimer *__restrict__ timer, int clock_flag,
 	start = ts2ns(&value->it_value) + 1;
 	period = ts2ns(&value->it_interval);
 
+	xntimer_set_slack(timer, slack);
+
 	/*
 	 * Now start the timer. If the timeout data has already
 	 * passed, the caller will handle the case.
@@ -340,7 +343,8 @@ cobalt_timer_set(struct cobalt_timer *timer, int flags,
 	xntimer_set_affinity(&timer->timerbase, thread->threadbase.sched);
 
 	return __cobalt_timer_setval(&timer->timerbase,
-				     clock_flag(flags, timer->clockid), value);
+				     clock_flag(flags, timer->clockid), value,
+				     __COBALT_TIMER_SLACK_NS(flags));
 }
 
 static inline void
@@ -54,7 +54,8 @@ void __cobalt_timer_getval(struct xntimer *__restrict__ timer,
 			   struct itimerspec64 *__restrict__ value);
 
 int __cobalt_timer_setval(struct xntimer *__restrict__ timer, int clock_flag, 
-			  const struct itimerspec64 *__restrict__ value);
+			  const struct itimerspec64 *__restrict__ value,
+			  xnticks_t slack);
 
 int __cobalt_timer_create(clockid_t clock,
 			  const struct sigevent *sev,
@@ -40,7 +40,8 @@ struct cobalt_tfd {
 
 #define COBALT_TFD_TICKED	(1 << 2)
 
-#define COBALT_TFD_SETTIME_FLAGS (TFD_TIMER_ABSTIME | TFD_WAKEUP)
+#define COBALT_TFD_SETTIME_FLAGS \
+	(TFD_TIMER_ABSTIME | TFD_WAKEUP | __COBALT_TIMER_SLACK_MASK)
 
 static ssize_t timerfd_read(struct rtdm_fd *fd, void __user *buf, size_t size)
 {
@@ -270,7 +271,8 @@ int __cobalt_timerfd_settime(int fd, int flags,
 	xntimer_set_affinity(&tfd->timer, xnthread_current()->sched);
 
 	ret = __cobalt_timer_setval(&tfd->timer,
-				    clock_flag(cflag, tfd->clockid), value);
+				    clock_flag(cflag, tfd->clockid), value,
+				    __COBALT_TIMER_SLACK_NS(flags));
 out:
 	xnlock_put_irqrestore(&nklock, s);
 
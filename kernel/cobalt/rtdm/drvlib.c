@@ -84,30 +84,10 @@ nanosecs_abs_t rtdm_clock_read_monotonic(void);
  * @{
  */
 
-/**
- * @brief Initialise and start a real-time task
- *
- * After initialising a task, the task handle remains valid and can be
- * passed to RTDM services until either rtdm_task_destroy() or
- * rtdm_task_join() was invoked.
- *
- * @param[in,out] task Task handle
- * @param[in] name Optional task name
- * @param[in] task_proc Procedure to be executed by the task
- * @param[in] arg Custom argument passed to @c task_proc() on entry
- * @param[in] priority Priority of the task, see also
- * @ref rtdmtaskprio "Task Priority Range"
- * @param[in] period Period in nanoseconds of a cyclic task, 0 for non-cyclic
- * mode. Waiting for the first and subsequent periodic events is
- * done using rtdm_task_wait_period().
- *
- * @return 0 on success, otherwise negative error code
- *
- * @coretags{secondary-only, might-switch}
- */
-int rtdm_task_init(rtdm_task_t *task, const char *name,
-		   rtdm_task_proc_t task_proc, void *arg,
-		   int priority, nanosecs_rel_t period)
+static int __rtdm_task_init(rtdm_task_t *task, const char *name,
+			    rtdm_task_proc_t task_proc, void *arg,
+			    int priority, nanosecs_rel_t period,
+			    const struct cpumask *affinity)
 {
 	union xnsched_policy_param param;
 	struct xnthread_start_attr sattr;
@@ -120,7 +100,7 @@ int rtdm_task_init(rtdm_task_t *task, const char *name,
 	iattr.name = name;
 	iattr.flags = 0;
 	iattr.personality = &xenomai_personality;
-	iattr.affinity = CPU_MASK_ALL;
+	cpumask_copy(&iattr.affinity, affinity);
 	param.rt.prio = priority;
 
 	err = xnthread_init(task, &iattr, &xnsched_class_rt, &param);
@@ -154,8 +134,71 @@ int rtdm_task_init(rtdm_task_t *task, const char *name,
 	return err;
 }
 
+/**
+ * @brief Initialise and start a real-time task
+ *
+ * After initialising a task, the task handle remains valid and can be
+ * passed to RTDM services until either rtdm_task_destroy() or
+ * rtdm_task_join() was invoked.
+ *
+ * @param[in,out] task Task handle
+ * @param[in] name Optional task name
+ * @param[in] task_proc Procedure to be executed by the task
+ * @param[in] arg Custom argument passed to @c task_proc() on entry
+ * @param[in] priority Priority of the task, see also
+ * @ref rtdmtaskprio "Task Priority Range"
+ * @param[in] period Period in nanoseconds of a cyclic task, 0 for non-cyclic
+ * mode. Waiting for the first and subsequent periodic events is
+ * done using rtdm_task_wait_period().
+ *
+ * @return 0 on success, otherwise negative error code
+ *
+ * @coretags{secondary-only, might-switch}
+ */
+int rtdm_task_init(rtdm_task_t *task, const char *name,
+		   rtdm_task_proc_t task_proc, void *arg,
+		   int priority, nanosecs_rel_t period)
+{
+	return __rtdm_task_init(task, name, task_proc, arg,
+				priority, period, cpu_all_mask);
+}
+
 EXPORT_SYMBOL_GPL(rtdm_task_init);
 
+/**
+ * @brief Initialise and start a real-time task on a given CPU
+ *
+ * Same as rtdm_task_init(), except that the task is pinned to @a cpu.
+ *
+ * @param[in,out] task Task handle
+ * @param[in] name Optional task name
+ * @param[in] task_proc Procedure to be executed by the task
+ * @param[in] arg Custom argument passed to @c task_proc() on entry
+ * @param[in] priority Priority of the task, see also
+ * @ref rtdmtaskprio "Task Priority Range"
+ * @param[in] period Period in nanoseconds of a cyclic task, 0 for non-cyclic
+ * mode.
+ * @param[in] cpu CPU the task should run on, which must be part of
+ * the real-time CPU set.
+ *
+ * @return 0 on success, otherwise negative error code. -EINVAL is
+ * returned if @a cpu cannot run real-time tasks.
+ *
+ * @coretags{secondary-only, might-switch}
+ */
+int rtdm_task_init_cpu(rtdm_task_t *task, const char *name,
+		       rtdm_task_proc_t task_proc, void *arg,
+		       int priority, nanosecs_rel_t period, int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpu_ids || !xnsched_threading_cpu(cpu))
+		return -EINVAL;
+
+	return __rtdm_task_init(task, name, task_proc, arg,
+				priority, period, cpumask_of(cpu));
+}
+
+EXPORT_SYMBOL_GPL(rtdm_task_init_cpu);
+
 #ifdef DOXYGEN_CPP /* Only used for doxygen doc generation */
 /**
  * @brief Destroy a real-time task
@@ -1158,6 +1201,86 @@ int rtdm_sem_timeddown(rtdm_sem_t *sem, nanosecs_rel_t timeout,
 
 EXPORT_SYMBOL_GPL(rtdm_sem_timeddown);
 
+/**
+ * @brief Decrement a semaphore by up to a given count, with timeout
+ *
+ * This function behaves like rtdm_sem_timeddown(), except that once
+ * the semaphore is available, it consumes as many units as possible
+ * up to @a max in a single step. This allows drivers which count
+ * queued items with a semaphore to dequeue a batch of them at once.
+ *
+ * @param[in,out] sem Semaphore handle as returned by rtdm_sem_init()
+ * @param[in] max Maximum number of units to consume, must be non-zero
+ * @param[in] timeout Relative timeout in nanoseconds, see
+ * @ref RTDM_TIMEOUT_xxx for special values
+ * @param[in,out] timeout_seq Handle of a timeout sequence as returned by
+ * rtdm_toseq_init() or NULL
+ *
+ * @return The number of units consumed on success (at least one),
+ * otherwise the same error codes as rtdm_sem_timeddown().
+ *
+ * @coretags{primary-timed, might-switch}
+ */
+int rtdm_sem_timeddown_batch(rtdm_sem_t *sem, unsigned int max,
+			     nanosecs_rel_t timeout, rtdm_toseq_t *timeout_seq)
+{
+	unsigned int count = 0;
+	int err = 0, ret;
+	spl_t s;
+
+	if (!XENO_ASSERT(COBALT, timeout < 0 || !xnsched_unblockable_p()))
+		return -EPERM;
+
+	if (max == 0)
+		return -EINVAL;
+
+	trace_cobalt_driver_sem_wait(sem, xnthread_current());
+
+	xnlock_get_irqsave(&nklock, s);
+
+	if (unlikely(sem->synch_base.status & RTDM_SYNCH_DELETED))
+		err = -EIDRM;
+	else if (sem->value == 0) {
+		if (timeout < 0) { /* non-blocking mode */
+			err = -EWOULDBLOCK;
+			goto out;
+		}
+
+		if (timeout_seq && timeout > 0)
+			ret = xnsynch_sleep_on(&sem->synch_base, *timeout_seq,
+					       XN_ABSOLUTE);
+		else
+			ret = xnsynch_sleep_on(&sem->synch_base, timeout, XN_RELATIVE);
+
+		if (ret) {
+			if (ret & XNTIMEO)
+				err = -ETIMEDOUT;
+			else if (ret & XNRMID)
+				err = -EIDRM;
+			else /* XNBREAK */
+				err = -EINTR;
+			goto out;
+		}
+
+		/* rtdm_sem_up() handed over one unit to us. */
+		count = 1;
+	}
+
+	if (!err && count < max && sem->value > 0) {
+		ret = min_t(unsigned long, sem->value, max - count);
+		sem->value -= ret;
+		count += ret;
+		if (sem->value == 0)
+			xnselect_signal(&sem->select_block, 0);
+	}
+out:
+	xnlock_put_irqrestore(&nklock, s);
+
+	return err ?: count;
+}
+
+EXPORT_SYMBOL_GPL(rtdm_sem_timeddown_batch);
+
 /**
  * @brief Increment a semaphore
  *
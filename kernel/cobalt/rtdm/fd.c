@@ -27,6 +27,10 @@
 #include <linux/poll.h>
 #include <linux/kthread.h>
 #include <linux/fdtable.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
+#include <linux/overflow.h>
 #include <cobalt/kernel/registry.h>
 #include <cobalt/kernel/lock.h>
 #include <cobalt/kernel/ppd.h>
@@ -41,13 +45,25 @@
 
 #define RTDM_SETFL_MASK (O_NONBLOCK)
 
-DEFINE_PRIVATE_XNLOCK(fdtree_lock);
+DEFINE_PRIVATE_XNLOCK(fdlist_lock);
+static DEFINE_MUTEX(fdtab_mutex);
 static LIST_HEAD(rtdm_fd_cleanup_queue);
 static struct semaphore rtdm_fd_cleanup_sem;
+static DEFINE_PER_CPU(unsigned long, fd_lookup_seq);
 
-struct rtdm_fd_index {
-	struct xnid id;
-	struct rtdm_fd *fd;
+#define RTDM_FD_TABLE_MINSZ	64
+
+/*
+ * Per-process file descriptor table, indexed by ufd. Lookups are
+ * lockless: the table is only ever replaced as a whole when growing
+ * and individual slots are updated atomically, all under
+ * fdtab_mutex. Updaters wait for in-flight lookups to complete
+ * before releasing a stale table or dropping the reference held by
+ * a slot, see wait_fd_lookups().
+ */
+struct rtdm_fd_table {
+	unsigned int size;
+	struct rtdm_fd *slots[];
 };
 
 static int enosys(void)
@@ -70,23 +86,58 @@ static int enodev(void)
 	return -ENODEV;
 }
 
-static inline struct rtdm_fd_index *
-fetch_fd_index(struct cobalt_ppd *p, int ufd)
+/*
+ * Fetch the descriptor indexed by ufd, grabbing a reference on it.
+ * The lookup runs with hard irqs off, within a window delimited by
+ * a per-CPU sequence count which is odd while the lookup is in
+ * progress.
+ */
+static struct rtdm_fd *fetch_fd(struct cobalt_ppd *p, int ufd)
 {
-	struct xnid *id = xnid_fetch(&p->fds, ufd);
-	if (id == NULL)
-		return NULL;
+	struct rtdm_fd_table *tab;
+	struct rtdm_fd *fd = NULL;
+	unsigned long *seq;
+	spl_t s;
 
-	return container_of(id, struct rtdm_fd_index, id);
+	splhigh(s);
+	seq = raw_cpu_ptr(&fd_lookup_seq);
+	WRITE_ONCE(*seq, *seq + 1);
+	smp_mb();
+
+	tab = smp_load_acquire(&p->fdtab);
+	if (tab && (unsigned int)ufd < tab->size) {
+		fd = READ_ONCE(tab->slots[ufd]);
+		if (fd && !atomic_inc_not_zero(&fd->refs))
+			fd = NULL;
+	}
+
+	smp_mb();
+	WRITE_ONCE(*seq, *seq + 1);
+	splexit(s);
+
+	return fd;
 }
 
-static struct rtdm_fd *fetch_fd(struct cobalt_ppd *p, int ufd)
+/*
+ * Wait for all lookups which might have observed a table or slot
+ * content before it was changed by the caller. Lookup windows are
+ * short and run with hard irqs off, so this does not spin for long.
+ */
+static void wait_fd_lookups(void)
 {
-	struct rtdm_fd_index *idx = fetch_fd_index(p, ufd);
-	if (idx == NULL)
-		return NULL;
+	unsigned long seq, *p;
+	int cpu;
 
-	return idx->fd;
+	smp_mb();
+
+	for_each_online_cpu(cpu) {
+		p = per_cpu_ptr(&fd_lookup_seq, cpu);
+		seq = READ_ONCE(*p);
+		if (seq & 1) {
+			while (READ_ONCE(*p) == seq)
+				cpu_relax();
+		}
+	}
 }
 
 #define assign_invalid_handler(__handler, __invalid)			\
@@ -174,7 +225,7 @@ int rtdm_fd_enter(struct rtdm_fd *fd, int ufd, unsigned int magic,
 	fd->ops = ops;
 	fd->owner = ppd;
 	fd->ufd = ufd;
-	fd->refs = 1;
+	atomic_set(&fd->refs, 1);
 	fd->stale = false;
 	set_compat_bit(fd);
 	INIT_LIST_HEAD(&fd->next);
@@ -184,24 +235,46 @@ int rtdm_fd_enter(struct rtdm_fd *fd, int ufd, unsigned int magic,
 
 int rtdm_fd_register(struct rtdm_fd *fd, int ufd)
 {
-	struct rtdm_fd_index *idx;
+	struct rtdm_fd_table *tab, *new = NULL;
 	struct cobalt_ppd *ppd;
-	spl_t s;
+	unsigned int size;
 	int ret = 0;
 
+	secondary_mode_only();
+
+	if (ufd < 0)
+		return -EBADF;
+
 	ppd = cobalt_ppd_get(0);
-	idx = kmalloc(sizeof(*idx), GFP_KERNEL);
-	if (idx == NULL)
-		return -ENOMEM;
 
-	idx->fd = fd;
+	mutex_lock(&fdtab_mutex);
 
-	xnlock_get_irqsave(&fdtree_lock, s);
-	ret = xnid_enter(&ppd->fds, &idx->id, ufd);
-	xnlock_put_irqrestore(&fdtree_lock, s);
-	if (ret < 0) {
-		kfree(idx);
+	tab = ppd->fdtab;
+	if (tab == NULL || ufd >= tab->size) {
+		size = tab ? tab->size * 2 : RTDM_FD_TABLE_MINSZ;
+		size = max_t(unsigned int, size, roundup_pow_of_two(ufd + 1));
+		new = kvzalloc(struct_size(new, slots, size), GFP_KERNEL);
+		if (new == NULL) {
+			mutex_unlock(&fdtab_mutex);
+			return -ENOMEM;
+		}
+		new->size = size;
+		if (tab)
+			memcpy(new->slots, tab->slots,
+			       tab->size * sizeof(tab->slots[0]));
+		smp_store_release(&ppd->fdtab, new);
+	}
+
+	if (ppd->fdtab->slots[ufd])
 		ret = -EBUSY;
+	else
+		WRITE_ONCE(ppd->fdtab->slots[ufd], fd);
+
+	mutex_unlock(&fdtab_mutex);
+
+	if (new && tab) {
+		wait_fd_lookups();
+		kvfree(tab);
 	}
 
 	return ret;
@@ -218,9 +291,9 @@ int rtdm_device_new_fd(struct rtdm_fd *fd, int ufd,
 		return ret;
 
 	trace_cobalt_fd_created(fd, ufd);
-	xnlock_get_irqsave(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdlist_lock, s);
 	list_add(&fd->next, &device->openfd_list);
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	xnlock_put_irqrestore(&fdlist_lock, s);
 
 	return 0;
 }
@@ -249,24 +322,21 @@ struct rtdm_fd *rtdm_fd_get(int ufd, unsigned int magic)
 {
 	struct cobalt_ppd *p = cobalt_ppd_get(0);
 	struct rtdm_fd *fd;
-	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
 	fd = fetch_fd(p, ufd);
-	if (fd == NULL || (magic != 0 && fd->magic != magic)) {
-		fd = ERR_PTR(-EADV);
-		goto out;
+	if (fd == NULL)
+		return ERR_PTR(-EADV);
+
+	if (magic != 0 && fd->magic != magic) {
+		rtdm_fd_put(fd);
+		return ERR_PTR(-EADV);
 	}
 
 	if (fd->stale) {
-		fd = ERR_PTR(-EBADF);
-		goto out;
+		rtdm_fd_put(fd);
+		return ERR_PTR(-EBADF);
 	}
 
-	++fd->refs;
-out:
-	xnlock_put_irqrestore(&fdtree_lock, s);
-
 	return fd;
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_get);
@@ -286,11 +356,11 @@ static int fd_cleanup_thread(void *data)
 				return 0;
 		} while (err);
 
-		xnlock_get_irqsave(&fdtree_lock, s);
+		xnlock_get_irqsave(&fdlist_lock, s);
 		fd = list_first_entry(&rtdm_fd_cleanup_queue,
 				struct rtdm_fd, cleanup);
 		list_del(&fd->cleanup);
-		xnlock_put_irqrestore(&fdtree_lock, s);
+		xnlock_put_irqrestore(&fdlist_lock, s);
 
 		fd->ops->close(fd);
 	}
@@ -305,27 +375,27 @@ static void lostage_trigger_close(struct irq_work *inband_work)
 
 static DEFINE_IRQ_WORK(fd_closework, lostage_trigger_close);
 
-static void __put_fd(struct rtdm_fd *fd, spl_t s)
+static void __put_fd(struct rtdm_fd *fd)
 {
-	bool destroy, trigger;
-
-	XENO_WARN_ON(COBALT, fd->refs <= 0);
-	destroy = --fd->refs == 0;
-	if (destroy && !list_empty(&fd->next))
-		list_del_init(&fd->next);
-
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	bool trigger;
+	spl_t s;
 
-	if (!destroy)
+	XENO_WARN_ON(COBALT, atomic_read(&fd->refs) <= 0);
+	if (!atomic_dec_and_test(&fd->refs))
 		return;
 
+	xnlock_get_irqsave(&fdlist_lock, s);
+	if (!list_empty(&fd->next))
+		list_del_init(&fd->next);
+	xnlock_put_irqrestore(&fdlist_lock, s);
+
 	if (is_secondary_domain())
 		fd->ops->close(fd);
 	else {
-		xnlock_get_irqsave(&fdtree_lock, s);
+		xnlock_get_irqsave(&fdlist_lock, s);
 		trigger = list_empty(&rtdm_fd_cleanup_queue);
 		list_add_tail(&fd->cleanup, &rtdm_fd_cleanup_queue);
-		xnlock_put_irqrestore(&fdtree_lock, s);
+		xnlock_put_irqrestore(&fdlist_lock, s);
 
 		if (trigger)
 			irq_work_queue(&fd_closework);
@@ -338,21 +408,21 @@ void rtdm_device_flush_fds(struct rtdm_device *dev)
 	struct rtdm_fd *fd;
 	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
+	xnlock_get_irqsave(&fdlist_lock, s);
 
 	while (!list_empty(&dev->openfd_list)) {
 		fd = list_get_entry_init(&dev->openfd_list, struct rtdm_fd, next);
 		fd->stale = true;
-		if (drv->ops.close) {
-			rtdm_fd_get_light(fd);
-			xnlock_put_irqrestore(&fdtree_lock, s);
+		/* Skip descriptors already on their way out. */
+		if (drv->ops.close && rtdm_fd_get_light(fd)) {
+			xnlock_put_irqrestore(&fdlist_lock, s);
 			drv->ops.close(fd);
 			rtdm_fd_put(fd);
-			xnlock_get_irqsave(&fdtree_lock, s);
+			xnlock_get_irqsave(&fdlist_lock, s);
 		}
 	}
 
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	xnlock_put_irqrestore(&fdlist_lock, s);
 }
 
 /**
@@ -367,10 +437,7 @@ void rtdm_device_flush_fds(struct rtdm_device *dev)
  */
 void rtdm_fd_put(struct rtdm_fd *fd)
 {
-	spl_t s;
-
-	xnlock_get_irqsave(&fdtree_lock, s);
-	__put_fd(fd, s);
+	__put_fd(fd);
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_put);
 
@@ -390,17 +457,7 @@ EXPORT_SYMBOL_GPL(rtdm_fd_put);
  */
 int rtdm_fd_lock(struct rtdm_fd *fd)
 {
-	spl_t s;
-
-	xnlock_get_irqsave(&fdtree_lock, s);
-	if (fd->refs == 0) {
-		xnlock_put_irqrestore(&fdtree_lock, s);
-		return -EIDRM;
-	}
-	++fd->refs;
-	xnlock_put_irqrestore(&fdtree_lock, s);
-
-	return 0;
+	return rtdm_fd_get_light(fd) ? 0 : -EIDRM;
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_lock);
 
@@ -416,10 +473,7 @@ EXPORT_SYMBOL_GPL(rtdm_fd_lock);
  */
 void rtdm_fd_unlock(struct rtdm_fd *fd)
 {
-	spl_t s;
-
-	xnlock_get_irqsave(&fdtree_lock, s);
-	__put_fd(fd, s);
+	__put_fd(fd);
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_unlock);
 
@@ -641,6 +695,74 @@ out:
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_recvmsg);
 
+static inline size_t mmsg_stride(struct rtdm_fd *fd)
+{
+#ifdef CONFIG_XENO_ARCH_SYS3264
+	if (rtdm_fd_is_compat(fd))
+		return sizeof(struct compat_mmsghdr);
+#endif
+	return sizeof(struct mmsghdr);
+}
+
+/* Batches up to this size are mirrored on the stack. */
+#define RTDM_MMSG_FASTMAX  8
+
+static inline void drop_mmsgvec(struct mmsghdr *mmsgvec,
+				struct mmsghdr *mmsg_fast)
+{
+	if (mmsgvec != mmsg_fast)
+		xnfree(mmsgvec);
+}
+
+/*
+ * Mirror a vector of message headers to kernel memory, for batch
+ * handlers.
+ */
+static struct mmsghdr *
+fetch_mmsgvec(struct rtdm_fd *fd, void __user *u_msgvec, unsigned int vlen,
+	      int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
+	      struct mmsghdr *mmsg_fast)
+{
+	size_t stride = mmsg_stride(fd);
+	struct mmsghdr *mmsgvec;
+	unsigned int n;
+	int ret;
+
+	if (vlen <= RTDM_MMSG_FASTMAX)
+		mmsgvec = mmsg_fast;
+	else {
+		mmsgvec = xnmalloc(vlen * sizeof(*mmsgvec));
+		if (mmsgvec == NULL)
+			return ERR_PTR(-ENOMEM);
+	}
+
+	for (n = 0; n < vlen; n++, u_msgvec += stride) {
+		ret = get_mmsg(mmsgvec + n, u_msgvec);
+		if (ret) {
+			drop_mmsgvec(mmsgvec, mmsg_fast);
+			return ERR_PTR(ret);
+		}
+	}
+
+	return mmsgvec;
+}
+
+static int
+put_mmsgvec(void __user *u_msgvec, struct mmsghdr *mmsgvec, int count,
+	    int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg))
+{
+	void __user *u_p = u_msgvec;
+	int n, ret;
+
+	for (n = 0; n < count; n++) {
+		ret = put_mmsg(&u_p, mmsgvec + n);
+		if (ret)
+			return n ?: ret;
+	}
+
+	return count;
+}
+
 int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       unsigned int flags, void __user *u_timeout,
 		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
@@ -648,8 +770,9 @@ int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       int (*get_timespec)(struct timespec64 *ts, const void __user *u_ts))
 {
 	struct timespec64 ts = { 0 };
+	struct mmsghdr mmsg_fast[RTDM_MMSG_FASTMAX];
+	struct mmsghdr mmsg, *mmsgvec;
 	int ret = 0, datagrams = 0;
-	struct mmsghdr mmsg;
 	struct rtdm_fd *fd;
 	void __user *u_p;
 	ssize_t len;
@@ -669,12 +792,19 @@ int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		if (ret)
 			goto fail;
 
+		if (!timespec64_valid(&ts)) {
+			ret = -EINVAL;
+			goto fail;
+		}
+
 		if (ts.tv_sec == 0 && ts.tv_nsec == 0) {
 			flags |= MSG_DONTWAIT;
-		} else {
+			u_timeout = NULL;
+		} else if (fd->ops->recvmmsg_rt == NULL) {
 			/*
-			 * The timeout parameter is not supported.
-			 * Use recvmsg timeouts instead.
+			 * The timeout parameter is only supported by
+			 * batch handlers. Use recvmsg timeouts
+			 * instead.
 			 */
 			ret = -EINVAL;
 			goto fail;
@@ -684,6 +814,24 @@ int __rtdm_fd_recvmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 	if (fd->oflags & O_NONBLOCK)
 		flags |= MSG_DONTWAIT;
 
+	if (fd->ops->recvmmsg_rt) {
+		if (vlen == 0)
+			goto fail;
+		vlen = min_t(unsigned int, vlen, UIO_MAXIOV);
+		mmsgvec = fetch_mmsgvec(fd, u_msgvec, vlen, get_mmsg,
+					mmsg_fast);
+		if (IS_ERR(mmsgvec)) {
+			ret = PTR_ERR(mmsgvec);
+			goto fail;
+		}
+		ret = fd->ops->recvmmsg_rt(fd, mmsgvec, vlen, flags,
+					   u_timeout ? &ts : NULL);
+		if (ret > 0)
+			ret = put_mmsgvec(u_msgvec, mmsgvec, ret, put_mmsg);
+		drop_mmsgvec(mmsgvec, mmsg_fast);
+		goto fail;
+	}
+
 	for (u_p = u_msgvec; vlen > 0; vlen--) {
 		ret = get_mmsg(&mmsg, u_p);
 		if (ret)
@@ -775,8 +923,9 @@ int __rtdm_fd_sendmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		       int (*get_mmsg)(struct mmsghdr *mmsg, void __user *u_mmsg),
 		       int (*put_mmsg)(void __user **u_mmsg_p, const struct mmsghdr *mmsg))
 {
+	struct mmsghdr mmsg_fast[RTDM_MMSG_FASTMAX];
+	struct mmsghdr mmsg, *mmsgvec;
 	int ret = 0, datagrams = 0;
-	struct mmsghdr mmsg;
 	struct rtdm_fd *fd;
 	void __user *u_p;
 	ssize_t len;
@@ -794,6 +943,21 @@ int __rtdm_fd_sendmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 	if (fd->oflags & O_NONBLOCK)
 		flags |= MSG_DONTWAIT;
 
+	if (fd->ops->sendmmsg_rt && vlen > 0) {
+		vlen = min_t(unsigned int, vlen, UIO_MAXIOV);
+		mmsgvec = fetch_mmsgvec(fd, u_msgvec, vlen, get_mmsg,
+					mmsg_fast);
+		if (IS_ERR(mmsgvec)) {
+			ret = PTR_ERR(mmsgvec);
+			goto fail;
+		}
+		ret = fd->ops->sendmmsg_rt(fd, mmsgvec, vlen, flags);
+		if (ret > 0)
+			ret = put_mmsgvec(u_msgvec, mmsgvec, ret, put_mmsg);
+		drop_mmsgvec(mmsgvec, mmsg_fast);
+		goto fail;
+	}
+
 	for (u_p = u_msgvec; vlen > 0; vlen--) {
 		ret = get_mmsg(&mmsg, u_p);
 		if (ret)
@@ -810,6 +974,7 @@ int __rtdm_fd_sendmmsg(int ufd, void __user *u_msgvec, unsigned int vlen,
 		datagrams++;
 	}
 
+fail:
 	rtdm_fd_put(fd);
 
 	if (datagrams > 0)
@@ -821,41 +986,32 @@ out:
 	return ret;
 }
 
-static void
-__fd_close(struct cobalt_ppd *p, struct rtdm_fd_index *idx, spl_t s)
-{
-	xnid_remove(&p->fds, &idx->id);
-	__put_fd(idx->fd, s);
-
-	kfree(idx);
-}
-
 int rtdm_fd_close(int ufd, unsigned int magic)
 {
-	struct rtdm_fd_index *idx;
+	struct rtdm_fd_table *tab;
 	struct cobalt_ppd *ppd;
 	struct rtdm_fd *fd;
-	spl_t s;
 
 	secondary_mode_only();
 
 	ppd = cobalt_ppd_get(0);
 
-	xnlock_get_irqsave(&fdtree_lock, s);
-	idx = fetch_fd_index(ppd, ufd);
-	if (idx == NULL)
-		goto eadv;
+	mutex_lock(&fdtab_mutex);
 
-	fd = idx->fd;
-	if (magic != 0 && fd->magic != magic) {
-eadv:
-		xnlock_put_irqrestore(&fdtree_lock, s);
+	tab = ppd->fdtab;
+	fd = tab && (unsigned int)ufd < tab->size ? tab->slots[ufd] : NULL;
+	if (fd == NULL || (magic != 0 && fd->magic != magic)) {
+		mutex_unlock(&fdtab_mutex);
 		return -EADV;
 	}
 
 	set_compat_bit(fd);
 
-	trace_cobalt_fd_close(current, fd, ufd, fd->refs);
+	trace_cobalt_fd_close(current, fd, ufd, atomic_read(&fd->refs));
+
+	WRITE_ONCE(tab->slots[ufd], NULL);
+
+	mutex_unlock(&fdtab_mutex);
 
 	/*
 	 * In dual kernel mode, the linux-side fdtable and the RTDM
@@ -864,7 +1020,8 @@ eadv:
 	 * descriptor was removed from the fdtable if some refs on
 	 * rtdm_fd are still pending.
 	 */
-	__fd_close(ppd, idx, s);
+	wait_fd_lookups();
+	__put_fd(fd);
 	close_fd(ufd);
 
 	return 0;
@@ -908,13 +1065,14 @@ out:
 int rtdm_fd_valid_p(int ufd)
 {
 	struct rtdm_fd *fd;
-	spl_t s;
 
-	xnlock_get_irqsave(&fdtree_lock, s);
 	fd = fetch_fd(cobalt_ppd_get(0), ufd);
-	xnlock_put_irqrestore(&fdtree_lock, s);
+	if (fd == NULL)
+		return 0;
+
+	rtdm_fd_put(fd);
 
-	return fd != NULL;
+	return 1;
 }
 
 /**
@@ -1083,25 +1241,32 @@ int rtdm_fd_put_iovec(struct rtdm_fd *fd, const struct iovec *iov,
 }
 EXPORT_SYMBOL_GPL(rtdm_fd_put_iovec);
 
-static void destroy_fd(void *cookie, struct xnid *id)
-{
-	struct cobalt_ppd *p = cookie;
-	struct rtdm_fd_index *idx;
-	spl_t s;
-
-	idx = container_of(id, struct rtdm_fd_index, id);
-	xnlock_get_irqsave(&fdtree_lock, s);
-	__fd_close(p, idx, 0);
-}
-
 void rtdm_fd_cleanup(struct cobalt_ppd *p)
 {
+	struct rtdm_fd_table *tab;
+	unsigned int ufd;
+
 	/*
 	 * This is called on behalf of a (userland) task exit handler,
 	 * so we don't have to deal with the regular file descriptors,
 	 * we only have to empty our own index.
 	 */
-	xntree_cleanup(&p->fds, p, destroy_fd);
+	mutex_lock(&fdtab_mutex);
+	tab = p->fdtab;
+	WRITE_ONCE(p->fdtab, NULL);
+	mutex_unlock(&fdtab_mutex);
+
+	if (tab == NULL)
+		return;
+
+	wait_fd_lookups();
+
+	for (ufd = 0; ufd < tab->size; ufd++) {
+		if (tab->slots[ufd])
+			__put_fd(tab->slots[ufd]);
+	}
+
+	kvfree(tab);
 }
 
 void rtdm_fd_init(void)
@@ -20,7 +20,7 @@
 
 static void xnsched_rt_init(struct xnsched *sched)
 {
-	xnsched_initq(&sched->rt.runnable);
+	xnsched_initq(&sched->rt.runnable, XNSCHED_MLQ_LEVELS);
 }
 
 static void xnsched_rt_requeue(struct xnthread *thread)
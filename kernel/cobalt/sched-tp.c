@@ -89,9 +89,10 @@ static void xnsched_tp_init(struct xnsched *sched)
 	int n;
 
 	for (n = 0; n < CONFIG_XENO_OPT_SCHED_TP_NRPART; n++)
-		xnsched_initq(&tp->partitions[n].runnable);
+		xnsched_initq(&tp->partitions[n].runnable,
+			      XNSCHED_TP_MAX_PRIO + 1);
 
-	xnsched_initq(&tp->idle.runnable);
+	xnsched_initq(&tp->idle.runnable, XNSCHED_TP_MAX_PRIO + 1);
 
 #ifdef CONFIG_SMP
 	ksformat(timer_name, sizeof(timer_name), "[tp-tick/%u]", sched->cpu);
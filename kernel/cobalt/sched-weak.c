@@ -21,7 +21,7 @@
 
 static void xnsched_weak_init(struct xnsched *sched)
 {
-	xnsched_initq(&sched->weak.runnable);
+	xnsched_initq(&sched->weak.runnable, XNSCHED_WEAK_NR_PRIO);
 }
 
 static void xnsched_weak_requeue(struct xnthread *thread)
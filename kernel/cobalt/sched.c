@@ -622,31 +622,33 @@ void xnsched_migrate_passive(struct xnthread *thread, struct xnsched *sched)
 	}
 }
 
-#ifdef CONFIG_XENO_OPT_SCALABLE_SCHED
-
-void xnsched_initq(struct xnsched_mlq *q)
+void xnsched_initq(struct xnsched_mlq *q, int levels)
 {
 	int prio;
 
-	q->elems = 0;
+	BUILD_BUG_ON(XNSCHED_MLQ_WORDS > BITS_PER_LONG);
+	XENO_BUG_ON(COBALT, levels <= 0 || levels > XNSCHED_MLQ_LEVELS);
+
+	q->summary = 0;
 	bitmap_zero(q->prio_map, XNSCHED_MLQ_LEVELS);
+	q->levels = levels;
 
-	for (prio = 0; prio < XNSCHED_MLQ_LEVELS; prio++)
+	for (prio = 0; prio < levels; prio++)
 		INIT_LIST_HEAD(q->heads + prio);
 }
 
 static inline int get_qindex(struct xnsched_mlq *q, int prio)
 {
-	XENO_BUG_ON(COBALT, prio < 0 || prio >= XNSCHED_MLQ_LEVELS);
+	XENO_BUG_ON(COBALT, prio < 0 || prio >= q->levels);
 	/*
 	 * BIG FAT WARNING: We need to rescale the priority level to a
-	 * 0-based range. We use find_first_bit() to scan the bitmap
+	 * 0-based range. We use __ffs() to scan the bitmap words
 	 * which is a bit scan forward operation. Therefore, the lower
 	 * the index value, the higher the priority (since least
 	 * significant bits will be found first when scanning the
-	 * bitmap).
+	 * bitmap). The same goes for the summary word.
 	 */
-	return XNSCHED_MLQ_LEVELS - prio - 1;
+	return q->levels - prio - 1;
 }
 
 static struct list_head *add_q(struct xnsched_mlq *q, int prio)
@@ -656,11 +658,12 @@ static struct list_head *add_q(struct xnsched_mlq *q, int prio)
 
 	idx = get_qindex(q, prio);
 	head = q->heads + idx;
-	q->elems++;
 
 	/* New item is not linked yet. */
-	if (list_empty(head))
+	if (list_empty(head)) {
 		__set_bit(idx, q->prio_map);
+		q->summary |= BIT(BIT_WORD(idx));
+	}
 
 	return head;
 }
@@ -683,10 +686,12 @@ static void del_q(struct xnsched_mlq *q,
 	struct list_head *head = q->heads + idx;
 
 	list_del(entry);
-	q->elems--;
 
-	if (list_empty(head))
+	if (list_empty(head)) {
 		__clear_bit(idx, q->prio_map);
+		if (q->prio_map[BIT_WORD(idx)] == 0)
+			q->summary &= ~BIT(BIT_WORD(idx));
+	}
 }
 
 void xnsched_delq(struct xnsched_mlq *q, struct xnthread *thread)
@@ -700,7 +705,7 @@ struct xnthread *xnsched_getq(struct xnsched_mlq *q)
 	struct list_head *head;
 	int idx;
 
-	if (q->elems == 0)
+	if (xnsched_emptyq_p(q))
 		return NULL;
 
 	idx = xnsched_weightq(q);
@@ -734,7 +739,7 @@ struct xnthread *xnsched_rt_pick(struct xnsched *sched)
 	struct list_head *head;
 	int idx;
 
-	if (q->elems == 0)
+	if (xnsched_emptyq_p(q))
 		return NULL;
 
 	/*
@@ -764,47 +769,6 @@ struct xnthread *xnsched_rt_pick(struct xnsched *sched)
 
 #endif /* CONFIG_XENO_OPT_SCHED_CLASSES */
 
-#else /* !CONFIG_XENO_OPT_SCALABLE_SCHED */
-
-struct xnthread *xnsched_findq(struct list_head *q, int prio)
-{
-	struct xnthread *thread;
-
-	if (list_empty(q))
-		return NULL;
-
-	/* Find thread leading a priority group. */
-	list_for_each_entry(thread, q, rlink) {
-		if (prio == thread->cprio)
-			return thread;
-	}
-
-	return NULL;
-}
-
-#ifdef CONFIG_XENO_OPT_SCHED_CLASSES
-
-struct xnthread *xnsched_rt_pick(struct xnsched *sched)
-{
-	struct list_head *q = &sched->rt.runnable;
-	struct xnthread *thread;
-
-	if (list_empty(q))
-		return NULL;
-
-	thread = list_first_entry(q, struct xnthread, rlink);
-	if (unlikely(thread->sched_class != &xnsched_class_rt))
-		return thread->sched_class->sched_pick(sched);
-
-	list_del(&thread->rlink);
-
-	return thread;
-}
-
-#endif /* CONFIG_XENO_OPT_SCHED_CLASSES */
-
-#endif /* !CONFIG_XENO_OPT_SCALABLE_SCHED */
-
 /**
  * @fn int xnsched_run(void)
  * @brief The rescheduling procedure.
@@ -45,6 +45,13 @@
  * - a @a struct @a xnselector structure, the selection structure,  passed by
  * the thread calling the xnselect service, where this service does all its
  * housekeeping.
+ *
+ * A selector may additionally be switched to event mode with
+ * xnselector_set_evmode(), in which case the bindings receiving an
+ * event are queued to the selector ready list as well. This allows
+ * event-based multiplexers to collect the pending events in a time
+ * proportional to the number of ready descriptors, instead of
+ * scanning the whole descriptor sets.
  * @{
  */
 
@@ -120,12 +127,15 @@ int xnselect_bind(struct xnselect *select_block,
 	binding->fd = select_block;
 	binding->type = type;
 	binding->bit_index = index;
+	INIT_LIST_HEAD(&binding->rlink);
 
 	list_add_tail(&binding->slink, &selector->bindings);
 	list_add_tail(&binding->link, &select_block->bindings);
 	__FD_SET__(index, &selector->fds[type].expected);
 	if (state) {
 		__FD_SET__(index, &selector->fds[type].pending);
+		if (selector->evmode)
+			list_add_tail(&binding->rlink, &selector->ready);
 		if (xnselect_wakeup(selector))
 			xnsched_run();
 	} else
@@ -149,12 +159,17 @@ int __xnselect_signal(struct xnselect *select_block, unsigned state)
 					&selector->fds[binding->type].pending)) {
 				__FD_SET__(binding->bit_index,
 					 &selector->fds[binding->type].pending);
+				if (selector->evmode)
+					list_add_tail(&binding->rlink,
+						      &selector->ready);
 				if (xnselect_wakeup(selector))
 					resched = 1;
 			}
-		} else
+		} else {
 			__FD_CLR__(binding->bit_index,
 				 &selector->fds[binding->type].pending);
+			list_del_init(&binding->rlink);
+		}
 	}
 
 	return resched;
@@ -175,16 +190,19 @@ void xnselect_destroy(struct xnselect *select_block)
 {
 	struct xnselect_binding *binding, *tmp;
 	struct xnselector *selector;
+	LIST_HEAD(zombies);
 	int resched = 0;
 	spl_t s;
 
 	xnlock_get_irqsave(&nklock, s);
 
-	if (list_empty(&select_block->bindings))
-		goto out;
-
+	/*
+	 * Unlink all bindings in one go, so that nobody may walk them
+	 * once we release them outside of the locked section.
+	 */
 	list_for_each_entry_safe(binding, tmp, &select_block->bindings, link) {
 		list_del(&binding->link);
+		list_del(&binding->rlink);
 		selector = binding->selector;
 		__FD_CLR__(binding->bit_index,
 			 &selector->fds[binding->type].expected);
@@ -195,15 +213,15 @@ void xnselect_destroy(struct xnselect *select_block)
 			if (xnselect_wakeup(selector))
 				resched = 1;
 		}
-		list_del(&binding->slink);
-		xnlock_put_irqrestore(&nklock, s);
-		xnfree(binding);
-		xnlock_get_irqsave(&nklock, s);
+		list_move(&binding->slink, &zombies);
 	}
 	if (resched)
 		xnsched_run();
-out:
+
 	xnlock_put_irqrestore(&nklock, s);
+
+	list_for_each_entry_safe(binding, tmp, &zombies, slink)
+		xnfree(binding);
 }
 EXPORT_SYMBOL_GPL(xnselect_destroy);
 
@@ -289,11 +307,74 @@ int xnselector_init(struct xnselector *selector)
 		__FD_ZERO__(&selector->fds[i].pending);
 	}
 	INIT_LIST_HEAD(&selector->bindings);
+	INIT_LIST_HEAD(&selector->ready);
+	selector->evmode = false;
 
 	return 0;
 }
 EXPORT_SYMBOL_GPL(xnselector_init);
 
+/**
+ * Switch a selector to event mode.
+ *
+ * In event mode, every binding of @a selector which receives an event
+ * is linked to the selector ready list, until the event is cleared by
+ * the file descriptor or the binding is destroyed. This service must
+ * be called before any file descriptor is bound to @a selector.
+ *
+ * @param selector The selector structure, initialized with
+ * xnselector_init().
+ *
+ * @coretags{task-unrestricted}
+ */
+void xnselector_set_evmode(struct xnselector *selector)
+{
+	selector->evmode = true;
+}
+EXPORT_SYMBOL_GPL(xnselector_set_evmode);
+
+/**
+ * Drop a binding from a selector.
+ *
+ * Remove the binding established by xnselect_bind() between the file
+ * descriptor at @a index and @a selector for events of type @a type,
+ * if any.
+ *
+ * @param selector the selector structure;
+ *
+ * @param type type of events (@a XNSELECT_READ, @a XNSELECT_WRITE, or @a
+ * XNSELECT_EXCEPT);
+ *
+ * @param index index of the file descriptor in the bit fields used by
+ * the @a selector structure.
+ *
+ * @coretags{task-unrestricted}
+ */
+void xnselector_unbind(struct xnselector *selector,
+		       unsigned int type, unsigned int index)
+{
+	struct xnselect_binding *binding;
+	spl_t s;
+
+	xnlock_get_irqsave(&nklock, s);
+
+	list_for_each_entry(binding, &selector->bindings, slink) {
+		if (binding->type != type || binding->bit_index != index)
+			continue;
+		list_del(&binding->slink);
+		list_del(&binding->link);
+		list_del(&binding->rlink);
+		__FD_CLR__(index, &selector->fds[type].expected);
+		__FD_CLR__(index, &selector->fds[type].pending);
+		xnlock_put_irqrestore(&nklock, s);
+		xnfree(binding);
+		return;
+	}
+
+	xnlock_put_irqrestore(&nklock, s);
+}
+EXPORT_SYMBOL_GPL(xnselector_unbind);
+
 /**
  * Check the state of a number of file descriptors, wait for a state change if
  * no descriptor is ready.
@@ -404,38 +485,36 @@ static irqreturn_t xnselector_destroy_loop(int virq, void *dev_id)
 {
 	struct xnselect_binding *binding, *tmpb;
 	struct xnselector *selector, *tmps;
-	struct xnselect *fd;
+	LIST_HEAD(selectors);
+	LIST_HEAD(zombies);
 	spl_t s;
 
 	xnlock_get_irqsave(&nklock, s);
 
-	if (list_empty(&selector_list))
-		goto out;
-
+	/*
+	 * Detach the bindings from all lists they may be linked to,
+	 * including the ready list xnselect_signal() feeds, before
+	 * any of them is released outside of the locked section.
+	 */
 	list_for_each_entry_safe(selector, tmps, &selector_list, destroy_link) {
-		list_del(&selector->destroy_link);
-		if (list_empty(&selector->bindings))
-			goto release;
+		list_move_tail(&selector->destroy_link, &selectors);
 		list_for_each_entry_safe(binding, tmpb, &selector->bindings, slink) {
-			list_del(&binding->slink);
-			fd = binding->fd;
 			list_del(&binding->link);
-			xnlock_put_irqrestore(&nklock, s);
-			xnfree(binding);
-			xnlock_get_irqsave(&nklock, s);
+			list_del(&binding->rlink);
+			list_move(&binding->slink, &zombies);
 		}
-	release:
 		xnsynch_destroy(&selector->synchbase);
-		xnsched_run();
-		xnlock_put_irqrestore(&nklock, s);
-
-		xnfree(selector);
-
-		xnlock_get_irqsave(&nklock, s);
 	}
-out:
+
+	xnsched_run();
 	xnlock_put_irqrestore(&nklock, s);
 
+	list_for_each_entry_safe(binding, tmpb, &zombies, slink)
+		xnfree(binding);
+
+	list_for_each_entry_safe(selector, tmps, &selectors, destroy_link)
+		xnfree(selector);
+
 	return IRQ_HANDLED;
 }
 
@@ -42,6 +42,7 @@
  * @{
  */
 
+/* Timer queue locked, IRQs off. */
 int xntimer_heading_p(struct xntimer *timer)
 {
 	struct xnsched *sched = timer->sched;
@@ -62,9 +63,12 @@ int xntimer_heading_p(struct xntimer *timer)
 	return 0;
 }
 
+/* Timer queue locked, IRQs off. */
 static void xntimer_enqueue_and_program(struct xntimer *timer, xntimerq_t *q)
 {
 	struct xnsched *sched = xntimer_sched(timer);
+	struct xntimerdata *tmd;
+	xntimerh_t *h;
 
 	xntimer_enqueue(timer, q);
 	if (pipeline_must_force_program_tick(sched) || xntimer_heading_p(timer)) {
@@ -74,11 +78,23 @@ static void xntimer_enqueue_and_program(struct xntimer *timer, xntimerq_t *q)
 			xnclock_remote_shot(clock, sched);
 		else
 			xnclock_program_shot(clock, sched);
+	} else if (timer->slack) {
+		/*
+		 * Account for the shot we did not have to program,
+		 * the pending one will fire this timer too.
+		 */
+		h = xntimerq_head(q);
+		if ((xnsticks_t)(xntimer_soft_date(timer) - xntimerh_date(h)) < 0) {
+			tmd = container_of(q, struct xntimerdata, q);
+			xnstat_counter_inc(&tmd->nrskipped);
+		}
 	}
 }
 
 /**
- * Arm a timer.
+ * @fn int xntimer_start(struct xntimer *timer, xnticks_t value, xnticks_t interval, xntmode_t mode)
+ *
+ * @brief Arm a timer.
  *
  * Activates a timer so that the associated timeout handler will be
  * fired after each expiration time. A timer can be either periodic or
@@ -111,17 +127,14 @@ static void xntimer_enqueue_and_program(struct xntimer *timer, xntimerq_t *q)
  *
  * @coretags{unrestricted, atomic-entry}
  */
-int xntimer_start(struct xntimer *timer,
-		  xnticks_t value, xnticks_t interval,
-		  xntmode_t mode)
-{
+static int __xntimer_start(struct xntimer *timer,
+			   xnticks_t value, xnticks_t interval,
+			   xntmode_t mode)
+{				/* Timer queue locked, IRQs off. */
 	struct xnclock *clock = xntimer_clock(timer);
 	xntimerq_t *q = xntimer_percpu_queue(timer);
 	xnticks_t date, now, delay, period;
 	unsigned long gravity;
-	int ret = 0;
-
-	atomic_only();
 
 	trace_cobalt_timer_start(timer, value, interval, mode);
 
@@ -171,6 +184,12 @@ int xntimer_start(struct xntimer *timer,
 	if (now >= xntimerh_date(&timer->aplink))
 		xntimerh_date(&timer->aplink) += gravity / 2;
 
+	/*
+	 * A timer with some slack is queued by the latest date it
+	 * may fire at, so that any earlier shot may carry it.
+	 */
+	xntimerh_date(&timer->aplink) += timer->slack;
+
 	timer->interval_ns = XN_INFINITE;
 	timer->interval = XN_INFINITE;
 	if (interval != XN_INFINITE) {
@@ -185,10 +204,66 @@ int xntimer_start(struct xntimer *timer,
 	timer->status |= XNTIMER_RUNNING;
 	xntimer_enqueue_and_program(timer, q);
 
+	return 0;
+}
+
+int xntimer_start(struct xntimer *timer,
+		  xnticks_t value, xnticks_t interval,
+		  xntmode_t mode)
+{
+	struct xntimerdata *tmd = xntimer_percpu_timerdata(timer);
+	int ret;
+
+	atomic_only();
+
+	xnlock_get(&tmd->lock);
+	ret = __xntimer_start(timer, value, interval, mode);
+	xnlock_put(&tmd->lock);
+
 	return ret;
 }
 EXPORT_SYMBOL_GPL(xntimer_start);
 
+/**
+ * Arm a CPU-local timer.
+ *
+ * This service is a variant of xntimer_start() for timers which are
+ * only ever started, stopped or expired from the CPU they are queued
+ * to, such as the host tick emulation timer. Since such a timer
+ * neither wakes up threads nor migrates, only the timer queue of the
+ * current CPU is involved, so nklock is not required.
+ *
+ * @param timer The address of a valid timer descriptor, which must
+ * be bound to the current CPU.
+ *
+ * @param value The date of the initial timer shot (see xntimer_start()).
+ *
+ * @param interval The reload value of the timer (see xntimer_start()).
+ *
+ * @param mode The timer mode (see xntimer_start()).
+ *
+ * @return 0 is returned upon success, or -ETIMEDOUT if an absolute
+ * date in the past has been given.
+ *
+ * @coretags{unrestricted}
+ */
+int xntimer_start_local(struct xntimer *timer,
+			xnticks_t value, xnticks_t interval,
+			xntmode_t mode)
+{
+	struct xntimerdata *tmd = xntimer_percpu_timerdata(timer);
+	int ret;
+
+	irqoff_only();
+	XENO_BUG_ON(COBALT, xntimer_sched(timer) != xnsched_current());
+
+	xnlock_get(&tmd->lock);
+	ret = __xntimer_start(timer, value, interval, mode);
+	xnlock_put(&tmd->lock);
+
+	return ret;
+}
+
 /**
  * @fn int xntimer_stop(struct xntimer *timer)
  *
@@ -204,8 +279,9 @@ EXPORT_SYMBOL_GPL(xntimer_start);
  */
 void __xntimer_stop(struct xntimer *timer)
 {
+	struct xntimerdata *tmd = xntimer_percpu_timerdata(timer);
 	struct xnclock *clock = xntimer_clock(timer);
-	xntimerq_t *q = xntimer_percpu_queue(timer);
+	xntimerq_t *q = &tmd->q;
 	struct xnsched *sched;
 	int heading = 1;
 
@@ -213,6 +289,8 @@ void __xntimer_stop(struct xntimer *timer)
 
 	trace_cobalt_timer_stop(timer);
 
+	xnlock_get(&tmd->lock);
+
 	if ((timer->status & XNTIMER_DEQUEUED) == 0) {
 		heading = xntimer_heading_p(timer);
 		xntimer_dequeue(timer, q);
@@ -226,6 +304,8 @@ void __xntimer_stop(struct xntimer *timer)
 	 */
 	if (heading && sched == xnsched_current())
 		xnclock_program_shot(clock, sched);
+
+	xnlock_put(&tmd->lock);
 }
 EXPORT_SYMBOL_GPL(__xntimer_stop);
 
@@ -351,6 +431,7 @@ void __xntimer_init(struct xntimer *timer,
 	timer->status = (XNTIMER_DEQUEUED|(flags & XNTIMER_INIT_MASK));
 	timer->handler = handler;
 	timer->interval_ns = 0;
+	timer->slack = 0;
 	timer->sched = NULL;
 
 	/*
@@ -389,6 +470,34 @@ void xntimer_set_gravity(struct xntimer *timer, int gravity)
 }
 EXPORT_SYMBOL_GPL(xntimer_set_gravity);
 
+/**
+ * @fn void xntimer_set_slack(struct xntimer *timer, xnticks_t slack_ns)
+ *
+ * @brief Set the coalescing window of a timer.
+ *
+ * Allow a timer to fire up to @a slack_ns nanoseconds after its
+ * expiry date, so that the core may serve it from the clock shot
+ * programmed for another timer instead of reprogramming the hardware
+ * for it. A zero slack restores exact timing, which is the default.
+ *
+ * @param timer The address of a valid timer descriptor.
+ *
+ * @param slack_ns The coalescing window in nanoseconds.
+ *
+ * @note The new window applies from the next call to
+ * xntimer_start(), which must follow immediately unless the timer is
+ * stopped.
+ *
+ * @coretags{unrestricted, atomic-entry}
+ */
+void xntimer_set_slack(struct xntimer *timer, xnticks_t slack_ns)
+{
+	atomic_only();
+
+	timer->slack = xnclock_ns_to_ticks(xntimer_clock(timer), slack_ns);
+}
+EXPORT_SYMBOL_GPL(xntimer_set_slack);
+
 #ifdef CONFIG_XENO_OPT_EXTCLOCK
 
 #ifdef CONFIG_XENO_OPT_STATS
@@ -506,8 +615,8 @@ EXPORT_SYMBOL_GPL(xntimer_destroy);
  */
 void __xntimer_migrate(struct xntimer *timer, struct xnsched *sched)
 {				/* nklocked, IRQs off, sched != timer->sched */
+	struct xntimerdata *tmd;
 	struct xnclock *clock;
-	xntimerq_t *q;
 
 	trace_cobalt_timer_migrate(timer, xnsched_cpu(sched));
 
@@ -526,10 +635,12 @@ void __xntimer_migrate(struct xntimer *timer, struct xnsched *sched)
 		xntimer_stop(timer);
 		timer->sched = sched;
 		clock = xntimer_clock(timer);
-		q = xntimer_percpu_queue(timer);
-		xntimer_enqueue(timer, q);
+		tmd = xntimer_percpu_timerdata(timer);
+		xnlock_get(&tmd->lock);
+		xntimer_enqueue(timer, &tmd->q);
 		if (xntimer_heading_p(timer))
 			xnclock_remote_shot(clock, sched);
+		xnlock_put(&tmd->lock);
 	} else
 		timer->sched = sched;
 }
@@ -615,8 +726,8 @@ unsigned long long xntimer_get_overruns(struct xntimer *timer,
 {
 	xnticks_t period = timer->interval;
 	unsigned long long overruns = 0;
+	struct xntimerdata *tmd;
 	xnsticks_t delta;
-	xntimerq_t *q;
 
 	atomic_only();
 
@@ -630,13 +741,15 @@ unsigned long long xntimer_get_overruns(struct xntimer *timer,
 			XENO_BUG_ON(COBALT, (timer->status &
 				    (XNTIMER_DEQUEUED|XNTIMER_PERIODIC))
 				    != XNTIMER_PERIODIC);
-				q = xntimer_percpu_queue(timer);
-			xntimer_dequeue(timer, q);
+			tmd = xntimer_percpu_timerdata(timer);
+			xnlock_get(&tmd->lock);
+			xntimer_dequeue(timer, &tmd->q);
 			while (xntimerh_date(&timer->aplink) < now) {
 				timer->periodic_ticks++;
 				xntimer_update_date(timer);
 			}
-			xntimer_enqueue_and_program(timer, q);
+			xntimer_enqueue_and_program(timer, &tmd->q);
+			xnlock_put(&tmd->lock);
 		}
 	}
 
@@ -714,6 +827,216 @@ void xntimerq_insert(xntimerq_t *q, xntimerh_t *holder)
 	rb_link_node(&holder->link, parent, new);
 	rb_insert_color(&holder->link, &q->root);
 }
+#elif defined(CONFIG_XENO_OPT_TIMER_WHEEL)
+static inline bool xntimerh_is_lt(xntimerh_t *left, xntimerh_t *right)
+{
+	return left->date < right->date
+		|| (left->date == right->date && left->prio > right->prio);
+}
+
+static inline unsigned long long xntimerh_unit(xntimerh_t *holder)
+{
+	return holder->date >> XNTIMERQ_WHEEL_SHIFT;
+}
+
+/*
+ * The wheel time starts at @now, so that the first timers are
+ * hashed to the low levels instead of being parked into the top
+ * slot, then cascaded all the way down.
+ */
+void xntimerq_init(xntimerq_t *q, xnticks_t now)
+{
+	int n;
+
+	q->near = RB_ROOT;
+	q->head = NULL;
+	q->clk = now >> XNTIMERQ_WHEEL_SHIFT;
+	q->nr_wheel = 0;
+
+	for (n = 0; n < XNTIMERQ_WHEEL_LEVELS; n++)
+		q->map[n] = 0;
+
+	for (n = 0; n < XNTIMERQ_WHEEL_SLOTS; n++)
+		INIT_HLIST_HEAD(&q->slots[n]);
+}
+
+static void insert_near(xntimerq_t *q, xntimerh_t *holder)
+{
+	struct rb_node **new = &q->near.rb_node, *parent = NULL;
+
+	holder->slot = XNTIMERQ_NEAR;
+
+	if (!q->head)
+		q->head = holder;
+	else if (xntimerh_is_lt(holder, q->head)) {
+		parent = &q->head->node;
+		new = &parent->rb_left;
+		q->head = holder;
+	} else while (*new) {
+		xntimerh_t *i = rb_entry(*new, xntimerh_t, node);
+
+		parent = *new;
+		if (xntimerh_is_lt(holder, i))
+			new = &((*new)->rb_left);
+		else
+			new = &((*new)->rb_right);
+	}
+
+	rb_link_node(&holder->node, parent, new);
+	rb_insert_color(&holder->node, &q->near);
+}
+
+static void insert_wheel(xntimerq_t *q, xntimerh_t *holder,
+			 unsigned long long unit)
+{
+	unsigned long long base, block;
+	int level, shift, idx;
+
+	/*
+	 * Pick the lowest level which can index the timeout date
+	 * within XNTIMERQ_WHEEL_SIZE slots from the current wheel
+	 * time. This guarantees that a given slot never holds timers
+	 * from distinct blocks at any point in time.
+	 */
+	for (level = 0; level < XNTIMERQ_WHEEL_LEVELS - 1; level++) {
+		shift = level * XNTIMERQ_WHEEL_BITS;
+		if ((unit >> shift) - (q->clk >> shift) < XNTIMERQ_WHEEL_SIZE)
+			break;
+	}
+
+	shift = level * XNTIMERQ_WHEEL_BITS;
+	base = q->clk >> shift;
+	block = unit >> shift;
+	/* Beyond the wheel range: park into the farthest slot. */
+	if (block - base >= XNTIMERQ_WHEEL_SIZE)
+		block = base + XNTIMERQ_WHEEL_SIZE - 1;
+
+	idx = block & XNTIMERQ_WHEEL_MASK;
+	holder->slot = level * XNTIMERQ_WHEEL_SIZE + idx;
+	hlist_add_head(&holder->link, &q->slots[holder->slot]);
+	q->map[level] |= 1ULL << idx;
+	q->nr_wheel++;
+}
+
+void xntimerq_insert(xntimerq_t *q, xntimerh_t *holder)
+{
+	unsigned long long unit = xntimerh_unit(holder);
+
+	if (unit <= q->clk)
+		insert_near(q, holder);
+	else
+		insert_wheel(q, holder, unit);
+}
+
+/*
+ * Cascade the wheel down to the near bucket, until the latter
+ * receives at least one timer, or the wheel runs empty. Each round
+ * drains the earliest occupied block across all levels; on ties,
+ * the highest level wins since its block covers the lower ones.
+ * Blocks starting no later than the wheel time once the near bucket
+ * is populated must be drained too, so that no wheel timer may be
+ * due earlier than the near bucket head.
+ */
+static bool cascade_wheel(xntimerq_t *q)
+{
+	int level, shift, idx, off, best_level, best_idx;
+	unsigned long long base, start, best_start;
+	struct hlist_node *tmp;
+	struct hlist_head list;
+	xntimerh_t *holder;
+	bool landed = false;
+
+	while (q->nr_wheel > 0) {
+		best_level = -1;
+		best_idx = 0;
+		best_start = 0;
+
+		for (level = 0; level < XNTIMERQ_WHEEL_LEVELS; level++) {
+			if (q->map[level] == 0)
+				continue;
+			shift = level * XNTIMERQ_WHEEL_BITS;
+			base = q->clk >> shift;
+			idx = base & XNTIMERQ_WHEEL_MASK;
+			off = __ffs64(ror64(q->map[level], idx));
+			start = (base + off) << shift;
+			if (best_level < 0 || start <= best_start) {
+				best_level = level;
+				best_idx = (idx + off) & XNTIMERQ_WHEEL_MASK;
+				best_start = start;
+			}
+		}
+
+		if (landed && best_start > q->clk)
+			break;
+
+		if (best_start > q->clk)
+			q->clk = best_start;
+
+		idx = best_level * XNTIMERQ_WHEEL_SIZE + best_idx;
+		hlist_move_list(&q->slots[idx], &list);
+		q->map[best_level] &= ~(1ULL << best_idx);
+
+		hlist_for_each_entry_safe(holder, tmp, &list, link) {
+			q->nr_wheel--;
+			if (xntimerh_unit(holder) <= q->clk) {
+				insert_near(q, holder);
+				landed = true;
+			} else
+				insert_wheel(q, holder, xntimerh_unit(holder));
+		}
+	}
+
+	return landed;
+}
+
+xntimerh_t *xntimerq_pull(xntimerq_t *q)
+{
+	cascade_wheel(q);
+
+	return q->head;
+}
+
+xntimerh_t *xntimerq_second(xntimerq_t *q, xntimerh_t *h)
+{
+	struct rb_node *node;
+
+	node = rb_next(&h->node);
+	if (node == NULL) {
+		if (!cascade_wheel(q))
+			return NULL;
+		node = rb_next(&h->node);
+	}
+
+	return rb_entry(node, xntimerh_t, node);
+}
+
+xntimerh_t *xntimerq_it_next(xntimerq_t *q, xntimerq_it_t *it,
+			     xntimerh_t *h)
+{
+	struct rb_node *node;
+	int slot = 0;
+
+	if (h) {
+		if (h->slot == XNTIMERQ_NEAR) {
+			node = rb_next(&h->node);
+			if (node)
+				return rb_entry(node, xntimerh_t, node);
+		} else {
+			if (h->link.next)
+				return hlist_entry(h->link.next,
+						   xntimerh_t, link);
+			slot = h->slot + 1;
+		}
+	}
+
+	for (; slot < XNTIMERQ_WHEEL_SLOTS; slot++) {
+		if (!hlist_empty(&q->slots[slot]))
+			return hlist_entry(q->slots[slot].first,
+					   xntimerh_t, link);
+	}
+
+	return NULL;
+}
 #endif
 
 /** @} */
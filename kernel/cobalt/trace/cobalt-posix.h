@@ -172,7 +172,12 @@
 		__cobalt_symbolic_syscall(timer_gettime64),		\
 		__cobalt_symbolic_syscall(timerfd_settime64),		\
 		__cobalt_symbolic_syscall(timerfd_gettime64),		\
-		__cobalt_symbolic_syscall(pselect64))
+		__cobalt_symbolic_syscall(pselect64),			\
+		__cobalt_symbolic_syscall(epoll_create),		\
+		__cobalt_symbolic_syscall(epoll_ctl),			\
+		__cobalt_symbolic_syscall(epoll_wait),			\
+		__cobalt_symbolic_syscall(mq_map),			\
+		__cobalt_symbolic_syscall(mq_kick))
 
 DECLARE_EVENT_CLASS(cobalt_syscall_entry,
 	TP_PROTO(unsigned int nr),
@@ -523,32 +523,21 @@ do {									\
 	recv_buf_index = (recv_buf_index + len) & (RTCAN_RXBUF_SIZE - 1); \
 } while (0)
 
-static ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
-				 int flags)
-{
-    struct rtcan_socket *sock = rtdm_fd_to_private(fd);
-    struct sockaddr_can scan;
-    nanosecs_rel_t timeout;
-    struct iovec *iov = (struct iovec *)msg->msg_iov;
-    struct iovec iov_buf;
+/* Maximum number of frames pulled from the ring buffer at once. */
+#define RTCAN_RX_BATCH	8
+
+struct rtcan_rx_frame {
     can_frame_t frame;
-    nanosecs_abs_t timestamp = 0;
+    nanosecs_abs_t timestamp;
     unsigned char ifindex;
     unsigned char can_dlc;
-    unsigned char *recv_buf;
-    int recv_buf_index;
-    size_t first_part_size;
-    size_t payload_size;
-    rtdm_lockctx_t lock_ctx;
-    int ret;
-
-    /* Clear frame memory location */
-    memset(&frame, 0, sizeof(can_frame_t));
-
-    /* Check flags */
-    if (flags & ~(MSG_DONTWAIT | MSG_PEEK))
-	return -EINVAL;
+};
 
+static int rtcan_raw_check_msg(struct rtdm_fd *fd, struct user_msghdr *msg,
+			       struct iovec *iov_buf, struct iovec **iovp)
+{
+    struct iovec *iov = (struct iovec *)msg->msg_iov;
+    int ret;
 
     /* Check if msghdr entries are sane */
 
@@ -572,11 +561,11 @@ static ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
 
     if (rtdm_fd_is_user(fd)) {
 	/* Copy IO vector from userspace */
-	ret = rtdm_fd_get_iovec(fd, &iov_buf, msg, true);
+	ret = rtdm_fd_get_iovec(fd, iov_buf, msg, true);
 	if (ret)
 		return -EFAULT;
 
-	iov = &iov_buf;
+	iov = iov_buf;
     }
 
     /* Check size of buffer */
@@ -604,88 +593,130 @@ static ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
 	    return -EINVAL;
     }
 
-    rtcan_raw_enable_bus_err(sock);
-
-    /* Set RX timeout */
-    timeout = (flags & MSG_DONTWAIT) ? RTDM_TIMEOUT_NONE : sock->rx_timeout;
-
-    /* Fetch message (ok, try it ...) */
-    ret = rtdm_sem_timeddown(&sock->recv_sem, timeout, NULL);
-
-    /* Error code returned? */
-    if (unlikely(ret)) {
-	/* Which error code? */
-
-	if (ret == -EIDRM)
-	    /* Socket was closed */
-	    return -EBADF;
-
-	else if (ret == -EWOULDBLOCK)
-	    /* We would block but don't want to */
-	    return -EAGAIN;
-
-	else
-	    /* Return all other error codes unmodified. */
-	    return ret;
-    }
-
-
-    /* OK, we've got mail. */
-
-    rtdm_lock_get_irqsave(&rtcan_socket_lock, lock_ctx);
+    *iovp = iov;
 
+    return 0;
+}
 
-    /* Construct a struct can_frame with data from socket's ring buffer */
-    recv_buf_index = sock->recv_head;
-    recv_buf = sock->recv_buf;
+/*
+ * Construct a struct can_frame with data from socket's ring buffer,
+ * starting at recv_buf_index. Returns the index of the next
+ * message. Must be called with rtcan_socket_lock held.
+ */
+static int __rtcan_raw_pull_frame(struct rtcan_socket *sock,
+				  int recv_buf_index,
+				  struct rtcan_rx_frame *rx, int want_timestamp)
+{
+    unsigned char *recv_buf = sock->recv_buf;
+    size_t first_part_size;
+    size_t payload_size;
 
+    /* Clear frame memory location */
+    memset(&rx->frame, 0, sizeof(can_frame_t));
+    rx->timestamp = 0;
 
     /* Begin with CAN ID */
-    MEMCPY_FROM_RING_BUF(&frame.can_id, sizeof(uint32_t));
+    MEMCPY_FROM_RING_BUF(&rx->frame.can_id, sizeof(uint32_t));
 
 
     /* Fetch interface index */
-    ifindex = recv_buf[recv_buf_index];
+    rx->ifindex = recv_buf[recv_buf_index];
     recv_buf_index = (recv_buf_index + 1) & (RTCAN_RXBUF_SIZE - 1);
 
 
     /* Fetch DLC (with indicator if a timestamp exists) */
-    can_dlc = recv_buf[recv_buf_index];
+    rx->can_dlc = recv_buf[recv_buf_index];
     recv_buf_index = (recv_buf_index + 1) & (RTCAN_RXBUF_SIZE - 1);
 
-    frame.can_dlc = can_dlc & RTCAN_HAS_NO_TIMESTAMP;
-    payload_size = (frame.can_dlc > 8) ? 8 : frame.can_dlc;
+    rx->frame.can_dlc = rx->can_dlc & RTCAN_HAS_NO_TIMESTAMP;
+    payload_size = (rx->frame.can_dlc > 8) ? 8 : rx->frame.can_dlc;
 
 
     /* If frame is an RTR or one with no payload it's not necessary
      * to copy the data bytes. */
-    if (!(frame.can_id & CAN_RTR_FLAG) && payload_size)
+    if (!(rx->frame.can_id & CAN_RTR_FLAG) && payload_size)
 	/* Copy data bytes */
-	MEMCPY_FROM_RING_BUF(frame.data, payload_size);
+	MEMCPY_FROM_RING_BUF(rx->frame.data, payload_size);
 
     /* Is a timestamp available and is the caller actually interested? */
-    if (msg->msg_controllen && (can_dlc & RTCAN_HAS_TIMESTAMP))
+    if (want_timestamp && (rx->can_dlc & RTCAN_HAS_TIMESTAMP))
 	/* Copy timestamp */
-	MEMCPY_FROM_RING_BUF(&timestamp, RTCAN_TIMESTAMP_SIZE);
+	MEMCPY_FROM_RING_BUF(&rx->timestamp, RTCAN_TIMESTAMP_SIZE);
 
-    /* Message completely read from the socket's ring buffer. Now check if
-     * caller is just peeking. */
-    if (flags & MSG_PEEK)
-	/* Next one, please! */
-	rtdm_sem_up(&sock->recv_sem);
-    else
-	/* Adjust begin of first message in the ring buffer. */
-	sock->recv_head = recv_buf_index;
+    return recv_buf_index;
+}
+
+/*
+ * Requeue a frame pulled by __rtcan_raw_pull_frame() at the head of
+ * the socket's ring buffer, for a reader which could not deliver
+ * it. Frames must be pushed back newest first. Must be called with
+ * rtcan_socket_lock held.
+ */
+static int __rtcan_raw_push_frame(struct rtcan_socket *sock,
+				  const struct rtcan_rx_frame *rx,
+				  int want_timestamp)
+{
+    unsigned char *recv_buf = sock->recv_buf;
+    size_t payload_size, size, part;
+    unsigned char hdr[6];
+    int recv_buf_index;
+    int size_free;
 
+    payload_size = (rx->frame.can_dlc > 8) ? 8 : rx->frame.can_dlc;
+    if (rx->frame.can_id & CAN_RTR_FLAG)
+	payload_size = 0;
 
-    /* Release lock */
-    rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+    memcpy(hdr, &rx->frame.can_id, sizeof(uint32_t));
+    hdr[4] = rx->ifindex;
+    /* The timestamp is only there if it was pulled. */
+    hdr[5] = rx->can_dlc;
+    if (!want_timestamp)
+	hdr[5] &= RTCAN_HAS_NO_TIMESTAMP;
+
+    size = sizeof(hdr) + payload_size;
+    if (hdr[5] & RTCAN_HAS_TIMESTAMP)
+	size += RTCAN_TIMESTAMP_SIZE;
+
+    /* Same free space rule as the producer, which never fills up. */
+    size_free = sock->recv_head - sock->recv_tail;
+    if (size_free <= 0)
+	size_free += RTCAN_RXBUF_SIZE;
+    if (size_free <= size)
+	return -ENOBUFS;
+
+    recv_buf_index = (sock->recv_head - size) & (RTCAN_RXBUF_SIZE - 1);
+    sock->recv_head = recv_buf_index;
 
+#define MEMCPY_TO_RING_BUF(from, len)					\
+do {									\
+	part = min_t(size_t, len, RTCAN_RXBUF_SIZE - recv_buf_index);	\
+	memcpy(&recv_buf[recv_buf_index], from, part);			\
+	memcpy(recv_buf, (const void *)(from) + part, len - part);	\
+	recv_buf_index = (recv_buf_index + len) & (RTCAN_RXBUF_SIZE - 1); \
+} while (0)
+
+    MEMCPY_TO_RING_BUF(hdr, sizeof(hdr));
+    if (payload_size)
+	MEMCPY_TO_RING_BUF(rx->frame.data, payload_size);
+    if (hdr[5] & RTCAN_HAS_TIMESTAMP)
+	MEMCPY_TO_RING_BUF(&rx->timestamp, RTCAN_TIMESTAMP_SIZE);
+
+#undef MEMCPY_TO_RING_BUF
+
+    return 0;
+}
+
+static ssize_t rtcan_raw_put_msg(struct rtdm_fd *fd, struct user_msghdr *msg,
+				 struct iovec *iov,
+				 const struct rtcan_rx_frame *rx)
+{
+    struct sockaddr_can scan;
+    int ret;
 
     /* Create CAN socket address to give back */
     if (msg->msg_namelen) {
 	scan.can_family = AF_CAN;
-	scan.can_ifindex = ifindex;
+	scan.can_ifindex = rx->ifindex;
     }
 
 
@@ -704,7 +735,7 @@ static ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
 	}
 
 	/* Copy CAN frame */
-	if (rtdm_copy_to_user(fd, iov->iov_base, &frame,
+	if (rtdm_copy_to_user(fd, iov->iov_base, &rx->frame,
 			      sizeof(can_frame_t)))
 	    return -EFAULT;
 	/* Adjust iovec in the common way */
@@ -717,9 +748,9 @@ static ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
 
 	/* Copy timestamp if existent and wanted */
 	if (msg->msg_controllen) {
-	    if (can_dlc & RTCAN_HAS_TIMESTAMP) {
+	    if (rx->can_dlc & RTCAN_HAS_TIMESTAMP) {
 		if (rtdm_copy_to_user(fd, msg->msg_control,
-				      &timestamp, RTCAN_TIMESTAMP_SIZE))
+				      &rx->timestamp, RTCAN_TIMESTAMP_SIZE))
 		    return -EFAULT;
 
 		msg->msg_controllen = RTCAN_TIMESTAMP_SIZE;
@@ -737,15 +768,16 @@ static ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
 	}
 
 	/* Copy CAN frame */
-	memcpy(iov->iov_base, &frame, sizeof(can_frame_t));
+	memcpy(iov->iov_base, &rx->frame, sizeof(can_frame_t));
 	/* Adjust iovec in the common way */
 	iov->iov_base += sizeof(can_frame_t);
 	iov->iov_len -= sizeof(can_frame_t);
 
 	/* Copy timestamp if existent and wanted */
 	if (msg->msg_controllen) {
-	    if (can_dlc & RTCAN_HAS_TIMESTAMP) {
-		memcpy(msg->msg_control, &timestamp, RTCAN_TIMESTAMP_SIZE);
+	    if (rx->can_dlc & RTCAN_HAS_TIMESTAMP) {
+		memcpy(msg->msg_control, &rx->timestamp,
+		       RTCAN_TIMESTAMP_SIZE);
 		msg->msg_controllen = RTCAN_TIMESTAMP_SIZE;
 	    } else
 		msg->msg_controllen = 0;
@@ -756,6 +788,181 @@ static ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
     return sizeof(can_frame_t);
 }
 
+static inline int rtcan_raw_wait_error(int ret)
+{
+    if (ret == -EIDRM)
+	/* Socket was closed */
+	return -EBADF;
+
+    if (ret == -EWOULDBLOCK)
+	/* We would block but don't want to */
+	return -EAGAIN;
+
+    /* Return all other error codes unmodified. */
+    return ret;
+}
+
+static ssize_t rtcan_raw_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
+				 int flags)
+{
+    struct rtcan_socket *sock = rtdm_fd_to_private(fd);
+    struct rtcan_rx_frame rx;
+    nanosecs_rel_t timeout;
+    struct iovec iov_buf, *iov;
+    rtdm_lockctx_t lock_ctx;
+    int ret;
+
+    /* Check flags */
+    if (flags & ~(MSG_DONTWAIT | MSG_PEEK))
+	return -EINVAL;
+
+    ret = rtcan_raw_check_msg(fd, msg, &iov_buf, &iov);
+    if (ret)
+	return ret;
+
+    rtcan_raw_enable_bus_err(sock);
+
+    /* Set RX timeout */
+    timeout = (flags & MSG_DONTWAIT) ? RTDM_TIMEOUT_NONE : sock->rx_timeout;
+
+    /* Fetch message (ok, try it ...) */
+    ret = rtdm_sem_timeddown(&sock->recv_sem, timeout, NULL);
+    if (unlikely(ret))
+	return rtcan_raw_wait_error(ret);
+
+
+    /* OK, we've got mail. */
+
+    rtdm_lock_get_irqsave(&rtcan_socket_lock, lock_ctx);
+
+    ret = __rtcan_raw_pull_frame(sock, sock->recv_head, &rx,
+				 msg->msg_controllen);
+
+    /* Message completely read from the socket's ring buffer. Now check if
+     * caller is just peeking. */
+    if (flags & MSG_PEEK)
+	/* Next one, please! */
+	rtdm_sem_up(&sock->recv_sem);
+    else
+	/* Adjust begin of first message in the ring buffer. */
+	sock->recv_head = ret;
+
+
+    /* Release lock */
+    rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+
+    return rtcan_raw_put_msg(fd, msg, iov, &rx);
+}
+
+static int rtcan_raw_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			      unsigned int vlen, int flags,
+			      const struct timespec64 *ts)
+{
+    struct rtcan_socket *sock = rtdm_fd_to_private(fd);
+    struct iovec iov_buf[RTCAN_RX_BATCH], *iov[RTCAN_RX_BATCH];
+    struct rtcan_rx_frame rx[RTCAN_RX_BATCH];
+    struct user_msghdr *msg;
+    rtdm_toseq_t timeout_seq;
+    nanosecs_rel_t timeout;
+    rtdm_lockctx_t lock_ctx;
+    int recv_buf_index, count, i, ret = 0;
+    unsigned int n = 0;
+    ssize_t len;
+
+    /* Check flags */
+    if (flags & ~(MSG_DONTWAIT | MSG_PEEK | MSG_WAITFORONE))
+	return -EINVAL;
+
+    /* Peeking would return the same frame over and over. */
+    if (flags & MSG_PEEK)
+	vlen = 1;
+
+    rtcan_raw_enable_bus_err(sock);
+
+    /* Set RX timeout, bounding the whole batch */
+    timeout = ts ? timespec64_to_ns(ts) : sock->rx_timeout;
+    if (flags & MSG_DONTWAIT)
+	timeout = RTDM_TIMEOUT_NONE;
+
+    rtdm_toseq_init(&timeout_seq, timeout);
+
+    while (n < vlen) {
+	count = min_t(unsigned int, vlen - n, RTCAN_RX_BATCH);
+
+	/* Validate the descriptors before consuming any frame. */
+	for (i = 0; i < count; i++) {
+	    ret = rtcan_raw_check_msg(fd, &mmsgvec[n + i].msg_hdr,
+				      &iov_buf[i], &iov[i]);
+	    if (ret)
+		break;
+	}
+
+	if (i == 0)
+	    break;
+
+	ret = rtdm_sem_timeddown_batch(&sock->recv_sem, i,
+				       timeout, &timeout_seq);
+	if (unlikely(ret < 0)) {
+	    ret = rtcan_raw_wait_error(ret);
+	    break;
+	}
+
+	count = ret;
+	ret = 0;
+
+	/* Pull all frames under a single lock section. */
+	rtdm_lock_get_irqsave(&rtcan_socket_lock, lock_ctx);
+
+	recv_buf_index = sock->recv_head;
+	for (i = 0; i < count; i++) {
+	    msg = &mmsgvec[n + i].msg_hdr;
+	    recv_buf_index = __rtcan_raw_pull_frame(sock, recv_buf_index,
+						    &rx[i], msg->msg_controllen);
+	}
+
+	if (flags & MSG_PEEK)
+	    rtdm_sem_up(&sock->recv_sem);
+	else
+	    sock->recv_head = recv_buf_index;
+
+	rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+
+	for (i = 0; i < count; i++) {
+	    len = rtcan_raw_put_msg(fd, &mmsgvec[n].msg_hdr, iov[i], &rx[i]);
+	    if (len < 0) {
+		ret = len;
+		break;
+	    }
+	    mmsgvec[n++].msg_len = len;
+	}
+
+	if (ret) {
+	    /*
+	     * Leave the frames we could not deliver queued, unless
+	     * peeking in which case they were not consumed.
+	     */
+	    if (!(flags & MSG_PEEK)) {
+		rtdm_lock_get_irqsave(&rtcan_socket_lock, lock_ctx);
+		while (--count >= i) {
+		    if (__rtcan_raw_push_frame(sock, &rx[count],
+				mmsgvec[n + count - i].msg_hdr.msg_controllen)) {
+			sock->rx_buf_full++;
+			continue;
+		    }
+		    rtdm_sem_up(&sock->recv_sem);
+		}
+		rtdm_lock_put_irqrestore(&rtcan_socket_lock, lock_ctx);
+	    }
+	    break;
+	}
+
+	if (flags & MSG_WAITFORONE)
+	    timeout = RTDM_TIMEOUT_NONE;
+    }
+
+    return n ?: ret;
+}
+
 
 static ssize_t __rtcan_raw_sendmsg(struct rtcan_device *dev, struct rtcan_socket *sock,
 				   can_frame_t *frame, nanosecs_rel_t timeout)
@@ -988,6 +1195,7 @@ static struct rtdm_driver rtcan_driver = {
 		.close		= rtcan_raw_close,
 		.ioctl_nrt	= rtcan_raw_ioctl,
 		.recvmsg_rt	= rtcan_raw_recvmsg,
+		.recvmmsg_rt	= rtcan_raw_recvmmsg,
 		.sendmsg_rt	= rtcan_raw_sendmsg,
 	},
 };
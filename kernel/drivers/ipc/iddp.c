@@ -225,18 +225,88 @@ static void iddp_close(struct rtdm_fd *fd)
 	return;
 }
 
+/* Maximum number of datagrams moved at once by batch requests. */
+#define IDDP_BATCH  8
+
+static int __iddp_copy_mbuf(struct rtdm_fd *fd,
+			    struct iovec *iov, int iovlen,
+			    struct iddp_message *mbuf, int rdoff, ssize_t len)
+{
+	ssize_t wrlen, vlen;
+	struct xnbufd bufd;
+	int nvec, ret = 0;
+
+	/* Write "len" bytes from mbuf->data to the vector cells */
+	for (nvec = 0, wrlen = len; nvec < iovlen && wrlen > 0; nvec++) {
+		if (iov[nvec].iov_len == 0)
+			continue;
+		vlen = wrlen >= iov[nvec].iov_len ? iov[nvec].iov_len : wrlen;
+		if (rtdm_fd_is_user(fd)) {
+			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
+			xnbufd_unmap_uread(&bufd);
+		} else {
+			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
+			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
+			xnbufd_unmap_kread(&bufd);
+		}
+		if (ret < 0)
+			return ret;
+		iov[nvec].iov_base += vlen;
+		iov[nvec].iov_len -= vlen;
+		wrlen -= vlen;
+		rdoff += vlen;
+	}
+
+	return 0;
+}
+
+/*
+ * Pull the heading message from the input queue, reading at most
+ * maxlen bytes from it. Must be called under the cobalt lock.
+ */
+static struct iddp_message *
+__iddp_pull_mbuf(struct rtipc_private *priv, ssize_t maxlen,
+		 int *rdoffp, ssize_t *lenp, int *dofreep)
+{
+	struct iddp_socket *sk = priv->state;
+	struct iddp_message *mbuf;
+	ssize_t len;
+	int rdoff;
+
+	mbuf = list_entry(sk->inq.next, struct iddp_message, next);
+	rdoff = mbuf->rdoff;
+	len = mbuf->len - rdoff;
+	if (maxlen >= len) {
+		list_del(&mbuf->next);
+		*dofreep = 1;
+		if (list_empty(&sk->inq)) /* -> non-readable */
+			xnselect_signal(&priv->recv_block, 0);
+
+	} else {
+		/* Buffer is only partially read: repost. */
+		mbuf->rdoff += maxlen;
+		len = maxlen;
+		*dofreep = 0;
+	}
+
+	*rdoffp = rdoff;
+	*lenp = len;
+
+	return mbuf;
+}
+
 static ssize_t __iddp_recvmsg(struct rtdm_fd *fd,
 			      struct iovec *iov, int iovlen, int flags,
 			      struct sockaddr_ipc *saddr)
 {
 	struct rtipc_private *priv = rtdm_fd_to_private(fd);
 	struct iddp_socket *sk = priv->state;
-	ssize_t maxlen, len, wrlen, vlen;
 	rtdm_toseq_t timeout_seq, *toseq;
-	int nvec, rdoff, ret, dofree;
 	struct iddp_message *mbuf;
+	int rdoff, ret, dofree;
 	nanosecs_rel_t timeout;
-	struct xnbufd bufd;
+	ssize_t maxlen, len;
 	rtdm_lockctx_t s;
 
 	if (!test_bit(_IDDP_BOUND, &sk->status))
@@ -271,52 +341,18 @@ static ssize_t __iddp_recvmsg(struct rtdm_fd *fd,
 	}
 
 	/* Pull heading message from input queue. */
-	mbuf = list_entry(sk->inq.next, struct iddp_message, next);
-	rdoff = mbuf->rdoff;
-	len = mbuf->len - rdoff;
+	mbuf = __iddp_pull_mbuf(priv, maxlen, &rdoff, &len, &dofree);
 	if (saddr) {
 		saddr->sipc_family = AF_RTIPC;
 		saddr->sipc_port = mbuf->from;
 	}
-	if (maxlen >= len) {
-		list_del(&mbuf->next);
-		dofree = 1;
-		if (list_empty(&sk->inq)) /* -> non-readable */
-			xnselect_signal(&priv->recv_block, 0);
-
-	} else {
-		/* Buffer is only partially read: repost. */
-		mbuf->rdoff += maxlen;
-		len = maxlen;
-		dofree = 0;
-	}
 
 	if (!dofree)
 		rtdm_sem_up(&sk->insem);
 
 	cobalt_atomic_leave(s);
 
-	/* Now, write "len" bytes from mbuf->data to the vector cells */
-	for (nvec = 0, wrlen = len; nvec < iovlen && wrlen > 0; nvec++) {
-		if (iov[nvec].iov_len == 0)
-			continue;
-		vlen = wrlen >= iov[nvec].iov_len ? iov[nvec].iov_len : wrlen;
-		if (rtdm_fd_is_user(fd)) {
-			xnbufd_map_uread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
-			xnbufd_unmap_uread(&bufd);
-		} else {
-			xnbufd_map_kread(&bufd, iov[nvec].iov_base, vlen);
-			ret = xnbufd_copy_from_kmem(&bufd, mbuf->data + rdoff, vlen);
-			xnbufd_unmap_kread(&bufd);
-		}
-		if (ret < 0)
-			break;
-		iov[nvec].iov_base += vlen;
-		iov[nvec].iov_len -= vlen;
-		wrlen -= vlen;
-		rdoff += vlen;
-	}
+	ret = __iddp_copy_mbuf(fd, iov, iovlen, mbuf, rdoff, len);
 
 	if (dofree)
 		__iddp_free_mbuf(sk, mbuf);
@@ -324,6 +360,20 @@ static ssize_t __iddp_recvmsg(struct rtdm_fd *fd,
 	return ret ?: len;
 }
 
+static int iddp_check_recvmsg(const struct user_msghdr *msg)
+{
+	if (msg->msg_name) {
+		if (msg->msg_namelen < sizeof(struct sockaddr_ipc))
+			return -EINVAL;
+	} else if (msg->msg_namelen != 0)
+		return -EINVAL;
+
+	if (msg->msg_iovlen >= UIO_MAXIOV)
+		return -EINVAL;
+
+	return 0;
+}
+
 static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
 			    struct user_msghdr *msg, int flags)
 {
@@ -334,14 +384,9 @@ static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
 	if (flags & ~MSG_DONTWAIT)
 		return -EINVAL;
 
-	if (msg->msg_name) {
-		if (msg->msg_namelen < sizeof(struct sockaddr_ipc))
-			return -EINVAL;
-	} else if (msg->msg_namelen != 0)
-		return -EINVAL;
-
-	if (msg->msg_iovlen >= UIO_MAXIOV)
-		return -EINVAL;
+	ret = iddp_check_recvmsg(msg);
+	if (ret)
+		return ret;
 
 	/* Copy I/O vector in */
 	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
@@ -368,6 +413,161 @@ static ssize_t iddp_recvmsg(struct rtdm_fd *fd,
 	return ret;
 }
 
+static ssize_t iddp_msg_flatlen(struct rtdm_fd *fd, struct user_msghdr *msg)
+{
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	ssize_t len;
+	int ret;
+
+	ret = iddp_check_recvmsg(msg);
+	if (ret)
+		return ret;
+
+	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+	if (ret)
+		return ret;
+
+	len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+	rtdm_drop_iovec(iov, iov_fast);
+
+	return len;
+}
+
+static ssize_t iddp_deliver(struct rtdm_fd *fd, struct user_msghdr *msg,
+			    struct iddp_message *mbuf, int rdoff, ssize_t len)
+{
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct sockaddr_ipc saddr;
+	int ret;
+
+	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+	if (ret)
+		return ret;
+
+	ret = __iddp_copy_mbuf(fd, iov, msg->msg_iovlen, mbuf, rdoff, len);
+	if (ret) {
+		rtdm_drop_iovec(iov, iov_fast);
+		return ret;
+	}
+
+	if (rtdm_put_iovec(fd, iov, msg, iov_fast))
+		return -EFAULT;
+
+	if (msg->msg_name) {
+		saddr.sipc_family = AF_RTIPC;
+		saddr.sipc_port = mbuf->from;
+		if (rtipc_put_arg(fd, msg->msg_name, &saddr, sizeof(saddr)))
+			return -EFAULT;
+		msg->msg_namelen = sizeof(struct sockaddr_ipc);
+	}
+
+	return len;
+}
+
+static int iddp_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			 unsigned int vlen, int flags,
+			 const struct timespec64 *ts)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iddp_socket *sk = priv->state;
+	struct {
+		struct iddp_message *mbuf;
+		ssize_t maxlen, len;
+		int rdoff, dofree;
+	} rx[IDDP_BATCH];
+	rtdm_toseq_t timeout_seq;
+	nanosecs_rel_t timeout;
+	int count, i, ret = 0;
+	unsigned int n = 0;
+	rtdm_lockctx_t s;
+	ssize_t len;
+
+	if (flags & ~(MSG_DONTWAIT | MSG_WAITFORONE))
+		return -EINVAL;
+
+	if (!test_bit(_IDDP_BOUND, &sk->status))
+		return -EAGAIN;
+
+	timeout = ts ? timespec64_to_ns(ts) : sk->rx_timeout;
+	if (flags & MSG_DONTWAIT)
+		timeout = RTDM_TIMEOUT_NONE;
+
+	rtdm_toseq_init(&timeout_seq, timeout);
+
+	while (n < vlen) {
+		count = min_t(unsigned int, vlen - n, IDDP_BATCH);
+
+		/* Validate the descriptors before consuming anything. */
+		for (i = 0; i < count; i++) {
+			len = iddp_msg_flatlen(fd, &mmsgvec[n + i].msg_hdr);
+			if (len <= 0) {
+				ret = len;
+				break;
+			}
+			rx[i].maxlen = len;
+		}
+
+		if (i == 0)
+			break;
+
+		ret = rtdm_sem_timeddown_batch(&sk->insem, i,
+					       timeout, &timeout_seq);
+		if (unlikely(ret < 0)) {
+			if (ret == -EIDRM)
+				ret = -ECONNRESET;
+			break;
+		}
+
+		count = ret;
+		ret = 0;
+
+		/* Pull all messages under a single atomic section. */
+		cobalt_atomic_enter(s);
+
+		/* We may have spurious wakeups, like __iddp_recvmsg(). */
+		for (i = 0; i < count && !list_empty(&sk->inq); ) {
+			rx[i].mbuf = __iddp_pull_mbuf(priv, rx[i].maxlen,
+						      &rx[i].rdoff, &rx[i].len,
+						      &rx[i].dofree);
+			if (!rx[i++].dofree) {
+				/*
+				 * Stop on partial read, giving back
+				 * the units we did not consume plus
+				 * the one of the reposted message.
+				 */
+				for (count -= i - 1; count > 0; count--)
+					rtdm_sem_up(&sk->insem);
+				break;
+			}
+		}
+
+		cobalt_atomic_leave(s);
+
+		count = i;
+		for (i = 0; i < count; i++) {
+			if (ret == 0) {
+				len = iddp_deliver(fd, &mmsgvec[n].msg_hdr,
+						   rx[i].mbuf, rx[i].rdoff,
+						   rx[i].len);
+				if (len < 0)
+					ret = len;
+				else
+					mmsgvec[n++].msg_len = len;
+			}
+			if (rx[i].dofree)
+				__iddp_free_mbuf(sk, rx[i].mbuf);
+		}
+
+		if (ret)
+			break;
+
+		if (n > 0 && (flags & MSG_WAITFORONE))
+			timeout = RTDM_TIMEOUT_NONE;
+	}
+
+	return n ?: ret;
+}
+
 static ssize_t iddp_read(struct rtdm_fd *fd, void *buf, size_t len)
 {
 	struct iovec iov = { .iov_base = buf, .iov_len = len };
@@ -375,41 +575,36 @@ static ssize_t iddp_read(struct rtdm_fd *fd, void *buf, size_t len)
 	return __iddp_recvmsg(fd, &iov, 1, 0, NULL);
 }
 
-static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
-			      struct iovec *iov, int iovlen, int flags,
-			      const struct sockaddr_ipc *daddr)
+static struct rtdm_fd *__iddp_lock_peer(struct sockaddr_ipc *daddr)
 {
-	struct rtipc_private *priv = rtdm_fd_to_private(fd);
-	struct iddp_socket *sk = priv->state, *rsk;
-	struct iddp_message *mbuf;
-	ssize_t len, rdlen, vlen;
-	int nvec, wroff, ret;
 	struct rtdm_fd *rfd;
-	struct xnbufd bufd;
 	rtdm_lockctx_t s;
 
-	len = rtdm_get_iov_flatlen(iov, iovlen);
-	if (len == 0)
-		return 0;
-
 	cobalt_atomic_enter(s);
 	rfd = xnmap_fetch_nocheck(portmap, daddr->sipc_port);
 	if (rfd && rtdm_fd_lock(rfd) < 0)
 		rfd = NULL;
 	cobalt_atomic_leave(s);
-	if (rfd == NULL)
-		return -ECONNRESET;
 
-	rsk = rtipc_fd_to_state(rfd);
-	if (!test_bit(_IDDP_BOUND, &rsk->status)) {
-		rtdm_fd_unlock(rfd);
-		return -ECONNREFUSED;
-	}
+	return rfd;
+}
+
+static struct iddp_message *
+__iddp_fill_mbuf(struct rtdm_fd *fd, struct iddp_socket *rsk,
+		 struct iovec *iov, int iovlen, ssize_t len,
+		 int flags, int *pret)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iddp_socket *sk = priv->state;
+	struct iddp_message *mbuf;
+	ssize_t rdlen, vlen;
+	int nvec, wroff, ret;
+	struct xnbufd bufd;
 
 	mbuf = __iddp_alloc_mbuf(rsk, len, sk->tx_timeout, flags, &ret);
 	if (unlikely(ret)) {
-		rtdm_fd_unlock(rfd);
-		return ret;
+		*pret = ret;
+		return NULL;
 	}
 
 	/* Now, move "len" bytes to mbuf->data from the vector cells */
@@ -427,16 +622,27 @@ static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
 			ret = xnbufd_copy_to_kmem(mbuf->data + wroff, &bufd, vlen);
 			xnbufd_unmap_kread(&bufd);
 		}
-		if (ret < 0)
-			goto fail;
+		if (ret < 0) {
+			__iddp_free_mbuf(rsk, mbuf);
+			*pret = ret;
+			return NULL;
+		}
 		iov[nvec].iov_base += vlen;
 		iov[nvec].iov_len -= vlen;
 		rdlen -= vlen;
 		wroff += vlen;
 	}
 
-	cobalt_atomic_enter(s);
+	mbuf->from = sk->name.sipc_port;
+	*pret = 0;
 
+	return mbuf;
+}
+
+/* Must be called under the cobalt lock. */
+static void __iddp_post_mbuf(struct iddp_socket *rsk,
+			     struct iddp_message *mbuf, int flags)
+{
 	/*
 	 * CAUTION: we must remain atomic from the moment we signal
 	 * POLLIN, until sem_up has happened.
@@ -444,27 +650,52 @@ static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
 	if (list_empty(&rsk->inq)) /* -> readable */
 		xnselect_signal(&rsk->priv->recv_block, POLLIN);
 
-	mbuf->from = sk->name.sipc_port;
-
 	if (flags & MSG_OOB)
 		list_add(&mbuf->next, &rsk->inq);
 	else
 		list_add_tail(&mbuf->next, &rsk->inq);
 
 	rtdm_sem_up(&rsk->insem); /* Will resched. */
+}
 
-	cobalt_atomic_leave(s);
+static ssize_t __iddp_sendmsg(struct rtdm_fd *fd,
+			      struct iovec *iov, int iovlen, int flags,
+			      const struct sockaddr_ipc *daddr)
+{
+	struct iddp_socket *rsk;
+	struct iddp_message *mbuf;
+	struct rtdm_fd *rfd;
+	rtdm_lockctx_t s;
+	ssize_t len;
+	int ret;
 
-	rtdm_fd_unlock(rfd);
+	len = rtdm_get_iov_flatlen(iov, iovlen);
+	if (len == 0)
+		return 0;
 
-	return len;
+	rfd = __iddp_lock_peer((struct sockaddr_ipc *)daddr);
+	if (rfd == NULL)
+		return -ECONNRESET;
 
-fail:
-	__iddp_free_mbuf(rsk, mbuf);
+	rsk = rtipc_fd_to_state(rfd);
+	if (!test_bit(_IDDP_BOUND, &rsk->status)) {
+		rtdm_fd_unlock(rfd);
+		return -ECONNREFUSED;
+	}
+
+	mbuf = __iddp_fill_mbuf(fd, rsk, iov, iovlen, len, flags, &ret);
+	if (unlikely(ret)) {
+		rtdm_fd_unlock(rfd);
+		return ret;
+	}
+
+	cobalt_atomic_enter(s);
+	__iddp_post_mbuf(rsk, mbuf, flags);
+	cobalt_atomic_leave(s);
 
 	rtdm_fd_unlock(rfd);
 
-	return ret;
+	return len;
 }
 
 static ssize_t iddp_sendmsg(struct rtdm_fd *fd,
@@ -516,6 +747,116 @@ static ssize_t iddp_sendmsg(struct rtdm_fd *fd,
 	return rtdm_put_iovec(fd, iov, msg, iov_fast) ?: ret;
 }
 
+/*
+ * Batch transmission to the connected peer: the peer is looked up
+ * once for the whole batch, and messages are posted to its input
+ * queue by groups, under a single atomic section. Messages carrying
+ * an explicit destination are sent one by one.
+ *
+ * We must not wait for buffer memory while holding unposted
+ * messages, since the receiver could not consume them in order to
+ * release some: only the first message of a group may block, the
+ * group is flushed as soon as another one would.
+ */
+static int iddp_sendmmsg(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			 unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	struct iddp_message *mbufs[IDDP_BATCH];
+	struct iddp_socket *sk = priv->state;
+	struct iddp_socket *rsk;
+	struct user_msghdr *msg;
+	struct sockaddr_ipc daddr;
+	int count, i, ret = 0;
+	struct rtdm_fd *rfd;
+	unsigned int n;
+	rtdm_lockctx_t s;
+	ssize_t len;
+
+	if (flags & ~(MSG_OOB | MSG_DONTWAIT))
+		return -EINVAL;
+
+	for (n = 0; n < vlen; n++) {
+		if (mmsgvec[n].msg_hdr.msg_name ||
+		    mmsgvec[n].msg_hdr.msg_namelen)
+			goto slow;
+	}
+
+	daddr = sk->peer;
+	if (daddr.sipc_port < 0)
+		return -EDESTADDRREQ;
+
+	rfd = __iddp_lock_peer(&daddr);
+	if (rfd == NULL)
+		return -ECONNRESET;
+
+	rsk = rtipc_fd_to_state(rfd);
+	if (!test_bit(_IDDP_BOUND, &rsk->status)) {
+		rtdm_fd_unlock(rfd);
+		return -ECONNREFUSED;
+	}
+
+	for (n = 0; n < vlen && ret == 0; n += count) {
+		count = min_t(unsigned int, vlen - n, IDDP_BATCH);
+		for (i = 0; i < count; i++) {
+			msg = &mmsgvec[n + i].msg_hdr;
+			mbufs[i] = NULL;
+			if (msg->msg_iovlen >= UIO_MAXIOV) {
+				ret = -EINVAL;
+				break;
+			}
+			ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+			if (ret)
+				break;
+			len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
+			if (len > 0) {
+				mbufs[i] = __iddp_fill_mbuf(fd, rsk, iov,
+						msg->msg_iovlen, len,
+						i > 0 ? flags | MSG_DONTWAIT : flags,
+						&ret);
+				if (ret) {
+					rtdm_drop_iovec(iov, iov_fast);
+					/* Flush, then retry this one. */
+					if (ret == -EAGAIN && i > 0 &&
+					    !(flags & MSG_DONTWAIT))
+						ret = 0;
+					break;
+				}
+			}
+			mmsgvec[n + i].msg_len = len;
+			ret = rtdm_put_iovec(fd, iov, msg, iov_fast);
+			if (ret) {
+				i++;	/* Message is sent nevertheless. */
+				break;
+			}
+		}
+
+		count = i;
+		cobalt_atomic_enter(s);
+		for (i = 0; i < count; i++) {
+			if (mbufs[i])
+				__iddp_post_mbuf(rsk, mbufs[i], flags);
+		}
+		cobalt_atomic_leave(s);
+	}
+
+	rtdm_fd_unlock(rfd);
+
+	return n ?: ret;
+slow:
+	for (n = 0; n < vlen; n++) {
+		len = iddp_sendmsg(fd, &mmsgvec[n].msg_hdr, flags);
+		if (len < 0) {
+			ret = len;
+			break;
+		}
+		mmsgvec[n].msg_len = len;
+	}
+
+	return n ?: ret;
+}
+
 static ssize_t iddp_write(struct rtdm_fd *fd,
 			  const void *buf, size_t len)
 {
@@ -1020,6 +1361,8 @@ struct rtipc_protocol iddp_proto_driver = {
 		.close = iddp_close,
 		.recvmsg = iddp_recvmsg,
 		.sendmsg = iddp_sendmsg,
+		.recvmmsg = iddp_recvmmsg,
+		.sendmmsg = iddp_sendmmsg,
 		.read = iddp_read,
 		.write = iddp_write,
 		.ioctl = iddp_ioctl,
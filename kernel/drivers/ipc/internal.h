@@ -50,6 +50,11 @@ struct rtipc_protocol {
 				   struct user_msghdr *msg, int flags);
 		ssize_t (*sendmsg)(struct rtdm_fd *fd,
 				   const struct user_msghdr *msg, int flags);
+		int (*recvmmsg)(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+				unsigned int vlen, int flags,
+				const struct timespec64 *timeout);
+		int (*sendmmsg)(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+				unsigned int vlen, int flags);
 		ssize_t (*read)(struct rtdm_fd *fd,
 				void *buf, size_t len);
 		ssize_t (*write)(struct rtdm_fd *fd,
@@ -427,6 +427,60 @@ static ssize_t rtipc_sendmsg(struct rtdm_fd *fd,
 	return priv->proto->proto_ops.sendmsg(fd, msg, flags);
 }
 
+static int rtipc_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			  unsigned int vlen, int flags,
+			  const struct timespec64 *timeout)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	unsigned int n;
+	ssize_t ret;
+
+	if (priv->proto->proto_ops.recvmmsg)
+		return priv->proto->proto_ops.recvmmsg(fd, mmsgvec, vlen,
+						       flags, timeout);
+
+	/*
+	 * Per-message fallback for protocols without batch support,
+	 * which cannot honor a timeout.
+	 */
+	if (timeout)
+		return -EINVAL;
+
+	for (n = 0; n < vlen; n++) {
+		ret = priv->proto->proto_ops.recvmsg(fd, &mmsgvec[n].msg_hdr,
+						     flags & ~MSG_WAITFORONE);
+		if (ret < 0)
+			return n ?: ret;
+		mmsgvec[n].msg_len = ret;
+		if (flags & MSG_WAITFORONE)
+			flags |= MSG_DONTWAIT;
+	}
+
+	return n;
+}
+
+static int rtipc_sendmmsg(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			  unsigned int vlen, int flags)
+{
+	struct rtipc_private *priv = rtdm_fd_to_private(fd);
+	unsigned int n;
+	ssize_t ret;
+
+	if (priv->proto->proto_ops.sendmmsg)
+		return priv->proto->proto_ops.sendmmsg(fd, mmsgvec, vlen,
+						       flags);
+
+	for (n = 0; n < vlen; n++) {
+		ret = priv->proto->proto_ops.sendmsg(fd, &mmsgvec[n].msg_hdr,
+						     flags);
+		if (ret < 0)
+			return n ?: ret;
+		mmsgvec[n].msg_len = ret;
+	}
+
+	return n;
+}
+
 static ssize_t rtipc_read(struct rtdm_fd *fd,
 			  void *buf, size_t len)
 {
@@ -504,6 +558,8 @@ static struct rtdm_driver rtipc_driver = {
 		.recvmsg_nrt	=	NULL,
 		.sendmsg_rt	=	rtipc_sendmsg,
 		.sendmsg_nrt	=	NULL,
+		.recvmmsg_rt	=	rtipc_recvmmsg,
+		.sendmmsg_rt	=	rtipc_sendmmsg,
 		.ioctl_rt	=	rtipc_ioctl,
 		.ioctl_nrt	=	rtipc_ioctl,
 		.read_rt	=	rtipc_read,
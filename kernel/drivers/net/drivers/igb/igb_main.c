@@ -82,16 +82,6 @@
 #define NETIF_F_HW_VLAN_FILTER 0
 #endif
 
-#ifdef  IGB_MAX_TX_QUEUES
-#undef  IGB_MAX_TX_QUEUES
-#define IGB_MAX_TX_QUEUES 1
-#endif
-
-#ifdef  IGB_MAX_RX_QUEUES
-#undef  IGB_MAX_RX_QUEUES
-#define IGB_MAX_RX_QUEUES 1
-#endif
-
 #ifdef CONFIG_IGB_NAPI
 #undef CONFIG_IGB_NAPI
 #endif
@@ -142,6 +132,15 @@ static int InterruptThrottle = 0;
 module_param(InterruptThrottle, uint, 0);
 MODULE_PARM_DESC(InterruptThrottle, "Throttle interrupts (boolean, false by default)");
 
+static unsigned int queues = 1;
+module_param(queues, uint, 0444);
+MODULE_PARM_DESC(queues, "Number of TX/RX queue pairs, capped by the hardware (1 by default)");
+
+static inline unsigned int igb_requested_queues(void)
+{
+	return clamp_t(unsigned int, queues, 1, IGB_MAX_RX_QUEUES);
+}
+
 static const struct pci_device_id igb_pci_tbl[] = {
 	{ PCI_VDEVICE(INTEL, E1000_DEV_ID_I354_BACKPLANE_1GBPS) },
 	{ PCI_VDEVICE(INTEL, E1000_DEV_ID_I354_SGMII) },
@@ -2038,7 +2037,8 @@ static int igb_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 
 	err = -ENOMEM;
 	netdev = rt_alloc_etherdev(sizeof(*adapter),
-				2 * IGB_DEFAULT_RXD + IGB_DEFAULT_TXD);
+				igb_requested_queues() *
+				(2 * IGB_DEFAULT_RXD + IGB_DEFAULT_TXD));
 	if (!netdev)
 		goto err_alloc_etherdev;
 
@@ -2285,6 +2285,15 @@ static int igb_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	 */
 	igb_get_hw_control(adapter);
 
+	/* expose the rings to the stack, see rtdev_set_num_queues() */
+	err = rtdev_set_num_queues(netdev,
+				   min_t(unsigned int, adapter->num_tx_queues,
+					 RTDEV_MAX_QUEUES),
+				   min_t(unsigned int, adapter->num_rx_queues,
+					 RTDEV_MAX_QUEUES));
+	if (err)
+		goto err_release_hw_control;
+
 	strcpy(netdev->name, "rteth%d");
 	err = rt_register_rtnetdev(netdev);
 	if (err)
@@ -2492,8 +2501,22 @@ static void igb_init_queue_configuration(struct igb_adapter *adapter)
 	struct e1000_hw *hw = &adapter->hw;
 	u32 max_rss_queues;
 
-	max_rss_queues = 1;
-	adapter->rss_queues = max_rss_queues;
+	/* Determine the maximum number of RSS queues supported. */
+	switch (hw->mac.type) {
+	case e1000_i211:
+		max_rss_queues = IGB_MAX_RX_QUEUES_I211;
+		break;
+	case e1000_82575:
+	case e1000_i210:
+		max_rss_queues = IGB_MAX_RX_QUEUES_82575;
+		break;
+	default:
+		max_rss_queues = IGB_MAX_RX_QUEUES;
+		break;
+	}
+
+	adapter->rss_queues = min_t(u32, max_rss_queues,
+				    igb_requested_queues());
 
 	/* Determine if we need to pair queues. */
 	switch (hw->mac.type) {
@@ -2920,6 +2943,36 @@ static int igb_setup_all_rx_resources(struct igb_adapter *adapter)
 	return err;
 }
 
+/**
+ *  igb_write_rss_indir_tbl - spread RSS hashes over the RX queues
+ *  @adapter: Board private structure
+ **/
+void igb_write_rss_indir_tbl(struct igb_adapter *adapter)
+{
+	struct e1000_hw *hw = &adapter->hw;
+	u32 reg = E1000_RETA(0);
+	u32 shift = 0;
+	int i = 0;
+
+	/* 82575 reads the queue index from bits 7:6 of each entry */
+	if (hw->mac.type == e1000_82575)
+		shift = 6;
+
+	while (i < IGB_RETA_SIZE) {
+		u32 val = 0;
+		int j;
+
+		for (j = 3; j >= 0; j--) {
+			val <<= 8;
+			val |= adapter->rss_indir_tbl[i + j];
+		}
+
+		wr32(reg, val << shift);
+		reg += 4;
+		i += 4;
+	}
+}
+
 /**
  *  igb_setup_mrqc - configure the multiple receive queue control registers
  *  @adapter: Board private structure
@@ -2951,6 +3004,7 @@ static void igb_setup_mrqc(struct igb_adapter *adapter)
 			(j * num_rx_queues) / IGB_RETA_SIZE;
 		adapter->rss_indir_tbl_init = num_rx_queues;
 	}
+	igb_write_rss_indir_tbl(adapter);
 
 	/* Disable raw packet checksumming so that RSS hash is placed in
 	 * descriptor on writeback.  No need to enable TCP/UDP/IP checksum
@@ -4177,7 +4231,12 @@ netdev_tx_t igb_xmit_frame_ring(struct rtskb *skb,
 static inline struct igb_ring *igb_tx_queue_mapping(struct igb_adapter *adapter,
 						    struct rtskb *skb)
 {
-	return adapter->tx_ring[0];
+	unsigned int r_idx = rtdev_skb_tx_queue(adapter->netdev, skb);
+
+	if (r_idx >= adapter->num_tx_queues)
+		r_idx = r_idx % adapter->num_tx_queues;
+
+	return adapter->tx_ring[r_idx];
 }
 
 static netdev_tx_t igb_xmit_frame(struct rtskb *skb,
@@ -4862,6 +4921,8 @@ static void igb_process_skb_fields(struct igb_ring *rx_ring,
 {
 	igb_rx_checksum(rx_ring, rx_desc, skb);
 
+	rtskb_record_rx_queue(skb, rx_ring->queue_index);
+
 	skb->protocol = rt_eth_type_trans(skb, rx_ring->netdev);
 }
 
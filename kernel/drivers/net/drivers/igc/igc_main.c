@@ -45,16 +45,6 @@
 #define NETIF_F_HW_VLAN_FILTER 0
 #endif
 
-#ifdef IGC_MAX_TX_QUEUES
-#undef IGC_MAX_TX_QUEUES
-#define IGC_MAX_TX_QUEUES 1
-#endif
-
-#ifdef IGC_MAX_RX_QUEUES
-#undef IGC_MAX_RX_QUEUES
-#define IGC_MAX_RX_QUEUES 1
-#endif
-
 #ifdef CONFIG_IGC_NAPI
 #undef CONFIG_IGC_NAPI
 #endif
@@ -106,6 +96,15 @@ static int InterruptThrottle;
 module_param(InterruptThrottle, uint, 0);
 MODULE_PARM_DESC(InterruptThrottle, "Throttle interrupts (boolean, false by default)");
 
+static unsigned int queues = 1;
+module_param(queues, uint, 0444);
+MODULE_PARM_DESC(queues, "Number of TX/RX queue pairs, capped by the hardware (1 by default)");
+
+static inline unsigned int igc_requested_queues(void)
+{
+	return clamp_t(unsigned int, queues, 1, IGC_MAX_RX_QUEUES);
+}
+
 static const struct igc_info *igc_info_tbl[] = {
 	[board_base] = &igc_base_info,
 };
@@ -660,6 +659,31 @@ static void igc_configure_tx(struct igc_adapter *adapter)
 		igc_configure_tx_ring(adapter, adapter->tx_ring[i]);
 }
 
+/**
+ * igc_write_rss_indir_tbl - spread RSS hashes over the RX queues
+ * @adapter: Board private structure
+ */
+void igc_write_rss_indir_tbl(struct igc_adapter *adapter)
+{
+	struct igc_hw *hw = &adapter->hw;
+	u32 reg = IGC_RETA(0);
+	int i = 0;
+
+	while (i < IGC_RETA_SIZE) {
+		u32 val = 0;
+		int j;
+
+		for (j = 3; j >= 0; j--) {
+			val <<= 8;
+			val |= adapter->rss_indir_tbl[i + j];
+		}
+
+		wr32(reg, val);
+		reg += 4;
+		i += 4;
+	}
+}
+
 /**
  * igc_setup_mrqc - configure the multiple receive queue control registers
  * @adapter: Board private structure
@@ -683,6 +707,7 @@ static void igc_setup_mrqc(struct igc_adapter *adapter)
 			(j * num_rx_queues) / IGC_RETA_SIZE;
 		adapter->rss_indir_tbl_init = num_rx_queues;
 	}
+	igc_write_rss_indir_tbl(adapter);
 
 	/* Disable raw packet checksumming so that RSS hash is placed in
 	 * descriptor on writeback.  No need to enable TCP/UDP/IP checksum
@@ -967,7 +992,12 @@ static netdev_tx_t igc_xmit_frame_ring(struct rtskb *skb,
 static inline struct igc_ring *igc_tx_queue_mapping(struct igc_adapter *adapter,
 						    struct rtskb *skb)
 {
-	return adapter->tx_ring[0];
+	unsigned int r_idx = rtdev_skb_tx_queue(adapter->netdev, skb);
+
+	if (r_idx >= adapter->num_tx_queues)
+		r_idx = r_idx % adapter->num_tx_queues;
+
+	return adapter->tx_ring[r_idx];
 }
 
 static netdev_tx_t igc_xmit_frame(struct rtskb *skb,
@@ -1053,6 +1083,8 @@ static void igc_process_skb_fields(struct igc_ring *rx_ring,
 {
 	igc_rx_checksum(rx_ring, rx_desc, skb);
 
+	rtskb_record_rx_queue(skb, rx_ring->queue_index);
+
 	skb->protocol = rt_eth_type_trans(skb, rx_ring->netdev);
 }
 
@@ -1737,7 +1769,8 @@ static void igc_init_queue_configuration(struct igc_adapter *adapter)
 	u32 max_rss_queues;
 
 	max_rss_queues = igc_get_max_rss_queues(adapter);
-	adapter->rss_queues = min_t(u32, max_rss_queues, num_online_cpus());
+	adapter->rss_queues = min_t(u32, max_rss_queues,
+				    igc_requested_queues());
 
 	igc_set_flag_queue_pairs(adapter, max_rss_queues);
 }
@@ -3699,7 +3732,8 @@ static int igc_probe(struct pci_dev *pdev,
 
 	err = -ENOMEM;
 	netdev = rt_alloc_etherdev(sizeof(*adapter),
-				2 * IGC_DEFAULT_RXD + IGC_DEFAULT_TXD);
+				igc_requested_queues() *
+				(2 * IGC_DEFAULT_RXD + IGC_DEFAULT_TXD));
 
 	if (!netdev)
 		goto err_alloc_etherdev;
@@ -3839,6 +3873,15 @@ static int igc_probe(struct pci_dev *pdev,
 	 */
 	igc_get_hw_control(adapter);
 
+	/* expose the rings to the stack, see rtdev_set_num_queues() */
+	err = rtdev_set_num_queues(netdev,
+				   min_t(unsigned int, adapter->num_tx_queues,
+					 RTDEV_MAX_QUEUES),
+				   min_t(unsigned int, adapter->num_rx_queues,
+					 RTDEV_MAX_QUEUES));
+	if (err)
+		goto err_register;
+
 	strncpy(netdev->name, "rteth%d", IFNAMSIZ);
 	err = rt_register_rtnetdev(netdev);
 	if (err)
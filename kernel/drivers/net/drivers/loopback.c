@@ -34,6 +34,15 @@ MODULE_AUTHOR("Maintainer: Jan Kiszka <Jan.Kiszka@web.de>");
 MODULE_DESCRIPTION("RTnet loopback driver");
 MODULE_LICENSE("GPL");
 
+static bool rx_deferred;
+module_param(rx_deferred, bool, 0444);
+MODULE_PARM_DESC(rx_deferred,
+		 "Deliver packets through the stack manager tasks like a NIC");
+
+static unsigned int queues = 1;
+module_param(queues, uint, 0444);
+MODULE_PARM_DESC(queues, "Number of software TX/RX queues");
+
 static struct rtnet_device *rt_loopback_dev;
 
 /***
@@ -80,7 +89,19 @@ static int rt_loopback_xmit(struct rtskb *rtskb, struct rtnet_device *rtdev)
 	/* parse the Ethernet header as usual */
 	rtskb->protocol = rt_eth_type_trans(rtskb, rtdev);
 
-	rt_stack_deliver(rtskb);
+	/* each TX queue loops back to the RX queue of the same index */
+	rtskb_record_rx_queue(rtskb, rtdev_skb_tx_queue(rtdev, rtskb));
+
+	if (rx_deferred) {
+		rtdm_lockctx_t context;
+
+		/* rtnetif_rx() expects to be called with IRQs off. */
+		rtdm_lock_irqsave(context);
+		rtnetif_rx(rtskb);
+		rtdm_lock_irqrestore(context);
+		rt_mark_stack_mgr(rtdev);
+	} else
+		rt_stack_deliver(rtskb);
 
 	return 0;
 }
@@ -110,6 +131,12 @@ static int __init loopback_init(void)
 	rtdev->flags &= ~IFF_BROADCAST;
 	rtdev->features |= NETIF_F_LLTX;
 
+	err = rtdev_set_num_queues(rtdev, queues, queues);
+	if (err) {
+		rtdev_free(rtdev);
+		return err;
+	}
+
 	if ((err = rt_register_rtnetdev(rtdev)) != 0) {
 		rtdev_free(rtdev);
 		return err;
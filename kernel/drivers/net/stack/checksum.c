@@ -0,0 +1,227 @@
+/***
+ *
+ *  stack/checksum.c - copy and checksum routines
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#define pr_fmt(fmt) "RTnet: " fmt
+
+#include <linux/version.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,12,0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
+#include <rtdm/driver.h>
+#include <rtnet_checksum.h>
+
+static char *csum_copy = "auto";
+module_param(csum_copy, charp, 0444);
+MODULE_PARM_DESC(csum_copy,
+		 "Copy and checksum routine (auto, twopass, word, unrolled)");
+
+/*
+ * The variants below sum native words into a 64-bit accumulator,
+ * which is congruent to the 16-bit one's complement sum modulo
+ * 0xffff regardless of the byte order. Vector registers are not
+ * used, since the out-of-band stage may not borrow the FPU.
+ */
+
+static __wsum csum_copy_twopass(const void *src, void *dst, int len,
+				__wsum csum)
+{
+	memcpy(dst, src, len);
+
+	return csum_partial(dst, len, csum);
+}
+
+static inline u32 csum_from64(u64 sum)
+{
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+
+	return (u32)sum;
+}
+
+static inline u64 csum_word(unsigned long w)
+{
+#if BITS_PER_LONG == 64
+	return (u64)(u32)w + (w >> 32);
+#else
+	return w;
+#endif
+}
+
+/* Less than a word left, starting at an even offset. */
+static inline u64 csum_copy_tail(const u8 *src, u8 *dst, int len)
+{
+	u64 sum = 0;
+	u32 w32;
+	u16 w16;
+
+#if BITS_PER_LONG == 64
+	if (len & 4) {
+		w32 = get_unaligned((const u32 *)src);
+		put_unaligned(w32, (u32 *)dst);
+		sum += w32;
+		src += 4;
+		dst += 4;
+	}
+#endif
+	if (len & 2) {
+		w16 = get_unaligned((const u16 *)src);
+		put_unaligned(w16, (u16 *)dst);
+		sum += w16;
+		src += 2;
+		dst += 2;
+	}
+
+	if (len & 1) {
+		*dst = *src;
+#ifdef __BIG_ENDIAN
+		sum += (u32)*src << 8;
+#else
+		sum += *src;
+#endif
+	}
+
+	return sum;
+}
+
+static __wsum csum_copy_word(const void *src, void *dst, int len,
+			     __wsum csum)
+{
+	const u8 *s = src;
+	u8 *d = dst;
+	unsigned long w;
+	u64 sum = 0;
+
+	for (; len >= (int)sizeof(long); len -= sizeof(long)) {
+		w = get_unaligned((const unsigned long *)s);
+		put_unaligned(w, (unsigned long *)d);
+		sum += csum_word(w);
+		s += sizeof(long);
+		d += sizeof(long);
+	}
+
+	sum += csum_copy_tail(s, d, len);
+
+	return csum_add(csum, (__force __wsum)csum_from64(sum));
+}
+
+/* Four words per round, with two accumulators to break the chain. */
+static __wsum csum_copy_unrolled(const void *src, void *dst, int len,
+				 __wsum csum)
+{
+	const unsigned long *s = src;
+	unsigned long *d = dst;
+	unsigned long w0, w1, w2, w3;
+	u64 sum0 = 0, sum1 = 0;
+
+	for (; len >= 4 * (int)sizeof(long); len -= 4 * sizeof(long)) {
+		w0 = get_unaligned(s);
+		w1 = get_unaligned(s + 1);
+		w2 = get_unaligned(s + 2);
+		w3 = get_unaligned(s + 3);
+		put_unaligned(w0, d);
+		put_unaligned(w1, d + 1);
+		put_unaligned(w2, d + 2);
+		put_unaligned(w3, d + 3);
+		sum0 += csum_word(w0) + csum_word(w2);
+		sum1 += csum_word(w1) + csum_word(w3);
+		s += 4;
+		d += 4;
+	}
+
+	csum = csum_add(csum, (__force __wsum)csum_from64(sum0 + sum1));
+
+	return csum_copy_word(s, d, len, csum);
+}
+
+const struct rtnet_csum_copy_variant rtnet_csum_copy_variants[] = {
+	{ "twopass", csum_copy_twopass },
+	{ "word", csum_copy_word },
+	{ "unrolled", csum_copy_unrolled },
+	{ NULL, NULL },
+};
+EXPORT_SYMBOL_GPL(rtnet_csum_copy_variants);
+
+__wsum (*rtnet_csum_copy_fn)(const void *src, void *dst, int len,
+			     __wsum csum) __read_mostly = csum_copy_word;
+EXPORT_SYMBOL_GPL(rtnet_csum_copy_fn);
+
+#define CSUM_CALIB_LEN		4096
+#define CSUM_CALIB_ROUNDS	32
+
+static nanosecs_rel_t csum_copy_time(const struct rtnet_csum_copy_variant *v,
+				     const void *src, void *dst)
+{
+	nanosecs_rel_t best = -1, t;
+	nanosecs_abs_t start;
+	int n;
+
+	for (n = 0; n < CSUM_CALIB_ROUNDS; n++) {
+		start = rtdm_clock_read_monotonic();
+		v->copy(src, dst, CSUM_CALIB_LEN, 0);
+		t = rtdm_clock_read_monotonic() - start;
+		if (best < 0 || t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+/* Pick the fastest variant on a page-sized copy, unless told otherwise. */
+void rtnet_csum_init(void)
+{
+	const struct rtnet_csum_copy_variant *v, *fastest = NULL;
+	nanosecs_rel_t t, best = 0;
+	u8 *buf;
+
+	for (v = rtnet_csum_copy_variants; v->name; v++) {
+		if (strcmp(csum_copy, v->name) == 0) {
+			rtnet_csum_copy_fn = v->copy;
+			pr_info("using %s copy and checksum\n", v->name);
+			return;
+		}
+	}
+
+	if (strcmp(csum_copy, "auto"))
+		pr_warn("unknown copy and checksum routine '%s'\n", csum_copy);
+
+	buf = kmalloc(2 * CSUM_CALIB_LEN, GFP_KERNEL);
+	if (buf == NULL)
+		return;
+
+	memset(buf, 0x5a, CSUM_CALIB_LEN);
+
+	for (v = rtnet_csum_copy_variants; v->name; v++) {
+		t = csum_copy_time(v, buf, buf + CSUM_CALIB_LEN);
+		if (fastest == NULL || t < best) {
+			fastest = v;
+			best = t;
+		}
+	}
+
+	kfree(buf);
+
+	rtnet_csum_copy_fn = fastest->copy;
+	pr_info("using %s copy and checksum\n", fastest->name);
+}
@@ -0,0 +1,197 @@
+/***
+ *
+ *  include/ipv4/sock_table.h - resizable port tables for UDP and TCP
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RTNET_SOCK_TABLE_H_
+#define __RTNET_SOCK_TABLE_H_
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <linux/in.h>
+
+#include <rtdm/driver.h>
+
+/***
+ *  Sockets are hashed on their local port. Lookups take no lock: they
+ *  run with hard irqs off, within a window delimited by a per-CPU
+ *  sequence count which is odd while the lookup is in progress, and
+ *  writers wait for those windows to close before a node or a bucket
+ *  array may be reused. Writers serialise on a per-bucket lock.
+ *
+ *  The bucket array doubles when there are more sockets than buckets.
+ *  A node carries one link per generation, so that it can be chained
+ *  into the new array while lookups still walk the old one. Buckets
+ *  are moved one at a time, each under its own lock, and lookups
+ *  hitting a moved bucket follow on to the new array.
+ *
+ *  Rebinding moves a node to another bucket without waiting, so a
+ *  lookup walking the node at that time may be sent to the wrong
+ *  chain. Buckets a node leaves have their sequence count bumped, and
+ *  lookups which miss retry when it changed under them.
+ */
+struct rt_sock_node {
+	struct hlist_node link[2];
+	u32 saddr; /* local ip-addr */
+	u16 sport; /* local port */
+};
+
+struct rt_sock_bucket {
+	rtdm_lock_t lock;
+	int migrated;
+	unsigned int seq; /* odd while a node leaves */
+	struct hlist_head head;
+};
+
+struct rt_sock_hash {
+	unsigned int mask;
+	unsigned int link; /* index of rt_sock_node.link used here */
+	struct rt_sock_hash *next; /* replacement while resizing */
+	struct rt_sock_bucket buckets[];
+};
+
+struct rt_sock_table {
+	struct rt_sock_hash *hash;
+	unsigned int size; /* buckets in hash, under resize_lock */
+	atomic_t count; /* reserved nodes */
+	struct mutex resize_lock;
+};
+
+DECLARE_PER_CPU(unsigned long, rt_sock_lookup_seq);
+
+static inline void rt_sock_node_init(struct rt_sock_node *node)
+{
+	INIT_HLIST_NODE(&node->link[0]);
+	INIT_HLIST_NODE(&node->link[1]);
+	node->saddr = INADDR_ANY;
+	node->sport = 0;
+}
+
+static inline bool rt_sock_node_hashed(struct rt_sock_node *node)
+{
+	return !hlist_unhashed(&node->link[0]) ||
+	       !hlist_unhashed(&node->link[1]);
+}
+
+/* The bucket only depends on the port, no need to rehash. */
+static inline void rt_sock_node_set_saddr(struct rt_sock_node *node, u32 saddr)
+{
+	WRITE_ONCE(node->saddr, saddr);
+}
+
+/* Call with hard irqs off. */
+static inline void rt_sock_lookup_begin(void)
+{
+	unsigned long *seq = raw_cpu_ptr(&rt_sock_lookup_seq);
+
+	WRITE_ONCE(*seq, *seq + 1);
+	smp_mb();
+}
+
+static inline void rt_sock_lookup_end(void)
+{
+	unsigned long *seq = raw_cpu_ptr(&rt_sock_lookup_seq);
+
+	smp_mb();
+	WRITE_ONCE(*seq, *seq + 1);
+}
+
+static inline struct rt_sock_bucket *
+rt_sock_hash_bucket(struct rt_sock_hash *hash, u16 sport)
+{
+	return &hash->buckets[sport & hash->mask];
+}
+
+static inline bool rt_sock_node_match(struct rt_sock_node *node, u32 saddr,
+				      u16 sport)
+{
+	return node->sport == sport &&
+	       (saddr == INADDR_ANY || node->saddr == saddr ||
+		node->saddr == INADDR_ANY);
+}
+
+static inline struct rt_sock_node *
+rt_sock_bucket_search(struct rt_sock_hash *hash, struct rt_sock_bucket *bucket,
+		      u32 saddr, u16 sport)
+{
+	struct rt_sock_node *node;
+	struct hlist_node *pos;
+
+	for (pos = rcu_dereference_raw(hlist_first_rcu(&bucket->head)); pos;
+	     pos = rcu_dereference_raw(hlist_next_rcu(pos))) {
+		node = container_of(pos - hash->link, struct rt_sock_node,
+				    link[0]);
+		if (rt_sock_node_match(node, saddr, sport))
+			return node;
+	}
+
+	return NULL;
+}
+
+/*
+ * Find the node bound to saddr:sport. Must be called between
+ * rt_sock_lookup_begin() and rt_sock_lookup_end(), the node is only
+ * guaranteed to stay around until the latter.
+ */
+static inline struct rt_sock_node *
+rt_sock_table_search(struct rt_sock_table *table, u32 saddr, u16 sport)
+{
+	struct rt_sock_bucket *bucket;
+	struct rt_sock_hash *hash;
+	struct rt_sock_node *node;
+	unsigned int seq;
+
+	hash = smp_load_acquire(&table->hash);
+	bucket = rt_sock_hash_bucket(hash, sport);
+	if (smp_load_acquire(&bucket->migrated)) {
+		hash = READ_ONCE(hash->next);
+		bucket = rt_sock_hash_bucket(hash, sport);
+	}
+
+	do {
+		seq = smp_load_acquire(&bucket->seq);
+		node = rt_sock_bucket_search(hash, bucket, saddr, sport);
+		if (node)
+			return node;
+		smp_rmb();
+	} while ((seq & 1) || READ_ONCE(bucket->seq) != seq);
+
+	return NULL;
+}
+
+int rt_sock_table_init(struct rt_sock_table *table, unsigned int buckets);
+void rt_sock_table_destroy(struct rt_sock_table *table);
+
+void rt_sock_table_reserve(struct rt_sock_table *table);
+void rt_sock_table_unreserve(struct rt_sock_table *table);
+
+int rt_sock_table_insert(struct rt_sock_table *table,
+			 struct rt_sock_node *node, u32 saddr, u16 sport);
+void rt_sock_table_remove(struct rt_sock_table *table,
+			  struct rt_sock_node *node);
+int rt_sock_table_rebind(struct rt_sock_table *table,
+			 struct rt_sock_node *node, u32 saddr, u16 sport);
+
+void rt_sock_table_for_each(struct rt_sock_table *table,
+			    void (*fn)(struct rt_sock_node *node, void *arg),
+			    void *arg);
+
+#endif /* __RTNET_SOCK_TABLE_H_ */
@@ -25,7 +25,9 @@
 #include <rtskb.h>
 #include <ipv4/protocol.h>
 
-/* Maximum number of active tcp sockets, must be power of 2 */
+/* Default number of active tcp sockets, must be power of 2
+   The limit is set by the tcp_auto_port_mask module parameter, the
+   port table starts with twice as many buckets and grows on demand. */
 #define RT_TCP_SOCKETS 32
 
 /*Maximum number of active tcp connections, must be power of 2 */
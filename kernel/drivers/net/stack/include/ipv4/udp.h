@@ -26,8 +26,9 @@
 #ifndef __RTNET_UDP_H_
 #define __RTNET_UDP_H_
 
-/* Maximum number of active udp sockets
-   Only increase with care (look-up delays!), must be power of 2 */
+/* Default number of active udp sockets, must be power of 2
+   The limit is set by the auto_port_mask module parameter, the port
+   table starts with twice as many buckets and grows on demand. */
 #define RT_UDP_SOCKETS 64
 
 #endif /* __RTNET_UDP_H_ */
@@ -28,6 +28,8 @@
 
 #define MAX_RT_DEVICES 8
 
+#define RTDEV_MAX_QUEUES 8
+
 #ifdef __KERNEL__
 
 #include <asm/atomic.h>
@@ -59,6 +61,13 @@ enum rtnet_link_state {
 #define RTNET_LINK_STATE_PRESENT (1 << __RTNET_LINK_STATE_PRESENT)
 #define RTNET_LINK_STATE_NOCARRIER (1 << __RTNET_LINK_STATE_NOCARRIER)
 
+/***
+ *  rtnet_tx_queue - per hardware queue transmission state
+ */
+struct rtnet_tx_queue {
+	rtdm_mutex_t xmit_mutex; /* protects xmit on this queue */
+};
+
 /***
  *  rtnet_device
  */
@@ -116,6 +125,14 @@ struct rtnet_device {
 	rtdm_event_t *stack_event;
 
 	rtdm_mutex_t xmit_mutex; /* protects xmit routine        */
+
+	/* Hardware queues, see rtdev_set_num_queues(). RX queue n is
+     * owned by the stack manager task n modulo the number of tasks.
+     */
+	unsigned int num_tx_queues;
+	unsigned int num_rx_queues;
+	struct rtnet_tx_queue tx_queue[RTDEV_MAX_QUEUES];
+	u8 prio_txq[QUEUE_MIN_PRIO + 1]; /* default TX queue per prio */
 	rtdm_lock_t rtdev_lock; /* management lock              */
 	struct mutex nrt_lock; /* non-real-time locking        */
 
@@ -196,6 +213,22 @@ void rtdev_del_event_hook(struct rtdev_event_hook *hook);
 
 void rtdev_alloc_name(struct rtnet_device *rtdev, const char *name_mask);
 
+int rtdev_set_num_queues(struct rtnet_device *rtdev, unsigned int txqs,
+			 unsigned int rxqs);
+
+/**
+ *  rtdev_skb_tx_queue - TX queue a driver should use for an rtskb
+ *  @rtdev: device transmitting the rtskb
+ *  @skb: rtskb to send
+ */
+static inline unsigned int rtdev_skb_tx_queue(struct rtnet_device *rtdev,
+					      const struct rtskb *skb)
+{
+	unsigned int queue = rtskb_get_queue_mapping(skb);
+
+	return queue < rtdev->num_tx_queues ? queue : 0;
+}
+
 /**
  *  __rtdev_get_by_index - find a rtnet_device by its ifindex
  *  @ifindex: index of device
@@ -10,10 +10,28 @@
 		csum_partial(__buf, __len, (__force __wsum)__csum);	\
 	})
 
+/*
+ * Copy and checksum routines, walking the data once except for the
+ * two-pass reference. The one used by rtnet_csum_copy() is picked
+ * when the stack is loaded, see the csum_copy module parameter.
+ */
+struct rtnet_csum_copy_variant {
+	const char *name;
+	__wsum (*copy)(const void *src, void *dst, int len, __wsum csum);
+};
+
+/* NULL-terminated */
+extern const struct rtnet_csum_copy_variant rtnet_csum_copy_variants[];
+
+extern __wsum (*rtnet_csum_copy_fn)(const void *src, void *dst, int len,
+				    __wsum csum);
+
 #define rtnet_csum_copy(__src, __dst, __len, __csum)			\
 	({								\
-		memcpy(__dst, __src, __len);				\
-		csum_partial(__dst, __len, (__force __wsum)__csum);	\
+		rtnet_csum_copy_fn(__src, __dst, __len,			\
+				   (__force __wsum)__csum);		\
 	})
 
+void rtnet_csum_init(void);
+
 #endif /* !__RTNET_CHECKSUM_H_ */
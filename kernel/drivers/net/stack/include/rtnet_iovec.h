@@ -24,6 +24,7 @@
 #ifdef __KERNEL__
 
 #include <linux/uio.h>
+#include <linux/types.h>
 
 struct user_msghdr;
 struct rtdm_fd;
@@ -33,6 +34,15 @@ ssize_t rtnet_write_to_iov(struct rtdm_fd *fd, struct iovec *iov, int iovlen,
 
 ssize_t rtnet_read_from_iov(struct rtdm_fd *fd, struct iovec *iov, int iovlen,
 			    void *data, size_t len);
+
+/* Same as above, adding the checksum of the data copied to *csum. */
+ssize_t rtnet_write_to_iov_csum(struct rtdm_fd *fd, struct iovec *iov,
+				int iovlen, const void *data, size_t len,
+				__wsum *csum);
+
+ssize_t rtnet_read_from_iov_csum(struct rtdm_fd *fd, struct iovec *iov,
+				 int iovlen, void *data, size_t len,
+				 __wsum *csum);
 #endif /* __KERNEL__ */
 
 #endif /* __RTNET_IOVEC_H_ */
@@ -35,6 +35,8 @@
 #include <rtdm/driver.h>
 #include <stack_mgr.h>
 
+struct rtpacket_ring;
+
 struct rtsocket {
 	unsigned short protocol;
 
@@ -47,6 +49,7 @@ struct rtsocket {
 	rtdm_lock_t param_lock;
 
 	unsigned int priority;
+	unsigned short tx_queue; /* pinned TX queue or RTSKB_QUEUE_NONE */
 	nanosecs_rel_t timeout; /* receive timeout, 0 for infinite */
 
 	rtdm_sem_t pending_sem;
@@ -73,6 +76,7 @@ struct rtsocket {
 		struct {
 			struct rtpacket_type packet_type;
 			int ifindex;
+			struct rtpacket_ring *ring; /* mmap'ed RX/TX ring */
 		} packet;
 	} prot;
 };
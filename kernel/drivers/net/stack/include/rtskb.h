@@ -159,6 +159,7 @@ struct rtskb {
 	struct rtskb_pool *pool; /* owning pool */
 
 	unsigned int priority; /* bit 0..15: prio, 16..31: user-defined */
+	unsigned short queue_mapping; /* hardware TX or RX queue */
 
 	struct rtsocket *sk; /* assigned socket */
 	struct rtnet_device *rtdev; /* source or destination device */
@@ -260,6 +261,9 @@ struct rtskb_prio_queue {
 /* Note: always keep SOCK_XMIT_PARAMS consistent with definitions above! */
 #define RTSKB_PRIO_VALUE SOCK_XMIT_PARAMS
 
+/* no hardware queue assigned (TX) or recorded (RX) */
+#define RTSKB_QUEUE_NONE 0xFFFF
+
 /* default values for the module parameter */
 #define DEFAULT_GLOBAL_RTSKBS 0 /* default number of rtskb's in global pool */
 #define DEFAULT_DEVICE_RTSKBS                                                  \
@@ -288,6 +292,33 @@ extern struct rtskb *alloc_rtskb(unsigned int size, struct rtskb_pool *pool);
 extern void kfree_rtskb(struct rtskb *skb);
 #define dev_kfree_rtskb(a) kfree_rtskb(a)
 
+/***
+ *  On transmission, queue_mapping is either RTSKB_QUEUE_NONE or the
+ *  queue the sending socket is pinned to, and rtdev_xmit() turns it
+ *  into a valid TX queue of the device. On reception, drivers of
+ *  multi-queue devices record the RX queue the frame arrived on.
+ */
+static inline void rtskb_set_queue_mapping(struct rtskb *skb,
+					   unsigned int queue)
+{
+	skb->queue_mapping = queue;
+}
+
+static inline unsigned int rtskb_get_queue_mapping(const struct rtskb *skb)
+{
+	return skb->queue_mapping;
+}
+
+static inline void rtskb_record_rx_queue(struct rtskb *skb, unsigned int queue)
+{
+	skb->queue_mapping = queue;
+}
+
+static inline bool rtskb_rx_queue_recorded(const struct rtskb *skb)
+{
+	return skb->queue_mapping != RTSKB_QUEUE_NONE;
+}
+
 static inline void rtskb_tx_timestamp(struct rtskb *skb)
 {
 	nanosecs_abs_t *ts = skb->xmit_stamp;
@@ -598,6 +629,59 @@ static inline struct rtskb *rtskb_dequeue_chain(struct rtskb_queue *queue)
 	return result;
 }
 
+/***
+ *  rtskb_dequeue_chains - remove up to count chains from the head of
+ *                         the queue at once (lock protected)
+ *  @queue: queue to remove from
+ *  @count: maximum number of chains to remove
+ *
+ *  The chains returned remain linked through their chain_end->next
+ *  pointers, the last one being NULL-terminated.
+ */
+static inline struct rtskb *rtskb_dequeue_chains(struct rtskb_queue *queue,
+						 unsigned int count)
+{
+	struct rtskb *result, *skb, *chain_end = NULL;
+	rtdm_lockctx_t context;
+
+	rtdm_lock_get_irqsave(&queue->lock, context);
+	result = queue->first;
+	for (skb = result; skb && count > 0; count--) {
+		chain_end = skb->chain_end;
+		skb = chain_end->next;
+	}
+	if (chain_end) {
+		queue->first = skb;
+		chain_end->next = NULL;
+	}
+	rtdm_lock_put_irqrestore(&queue->lock, context);
+
+	return result;
+}
+
+/***
+ *  rtskb_requeue_chains - put back a list of chains at the head of the
+ *                         queue (lock protected)
+ *  @queue: queue to use
+ *  @skb: first chain, as returned by rtskb_dequeue_chains()
+ */
+static inline void rtskb_requeue_chains(struct rtskb_queue *queue,
+					struct rtskb *skb)
+{
+	struct rtskb *chain_end = skb->chain_end;
+	rtdm_lockctx_t context;
+
+	while (chain_end->next)
+		chain_end = chain_end->next->chain_end;
+
+	rtdm_lock_get_irqsave(&queue->lock, context);
+	chain_end->next = queue->first;
+	if (queue->first == NULL)
+		queue->last = chain_end;
+	queue->first = skb;
+	rtdm_lock_put_irqrestore(&queue->lock, context);
+}
+
 /***
  *  rtskb_prio_dequeue_chain - remove a chain from the head of the
  *                             prioritized queue
@@ -85,9 +85,11 @@ static inline void rtnetif_tx(struct rtnet_device *rtdev)
 {
 }
 
+void rt_stack_mgr_kick(void);
+
 static inline void rt_mark_stack_mgr(struct rtnet_device *rtdev)
 {
-	rtdm_event_signal(rtdev->stack_event);
+	rt_stack_mgr_kick();
 }
 
 #endif /* __KERNEL__ */
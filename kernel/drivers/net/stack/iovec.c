@@ -26,9 +26,18 @@
 #include <linux/module.h>
 #include <linux/string.h>
 #include <rtdm/driver.h>
+#include <rtnet_checksum.h>
 #include <rtnet_iovec.h>
 #include <rtnet_socket.h>
 
+/*
+ * User memory may only be accessed through the rtdm uaccess helpers,
+ * csum_and_copy_*_user() may fault in pages and sleep, which
+ * out-of-band callers cannot afford. So user data is copied by
+ * chunks, each of them being checksummed while still cache-hot.
+ */
+#define RTNET_CSUM_CHUNK 1024
+
 ssize_t rtnet_write_to_iov(struct rtdm_fd *fd, struct iovec *iov, int iovlen,
 			   const void *data, size_t len)
 {
@@ -101,3 +110,123 @@ ssize_t rtnet_read_from_iov(struct rtdm_fd *fd, struct iovec *iov, int iovlen,
 	return ret;
 }
 EXPORT_SYMBOL_GPL(rtnet_read_from_iov);
+
+static int copy_to_user_csum(struct rtdm_fd *fd, void __user *dst,
+			     const void *src, size_t len, __wsum *csum)
+{
+	__wsum sum = 0;
+	size_t done, n;
+
+	for (done = 0; done < len; done += n) {
+		n = min_t(size_t, len - done, RTNET_CSUM_CHUNK);
+		sum = rtnet_csum(src + done, n, sum);
+		if (rtdm_copy_to_user(fd, dst + done, src + done, n))
+			return -EFAULT;
+	}
+
+	*csum = sum;
+
+	return 0;
+}
+
+static int copy_from_user_csum(struct rtdm_fd *fd, void *dst,
+			       const void __user *src, size_t len,
+			       __wsum *csum)
+{
+	__wsum sum = 0;
+	size_t done, n;
+
+	for (done = 0; done < len; done += n) {
+		n = min_t(size_t, len - done, RTNET_CSUM_CHUNK);
+		if (rtdm_copy_from_user(fd, dst + done, src + done, n))
+			return -EFAULT;
+		sum = rtnet_csum(dst + done, n, sum);
+	}
+
+	*csum = sum;
+
+	return 0;
+}
+
+ssize_t rtnet_write_to_iov_csum(struct rtdm_fd *fd, struct iovec *iov,
+				int iovlen, const void *data, size_t len,
+				__wsum *csum)
+{
+	ssize_t ret = 0;
+	size_t nbytes;
+	__wsum part;
+	int n, err;
+
+	for (n = 0; len > 0 && n < iovlen; n++, iov++) {
+		if (iov->iov_len == 0)
+			continue;
+
+		nbytes = iov->iov_len;
+		if (nbytes > len)
+			nbytes = len;
+
+		if (!rtdm_fd_is_user(fd))
+			part = rtnet_csum_copy(data, iov->iov_base, nbytes, 0);
+		else {
+			err = copy_to_user_csum(fd, iov->iov_base, data,
+						nbytes, &part);
+			if (err)
+				return err;
+		}
+
+		/* Segments may start at odd offsets. */
+		*csum = csum_block_add(*csum, part, ret);
+
+		len -= nbytes;
+		data += nbytes;
+		iov->iov_len -= nbytes;
+		iov->iov_base += nbytes;
+		ret += nbytes;
+		if (ret < 0)
+			return -EINVAL;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(rtnet_write_to_iov_csum);
+
+ssize_t rtnet_read_from_iov_csum(struct rtdm_fd *fd, struct iovec *iov,
+				 int iovlen, void *data, size_t len,
+				 __wsum *csum)
+{
+	ssize_t ret = 0;
+	size_t nbytes;
+	__wsum part;
+	int n, err;
+
+	for (n = 0; len > 0 && n < iovlen; n++, iov++) {
+		if (iov->iov_len == 0)
+			continue;
+
+		nbytes = iov->iov_len;
+		if (nbytes > len)
+			nbytes = len;
+
+		if (!rtdm_fd_is_user(fd))
+			part = rtnet_csum_copy(iov->iov_base, data, nbytes, 0);
+		else {
+			err = copy_from_user_csum(fd, data, iov->iov_base,
+						  nbytes, &part);
+			if (err)
+				return err;
+		}
+
+		*csum = csum_block_add(*csum, part, ret);
+
+		len -= nbytes;
+		data += nbytes;
+		iov->iov_len -= nbytes;
+		iov->iov_base += nbytes;
+		ret += nbytes;
+		if (ret < 0)
+			return -EINVAL;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(rtnet_read_from_iov_csum);
@@ -494,7 +494,7 @@ void __init rt_icmp_init(void)
 		pr_debug("allocated only %d icmp rtskbs\n", skbs);
 
 	icmp_socket->prot.inet.tos = 0;
-	icmp_fd->refs = 1;
+	atomic_set(&icmp_fd->refs, 1);
 
 	rt_inet_add_protocol(&icmp_protocol);
 }
@@ -102,6 +102,7 @@ static int rt_ip_build_xmit_slow(struct rtsocket *sk,
 		skb->rtdev = rtdev;
 		skb->nh.iph = iph = (struct iphdr *)rtskb_put(skb, fraglen);
 		skb->priority = prio;
+		rtskb_set_queue_mapping(skb, sk->tx_queue);
 
 		iph->version = 4;
 		iph->ihl = 5; /* 20 byte header - no options */
@@ -204,6 +205,7 @@ int rt_ip_build_xmit(struct rtsocket *sk,
 	skb->rtdev = rtdev;
 	skb->nh.iph = iph = (struct iphdr *)rtskb_put(skb, length);
 	skb->priority = prio;
+	rtskb_set_queue_mapping(skb, sk->tx_queue);
 
 	iph->version = 4;
 	iph->ihl = 5;
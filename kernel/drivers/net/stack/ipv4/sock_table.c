@@ -0,0 +1,467 @@
+/***
+ *
+ *  ipv4/sock_table.c - resizable port tables for UDP and TCP
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/overflow.h>
+
+#include <ipv4/sock_table.h>
+
+DEFINE_PER_CPU(unsigned long, rt_sock_lookup_seq);
+EXPORT_PER_CPU_SYMBOL_GPL(rt_sock_lookup_seq);
+
+/*
+ * Wait for all lookups which might have observed a node or a bucket
+ * array before it was changed by the caller. Lookup windows are short
+ * and run with hard irqs off, so this does not spin for long. Never
+ * call from within a window.
+ */
+static void wait_lookups(void)
+{
+	unsigned long seq, *p;
+	int cpu;
+
+	smp_mb();
+
+	for_each_online_cpu(cpu) {
+		p = per_cpu_ptr(&rt_sock_lookup_seq, cpu);
+		seq = READ_ONCE(*p);
+		if (seq & 1) {
+			while (READ_ONCE(*p) == seq)
+				cpu_relax();
+		}
+	}
+}
+
+static struct rt_sock_hash *alloc_hash(unsigned int size, unsigned int link)
+{
+	struct rt_sock_hash *hash;
+	unsigned int n;
+
+	hash = kvzalloc(struct_size(hash, buckets, size), GFP_KERNEL);
+	if (hash == NULL)
+		return NULL;
+
+	hash->mask = size - 1;
+	hash->link = link;
+
+	for (n = 0; n < size; n++) {
+		rtdm_lock_init(&hash->buckets[n].lock);
+		INIT_HLIST_HEAD(&hash->buckets[n].head);
+	}
+
+	return hash;
+}
+
+/***
+ *  The buckets a port maps to, as seen by a writer. While resizing, a
+ *  bucket which moved already is updated in the new array only.
+ *  Moving a bucket requires its lock, so writers hold it as well
+ *  until the resize is over.
+ */
+struct port_buckets {
+	struct rt_sock_hash *hash;
+	struct rt_sock_bucket *bucket;
+	struct rt_sock_hash *next_hash;
+	struct rt_sock_bucket *next_bucket;
+};
+
+/* Call with pb->bucket locked. */
+static void find_next_bucket(struct port_buckets *pb, u16 sport)
+{
+	if (pb->bucket->migrated) {
+		pb->next_hash = pb->hash->next;
+		pb->next_bucket = rt_sock_hash_bucket(pb->next_hash, sport);
+	} else {
+		pb->next_hash = NULL;
+		pb->next_bucket = NULL;
+	}
+}
+
+/* Call within a lookup window. */
+static void lock_port(struct rt_sock_table *table, u16 sport,
+		      struct port_buckets *pb)
+{
+	pb->hash = smp_load_acquire(&table->hash);
+	pb->bucket = rt_sock_hash_bucket(pb->hash, sport);
+	rtdm_lock_get(&pb->bucket->lock);
+
+	find_next_bucket(pb, sport);
+	if (pb->next_bucket)
+		rtdm_lock_get(&pb->next_bucket->lock);
+}
+
+static void unlock_port(struct port_buckets *pb)
+{
+	if (pb->next_bucket)
+		rtdm_lock_put(&pb->next_bucket->lock);
+	rtdm_lock_put(&pb->bucket->lock);
+}
+
+/* Lock two buckets of the same array by address order, either may be NULL. */
+static void lock_bucket_pair(struct rt_sock_bucket *a, struct rt_sock_bucket *b)
+{
+	if (a == NULL || (b && b < a))
+		swap(a, b);
+	if (a)
+		rtdm_lock_get(&a->lock);
+	if (b && b != a)
+		rtdm_lock_get(&b->lock);
+}
+
+static void unlock_bucket_pair(struct rt_sock_bucket *a,
+			       struct rt_sock_bucket *b)
+{
+	if (b && b != a)
+		rtdm_lock_put(&b->lock);
+	if (a)
+		rtdm_lock_put(&a->lock);
+}
+
+/***
+ *  Lock the buckets of two ports at once. Buckets of the current
+ *  array are taken before those of the array being filled: each of
+ *  the latter is fed by a single bucket of the former, which writers
+ *  lock first, so this order cannot deadlock. Call within a lookup
+ *  window.
+ */
+static void lock_port_pair(struct rt_sock_table *table,
+			   u16 sport1, struct port_buckets *pb1,
+			   u16 sport2, struct port_buckets *pb2)
+{
+	struct rt_sock_hash *hash = smp_load_acquire(&table->hash);
+
+	pb1->hash = hash;
+	pb1->bucket = rt_sock_hash_bucket(hash, sport1);
+	pb2->hash = hash;
+	pb2->bucket = rt_sock_hash_bucket(hash, sport2);
+	lock_bucket_pair(pb1->bucket, pb2->bucket);
+
+	find_next_bucket(pb1, sport1);
+	find_next_bucket(pb2, sport2);
+	lock_bucket_pair(pb1->next_bucket, pb2->next_bucket);
+}
+
+static void unlock_port_pair(struct port_buckets *pb1,
+			     struct port_buckets *pb2)
+{
+	unlock_bucket_pair(pb1->next_bucket, pb2->next_bucket);
+	unlock_bucket_pair(pb1->bucket, pb2->bucket);
+}
+
+/* Bucket lock held. */
+static inline void bucket_leave_begin(struct rt_sock_bucket *bucket)
+{
+	WRITE_ONCE(bucket->seq, bucket->seq + 1);
+	smp_wmb();
+}
+
+static inline void bucket_leave_end(struct rt_sock_bucket *bucket)
+{
+	smp_wmb();
+	WRITE_ONCE(bucket->seq, bucket->seq + 1);
+}
+
+/* Whether a node other than self is bound to an overlapping address. */
+static bool port_in_use(struct rt_sock_hash *hash,
+			struct rt_sock_bucket *bucket,
+			struct rt_sock_node *self, u32 saddr, u16 sport)
+{
+	struct rt_sock_node *node;
+	struct hlist_node *pos;
+
+	hlist_for_each(pos, &bucket->head) {
+		node = container_of(pos - hash->link, struct rt_sock_node,
+				    link[0]);
+		if (node != self && rt_sock_node_match(node, saddr, sport))
+			return true;
+	}
+
+	return false;
+}
+
+/***
+ *  rt_sock_table_insert - hash a node on saddr:sport
+ *
+ *  Returns -EADDRINUSE if a node bound to an overlapping address is
+ *  hashed already.
+ */
+int rt_sock_table_insert(struct rt_sock_table *table,
+			 struct rt_sock_node *node, u32 saddr, u16 sport)
+{
+	struct rt_sock_bucket *bucket;
+	struct rt_sock_hash *hash;
+	struct port_buckets pb;
+	rtdm_lockctx_t context;
+	int ret = 0;
+
+	rtdm_lock_irqsave(context);
+	rt_sock_lookup_begin();
+	lock_port(table, sport, &pb);
+
+	if (pb.next_bucket) {
+		hash = pb.next_hash;
+		bucket = pb.next_bucket;
+	} else {
+		hash = pb.hash;
+		bucket = pb.bucket;
+	}
+
+	if (rt_sock_bucket_search(hash, bucket, saddr, sport)) {
+		ret = -EADDRINUSE;
+		goto unlock;
+	}
+
+	node->saddr = saddr;
+	node->sport = sport;
+	hlist_add_head_rcu(&node->link[hash->link], &bucket->head);
+unlock:
+	unlock_port(&pb);
+	rt_sock_lookup_end();
+	rtdm_lock_irqrestore(context);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(rt_sock_table_insert);
+
+/***
+ *  rt_sock_table_remove - unhash a node
+ *
+ *  The node may be reused or released on return, no lookup can
+ *  observe it anymore.
+ */
+void rt_sock_table_remove(struct rt_sock_table *table,
+			  struct rt_sock_node *node)
+{
+	struct port_buckets pb;
+	rtdm_lockctx_t context;
+	unsigned int link;
+
+	if (!rt_sock_node_hashed(node))
+		return;
+
+	rtdm_lock_irqsave(context);
+	rt_sock_lookup_begin();
+	lock_port(table, node->sport, &pb);
+
+	/*
+	 * Chains of a moved bucket are left alone: lookups walking one
+	 * keep going through the next pointers of its nodes, the rest
+	 * go for the new array. The link which is not hashed is only
+	 * marked as such, it may still be part of such a chain.
+	 */
+	link = pb.next_bucket ? pb.next_hash->link : pb.hash->link;
+	hlist_del_init_rcu(&node->link[link]);
+	node->link[!link].pprev = NULL;
+
+	unlock_port(&pb);
+	rt_sock_lookup_end();
+	rtdm_lock_irqrestore(context);
+
+	wait_lookups();
+}
+EXPORT_SYMBOL_GPL(rt_sock_table_remove);
+
+/***
+ *  rt_sock_table_rebind - move a node to saddr:sport
+ *
+ *  Lookups find the node on either address while it moves, never
+ *  on none. On -EADDRINUSE, the node is left on its former address.
+ */
+int rt_sock_table_rebind(struct rt_sock_table *table,
+			 struct rt_sock_node *node, u32 saddr, u16 sport)
+{
+	struct port_buckets opb, npb;
+	struct rt_sock_bucket *bucket;
+	struct rt_sock_hash *hash;
+	rtdm_lockctx_t context;
+	unsigned int link;
+	int ret = 0;
+
+	if (!rt_sock_node_hashed(node))
+		return rt_sock_table_insert(table, node, saddr, sport);
+
+	rtdm_lock_irqsave(context);
+	rt_sock_lookup_begin();
+	lock_port_pair(table, node->sport, &opb, sport, &npb);
+
+	if (npb.next_bucket) {
+		hash = npb.next_hash;
+		bucket = npb.next_bucket;
+	} else {
+		hash = npb.hash;
+		bucket = npb.bucket;
+	}
+
+	if (port_in_use(hash, bucket, node, saddr, sport)) {
+		ret = -EADDRINUSE;
+		goto unlock;
+	}
+
+	/*
+	 * The link may be reused right away, including the one left
+	 * in the chain of a moved bucket: lookups sent astray retry.
+	 */
+	bucket_leave_begin(opb.bucket);
+	if (opb.next_bucket)
+		bucket_leave_begin(opb.next_bucket);
+
+	link = opb.next_bucket ? opb.next_hash->link : opb.hash->link;
+	hlist_del_init_rcu(&node->link[link]);
+	node->link[!link].pprev = NULL;
+
+	WRITE_ONCE(node->saddr, saddr);
+	WRITE_ONCE(node->sport, sport);
+	hlist_add_head_rcu(&node->link[hash->link], &bucket->head);
+
+	if (opb.next_bucket)
+		bucket_leave_end(opb.next_bucket);
+	bucket_leave_end(opb.bucket);
+unlock:
+	unlock_port_pair(&opb, &npb);
+	rt_sock_lookup_end();
+	rtdm_lock_irqrestore(context);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(rt_sock_table_rebind);
+
+/* Double the bucket array, moving one bucket at a time. */
+static void grow_table(struct rt_sock_table *table)
+{
+	struct rt_sock_hash *old, *new;
+	struct rt_sock_bucket *bucket;
+	struct rt_sock_node *node;
+	struct hlist_node *pos;
+	rtdm_lockctx_t context;
+	unsigned int n;
+
+	mutex_lock(&table->resize_lock);
+
+	if (atomic_read(&table->count) <= table->size)
+		goto out;
+
+	old = table->hash;
+	new = alloc_hash(table->size * 2, !old->link);
+	if (new == NULL)
+		/* Keep going with longer chains. */
+		goto out;
+
+	WRITE_ONCE(old->next, new);
+
+	for (n = 0; n <= old->mask; n++) {
+		bucket = &old->buckets[n];
+		rtdm_lock_get_irqsave(&bucket->lock, context);
+
+		hlist_for_each(pos, &bucket->head) {
+			node = container_of(pos - old->link,
+					    struct rt_sock_node, link[0]);
+			hlist_add_head_rcu(&node->link[new->link],
+					   &rt_sock_hash_bucket(new,
+							node->sport)->head);
+		}
+		smp_store_release(&bucket->migrated, 1);
+
+		rtdm_lock_put_irqrestore(&bucket->lock, context);
+	}
+
+	smp_store_release(&table->hash, new);
+	table->size *= 2;
+
+	wait_lookups();
+	kvfree(old);
+out:
+	mutex_unlock(&table->resize_lock);
+}
+
+/***
+ *  rt_sock_table_reserve - account for a new socket
+ *
+ *  Grows the table if needed, so this requires non realtime context.
+ */
+void rt_sock_table_reserve(struct rt_sock_table *table)
+{
+	if (atomic_inc_return(&table->count) > READ_ONCE(table->size))
+		grow_table(table);
+}
+EXPORT_SYMBOL_GPL(rt_sock_table_reserve);
+
+void rt_sock_table_unreserve(struct rt_sock_table *table)
+{
+	atomic_dec(&table->count);
+}
+EXPORT_SYMBOL_GPL(rt_sock_table_unreserve);
+
+/***
+ *  rt_sock_table_for_each - call fn on every hashed node
+ *
+ *  fn runs under the bucket lock with hard irqs off. Requires non
+ *  realtime context.
+ */
+void rt_sock_table_for_each(struct rt_sock_table *table,
+			    void (*fn)(struct rt_sock_node *node, void *arg),
+			    void *arg)
+{
+	struct rt_sock_bucket *bucket;
+	struct rt_sock_hash *hash;
+	struct hlist_node *pos;
+	rtdm_lockctx_t context;
+	unsigned int n;
+
+	mutex_lock(&table->resize_lock);
+
+	hash = table->hash;
+	for (n = 0; n <= hash->mask; n++) {
+		bucket = &hash->buckets[n];
+		rtdm_lock_get_irqsave(&bucket->lock, context);
+		hlist_for_each(pos, &bucket->head)
+			fn(container_of(pos - hash->link,
+					struct rt_sock_node, link[0]), arg);
+		rtdm_lock_put_irqrestore(&bucket->lock, context);
+	}
+
+	mutex_unlock(&table->resize_lock);
+}
+EXPORT_SYMBOL_GPL(rt_sock_table_for_each);
+
+/***
+ *  rt_sock_table_init - set up a table
+ *  @buckets: initial number of buckets, must be a power of 2
+ */
+int rt_sock_table_init(struct rt_sock_table *table, unsigned int buckets)
+{
+	table->hash = alloc_hash(buckets, 0);
+	if (table->hash == NULL)
+		return -ENOMEM;
+
+	table->size = buckets;
+	atomic_set(&table->count, 0);
+	mutex_init(&table->resize_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(rt_sock_table_init);
+
+void rt_sock_table_destroy(struct rt_sock_table *table)
+{
+	kvfree(table->hash);
+	table->hash = NULL;
+}
+EXPORT_SYMBOL_GPL(rt_sock_table_destroy);
@@ -28,6 +28,7 @@
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/completion.h>
+#include <linux/idr.h>
 #include <net/tcp_states.h>
 #include <net/tcp.h>
 
@@ -43,6 +44,7 @@
 #include <ipv4/ip_fragment.h>
 #include <ipv4/route.h>
 #include <ipv4/af_inet.h>
+#include <ipv4/sock_table.h>
 #include "timerwheel.h"
 
 static unsigned int close_timeout = 1000;
@@ -113,9 +115,9 @@ struct tcp_keepalive {
 };
 
 /***
- *  This structure is used to register a TCP socket for reception. All
- *  structures are kept in the port_registry array to increase the cache
- *  locality during the critical port lookup in rt_tcp_v4_lookup().
+ *  This structure is registered for reception in port_table, which grows
+ *  with the number of sockets. The critical port lookup in
+ *  rt_tcp_v4_lookup() takes no lock, see ipv4/sock_table.h.
  */
 
 /* if dport & daddr are zeroes, it means a listening socket */
@@ -146,7 +148,7 @@ struct tcp_socket {
 	struct tcp_keepalive keepalive;
 	rtdm_lock_t socket_lock;
 
-	struct hlist_node link;
+	struct rt_sock_node node;
 
 	nanosecs_rel_t sk_sndtimeo;
 
@@ -176,13 +178,14 @@ struct rt_tcp_dispatched_packet_send_cmd {
 
  *  The automatic assignment of port numbers to unbound sockets is realised as
  *  a simple addition of two values:
- *   - the socket ID (lower 8 bits of file descriptor) which is set during
- *     initialisation and left unchanged afterwards
+ *   - the socket index which is allocated on creation and left unchanged
+ *     afterwards
  *   - the start value tcp_auto_port_start which is a module parameter
 
  *  tcp_auto_port_mask, also a module parameter, is used to define the range of
  *  port numbers which are used for automatic assignment. Any number within
- *  this range will be rejected when passed to bind_rt().
+ *  this range will be rejected when passed to bind_rt(). The size of the
+ *  range bounds the number of TCP sockets.
 
  */
 
@@ -190,6 +193,12 @@ MODULE_LICENSE("GPL");
 
 static struct {
 	struct rtdm_dev_context dummy;
+
+	/*
+     *  Socket for RST|ACK replies, which may be sent concurrently by
+     *  several stack manager tasks. Only its skb_pool and static
+     *  fields are used, see rt_tcp_send_rst().
+     */
 	struct tcp_socket rst_socket;
 } rst_socket_container;
 
@@ -198,16 +207,9 @@ static struct {
 
 static u32 tcp_auto_port_start = 1024;
 static u32 tcp_auto_port_mask = ~(RT_TCP_SOCKETS - 1);
-static u32 free_ports = RT_TCP_SOCKETS;
-#define RT_PORT_BITMAP_WORDS                                                   \
-	((RT_TCP_SOCKETS + BITS_PER_LONG - 1) / BITS_PER_LONG)
-static unsigned long port_bitmap[RT_PORT_BITMAP_WORDS];
-
-static struct tcp_socket *port_registry[RT_TCP_SOCKETS];
-static DEFINE_RTDM_LOCK(tcp_socket_base_lock);
-
-static struct hlist_head port_hash[RT_TCP_SOCKETS * 2];
-#define port_hash_mask (RT_TCP_SOCKETS * 2 - 1)
+static unsigned int nr_auto_ports;
+static DEFINE_IDA(port_ida);
+static struct rt_sock_table port_table;
 
 module_param(tcp_auto_port_start, uint, 0444);
 module_param(tcp_auto_port_mask, uint, 0444);
@@ -216,41 +218,9 @@ MODULE_PARM_DESC(tcp_auto_port_start, "Start of automatically assigned "
 MODULE_PARM_DESC(tcp_auto_port_mask, "Mask that defines port range for TCP "
 				     "for automatic assignment");
 
-static inline struct tcp_socket *port_hash_search(u32 saddr, u16 sport)
+static inline u16 tcp_auto_port(int index)
 {
-	u32 bucket = sport & port_hash_mask;
-	struct tcp_socket *ts;
-
-	hlist_for_each_entry (ts, &port_hash[bucket], link)
-		if (ts->sport == sport &&
-		    (saddr == INADDR_ANY || ts->saddr == saddr ||
-		     ts->saddr == INADDR_ANY))
-			return ts;
-
-	return NULL;
-}
-
-static int port_hash_insert(struct tcp_socket *ts, u32 saddr, u16 sport)
-{
-	u32 bucket;
-
-	if (port_hash_search(saddr, sport))
-		return -EADDRINUSE;
-
-	bucket = sport & port_hash_mask;
-	ts->saddr = saddr;
-	ts->sport = sport;
-	ts->daddr = 0;
-	ts->dport = 0;
-
-	hlist_add_head(&ts->link, &port_hash[bucket]);
-
-	return 0;
-}
-
-static inline void port_hash_del(struct tcp_socket *ts)
-{
-	hlist_del(&ts->link);
+	return htons(ntohs(tcp_auto_port_start) + index);
 }
 
 /***
@@ -258,26 +228,27 @@ static inline void port_hash_del(struct tcp_socket *ts)
  */
 static struct rtsocket *rt_tcp_v4_lookup(u32 daddr, u16 dport)
 {
+	struct rtsocket *sock = NULL;
+	struct rt_sock_node *node;
 	rtdm_lockctx_t context;
 	struct tcp_socket *ts;
 	int ret;
 
-	rtdm_lock_get_irqsave(&tcp_socket_base_lock, context);
-	ts = port_hash_search(daddr, dport);
+	rtdm_lock_irqsave(context);
+	rt_sock_lookup_begin();
 
-	if (ts != NULL) {
+	node = rt_sock_table_search(&port_table, daddr, dport);
+	if (node != NULL) {
+		ts = container_of(node, struct tcp_socket, node);
 		ret = rt_socket_reference(&ts->sock);
-		if (ret == 0 || (ret == -EIDRM && ts->is_closed)) {
-			rtdm_lock_put_irqrestore(&tcp_socket_base_lock,
-						 context);
-
-			return &ts->sock;
-		}
+		if (ret == 0 || (ret == -EIDRM && ts->is_closed))
+			sock = &ts->sock;
 	}
 
-	rtdm_lock_put_irqrestore(&tcp_socket_base_lock, context);
+	rt_sock_lookup_end();
+	rtdm_lock_irqrestore(context);
 
-	return NULL;
+	return sock;
 }
 
 /* test seq1 <= seq2 */
@@ -613,7 +584,7 @@ static int rt_ip_build_frame(struct rtskb *skb, struct rtsocket *sk,
 }
 
 static void rt_tcp_build_header(struct tcp_socket *ts, struct rtskb *skb,
-				__be32 flags, u8 is_keepalive)
+				__be32 flags, u8 is_keepalive, __wsum data_csum)
 {
 	u32 wcheck;
 	u8 tcphdrlen = 20;
@@ -638,13 +609,8 @@ static void rt_tcp_build_header(struct tcp_socket *ts, struct rtskb *skb,
 	th->check = 0;
 	th->urg_ptr = 0;
 
-	/* compute checksum */
-	wcheck = rtnet_csum(th, tcphdrlen, 0);
-
-	if (skb->len - tcphdrlen - iphdrlen) {
-		wcheck = rtnet_csum(skb->data + tcphdrlen + iphdrlen,
-				      skb->len - tcphdrlen - iphdrlen, wcheck);
-	}
+	/* compute checksum, the payload was summed while copied */
+	wcheck = rtnet_csum(th, tcphdrlen, data_csum);
 
 	th->check =
 		tcp_v4_check(skb->len - iphdrlen, ts->saddr, ts->daddr, wcheck);
@@ -668,6 +634,7 @@ static int rt_tcp_segment(struct dest_route *rt, struct tcp_socket *ts,
 	u32 prio = (volatile unsigned int)sk->priority;
 	u32 mtu = rtdev->get_mtu(rtdev, prio);
 
+	__wsum data_csum = 0;
 	u8 *data = NULL;
 
 	if ((skb = alloc_rtskb(mtu + hh_len + 15, &sk->skb_pool)) == NULL) {
@@ -687,10 +654,7 @@ static int rt_tcp_segment(struct dest_route *rt, struct tcp_socket *ts,
 	if (data_len) { /* check for available place */
 		data = (u8 *)rtskb_put(skb,
 				       data_len); /* length of TCP payload */
-		if (!memcpy(data, (void *)data_ptr, data_len)) {
-			ret = -EFAULT;
-			goto error;
-		}
+		data_csum = rtnet_csum_copy(data_ptr, data, data_len, 0);
 	}
 
 	/* used local phy MTU value */
@@ -699,12 +663,13 @@ static int rt_tcp_segment(struct dest_route *rt, struct tcp_socket *ts,
 
 	skb->rtdev = rtdev;
 	skb->priority = prio;
+	rtskb_set_queue_mapping(skb, sk->tx_queue);
 
 	/* do not validate socket connection on xmit
        this should be done at upper level */
 
 	rtdm_lock_get_irqsave(&ts->socket_lock, context);
-	rt_tcp_build_header(ts, skb, flags, is_keepalive);
+	rt_tcp_build_header(ts, skb, flags, is_keepalive, data_csum);
 
 	if ((ret = rt_ip_build_frame(skb, sk, rt, iph)) != 0) {
 		rtdm_lock_put_irqrestore(&ts->socket_lock, context);
@@ -773,6 +738,75 @@ static int rt_tcp_send(struct tcp_socket *ts, __be32 flags)
 	return ret;
 }
 
+/***
+ *  rt_tcp_send_rst - reply with a RST|ACK to a segment for which no
+ *  connection exists
+ *
+ *  The addresses and ports are those of the incoming segment @skb.
+ *  Nothing is stored in rst_socket, so this may run concurrently.
+ */
+static void rt_tcp_send_rst(struct rtskb *skb, u32 seq, u32 ack_seq)
+{
+	struct rtsocket *sk = &rst_socket.sock;
+	u32 saddr = skb->nh.iph->daddr;
+	u32 daddr = skb->nh.iph->saddr;
+	struct tcphdr *th = skb->h.th;
+	struct rtnet_device *rtdev;
+	struct rtskb *rst_skb;
+	struct dest_route rt;
+	struct tcphdr *rst_th;
+	struct iphdr *iph;
+	u32 hh_len;
+
+	if (rt_ip_route_output(&rt, daddr, saddr) != 0)
+		return;
+
+	rtdev = rt.rtdev;
+	hh_len = (rtdev->hard_header_len + 15) & ~15;
+
+	rt_socket_reference(sk);
+
+	rst_skb = alloc_rtskb(hh_len + 40 + 15, &sk->skb_pool);
+	if (rst_skb == NULL) {
+		pr_err("no more elements in skb_pool for allocation\n");
+		goto fail;
+	}
+
+	rtskb_reserve(rst_skb, hh_len);
+	iph = (struct iphdr *)rtskb_put(rst_skb, 20);
+	rst_th = (struct tcphdr *)rtskb_put(rst_skb, 20);
+	rst_skb->h.th = rst_th;
+	rst_skb->rtdev = rtdev;
+	rst_skb->priority = sk->priority;
+	rtskb_set_queue_mapping(rst_skb, sk->tx_queue);
+
+	rst_th->source = th->dest;
+	rst_th->dest = th->source;
+	rst_th->seq = htonl(seq);
+	tcp_flag_word(rst_th) = TCP_FLAG_RST | TCP_FLAG_ACK;
+	rst_th->ack_seq = htonl(ack_seq);
+	rst_th->window = 0;
+	rst_th->doff = 20 >> 2;
+	rst_th->res1 = 0;
+	rst_th->check = 0;
+	rst_th->urg_ptr = 0;
+	rst_th->check = tcp_v4_check(20, saddr, daddr,
+				     rtnet_csum(rst_th, 20, 0));
+
+	if (rt_ip_build_frame(rst_skb, sk, &rt, iph) != 0) {
+		kfree_rtskb(rst_skb);
+		goto fail;
+	}
+
+	rtdev_xmit(rst_skb);
+	rtdev_dereference(rtdev);
+
+	return;
+fail:
+	rt_socket_dereference(sk);
+	rtdev_dereference(rtdev);
+}
+
 #ifdef YET_UNUSED
 static void rt_tcp_keepalive_timer(rtdm_timer_t *timer)
 {
@@ -826,7 +860,6 @@ static struct rtsocket *rt_tcp_dest_socket(struct rtskb *skb)
 
 	u32 saddr = skb->nh.iph->saddr;
 	u32 daddr = skb->nh.iph->daddr;
-	u32 sport = th->source;
 	u32 dport = th->dest;
 
 	u32 data_len;
@@ -844,24 +877,9 @@ static struct rtsocket *rt_tcp_dest_socket(struct rtskb *skb)
 		*/
 		if (!th->rst) {
 			/* No listening socket found, send RST|ACK */
-			rst_socket.saddr = daddr;
-			rst_socket.daddr = saddr;
-			rst_socket.sport = dport;
-			rst_socket.dport = sport;
-
 			data_len = skb->len - (th->doff << 2);
-
-			rst_socket.sync.seq = 0;
-			rst_socket.sync.ack_seq =
-				rt_tcp_compute_ack_seq(th, data_len);
-
-			if (rt_ip_route_output(&rst_socket.rt, daddr, saddr) ==
-			    0) {
-				rt_socket_reference(&rst_socket.sock);
-				rt_tcp_send(&rst_socket,
-					    TCP_FLAG_ACK | TCP_FLAG_RST);
-				rtdev_dereference(rst_socket.rt.rtdev);
-			}
+			rt_tcp_send_rst(skb, 0,
+					rt_tcp_compute_ack_seq(th, data_len));
 		}
 	}
 
@@ -996,20 +1014,8 @@ static void rt_tcp_rcv(struct rtskb *skb)
 			 ts->sync.ack_seq + ts->sync.window);
 
 		/* That's a forced RST for a lost connection */
-		rst_socket.saddr = skb->nh.iph->daddr;
-		rst_socket.daddr = skb->nh.iph->saddr;
-		rst_socket.sport = th->dest;
-		rst_socket.dport = th->source;
-
-		rst_socket.sync.seq = ntohl(th->ack_seq);
-		rst_socket.sync.ack_seq = rt_tcp_compute_ack_seq(th, data_len);
-
-		if (rt_ip_route_output(&rst_socket.rt, rst_socket.daddr,
-				       rst_socket.saddr) == 0) {
-			rt_socket_reference(&rst_socket.sock);
-			rt_tcp_send(&rst_socket, TCP_FLAG_RST | TCP_FLAG_ACK);
-			rtdev_dereference(rst_socket.rt.rtdev);
-		}
+		rt_tcp_send_rst(skb, ntohl(th->ack_seq),
+				rt_tcp_compute_ack_seq(th, data_len));
 		goto drop;
 	}
 
@@ -1077,9 +1083,11 @@ static void rt_tcp_rcv(struct rtskb *skb)
 			/* Need to store ts->seq while sending SYN earlier */
 			/* The socket shall be in TCP_LISTEN state */
 
-			/* safe to update ts->saddr here due to a single task for
-	       rt_tcp_rcv() and rt_tcp_dest_socket() callers */
+			/* safe to update ts->saddr here, the stack manager tasks
+	       serialize on the socket lock and only the first SYN
+	       finds the socket in LISTEN state */
 			ts->saddr = skb->nh.iph->daddr;
+			rt_sock_node_set_saddr(&ts->node, ts->saddr);
 
 			ts->daddr = skb->nh.iph->saddr;
 			ts->dport = th->source;
@@ -1209,8 +1217,7 @@ static void rt_tcp_close_signal_handler(rtdm_nrtsig_t *nrtsig, void *arg)
 
 static int rt_tcp_socket_create(struct tcp_socket *ts)
 {
-	rtdm_lockctx_t context;
-	int i;
+	int ret;
 	int index;
 	struct rtsocket *sock = &ts->sock;
 
@@ -1253,31 +1260,31 @@ static int rt_tcp_socket_create(struct tcp_socket *ts)
 	ts->multi_error = multi_error;
 #endif /* CONFIG_XENO_DRIVERS_NET_RTIPV4_TCP_ERROR_INJECTION */
 
-	rtdm_lock_get_irqsave(&tcp_socket_base_lock, context);
-
 	/* enforce maximum number of TCP sockets */
-	if (free_ports == 0) {
-		rtdm_lock_put_irqrestore(&tcp_socket_base_lock, context);
+	index = ida_alloc_max(&port_ida, nr_auto_ports - 1, GFP_KERNEL);
+	if (index < 0) {
 		rtdm_nrtsig_destroy(&ts->close_sig);
-		return -EAGAIN;
+		return index == -ENOSPC ? -EAGAIN : index;
 	}
-	free_ports--;
-
-	/* find free auto-port in bitmap */
-	for (i = 0; i < RT_PORT_BITMAP_WORDS; i++)
-		if (port_bitmap[i] != (unsigned long)-1)
-			break;
-	index = ffz(port_bitmap[i]);
-	set_bit(index, &port_bitmap[i]);
-	index += i * 32;
 	sock->prot.inet.reg_index = index;
-	sock->prot.inet.sport = index + tcp_auto_port_start;
+	sock->prot.inet.sport = tcp_auto_port(index);
 
 	/* register TCP socket */
-	port_registry[index] = ts;
-	port_hash_insert(ts, INADDR_ANY, sock->prot.inet.sport);
+	rt_sock_node_init(&ts->node);
+	rt_sock_table_reserve(&port_table);
+	ret = rt_sock_table_insert(&port_table, &ts->node, INADDR_ANY,
+				   sock->prot.inet.sport);
+	if (ret) {
+		rt_sock_table_unreserve(&port_table);
+		ida_free(&port_ida, index);
+		rtdm_nrtsig_destroy(&ts->close_sig);
+		return ret;
+	}
 
-	rtdm_lock_put_irqrestore(&tcp_socket_base_lock, context);
+	ts->saddr = INADDR_ANY;
+	ts->sport = sock->prot.inet.sport;
+	ts->daddr = 0;
+	ts->dport = 0;
 
 	return 0;
 }
@@ -1327,17 +1334,14 @@ static void rt_tcp_socket_destruct(struct tcp_socket *ts)
 	pr_debug("rt_tcp_socket_destruct 0x%p\n", ts);
 	*/
 
-	rtdm_lock_get_irqsave(&tcp_socket_base_lock, context);
 	if (sock->prot.inet.reg_index >= 0) {
 		index = sock->prot.inet.reg_index;
 
-		clear_bit(index % BITS_PER_LONG,
-			  &port_bitmap[index / BITS_PER_LONG]);
-		port_hash_del(port_registry[index]);
-		free_ports++;
+		rt_sock_table_remove(&port_table, &ts->node);
+		rt_sock_table_unreserve(&port_table);
+		ida_free(&port_ida, index);
 		sock->prot.inet.reg_index = -1;
 	}
-	rtdm_lock_put_irqrestore(&tcp_socket_base_lock, context);
 
 	rtdm_lock_get_irqsave(&ts->socket_lock, context);
 
@@ -1475,29 +1479,28 @@ static int rt_tcp_bind(struct rtdm_fd *fd, struct tcp_socket *ts,
 	ts->is_binding = 1;
 	rtdm_lock_put_irqrestore(&ts->socket_lock, context);
 
-	rtdm_lock_get_irqsave(&tcp_socket_base_lock, context);
-
 	if ((index = ts->sock.prot.inet.reg_index) < 0) {
 		/* socket is destroyed */
 		ret = -EBADF;
-		goto unlock_out;
+		goto out;
 	}
 
-	port_hash_del(ts);
-	if (port_hash_insert(ts, usin->sin_addr.s_addr,
-			     usin->sin_port ?: index + tcp_auto_port_start)) {
-		port_hash_insert(ts, ts->saddr, ts->sport);
-
-		ret = -EADDRINUSE;
-		goto unlock_out;
-	}
+	ret = rt_sock_table_rebind(&port_table, &ts->node,
+				   usin->sin_addr.s_addr,
+				   usin->sin_port ?: tcp_auto_port(index));
+	if (ret)
+		goto out;
 
 	bound = 1;
 
-unlock_out:
-	rtdm_lock_put_irqrestore(&tcp_socket_base_lock, context);
-
+out:
 	rtdm_lock_get_irqsave(&ts->socket_lock, context);
+	if (bound) {
+		ts->saddr = ts->node.saddr;
+		ts->sport = ts->node.sport;
+		ts->daddr = 0;
+		ts->dport = 0;
+	}
 	ts->is_bound = bound;
 	ts->is_binding = 0;
 	rtdm_lock_put_irqrestore(&ts->socket_lock, context);
@@ -1553,6 +1556,7 @@ static int rt_tcp_connect(struct rtdm_fd *fd, struct tcp_socket *ts,
 		rtdev_dereference(rt.rtdev);
 
 	ts->saddr = rt.rtdev->local_ip;
+	rt_sock_node_set_saddr(&ts->node, ts->saddr);
 
 	ts->daddr = usin->sin_addr.s_addr;
 	ts->dport = usin->sin_port;
@@ -2320,46 +2324,32 @@ static inline char *rt_tcp_string_of_state(u8 state)
 	}
 }
 
-static int rtnet_ipv4_tcp_show(struct xnvfile_regular_iterator *it, void *data)
+static void rtnet_ipv4_tcp_show_socket(struct rt_sock_node *node, void *arg)
 {
-	rtdm_lockctx_t context;
-	struct tcp_socket *ts;
-	u32 saddr, daddr;
-	u16 sport = 0, dport = 0; /* set to 0 to silence compiler */
+	struct xnvfile_regular_iterator *it = arg;
+	struct tcp_socket *ts = container_of(node, struct tcp_socket, node);
 	char sbuffer[24];
 	char dbuffer[24];
-	int state;
-	int index;
 
-	xnvfile_printf(it, "Hash    Local Address           "
-			   "Foreign Address         State\n");
-
-	for (index = 0; index < RT_TCP_SOCKETS; index++) {
-		rtdm_lock_get_irqsave(&tcp_socket_base_lock, context);
-
-		ts = port_registry[index];
-		state = ts ? ts->tcp_state : TCP_CLOSE;
+	if (ts->tcp_state == TCP_CLOSE)
+		return;
 
-		if (ts && ts->tcp_state != TCP_CLOSE) {
-			saddr = ts->saddr;
-			sport = ts->sport;
-			daddr = ts->daddr;
-			dport = ts->dport;
-		}
+	snprintf(sbuffer, sizeof(sbuffer), "%u.%u.%u.%u:%u",
+		 NIPQUAD(ts->saddr), ntohs(ts->sport));
+	snprintf(dbuffer, sizeof(dbuffer), "%u.%u.%u.%u:%u",
+		 NIPQUAD(ts->daddr), ntohs(ts->dport));
 
-		rtdm_lock_put_irqrestore(&tcp_socket_base_lock, context);
+	xnvfile_printf(it, "%04X    %-23s %-23s %s\n",
+		       ts->sport & (port_table.size - 1), sbuffer, dbuffer,
+		       rt_tcp_string_of_state(ts->tcp_state));
+}
 
-		if (state != TCP_CLOSE) {
-			snprintf(sbuffer, sizeof(sbuffer), "%u.%u.%u.%u:%u",
-				 NIPQUAD(saddr), ntohs(sport));
-			snprintf(dbuffer, sizeof(dbuffer), "%u.%u.%u.%u:%u",
-				 NIPQUAD(daddr), ntohs(dport));
+static int rtnet_ipv4_tcp_show(struct xnvfile_regular_iterator *it, void *data)
+{
+	xnvfile_printf(it, "Hash    Local Address           "
+			   "Foreign Address         State\n");
 
-			xnvfile_printf(it, "%04X    %-23s %-23s %s\n",
-				       sport & port_hash_mask, sbuffer, dbuffer,
-				       rt_tcp_string_of_state(state));
-		}
-	}
+	rt_sock_table_for_each(&port_table, rtnet_ipv4_tcp_show_socket, it);
 
 	return 0;
 }
@@ -2397,18 +2387,19 @@ static void rt_tcp_proc_unregister(void)
 static int __init rt_tcp_init(void)
 {
 	unsigned int skbs;
-	int i;
 	int ret;
 
+	nr_auto_ports = (~tcp_auto_port_mask & 0xFFFF) + 1;
 	if ((tcp_auto_port_start < 0) ||
-	    (tcp_auto_port_start >= 0x10000 - RT_TCP_SOCKETS))
+	    (tcp_auto_port_start >= 0x10000 - nr_auto_ports))
 		tcp_auto_port_start = 1024;
 	tcp_auto_port_start =
 		htons(tcp_auto_port_start & (tcp_auto_port_mask & 0xFFFF));
 	tcp_auto_port_mask = htons(tcp_auto_port_mask | 0xFFFF0000);
 
-	for (i = 0; i < ARRAY_SIZE(port_hash); i++)
-		INIT_HLIST_HEAD(&port_hash[i]);
+	ret = rt_sock_table_init(&port_table, RT_TCP_SOCKETS * 2);
+	if (ret < 0)
+		return ret;
 
 	/* Perform essential initialization of the RST|ACK socket */
 	skbs = rt_bare_socket_init(rst_fd, IPPROTO_TCP, RT_TCP_RST_PRIO,
@@ -2416,7 +2407,7 @@ static int __init rt_tcp_init(void)
 	if (skbs < RT_TCP_RST_POOL_SIZE)
 		pr_debug("allocated only %d RST|ACK rtskbs\n", skbs);
 	rst_socket.sock.prot.inet.tos = 0;
-	rst_fd->refs = 1;
+	atomic_set(&rst_fd->refs, 1);
 	rtdm_lock_init(&rst_socket.socket_lock);
 
 	/*
@@ -2456,6 +2447,7 @@ out_2:
 
 out_1:
 	rt_bare_socket_cleanup(&rst_socket.sock);
+	rt_sock_table_destroy(&port_table);
 
 	return ret;
 }
@@ -2476,6 +2468,9 @@ static void __exit rt_tcp_release(void)
 	rt_bare_socket_cleanup(&rst_socket.sock);
 
 	rtdm_dev_unregister(&tcp_device);
+
+	rt_sock_table_destroy(&port_table);
+	ida_destroy(&port_ida);
 }
 
 module_init(rt_tcp_init);
@@ -32,6 +32,7 @@
 #include <linux/udp.h>
 #include <linux/tcp.h>
 #include <linux/list.h>
+#include <linux/idr.h>
 
 #include <rtdm/compat.h>
 #include <rtskb.h>
@@ -45,18 +46,17 @@
 #include <ipv4/ip_sock.h>
 #include <ipv4/protocol.h>
 #include <ipv4/route.h>
+#include <ipv4/sock_table.h>
 #include <ipv4/udp.h>
 
 /***
- *  This structure is used to register a UDP socket for reception. All
- +  structures are kept in the port_registry array to increase the cache
- *  locality during the critical port lookup in rt_udp_v4_lookup().
+ *  UDP sockets are registered for reception in port_table, which grows
+ *  with the number of sockets. The critical port lookup in
+ *  rt_udp_v4_lookup() takes no lock, see ipv4/sock_table.h.
  */
 struct udp_socket {
-	u16 sport; /* local port */
-	u32 saddr; /* local ip-addr */
-	struct rtsocket *sock;
-	struct hlist_node link;
+	struct rtsocket sock; /* set up by rt_socket_init() implicitly */
+	struct rt_sock_node node;
 };
 
 /***
@@ -64,26 +64,21 @@ struct udp_socket {
 
  *  The automatic assignment of port numbers to unbound sockets is realised as
  *  a simple addition of two values:
- *   - the socket ID (lower 8 bits of file descriptor) which is set during
- *     initialisation and left unchanged afterwards
+ *   - the socket index which is allocated on creation and left unchanged
+ *     afterwards
  *   - the start value auto_port_start which is a module parameter
 
  *  auto_port_mask, also a module parameter, is used to define the range of
  *  port numbers which are used for automatic assignment. Any number within
- *  this range will be rejected when passed to bind_rt().
+ *  this range will be rejected when passed to bind_rt(). The size of the
+ *  range bounds the number of UDP sockets.
 
  */
 static unsigned int auto_port_start = 1024;
 static unsigned int auto_port_mask = ~(RT_UDP_SOCKETS - 1);
-static int free_ports = RT_UDP_SOCKETS;
-#define RT_PORT_BITMAP_WORDS                                                   \
-	((RT_UDP_SOCKETS + BITS_PER_LONG - 1) / BITS_PER_LONG)
-static unsigned long port_bitmap[RT_PORT_BITMAP_WORDS];
-static struct udp_socket port_registry[RT_UDP_SOCKETS];
-static DEFINE_RTDM_LOCK(udp_socket_base_lock);
-
-static struct hlist_head port_hash[RT_UDP_SOCKETS * 2];
-#define port_hash_mask (RT_UDP_SOCKETS * 2 - 1)
+static unsigned int nr_auto_ports;
+static DEFINE_IDA(port_ida);
+static struct rt_sock_table port_table;
 
 MODULE_LICENSE("GPL");
 
@@ -93,38 +88,9 @@ MODULE_PARM_DESC(auto_port_start, "Start of automatically assigned port range");
 MODULE_PARM_DESC(auto_port_mask,
 		 "Mask that defines port range for automatic assignment");
 
-static inline struct udp_socket *port_hash_search(u32 saddr, u16 sport)
+static inline u16 auto_port(int index)
 {
-	unsigned bucket = sport & port_hash_mask;
-	struct udp_socket *sock;
-
-	hlist_for_each_entry (sock, &port_hash[bucket], link)
-		if (sock->sport == sport &&
-		    (saddr == INADDR_ANY || sock->saddr == saddr ||
-		     sock->saddr == INADDR_ANY))
-			return sock;
-
-	return NULL;
-}
-
-static inline int port_hash_insert(struct udp_socket *sock, u32 saddr,
-				   u16 sport)
-{
-	unsigned bucket;
-
-	if (port_hash_search(saddr, sport))
-		return -EADDRINUSE;
-
-	bucket = sport & port_hash_mask;
-	sock->saddr = saddr;
-	sock->sport = sport;
-	hlist_add_head(&sock->link, &port_hash[bucket]);
-	return 0;
-}
-
-static inline void port_hash_del(struct udp_socket *sock)
-{
-	hlist_del(&sock->link);
+	return htons(ntohs(auto_port_start) + index);
 }
 
 /***
@@ -132,20 +98,24 @@ static inline void port_hash_del(struct udp_socket *sock)
  */
 static inline struct rtsocket *rt_udp_v4_lookup(u32 daddr, u16 dport)
 {
+	struct rtsocket *sock = NULL;
+	struct rt_sock_node *node;
 	rtdm_lockctx_t context;
-	struct udp_socket *sock;
 
-	rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
-	sock = port_hash_search(daddr, dport);
-	if (sock && rt_socket_reference(sock->sock) == 0) {
-		rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+	rtdm_lock_irqsave(context);
+	rt_sock_lookup_begin();
 
-		return sock->sock;
+	node = rt_sock_table_search(&port_table, daddr, dport);
+	if (node) {
+		sock = &container_of(node, struct udp_socket, node)->sock;
+		if (rt_socket_reference(sock))
+			sock = NULL;
 	}
 
-	rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+	rt_sock_lookup_end();
+	rtdm_lock_irqrestore(context);
 
-	return NULL;
+	return sock;
 }
 
 /***
@@ -156,6 +126,7 @@ static inline struct rtsocket *rt_udp_v4_lookup(u32 daddr, u16 dport)
 static int rt_udp_bind(struct rtdm_fd *fd, struct rtsocket *sock,
 		       const struct sockaddr __user *addr, socklen_t addrlen)
 {
+	struct udp_socket *us = container_of(sock, struct udp_socket, sock);
 	struct sockaddr_in _sin, *sin;
 	rtdm_lockctx_t context;
 	int index;
@@ -171,7 +142,7 @@ static int rt_udp_bind(struct rtdm_fd *fd, struct rtsocket *sock,
 	if ((sin->sin_port & auto_port_mask) == auto_port_start)
 		return -EINVAL;
 
-	rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+	rtdm_lock_get_irqsave(&sock->param_lock, context);
 
 	if ((index = sock->prot.inet.reg_index) < 0) {
 		/* socket is being closed */
@@ -183,24 +154,20 @@ static int rt_udp_bind(struct rtdm_fd *fd, struct rtsocket *sock,
 		goto unlock_out;
 	}
 
-	port_hash_del(&port_registry[index]);
-	if (port_hash_insert(&port_registry[index], sin->sin_addr.s_addr,
-			     sin->sin_port ?: index + auto_port_start)) {
-		port_hash_insert(&port_registry[index],
-				 port_registry[index].saddr,
-				 port_registry[index].sport);
-		rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
-		return -EADDRINUSE;
-	}
+	err = rt_sock_table_rebind(&port_table, &us->node,
+				   sin->sin_addr.s_addr,
+				   sin->sin_port ?: auto_port(index));
+	if (err)
+		goto unlock_out;
 
 	/* set the source-addr */
-	sock->prot.inet.saddr = port_registry[index].saddr;
+	sock->prot.inet.saddr = us->node.saddr;
 
 	/* set source port, if not set by user */
-	sock->prot.inet.sport = port_registry[index].sport;
+	sock->prot.inet.sport = us->node.sport;
 
 unlock_out:
-	rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+	rtdm_lock_put_irqrestore(&sock->param_lock, context);
 
 	return err;
 }
@@ -229,18 +196,18 @@ static int rt_udp_connect(struct rtdm_fd *fd, struct rtsocket *sock,
 			/* socket is being closed */
 			return -EBADF;
 
-		rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+		rtdm_lock_get_irqsave(&sock->param_lock, context);
 
 		sock->prot.inet.saddr = INADDR_ANY;
 		/* Note: The following line differs from standard
 		   stacks, and we also don't remove the socket from
 		   the port list. Might get fixed in the future... */
-		sock->prot.inet.sport = index + auto_port_start;
+		sock->prot.inet.sport = auto_port(index);
 		sock->prot.inet.daddr = INADDR_ANY;
 		sock->prot.inet.dport = 0;
 		sock->prot.inet.state = TCP_CLOSE;
 
-		rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+		rtdm_lock_put_irqrestore(&sock->param_lock, context);
 	} else {
 		if (addrlen < sizeof(struct sockaddr_in))
 			return -EINVAL;
@@ -252,11 +219,10 @@ static int rt_udp_connect(struct rtdm_fd *fd, struct rtsocket *sock,
 		if (sin->sin_family != AF_INET)
 			return -EINVAL;
 
-		rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+		rtdm_lock_get_irqsave(&sock->param_lock, context);
 
 		if (sock->prot.inet.state != TCP_CLOSE) {
-			rtdm_lock_put_irqrestore(&udp_socket_base_lock,
-						 context);
+			rtdm_lock_put_irqrestore(&sock->param_lock, context);
 			return -EINVAL;
 		}
 
@@ -264,7 +230,7 @@ static int rt_udp_connect(struct rtdm_fd *fd, struct rtsocket *sock,
 		sock->prot.inet.daddr = sin->sin_addr.s_addr;
 		sock->prot.inet.dport = sin->sin_port;
 
-		rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+		rtdm_lock_put_irqrestore(&sock->param_lock, context);
 	}
 
 	return 0;
@@ -276,11 +242,10 @@ static int rt_udp_connect(struct rtdm_fd *fd, struct rtsocket *sock,
  */
 static int rt_udp_socket(struct rtdm_fd *fd)
 {
-	struct rtsocket *sock = rtdm_fd_to_private(fd);
+	struct udp_socket *us = rtdm_fd_to_private(fd);
+	struct rtsocket *sock = &us->sock;
 	int ret;
-	int i;
 	int index;
-	rtdm_lockctx_t context;
 
 	if ((ret = rt_socket_init(fd, IPPROTO_UDP)) != 0)
 		return ret;
@@ -289,34 +254,27 @@ static int rt_udp_socket(struct rtdm_fd *fd)
 	sock->prot.inet.state = TCP_CLOSE;
 	sock->prot.inet.tos = 0;
 
-	rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
-
 	/* enforce maximum number of UDP sockets */
-	if (free_ports == 0) {
-		rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+	index = ida_alloc_max(&port_ida, nr_auto_ports - 1, GFP_KERNEL);
+	if (index < 0) {
 		rt_socket_cleanup(fd);
-		return -EAGAIN;
+		return index == -ENOSPC ? -EAGAIN : index;
 	}
-	free_ports--;
-
-	/* find free auto-port in bitmap */
-	for (i = 0; i < RT_PORT_BITMAP_WORDS; i++)
-		if (port_bitmap[i] != (unsigned long)-1)
-			break;
-	index = ffz(port_bitmap[i]);
-	set_bit(index, &port_bitmap[i]);
-	index += i * BITS_PER_LONG;
 	sock->prot.inet.reg_index = index;
-	sock->prot.inet.sport = index + auto_port_start;
+	sock->prot.inet.sport = auto_port(index);
 
 	/* register UDP socket */
-	port_hash_insert(&port_registry[index], INADDR_ANY,
-			 sock->prot.inet.sport);
-	port_registry[index].sock = sock;
-
-	rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+	rt_sock_node_init(&us->node);
+	rt_sock_table_reserve(&port_table);
+	ret = rt_sock_table_insert(&port_table, &us->node, INADDR_ANY,
+				   sock->prot.inet.sport);
+	if (ret) {
+		rt_sock_table_unreserve(&port_table);
+		ida_free(&port_ida, index);
+		rt_socket_cleanup(fd);
+	}
 
-	return 0;
+	return ret;
 }
 
 /***
@@ -324,28 +282,26 @@ static int rt_udp_socket(struct rtdm_fd *fd)
  */
 static void rt_udp_close(struct rtdm_fd *fd)
 {
-	struct rtsocket *sock = rtdm_fd_to_private(fd);
+	struct udp_socket *us = rtdm_fd_to_private(fd);
+	struct rtsocket *sock = &us->sock;
 	struct rtskb *del;
-	int port;
 	rtdm_lockctx_t context;
+	int index;
 
-	rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+	rtdm_lock_get_irqsave(&sock->param_lock, context);
 
 	sock->prot.inet.state = TCP_CLOSE;
+	index = sock->prot.inet.reg_index;
+	sock->prot.inet.reg_index = -1;
 
-	if (sock->prot.inet.reg_index >= 0) {
-		port = sock->prot.inet.reg_index;
-		clear_bit(port % BITS_PER_LONG,
-			  &port_bitmap[port / BITS_PER_LONG]);
-		port_hash_del(&port_registry[port]);
-
-		free_ports++;
+	rtdm_lock_put_irqrestore(&sock->param_lock, context);
 
-		sock->prot.inet.reg_index = -1;
+	if (index >= 0) {
+		rt_sock_table_remove(&port_table, &us->node);
+		rt_sock_table_unreserve(&port_table);
+		ida_free(&port_ida, index);
 	}
 
-	rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
-
 	/* cleanup already collected fragments */
 	rt_ip_frag_invalidate_socket(sock);
 
@@ -391,56 +347,25 @@ static int rt_udp_ioctl(struct rtdm_fd *fd, unsigned int request,
  *  rt_udp_recvmsg
  */
 /***
- *  rt_udp_recvmsg
+ *  rt_udp_deliver - copy a received datagram to the user, releasing the
+ *                   buffer chain unless peeking
  */
-static ssize_t rt_udp_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
+static ssize_t rt_udp_deliver(struct rtdm_fd *fd, struct user_msghdr *msg,
+			      struct iovec *iov, struct rtskb *skb,
 			      int msg_flags)
 {
 	struct rtsocket *sock = rtdm_fd_to_private(fd);
-	size_t len;
-	struct rtskb *skb;
-	struct rtskb *first_skb;
+	struct rtskb *first_skb = skb;
+	struct udphdr *uh = skb->h.uh;
 	size_t copied = 0;
 	size_t block_size;
 	size_t data_len;
-	struct udphdr *uh;
 	struct sockaddr_in sin;
-	nanosecs_rel_t timeout = sock->timeout;
-	int ret, flags;
 	socklen_t namelen;
-	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
-
-	if (msg->msg_iovlen < 0)
-		return -EINVAL;
-
-	if (msg->msg_iovlen == 0)
-		return 0;
-
-	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
-	if (ret)
-		return ret;
-
-	/* non-blocking receive? */
-	if (msg_flags & MSG_DONTWAIT)
-		timeout = -1;
-
-	ret = rtdm_sem_timeddown(&sock->pending_sem, timeout, NULL);
-	if (unlikely(ret < 0))
-		switch (ret) {
-		default:
-			ret = -EBADF; /* socket has been closed */
-			fallthrough;
-		case -EWOULDBLOCK:
-		case -ETIMEDOUT:
-		case -EINTR:
-			rtdm_drop_iovec(iov, iov_fast);
-			return ret;
-		}
-
-	skb = rtskb_dequeue_chain(&sock->incoming);
-	RTNET_ASSERT(skb != NULL, return -EFAULT;);
-	uh = skb->h.uh;
-	first_skb = skb;
+	__wsum csum = 0;
+	bool verify;
+	int ret, flags;
+	size_t len;
 
 	/* copy the address if required. */
 	if (msg->msg_name) {
@@ -470,6 +395,13 @@ static ssize_t rt_udp_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
 	flags = msg->msg_flags & ~MSG_TRUNC;
 	len = rtdm_get_iov_flatlen(iov, msg->msg_iovlen);
 
+	/*
+	 * The checksum is verified while copying. Our senders only
+	 * account for the first fragment (see rt_udp_getfrag()), so
+	 * fragmented datagrams are passed as is.
+	 */
+	verify = skb->ip_summed != CHECKSUM_UNNECESSARY && skb->next == NULL;
+
 	/* iterate over all IP fragments */
 	do {
 		rtskb_trim(skb, data_len);
@@ -486,9 +418,14 @@ static ssize_t rt_udp_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
 		}
 
 		/* copy the data */
-		ret = rtnet_write_to_iov(fd, iov, msg->msg_iovlen, skb->data,
-					 block_size);
-		if (ret)
+		if (verify)
+			ret = rtnet_write_to_iov_csum(fd, iov, msg->msg_iovlen,
+						      skb->data, block_size,
+						      &csum);
+		else
+			ret = rtnet_write_to_iov(fd, iov, msg->msg_iovlen,
+						 skb->data, block_size);
+		if (ret < 0)
 			goto fail;
 
 		/* next fragment */
@@ -499,6 +436,23 @@ static ssize_t rt_udp_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
 	if (data_len > 0)
 		flags |= MSG_TRUNC;
 
+	if (verify) {
+		/* account for what did not fit in the buffer */
+		if (block_size < first_skb->len)
+			csum = csum_block_add(csum,
+					      rtnet_csum(first_skb->data +
+							 block_size,
+							 first_skb->len -
+							 block_size, 0),
+					      block_size);
+		csum = csum_add(csum, rtnet_csum(uh, sizeof(*uh),
+						 first_skb->csum));
+		if (unlikely(csum_fold(csum))) {
+			kfree_rtskb(first_skb);
+			return -EBADMSG;
+		}
+	}
+
 	msg->msg_flags = flags;
 out:
 	if ((msg_flags & MSG_PEEK) == 0)
@@ -508,7 +462,6 @@ out:
 		rtskb_queue_head(&sock->incoming, first_skb);
 		rtdm_sem_up(&sock->pending_sem);
 	}
-	rtdm_drop_iovec(iov, iov_fast);
 
 	return copied;
 fail:
@@ -516,6 +469,146 @@ fail:
 	goto out;
 }
 
+/***
+ *  rt_udp_recvmsg
+ */
+static ssize_t rt_udp_recvmsg(struct rtdm_fd *fd, struct user_msghdr *msg,
+			      int msg_flags)
+{
+	struct rtsocket *sock = rtdm_fd_to_private(fd);
+	struct rtskb *skb;
+	nanosecs_rel_t timeout = sock->timeout;
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	ssize_t ret;
+
+	if (msg->msg_iovlen < 0)
+		return -EINVAL;
+
+	if (msg->msg_iovlen == 0)
+		return 0;
+
+	/* non-blocking receive? */
+	if (msg_flags & MSG_DONTWAIT)
+		timeout = -1;
+again:
+	ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+	if (ret)
+		return ret;
+
+	ret = rtdm_sem_timeddown(&sock->pending_sem, timeout, NULL);
+	if (unlikely(ret < 0))
+		switch (ret) {
+		default:
+			ret = -EBADF; /* socket has been closed */
+			fallthrough;
+		case -EWOULDBLOCK:
+		case -ETIMEDOUT:
+		case -EINTR:
+			rtdm_drop_iovec(iov, iov_fast);
+			return ret;
+		}
+
+	skb = rtskb_dequeue_chain(&sock->incoming);
+	RTNET_ASSERT(skb != NULL, return -EFAULT;);
+
+	ret = rt_udp_deliver(fd, msg, iov, skb, msg_flags);
+	rtdm_drop_iovec(iov, iov_fast);
+	if (ret == -EBADMSG)
+		goto again; /* dropped, wait for the next datagram */
+
+	return ret;
+}
+
+/***
+ *  rt_udp_requeue - put back datagrams dequeued by a batch receive
+ */
+static void rt_udp_requeue(struct rtsocket *sock, struct rtskb *skb,
+			   int count)
+{
+	rtskb_requeue_chains(&sock->incoming, skb);
+	while (count-- > 0)
+		rtdm_sem_up(&sock->pending_sem);
+}
+
+/***
+ *  rt_udp_recvmmsg - receive a batch of datagrams, dequeuing all
+ *                    pending ones at once
+ */
+static int rt_udp_recvmmsg(struct rtdm_fd *fd, struct mmsghdr *mmsgvec,
+			   unsigned int vlen, int msg_flags,
+			   const struct timespec64 *ts)
+{
+	struct rtsocket *sock = rtdm_fd_to_private(fd);
+	struct iovec iov_fast[RTDM_IOV_FASTMAX], *iov;
+	nanosecs_rel_t timeout = sock->timeout;
+	struct rtskb *skb, *next;
+	rtdm_toseq_t timeout_seq;
+	struct user_msghdr *msg;
+	unsigned int n = 0;
+	int count, ret = 0;
+	ssize_t len;
+
+	/* Peeking would return the same datagram over and over. */
+	if (msg_flags & MSG_PEEK)
+		vlen = 1;
+
+	if (ts)
+		timeout = timespec64_to_ns(ts);
+
+	/* non-blocking receive? */
+	if (msg_flags & MSG_DONTWAIT)
+		timeout = -1;
+
+	rtdm_toseq_init(&timeout_seq, timeout);
+
+	while (n < vlen) {
+		count = rtdm_sem_timeddown_batch(&sock->pending_sem, vlen - n,
+						 timeout, &timeout_seq);
+		if (unlikely(count < 0)) {
+			ret = count;
+			if (ret != -EWOULDBLOCK && ret != -ETIMEDOUT &&
+			    ret != -EINTR)
+				ret = -EBADF; /* socket has been closed */
+			break;
+		}
+
+		skb = rtskb_dequeue_chains(&sock->incoming, count);
+		RTNET_ASSERT(skb != NULL, return n ?: -EFAULT;);
+
+		for (; skb; skb = next) {
+			next = skb->chain_end->next;
+			skb->chain_end->next = NULL;
+			msg = &mmsgvec[n].msg_hdr;
+			ret = rtdm_get_iovec(fd, &iov, msg, iov_fast);
+			if (ret) {
+				skb->chain_end->next = next;
+				rt_udp_requeue(sock, skb, count);
+				break;
+			}
+			len = rt_udp_deliver(fd, msg, iov, skb, msg_flags);
+			rtdm_drop_iovec(iov, iov_fast);
+			count--;
+			if (len == -EBADMSG)
+				continue; /* dropped, reuse the message */
+			if (len < 0) {
+				ret = len;
+				if (next)
+					rt_udp_requeue(sock, next, count);
+				break;
+			}
+			mmsgvec[n++].msg_len = len;
+		}
+
+		if (ret)
+			break;
+
+		if (msg_flags & MSG_WAITFORONE)
+			timeout = -1;
+	}
+
+	return n ?: ret;
+}
+
 /***
  *  struct udpfakehdr
  */
@@ -536,25 +629,23 @@ static int rt_udp_getfrag(const void *p, unsigned char *to, unsigned int offset,
 			  unsigned int fraglen)
 {
 	struct udpfakehdr *ufh = (struct udpfakehdr *)p;
+	__wsum csum = 0;
 	int ret;
 
-	// We should optimize this function a bit (copy+csum...)!
 	if (offset) {
 		ret = rtnet_read_from_iov(ufh->fd, ufh->iov, ufh->iovlen, to,
 					  fraglen);
 		return ret < 0 ? ret : 0;
 	}
 
-	ret = rtnet_read_from_iov(ufh->fd, ufh->iov, ufh->iovlen,
-				  to + sizeof(struct udphdr),
-				  fraglen - sizeof(struct udphdr));
+	/* Checksum the data part of the UDP message while copying it: */
+	ret = rtnet_read_from_iov_csum(ufh->fd, ufh->iov, ufh->iovlen,
+				       to + sizeof(struct udphdr),
+				       fraglen - sizeof(struct udphdr), &csum);
 	if (ret < 0)
 		return ret;
 
-	/* Checksum of the complete data part of the UDP message: */
-	ufh->wcheck =
-		rtnet_csum(to + sizeof(struct udphdr),
-			   fraglen - sizeof(struct udphdr), ufh->wcheck);
+	ufh->wcheck = (__force u32)csum_add((__force __wsum)ufh->wcheck, csum);
 
 	/* Checksum of the udp header: */
 	ufh->wcheck = rtnet_csum((unsigned char *)ufh, sizeof(struct udphdr),
@@ -631,13 +722,12 @@ static ssize_t rt_udp_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg,
 
 		daddr = sin->sin_addr.s_addr;
 		dport = sin->sin_port;
-		rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+		rtdm_lock_get_irqsave(&sock->param_lock, context);
 	} else {
-		rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+		rtdm_lock_get_irqsave(&sock->param_lock, context);
 
 		if (sock->prot.inet.state != TCP_ESTABLISHED) {
-			rtdm_lock_put_irqrestore(&udp_socket_base_lock,
-						 context);
+			rtdm_lock_put_irqrestore(&sock->param_lock, context);
 			err = -ENOTCONN;
 			goto out;
 		}
@@ -649,7 +739,7 @@ static ssize_t rt_udp_sendmsg(struct rtdm_fd *fd, const struct user_msghdr *msg,
 	saddr = sock->prot.inet.saddr;
 	ufh.uh.source = sock->prot.inet.sport;
 
-	rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+	rtdm_lock_put_irqrestore(&sock->param_lock, context);
 
 	if ((daddr | dport) == 0) {
 		err = -EINVAL;
@@ -776,7 +866,7 @@ static struct rtdm_driver udp_driver = {
                                         RTNET_RTDM_VER),
     .device_flags =     RTDM_PROTOCOL_DEVICE,
     .device_count =	1,
-    .context_size =     sizeof(struct rtsocket),
+    .context_size =     sizeof(struct udp_socket),
 
     .protocol_family =  PF_INET,
     .socket_type =      SOCK_DGRAM,
@@ -788,6 +878,7 @@ static struct rtdm_driver udp_driver = {
         .ioctl_rt =     rt_udp_ioctl,
         .ioctl_nrt =    rt_udp_ioctl,
         .recvmsg_rt =   rt_udp_recvmsg,
+        .recvmmsg_rt =  rt_udp_recvmmsg,
         .sendmsg_rt =   rt_udp_sendmsg,
         .select =       rt_socket_select_bind,
     },
@@ -803,22 +894,26 @@ static struct rtdm_device udp_device = {
  */
 static int __init rt_udp_init(void)
 {
-	int i, err;
+	int err;
 
+	nr_auto_ports = (~auto_port_mask & 0xFFFF) + 1;
 	if ((auto_port_start < 0) ||
-	    (auto_port_start >= 0x10000 - RT_UDP_SOCKETS))
+	    (auto_port_start >= 0x10000 - nr_auto_ports))
 		auto_port_start = 1024;
 	auto_port_start = htons(auto_port_start & (auto_port_mask & 0xFFFF));
 	auto_port_mask = htons(auto_port_mask | 0xFFFF0000);
 
-	rt_inet_add_protocol(&udp_protocol);
+	err = rt_sock_table_init(&port_table, RT_UDP_SOCKETS * 2);
+	if (err)
+		return err;
 
-	for (i = 0; i < ARRAY_SIZE(port_hash); i++)
-		INIT_HLIST_HEAD(&port_hash[i]);
+	rt_inet_add_protocol(&udp_protocol);
 
 	err = rtdm_dev_register(&udp_device);
-	if (err)
+	if (err) {
 		rt_inet_del_protocol(&udp_protocol);
+		rt_sock_table_destroy(&port_table);
+	}
 	return err;
 }
 
@@ -829,6 +924,8 @@ static void __exit rt_udp_release(void)
 {
 	rtdm_dev_unregister(&udp_device);
 	rt_inet_del_protocol(&udp_protocol);
+	rt_sock_table_destroy(&port_table);
+	ida_destroy(&port_ida);
 }
 
 module_init(rt_udp_init);
@@ -30,6 +30,8 @@
 #include <rtnet_socket.h>
 #include <stack_mgr.h>
 
+#include "af_packet_ring.h"
+
 MODULE_LICENSE("GPL");
 
 /***
@@ -41,12 +43,23 @@ static int rt_packet_rcv(struct rtskb *skb, struct rtpacket_type *pt)
 		container_of(pt, struct rtsocket, prot.packet.packet_type);
 	int ifindex = sock->prot.packet.ifindex;
 	void (*callback_func)(struct rtdm_fd *, void *);
+	struct rtpacket_ring *ring;
 	void *callback_arg;
 	rtdm_lockctx_t context;
 
 	if (unlikely((ifindex != 0) && (ifindex != skb->rtdev->ifindex)))
 		return -EUNATCH;
 
+	ring = smp_load_acquire(&sock->prot.packet.ring);
+	if (ring && rt_packet_ring_rcv(ring, skb)) {
+		/* The frame was copied to the ring. */
+#ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
+		if (pt->type != htons(ETH_P_ALL))
+#endif /* CONFIG_XENO_DRIVERS_NET_ETH_P_ALL */
+			kfree_rtskb(skb);
+		goto notify;
+	}
+
 #ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
 	if (pt->type == htons(ETH_P_ALL)) {
 		struct rtskb *clone_skb = rtskb_clone(skb, &sock->skb_pool);
@@ -63,6 +76,7 @@ static int rt_packet_rcv(struct rtskb *skb, struct rtpacket_type *pt)
 	rtskb_queue_tail(&sock->incoming, skb);
 	rtdm_sem_up(&sock->pending_sem);
 
+notify:
 	rtdm_lock_get_irqsave(&sock->param_lock, context);
 	callback_func = sock->callback_func;
 	callback_arg = sock->callback_arg;
@@ -210,6 +224,7 @@ static int rt_packet_socket(struct rtdm_fd *fd, int protocol)
 
 	sock->prot.packet.packet_type.type = protocol;
 	sock->prot.packet.ifindex = 0;
+	sock->prot.packet.ring = NULL;
 	sock->prot.packet.packet_type.trylock = rt_packet_trylock;
 	sock->prot.packet.packet_type.unlock = rt_packet_unlock;
 
@@ -252,6 +267,11 @@ static void rt_packet_close(struct rtdm_fd *fd)
 		kfree_rtskb(del);
 	}
 
+	if (sock->prot.packet.ring) {
+		rt_packet_ring_release(sock->prot.packet.ring);
+		sock->prot.packet.ring = NULL;
+	}
+
 	rt_socket_cleanup(fd);
 }
 
@@ -267,6 +287,15 @@ static int rt_packet_ioctl(struct rtdm_fd *fd, unsigned int request,
 	const struct _rtdm_getsockaddr_args *getaddr;
 	struct _rtdm_getsockaddr_args _getaddr;
 
+	switch (request) {
+	case RTNET_RTIOC_PACKET_RING:
+		return rt_packet_ring_setup(fd, sock, arg);
+	case RTNET_RTIOC_PACKET_KICK:
+		return rt_packet_ring_kick(sock);
+	case RTNET_RTIOC_PACKET_WAIT:
+		return rt_packet_ring_wait(fd, sock, arg);
+	}
+
 	/* fast path for common socket IOCTLs */
 	if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK)
 		return rt_socket_common_ioctl(fd, request, arg);
@@ -291,6 +320,14 @@ static int rt_packet_ioctl(struct rtdm_fd *fd, unsigned int request,
 	}
 }
 
+/***
+ *  rt_packet_mmap
+ */
+static int rt_packet_mmap(struct rtdm_fd *fd, struct vm_area_struct *vma)
+{
+	return rt_packet_ring_mmap(rtdm_fd_to_private(fd), vma);
+}
+
 /***
  *  rt_packet_recvmsg
  */
@@ -493,6 +530,7 @@ static ssize_t rt_packet_sendmsg(struct rtdm_fd *fd,
 
 	rtskb->rtdev = rtdev;
 	rtskb->priority = sock->priority;
+	rtskb_set_queue_mapping(rtskb, sock->tx_queue);
 
 	if (rtdev->hard_header) {
 		int hdr_len;
@@ -551,6 +589,7 @@ static struct rtdm_driver packet_proto_drv = {
 	.recvmsg_rt =   rt_packet_recvmsg,
 	.sendmsg_rt =   rt_packet_sendmsg,
 	.select =       rt_socket_select_bind,
+	.mmap =         rt_packet_mmap,
     },
 };
 
@@ -579,6 +618,7 @@ static struct rtdm_driver raw_packet_proto_drv = {
 	.recvmsg_rt =   rt_packet_recvmsg,
 	.sendmsg_rt =   rt_packet_sendmsg,
 	.select =       rt_socket_select_bind,
+	.mmap =         rt_packet_mmap,
     },
 };
 
@@ -0,0 +1,415 @@
+/***
+ *
+ *  packet/af_packet_ring.c - memory-mapped rings of packet sockets
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/err.h>
+
+#include <rtnet_socket.h>
+#include "af_packet_ring.h"
+
+/*
+ * The application and the stack exchange frames through slots of a
+ * shared area, handing them over by flipping their status word. The
+ * application only enters the kernel to kick transmission, or to
+ * wait for a frame when the next RX slot is still empty.
+ */
+
+#define RING_MAX_FRAMES 65536
+
+struct rtpacket_ring {
+	void *base; /* vmalloc'ed area mapped to user space */
+	atomic_t refs; /* socket and user mappings */
+	size_t map_len;
+	unsigned int frame_size;
+	unsigned int rx_frames;
+	unsigned int tx_frames;
+	unsigned int rx_offset;
+	unsigned int tx_offset;
+	bool raw; /* frames include the link-layer header */
+
+	rtdm_lock_t rx_lock; /* serializes the stack manager tasks */
+	unsigned int rx_head; /* next slot to fill */
+	rtdm_event_t rx_event; /* signaled for each frame received */
+
+	rtdm_mutex_t tx_lock; /* serializes kicks */
+	unsigned int tx_head; /* next slot to send */
+};
+
+static inline struct rtnet_packet_ring_hdr *
+ring_hdr(struct rtpacket_ring *ring)
+{
+	return ring->base;
+}
+
+static inline struct rtnet_packet_slot *ring_slot(struct rtpacket_ring *ring,
+						  unsigned int offset,
+						  unsigned int n)
+{
+	return ring->base + offset + (size_t)n * ring->frame_size;
+}
+
+static inline void *slot_data(struct rtnet_packet_slot *slot)
+{
+	return (void *)slot + RTNET_PACKET_SLOT_HDRLEN;
+}
+
+/***
+ *  rt_packet_ring_setup - RTNET_RTIOC_PACKET_RING handler
+ */
+int rt_packet_ring_setup(struct rtdm_fd *fd, struct rtsocket *sock,
+			 void __user *arg)
+{
+	struct rtnet_packet_ring_req _req, *req;
+	struct rtpacket_ring *ring;
+	rtdm_lockctx_t context;
+	size_t rx_len, tx_len;
+	bool raw;
+	int ret;
+
+	req = rtnet_get_arg(fd, &_req, arg, sizeof(_req));
+	if (IS_ERR(req))
+		return PTR_ERR(req);
+
+	if (rtdm_in_rt_context())
+		return -ENOSYS;
+
+	raw = rtdm_fd_to_context(fd)->device->driver->socket_type == SOCK_RAW;
+
+	if (req->frame_size <= RTNET_PACKET_SLOT_HDRLEN ||
+	    req->frame_size % RTNET_PACKET_SLOT_ALIGN ||
+	    req->frame_size > RTNET_PACKET_SLOT_HDRLEN + RTSKB_SIZE ||
+	    req->rx_frames > RING_MAX_FRAMES ||
+	    req->tx_frames > RING_MAX_FRAMES ||
+	    req->rx_frames + req->tx_frames == 0)
+		return -EINVAL;
+
+	/* Datagram sockets would need a destination per TX slot. */
+	if (req->tx_frames > 0 && !raw)
+		return -EINVAL;
+
+	if (sock->prot.packet.ring)
+		return -EBUSY; /* Rings may not be resized. */
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (ring == NULL)
+		return -ENOMEM;
+
+	rx_len = (size_t)req->rx_frames * req->frame_size;
+	tx_len = (size_t)req->tx_frames * req->frame_size;
+	ring->rx_offset = ALIGN(sizeof(struct rtnet_packet_ring_hdr),
+				RTNET_PACKET_SLOT_ALIGN);
+	ring->tx_offset = ring->rx_offset + rx_len;
+	ring->map_len = PAGE_ALIGN(ring->tx_offset + tx_len);
+	ring->frame_size = req->frame_size;
+	ring->rx_frames = req->rx_frames;
+	ring->tx_frames = req->tx_frames;
+	ring->raw = raw;
+
+	/* Zeroed, so that all slots start as RX_KERNEL/TX_AVAILABLE. */
+	ring->base = vmalloc_user(ring->map_len);
+	if (ring->base == NULL) {
+		kfree(ring);
+		return -ENOMEM;
+	}
+
+	atomic_set(&ring->refs, 1);
+	rtdm_lock_init(&ring->rx_lock);
+	rtdm_event_init(&ring->rx_event, 0);
+	rtdm_mutex_init(&ring->tx_lock);
+
+	req->rx_offset = ring->rx_offset;
+	req->tx_offset = ring->tx_offset;
+	req->map_len = ring->map_len;
+
+	rtdm_lock_get_irqsave(&sock->param_lock, context);
+	if (sock->prot.packet.ring) {
+		rtdm_lock_put_irqrestore(&sock->param_lock, context);
+		rt_packet_ring_release(ring);
+		return -EBUSY;
+	}
+	/* Publish the ring once set up, rt_packet_rcv() may pick it. */
+	smp_store_release(&sock->prot.packet.ring, ring);
+	rtdm_lock_put_irqrestore(&sock->param_lock, context);
+
+	ret = rtnet_put_arg(fd, arg, req, sizeof(*req));
+
+	return ret;
+}
+
+static void put_ring(struct rtpacket_ring *ring)
+{
+	if (atomic_dec_and_test(&ring->refs)) {
+		vfree(ring->base);
+		kfree(ring);
+	}
+}
+
+/*
+ * The area outlives the socket as long as the application maps it,
+ * so it is only freed on the last unmap.
+ */
+static void ring_vmopen(struct vm_area_struct *vma)
+{
+	struct rtpacket_ring *ring = vma->vm_private_data;
+
+	atomic_inc(&ring->refs);
+}
+
+static void ring_vmclose(struct vm_area_struct *vma)
+{
+	put_ring(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct ring_vmops = {
+	.open = ring_vmopen,
+	.close = ring_vmclose,
+};
+
+/***
+ *  rt_packet_ring_mmap - map the ring to user space
+ */
+int rt_packet_ring_mmap(struct rtsocket *sock, struct vm_area_struct *vma)
+{
+	struct rtpacket_ring *ring = READ_ONCE(sock->prot.packet.ring);
+	int ret;
+
+	if (ring == NULL)
+		return -ENXIO;
+
+	if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > ring->map_len)
+		return -EINVAL;
+
+	ret = rtdm_mmap_vmem(vma, ring->base);
+	if (ret)
+		return ret;
+
+	atomic_inc(&ring->refs);
+	vma->vm_ops = &ring_vmops;
+	vma->vm_private_data = ring;
+
+	return 0;
+}
+
+/***
+ *  rt_packet_ring_rcv - copy a received frame to the next RX slot
+ *
+ *  Returns false if the socket has no RX ring, the caller keeps
+ *  ownership of @skb in any case. Called from the stack manager
+ *  tasks.
+ */
+bool rt_packet_ring_rcv(struct rtpacket_ring *ring, struct rtskb *skb)
+{
+	struct rtnet_packet_slot *slot;
+	rtdm_lockctx_t context;
+	unsigned int len, room;
+	unsigned char *data;
+
+	if (ring->rx_frames == 0)
+		return false;
+
+	if (ring->raw) {
+		data = skb->mac.raw;
+		len = skb->len + (skb->data - skb->mac.raw);
+	} else {
+		data = skb->data;
+		len = skb->len;
+	}
+
+	room = ring->frame_size - RTNET_PACKET_SLOT_HDRLEN;
+
+	rtdm_lock_get_irqsave(&ring->rx_lock, context);
+
+	slot = ring_slot(ring, ring->rx_offset, ring->rx_head);
+	if (READ_ONCE(slot->status) != RTNET_PACKET_RX_KERNEL) {
+		/* The application is lagging behind. */
+		ring_hdr(ring)->rx_drops++;
+		rtdm_lock_put_irqrestore(&ring->rx_lock, context);
+		return true;
+	}
+
+	if (++ring->rx_head == ring->rx_frames)
+		ring->rx_head = 0;
+
+	/* Do not fill the slot before we saw it released. */
+	smp_mb();
+
+	memcpy(slot_data(slot), data, min(len, room));
+	slot->len = min(len, room);
+	slot->tstamp = skb->time_stamp;
+	slot->ifindex = skb->rtdev->ifindex;
+	slot->protocol = skb->protocol;
+	slot->pkttype = skb->pkt_type;
+
+	smp_wmb();
+	WRITE_ONCE(slot->status, len > room ?
+		   RTNET_PACKET_RX_USER | RTNET_PACKET_RX_TRUNC :
+		   RTNET_PACKET_RX_USER);
+
+	rtdm_lock_put_irqrestore(&ring->rx_lock, context);
+
+	rtdm_event_signal(&ring->rx_event);
+
+	return true;
+}
+
+/***
+ *  rt_packet_ring_wait - RTNET_RTIOC_PACKET_WAIT handler
+ */
+int rt_packet_ring_wait(struct rtdm_fd *fd, struct rtsocket *sock,
+			void __user *arg)
+{
+	struct rtpacket_ring *ring = READ_ONCE(sock->prot.packet.ring);
+	struct rtnet_packet_slot *slot;
+	const unsigned int *index;
+	unsigned int _index;
+	int ret;
+
+	if (ring == NULL || ring->rx_frames == 0)
+		return -ENXIO;
+
+	index = rtnet_get_arg(fd, &_index, arg, sizeof(_index));
+	if (IS_ERR(index))
+		return PTR_ERR(index);
+
+	if (*index >= ring->rx_frames)
+		return -EINVAL;
+
+	slot = ring_slot(ring, ring->rx_offset, *index);
+
+	for (;;) {
+		/* Any frame received from now on signals the event. */
+		rtdm_event_clear(&ring->rx_event);
+		if (READ_ONCE(slot->status) & RTNET_PACKET_RX_USER)
+			return 0;
+
+		ret = rtdm_event_timedwait(&ring->rx_event, sock->timeout,
+					   NULL);
+		if (ret)
+			return ret;
+	}
+}
+
+static int rt_packet_ring_xmit(struct rtsocket *sock,
+			       struct rtpacket_ring *ring,
+			       struct rtnet_device *rtdev,
+			       struct rtnet_packet_slot *slot)
+{
+	struct rtskb *rtskb;
+	unsigned int len;
+
+	len = READ_ONCE(slot->len);
+	if (len < rtdev->hard_header_len ||
+	    len > ring->frame_size - RTNET_PACKET_SLOT_HDRLEN ||
+	    len > rtdev->mtu + rtdev->hard_header_len)
+		return -EMSGSIZE;
+
+	rtskb = alloc_rtskb(rtdev->hard_header_len + len, &sock->skb_pool);
+	if (rtskb == NULL)
+		return -ENOBUFS;
+
+	/* Leave room for RTmac headers, like rt_packet_sendmsg(). */
+	rtskb_reserve(rtskb, rtdev->hard_header_len);
+
+	rtskb->rtdev = rtdev;
+	rtskb->priority = sock->priority;
+	rtskb_set_queue_mapping(rtskb, sock->tx_queue);
+	memcpy(rtskb_put(rtskb, len), slot_data(slot), len);
+
+	return rtdev_xmit(rtskb);
+}
+
+/***
+ *  rt_packet_ring_kick - RTNET_RTIOC_PACKET_KICK handler
+ *
+ *  Returns the number of frames sent, or a negative error code if
+ *  the first one could not be.
+ */
+int rt_packet_ring_kick(struct rtsocket *sock)
+{
+	struct rtpacket_ring *ring = READ_ONCE(sock->prot.packet.ring);
+	struct rtnet_packet_slot *slot;
+	struct rtnet_device *rtdev;
+	int ret = 0, sent = 0;
+	unsigned int n;
+
+	if (ring == NULL || ring->tx_frames == 0)
+		return -ENXIO;
+
+	rtdev = rtdev_get_by_index(sock->prot.packet.ifindex);
+	if (rtdev == NULL)
+		return -ENODEV;
+
+	if ((rtdev->flags & IFF_UP) == 0) {
+		ret = -ENETDOWN;
+		goto out;
+	}
+
+	rtdm_mutex_lock(&ring->tx_lock);
+
+	for (n = 0; n < ring->tx_frames; n++) {
+		slot = ring_slot(ring, ring->tx_offset, ring->tx_head);
+		if (READ_ONCE(slot->status) != RTNET_PACKET_TX_SEND_REQUEST)
+			break;
+
+		/* Read the frame only after its status. */
+		smp_rmb();
+
+		ret = rt_packet_ring_xmit(sock, ring, rtdev, slot);
+		if (ret == -ENOBUFS)
+			break; /* Retry on next kick. */
+
+		/* The frame was copied, the slot may be reused. */
+		smp_mb();
+		WRITE_ONCE(slot->status, ret == -EMSGSIZE ?
+			   RTNET_PACKET_TX_WRONG_FORMAT :
+			   RTNET_PACKET_TX_AVAILABLE);
+
+		if (++ring->tx_head == ring->tx_frames)
+			ring->tx_head = 0;
+
+		if (ret == 0)
+			sent++;
+		else if (ret != -EMSGSIZE)
+			break;
+	}
+
+	rtdm_mutex_unlock(&ring->tx_lock);
+
+	if (sent > 0 || ret == 0)
+		ret = sent;
+out:
+	rtdev_dereference(rtdev);
+
+	return ret;
+}
+
+/***
+ *  rt_packet_ring_release - drop the socket's reference, it is closed
+ *
+ *  The area itself is freed once the application unmapped it as well.
+ */
+void rt_packet_ring_release(struct rtpacket_ring *ring)
+{
+	rtdm_event_destroy(&ring->rx_event);
+	rtdm_mutex_destroy(&ring->tx_lock);
+	put_ring(ring);
+}
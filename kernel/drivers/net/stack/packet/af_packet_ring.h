@@ -0,0 +1,42 @@
+/***
+ *
+ *  packet/af_packet_ring.h - memory-mapped rings of packet sockets
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __AF_PACKET_RING_H_
+#define __AF_PACKET_RING_H_
+
+#include <rtnet_socket.h>
+
+struct vm_area_struct;
+
+int rt_packet_ring_setup(struct rtdm_fd *fd, struct rtsocket *sock,
+			 void __user *arg);
+
+int rt_packet_ring_mmap(struct rtsocket *sock, struct vm_area_struct *vma);
+
+bool rt_packet_ring_rcv(struct rtpacket_ring *ring, struct rtskb *skb);
+
+int rt_packet_ring_kick(struct rtsocket *sock);
+
+int rt_packet_ring_wait(struct rtdm_fd *fd, struct rtsocket *sock,
+			void __user *arg);
+
+void rt_packet_ring_release(struct rtpacket_ring *ring);
+
+#endif /* __AF_PACKET_RING_H_ */
@@ -223,6 +223,38 @@ void rtdev_alloc_name(struct rtnet_device *rtdev, const char *mask)
 	}
 }
 
+/***
+ *  rtdev_set_num_queues - declare the hardware queues of a device
+ *  @rtdev:         the rtnet_device
+ *  @txqs:          number of TX queues (rings)
+ *  @rxqs:          number of RX queues
+ *
+ *  This function has to be called from the driver probe function,
+ *  before the device is registered. Devices are single-queue
+ *  otherwise. By default, frames of the non-real-time priority go to
+ *  the last TX queue, all others to the first one, so that
+ *  time-critical frames never wait behind bulk traffic in the same
+ *  ring. Sockets may pin their traffic to any queue using
+ *  RTNET_RTIOC_TXQUEUE.
+ */
+int rtdev_set_num_queues(struct rtnet_device *rtdev, unsigned int txqs,
+			 unsigned int rxqs)
+{
+	int prio;
+
+	if (txqs == 0 || txqs > RTDEV_MAX_QUEUES || rxqs == 0 ||
+	    rxqs > RTDEV_MAX_QUEUES)
+		return -EINVAL;
+
+	rtdev->num_tx_queues = txqs;
+	rtdev->num_rx_queues = rxqs;
+
+	for (prio = QUEUE_MAX_PRIO; prio <= QUEUE_MIN_PRIO; prio++)
+		rtdev->prio_txq[prio] = prio == SOCK_NRT_PRIO ? txqs - 1 : 0;
+
+	return 0;
+}
+
 static int rtdev_pool_trylock(void *cookie)
 {
 	return rtdev_reference(cookie);
@@ -240,7 +272,7 @@ static const struct rtskb_pool_lock_ops rtdev_ops = {
 
 static int rtdev_init(struct rtnet_device *rtdev, unsigned dev_pool_size)
 {
-	int ret;
+	int ret, i;
 
 	ret = rtskb_pool_init(&rtdev->dev_pool, dev_pool_size, &rtdev_ops,
 			      rtdev);
@@ -251,6 +283,9 @@ static int rtdev_init(struct rtnet_device *rtdev, unsigned dev_pool_size)
 	}
 
 	rtdm_mutex_init(&rtdev->xmit_mutex);
+	for (i = 0; i < RTDEV_MAX_QUEUES; i++)
+		rtdm_mutex_init(&rtdev->tx_queue[i].xmit_mutex);
+	rtdev_set_num_queues(rtdev, 1, 1);
 	rtdm_lock_init(&rtdev->rtdev_lock);
 	mutex_init(&rtdev->nrt_lock);
 
@@ -264,10 +299,14 @@ static int rtdev_init(struct rtnet_device *rtdev, unsigned dev_pool_size)
 
 void rtdev_destroy(struct rtnet_device *rtdev)
 {
+	int i;
+
 	rtskb_pool_release(&rtdev->dev_pool);
 	rtskb_pool_shrink(&global_pool, rtdev->add_rtskbs);
 	rtdev->stack_event = NULL;
 	rtdm_mutex_destroy(&rtdev->xmit_mutex);
+	for (i = 0; i < RTDEV_MAX_QUEUES; i++)
+		rtdm_mutex_destroy(&rtdev->tx_queue[i].xmit_mutex);
 }
 EXPORT_SYMBOL_GPL(rtdev_destroy);
 
@@ -830,15 +869,38 @@ int rtdev_close(struct rtnet_device *rtdev)
 
 static int rtdev_locked_xmit(struct rtskb *skb, struct rtnet_device *rtdev)
 {
+	rtdm_mutex_t *mutex = &rtdev->xmit_mutex;
 	int ret;
 
-	rtdm_mutex_lock(&rtdev->xmit_mutex);
+	/* Each TX ring of a multi-queue device is serialised on its own. */
+	if (rtdev->num_tx_queues > 1)
+		mutex = &rtdev->tx_queue[rtskb_get_queue_mapping(skb)].xmit_mutex;
+
+	rtdm_mutex_lock(mutex);
 	ret = rtdev->hard_start_xmit(skb, rtdev);
-	rtdm_mutex_unlock(&rtdev->xmit_mutex);
+	rtdm_mutex_unlock(mutex);
 
 	return ret;
 }
 
+/***
+ *  rtdev_pick_tx_queue - assign a valid TX queue to an outgoing rtskb
+ */
+static inline void rtdev_pick_tx_queue(struct rtskb *skb,
+				       struct rtnet_device *rtdev)
+{
+	unsigned int queue = rtskb_get_queue_mapping(skb);
+	unsigned int prio;
+
+	if (queue >= rtdev->num_tx_queues) {
+		prio = min_t(unsigned int, skb->priority & RTSKB_PRIO_MASK,
+			     QUEUE_MIN_PRIO);
+		queue = rtdev->prio_txq[prio];
+	}
+
+	rtskb_set_queue_mapping(skb, queue);
+}
+
 /***
  *  rtdev_xmit - send real-time packet
  */
@@ -865,6 +927,8 @@ int rtdev_xmit(struct rtskb *rtskb)
 
 	RTNET_ASSERT(rtdev != NULL, return -EINVAL;);
 
+	rtdev_pick_tx_queue(rtskb, rtdev);
+
 	err = rtdev->start_xmit(rtskb, rtdev);
 	if (err) {
 		/* on error we must free the rtskb here */
@@ -891,6 +955,8 @@ int rtdev_xmit_proxy(struct rtskb *rtskb)
 
 	RTNET_ASSERT(rtdev != NULL, return -EINVAL;);
 
+	rtdev_pick_tx_queue(rtskb, rtdev);
+
 	/* TODO: make these lines race-condition-safe */
 	if (rtdev->mac_disc) {
 		RTNET_ASSERT(rtdev->mac_disc->nrt_packet_tx != NULL,
@@ -917,6 +983,7 @@ unsigned int rt_hard_mtu(struct rtnet_device *rtdev, unsigned int priority)
 }
 
 EXPORT_SYMBOL_GPL(rtdev_alloc_name);
+EXPORT_SYMBOL_GPL(rtdev_set_num_queues);
 
 EXPORT_SYMBOL_GPL(rt_register_rtnetdev);
 EXPORT_SYMBOL_GPL(rt_unregister_rtnetdev);
@@ -31,6 +31,7 @@
 
 #include <corectl.h>
 #include <rtdev_mgr.h>
+#include <rtnet_checksum.h>
 #include <rtnet_chrdev.h>
 #include <rtnet_internal.h>
 #include <rtnet_socket.h>
@@ -335,6 +336,8 @@ static int __init rtnet_init(void)
 	if (IS_ERR(rtnet_class))
 		return PTR_ERR(rtnet_class);
 
+	rtnet_csum_init();
+
 	if ((err = rtskb_pools_init()) != 0)
 		goto err_out1;
 
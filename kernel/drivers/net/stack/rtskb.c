@@ -224,6 +224,7 @@ struct rtskb *alloc_rtskb(unsigned int size, struct rtskb_pool *pool)
 	skb->pkt_type = PACKET_HOST;
 	skb->xmit_stamp = NULL;
 	skb->ip_summed = CHECKSUM_NONE;
+	skb->queue_mapping = RTSKB_QUEUE_NONE;
 
 #if IS_ENABLED(CONFIG_XENO_DRIVERS_NET_ADDON_RTCAP)
 	skb->cap_flags = 0;
@@ -468,6 +469,7 @@ struct rtskb *rtskb_clone(struct rtskb *rtskb, struct rtskb_pool *pool)
        until real use cases show up. */
 
 	clone_rtskb->priority = rtskb->priority;
+	clone_rtskb->queue_mapping = rtskb->queue_mapping;
 	clone_rtskb->rtdev = rtskb->rtdev;
 	clone_rtskb->time_stamp = rtskb->time_stamp;
 
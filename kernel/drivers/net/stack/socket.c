@@ -61,6 +61,7 @@ int rt_bare_socket_init(struct rtdm_fd *fd, unsigned short protocol,
 
 	sock->protocol = protocol;
 	sock->priority = priority;
+	sock->tx_queue = RTSKB_QUEUE_NONE;
 
 	return err;
 }
@@ -134,6 +135,8 @@ int rt_socket_common_ioctl(struct rtdm_fd *fd, int request, void __user *arg)
 	struct rtnet_callback *callback;
 	const unsigned int *val;
 	unsigned int _val;
+	const int *queue;
+	int _queue;
 	const nanosecs_rel_t *timeout;
 	nanosecs_rel_t _timeout;
 	rtdm_lockctx_t context;
@@ -146,6 +149,22 @@ int rt_socket_common_ioctl(struct rtdm_fd *fd, int request, void __user *arg)
 		sock->priority = *val;
 		break;
 
+	case RTNET_RTIOC_TXQUEUE:
+		queue = rtnet_get_arg(fd, &_queue, arg, sizeof(_queue));
+		if (IS_ERR(queue))
+			return PTR_ERR(queue);
+		/*
+		 * The device is only known at xmit time, which falls back
+		 * to the priority mapping if it has fewer queues.
+		 */
+		if (*queue == SOCK_TXQUEUE_AUTO)
+			sock->tx_queue = RTSKB_QUEUE_NONE;
+		else if (*queue >= 0 && *queue < RTDEV_MAX_QUEUES)
+			sock->tx_queue = *queue;
+		else
+			ret = -EINVAL;
+		break;
+
 	case RTNET_RTIOC_TIMEOUT:
 		timeout = rtnet_get_arg(fd, &_timeout, arg, sizeof(_timeout));
 		if (IS_ERR(timeout))
@@ -25,6 +25,10 @@
 #define pr_fmt(fmt) "RTnet: " fmt
 
 #include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
 
 #include <rtdev.h>
 #include <rtnet_internal.h>
@@ -35,11 +39,33 @@ static unsigned int stack_mgr_prio = RTNET_DEF_STACK_PRIORITY;
 module_param(stack_mgr_prio, uint, 0444);
 MODULE_PARM_DESC(stack_mgr_prio, "Priority of the stack manager task");
 
+static unsigned int stack_mgr_tasks;
+module_param(stack_mgr_tasks, uint, 0444);
+MODULE_PARM_DESC(stack_mgr_tasks,
+		 "Number of stack manager tasks (default: one per real-time CPU)");
+
 #if (CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE &                                    \
      (CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE - 1)) != 0
 #error CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE must be power of 2!
 #endif
-static DECLARE_RTSKB_FIFO(rx, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+
+/*
+ * Each stack manager task is pinned to a real-time CPU, and drains
+ * its own RX FIFO. Received frames are steered to the tasks by flow,
+ * see rt_stack_steer().
+ */
+struct rt_stack_worker {
+	rtdm_task_t task;
+	rtdm_event_t event;
+	int cpu;
+	unsigned long rx_packets; /* updated by the task only */
+	DECLARE_RTSKB_FIFO(rx, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+};
+
+static struct rt_stack_worker *stack_workers;
+static unsigned int nr_stack_workers;
+/* One bit per worker with frames queued since the last kick. */
+static unsigned long stack_workers_pending;
 
 struct list_head rt_packets[RTPACKET_HASH_TBL_SIZE];
 #ifdef CONFIG_XENO_DRIVERS_NET_ETH_P_ALL
@@ -101,6 +127,45 @@ void rtdev_remove_pack(struct rtpacket_type *pt)
 
 EXPORT_SYMBOL_GPL(rtdev_remove_pack);
 
+/***
+ *  rt_stack_steer: pick the stack manager task for a received packet
+ *
+ *  All packets of a flow go to the same task, so that they are
+ *  delivered in order. Packets received on one of several hardware
+ *  RX queues are handled by the task owning this queue, the device
+ *  already keeps flows on the same queue. Otherwise, TCP sets DF,
+ *  so its flows are told apart by ports. Other IP datagrams may be
+ *  fragmented, and only the first fragment carries ports, so only
+ *  addresses are hashed. Non-IP packets all go to the first task.
+ */
+static inline unsigned int rt_stack_steer(struct rtskb *skb)
+{
+	struct iphdr *iph;
+	struct tcphdr *th;
+	u32 ports = 0;
+
+	if (nr_stack_workers == 1)
+		return 0;
+
+	if (skb->rtdev->num_rx_queues > 1 && rtskb_rx_queue_recorded(skb))
+		return rtskb_get_queue_mapping(skb) % nr_stack_workers;
+
+	if (skb->protocol != htons(ETH_P_IP) || skb->len < sizeof(*iph))
+		return 0;
+
+	iph = (struct iphdr *)skb->data;
+	if (iph->protocol == IPPROTO_TCP &&
+	    !(iph->frag_off & htons(IP_MF | IP_OFFSET)) &&
+	    skb->len >= iph->ihl * 4 + sizeof(*th)) {
+		th = (struct tcphdr *)(skb->data + iph->ihl * 4);
+		ports = (u32)ntohs(th->source) << 16 | ntohs(th->dest);
+	}
+
+	return reciprocal_scale(jhash_3words(iph->saddr, iph->daddr, ports,
+					     iph->protocol),
+				nr_stack_workers);
+}
+
 /***
  *  rtnetif_rx: will be called from the driver interrupt handler
  *  (IRQs disabled!) and send a message to rtdev-owned stack-manager
@@ -109,17 +174,42 @@ EXPORT_SYMBOL_GPL(rtdev_remove_pack);
  */
 void rtnetif_rx(struct rtskb *skb)
 {
+	unsigned int n;
+
 	RTNET_ASSERT(skb != NULL, return;);
 	RTNET_ASSERT(skb->rtdev != NULL, return;);
 
-	if (unlikely(rtskb_fifo_insert_inirq(&rx.fifo, skb) < 0)) {
+	n = rt_stack_steer(skb);
+
+	if (unlikely(rtskb_fifo_insert_inirq(&stack_workers[n].rx.fifo,
+					     skb) < 0)) {
 		pr_warn("dropping packet in %s()\n", __FUNCTION__);
 		kfree_rtskb(skb);
+		return;
 	}
+
+	set_bit(n, &stack_workers_pending);
 }
 
 EXPORT_SYMBOL_GPL(rtnetif_rx);
 
+/***
+ *  rt_stack_mgr_kick: wake up the stack manager tasks which have
+ *  packets queued by rtnetif_rx()
+ */
+void rt_stack_mgr_kick(void)
+{
+	unsigned int n;
+
+	while (READ_ONCE(stack_workers_pending)) {
+		n = __ffs(READ_ONCE(stack_workers_pending));
+		if (test_and_clear_bit(n, &stack_workers_pending))
+			rtdm_event_signal(&stack_workers[n].event);
+	}
+}
+
+EXPORT_SYMBOL_GPL(rt_stack_mgr_kick);
+
 #if IS_ENABLED(CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK)
 #define __DELIVER_PREFIX
 #else /* !CONFIG_XENO_DRIVERS_NET_DRV_LOOPBACK */
@@ -194,16 +284,18 @@ EXPORT_SYMBOL_GPL(rt_stack_deliver);
 
 static void rt_stack_mgr_task(void *arg)
 {
-	rtdm_event_t *mgr_event = &((struct rtnet_mgr *)arg)->event;
+	struct rt_stack_worker *w = arg;
 	struct rtskb *rtskb;
 
 	while (!rtdm_task_should_stop()) {
-		if (rtdm_event_wait(mgr_event) < 0)
+		if (rtdm_event_wait(&w->event) < 0)
 			break;
 
 		/* we are the only reader => no locking required */
-		while ((rtskb = __rtskb_fifo_remove(&rx.fifo)))
+		while ((rtskb = __rtskb_fifo_remove(&w->rx.fifo))) {
+			w->rx_packets++;
 			rt_stack_deliver(rtskb);
+		}
 	}
 }
 
@@ -227,14 +319,62 @@ void rt_stack_disconnect(struct rtnet_device *rtdev)
 
 EXPORT_SYMBOL_GPL(rt_stack_disconnect);
 
+#ifdef CONFIG_XENO_OPT_VFILE
+/* Frames handled by each task, to check how flows are spread. */
+static int rt_stack_workers_show(struct xnvfile_regular_iterator *it,
+				 void *data)
+{
+	struct rt_stack_worker *w;
+	unsigned int n;
+
+	xnvfile_printf(it, "Task\tCPU\tRX packets\n");
+
+	for (n = 0; n < nr_stack_workers; n++) {
+		w = stack_workers + n;
+		xnvfile_printf(it, "%u\t%d\t%lu\n", n, w->cpu,
+			       READ_ONCE(w->rx_packets));
+	}
+
+	return 0;
+}
+
+static struct xnvfile_regular_ops rt_stack_workers_vfile_ops = {
+	.show = rt_stack_workers_show,
+};
+
+static struct xnvfile_regular rt_stack_workers_vfile = {
+	.ops = &rt_stack_workers_vfile_ops,
+};
+#endif /* CONFIG_XENO_OPT_VFILE */
+
+static void rt_stack_workers_delete(unsigned int count)
+{
+	struct rt_stack_worker *w;
+	unsigned int n;
+
+	for (n = 0; n < count; n++) {
+		w = stack_workers + n;
+		rtdm_event_destroy(&w->event);
+		rtdm_task_destroy(&w->task);
+	}
+
+	kfree(stack_workers);
+	stack_workers = NULL;
+	nr_stack_workers = 0;
+}
+
 /***
  *  rt_stack_mgr_init
+ *
+ *  The stack manager tasks are private to this module, @mgr only
+ *  provides the event drivers are connected to.
  */
 int rt_stack_mgr_init(struct rtnet_mgr *mgr)
 {
-	int i;
-
-	rtskb_fifo_init(&rx.fifo, CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+	struct rt_stack_worker *w;
+	unsigned int n = 0, max;
+	char name[32];
+	int i, cpu, ret;
 
 	for (i = 0; i < RTPACKET_HASH_TBL_SIZE; i++)
 		INIT_LIST_HEAD(&rt_packets[i]);
@@ -244,8 +384,58 @@ int rt_stack_mgr_init(struct rtnet_mgr *mgr)
 
 	rtdm_event_init(&mgr->event, 0);
 
-	return rtdm_task_init(&mgr->task, "rtnet-stack", rt_stack_mgr_task, mgr,
-			      stack_mgr_prio, 0);
+	max = min_t(unsigned int, num_online_cpus(), BITS_PER_LONG);
+	if (stack_mgr_tasks > 0 && stack_mgr_tasks < max)
+		max = stack_mgr_tasks;
+
+	stack_workers = kcalloc(max, sizeof(*w), GFP_KERNEL);
+	if (stack_workers == NULL) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	for_each_realtime_cpu(cpu) {
+		if (!xnsched_threading_cpu(cpu))
+			continue;
+		if (n == max)
+			break;
+		w = stack_workers + n;
+		w->cpu = cpu;
+		rtskb_fifo_init(&w->rx.fifo,
+				CONFIG_XENO_DRIVERS_NET_RX_FIFO_SIZE);
+		rtdm_event_init(&w->event, 0);
+		snprintf(name, sizeof(name), "rtnet-stack/%d", cpu);
+		ret = rtdm_task_init_cpu(&w->task, name, rt_stack_mgr_task, w,
+					 stack_mgr_prio, 0, cpu);
+		if (ret) {
+			rtdm_event_destroy(&w->event);
+			goto fail_workers;
+		}
+		n++;
+	}
+
+	if (n == 0) {
+		ret = -ENODEV;
+		goto fail_workers;
+	}
+
+	nr_stack_workers = n;
+
+#ifdef CONFIG_XENO_OPT_VFILE
+	ret = xnvfile_init_regular("stack_workers", &rt_stack_workers_vfile,
+				   &rtnet_proc_root);
+	if (ret < 0)
+		goto fail_workers;
+#endif /* CONFIG_XENO_OPT_VFILE */
+
+	return 0;
+
+fail_workers:
+	rt_stack_workers_delete(n);
+fail:
+	rtdm_event_destroy(&mgr->event);
+
+	return ret;
 }
 
 /***
@@ -253,6 +443,9 @@ int rt_stack_mgr_init(struct rtnet_mgr *mgr)
  */
 void rt_stack_mgr_delete(struct rtnet_mgr *mgr)
 {
+#ifdef CONFIG_XENO_OPT_VFILE
+	xnvfile_destroy_regular(&rt_stack_workers_vfile);
+#endif /* CONFIG_XENO_OPT_VFILE */
+	rt_stack_workers_delete(nr_stack_workers);
 	rtdm_event_destroy(&mgr->event);
-	rtdm_task_destroy(&mgr->task);
 }
@@ -0,0 +1,150 @@
+/*
+ * Xenomai is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <linux/module.h>
+#include <linux/vmalloc.h>
+#include <linux/kernel.h>
+#include <linux/random.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#include <rtdm/testing.h>
+#include <rtdm/driver.h>
+#include <rtnet_checksum.h>
+
+#define complain(__fmt, __args...)	\
+	printk(XENO_WARNING "csum bench: " __fmt "\n", ##__args)
+
+static const struct rtnet_csum_copy_variant *find_variant(unsigned int index)
+{
+	const struct rtnet_csum_copy_variant *v;
+
+	for (v = rtnet_csum_copy_variants; v->name; v++)
+		if (index-- == 0)
+			return v;
+
+	return NULL;
+}
+
+static int run_bench(struct rttst_csum_parms *parms)
+{
+	const struct rtnet_csum_copy_variant *v;
+	nanosecs_abs_t start;
+	__wsum ref, csum;
+	u8 *src, *dst;
+	unsigned int n;
+	u16 diff;
+	int ret = 0;
+
+	v = find_variant(parms->variant);
+	if (v == NULL)
+		return -ENOENT;
+
+	if (parms->len == 0 || parms->len > RTTST_CSUMBENCH_MAX_LEN ||
+	    parms->offset >= 8 || parms->loops == 0)
+		return -EINVAL;
+
+	src = vmalloc(parms->len + 8);
+	dst = vmalloc(parms->len + 8);
+	if (src == NULL || dst == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	get_random_bytes(src, parms->len + 8);
+	src += parms->offset;
+	dst += parms->offset;
+
+	/* Check the result against the generic checksum first. */
+	ref = csum_partial(src, parms->len, 0);
+	csum = v->copy(src, dst, parms->len, 0);
+	diff = (__force u16)csum_fold(csum_sub(csum, ref));
+	if ((diff != 0 && diff != 0xffff) || memcmp(src, dst, parms->len)) {
+		complain("%s: wrong result on %u bytes at offset %u",
+			 v->name, parms->len, parms->offset);
+		ret = -EPROTO;
+		goto unmap;
+	}
+
+	start = rtdm_clock_read_monotonic();
+	for (n = 0; n < parms->loops; n++)
+		v->copy(src, dst, parms->len, 0);
+	parms->avg_ns = div_u64(rtdm_clock_read_monotonic() - start,
+				parms->loops);
+	strscpy(parms->name, v->name, sizeof(parms->name));
+unmap:
+	src -= parms->offset;
+	dst -= parms->offset;
+out:
+	vfree(dst);
+	vfree(src);
+
+	return ret;
+}
+
+static int csumbench_ioctl(struct rtdm_fd *fd,
+			   unsigned int request, void __user *arg)
+{
+	struct rttst_csum_parms parms;
+	int ret;
+
+	switch (request) {
+	case RTTST_RTIOC_CSUM_BENCH:
+		ret = rtdm_copy_from_user(fd, &parms, arg, sizeof(parms));
+		if (ret)
+			return ret;
+		ret = run_bench(&parms);
+		if (ret)
+			return ret;
+		ret = rtdm_copy_to_user(fd, arg, &parms, sizeof(parms));
+		break;
+	default:
+		ret = -EINVAL;
+	}
+
+	return ret;
+}
+
+static struct rtdm_driver csumbench_driver = {
+	.profile_info		= RTDM_PROFILE_INFO(csum_bench,
+						    RTDM_CLASS_TESTING,
+						    RTDM_SUBCLASS_CSUMBENCH,
+						    RTTST_PROFILE_VER),
+	.device_flags		= RTDM_NAMED_DEVICE,
+	.device_count		= 1,
+	.ops = {
+		.ioctl_nrt	= csumbench_ioctl,
+	},
+};
+
+static struct rtdm_device csumbench_device = {
+	.driver = &csumbench_driver,
+	.label = "csumbench",
+};
+
+static int __init csumbench_init(void)
+{
+	return rtdm_dev_register(&csumbench_device);
+}
+
+static void __exit csumbench_exit(void)
+{
+	rtdm_dev_unregister(&csumbench_device);
+}
+
+module_init(csumbench_init);
+module_exit(csumbench_exit);
+
+MODULE_LICENSE("GPL");
@@ -23,6 +23,8 @@
 #include <linux/random.h>
 #include <cobalt/kernel/assert.h>
 #include <cobalt/kernel/heap.h>
+#include <cobalt/kernel/sched.h>
+#include <cobalt/kernel/thread.h>
 #include <rtdm/testing.h>
 #include <rtdm/driver.h>
 
@@ -419,6 +421,204 @@ bad:
 	goto done;
 }
 
+#define SMP_MAX_BLOCKS  64
+
+struct smp_worker {
+	struct xnthread thread;
+	rtdm_sem_t *start;
+	size_t block_size;
+	int loops;
+	int nrblocks;
+	s64 alloc_ns;
+	s64 free_ns;
+	s64 elapsed_ns;
+	int status;
+};
+
+static void smp_worker(void *cookie)
+{
+	struct smp_worker *w = cookie;
+	nanosecs_abs_t t0, t1, t2, start;
+	void *blocks[SMP_MAX_BLOCKS];
+	int loop, n, nr;
+
+	if (rtdm_sem_down(w->start)) {
+		w->status = -EINTR;
+		return;
+	}
+
+	start = rtdm_clock_read_monotonic();
+
+	for (loop = 0; loop < w->loops; loop++) {
+		t0 = rtdm_clock_read_monotonic();
+		for (nr = 0; nr < w->nrblocks; nr++) {
+			blocks[nr] = xnheap_alloc(&test_heap, w->block_size);
+			if (blocks[nr] == NULL)
+				break;
+		}
+		t1 = rtdm_clock_read_monotonic();
+		for (n = 0; n < nr; n++)
+			xnheap_free(&test_heap, blocks[n]);
+		t2 = rtdm_clock_read_monotonic();
+		w->alloc_ns += t1 - t0;
+		w->free_ns += t2 - t1;
+		if (nr < w->nrblocks) {
+			w->status = -ENOMEM;
+			break;
+		}
+	}
+
+	w->elapsed_ns = rtdm_clock_read_monotonic() - start;
+}
+
+static int start_worker(struct smp_worker *w, int cpu)
+{
+	union xnsched_policy_param param;
+	struct xnthread_start_attr sattr;
+	struct xnthread_init_attr iattr;
+	char name[XNOBJECT_NAME_LEN];
+	int ret;
+
+	ksformat(name, sizeof(name), "heapcheck/%d", cpu);
+	iattr.name = name;
+	iattr.flags = 0;
+	iattr.personality = &xenomai_personality;
+	iattr.affinity = *cpumask_of(cpu);
+	param.rt.prio = 10;
+
+	set_cpus_allowed_ptr(current, cpumask_of(cpu));
+
+	ret = xnthread_init(&w->thread, &iattr, &xnsched_class_rt, &param);
+	if (ret)
+		return ret;
+
+	sattr.mode = 0;
+	sattr.entry = smp_worker;
+	sattr.cookie = w;
+	ret = xnthread_start(&w->thread, &sattr);
+	if (ret)
+		__xnthread_discard(&w->thread);
+
+	return ret;
+}
+
+/*
+ * Hammer a test heap from real-time threads running concurrently
+ * on @nrcpus CPUs, each of them allocating then releasing bursts
+ * of @nrblocks blocks. This measures the contention on the heap
+ * lock, with or without per-CPU magazines.
+ */
+static int test_smp(struct rtdm_fd *fd,
+		    struct rttst_heap_smp_parms __user *u_parms)
+{
+	s64 alloc_sum = 0, free_sum = 0, max_elapsed = 0;
+	struct rttst_heap_smp_parms parms;
+	struct smp_worker *workers, *w;
+	int ret, n, cpu, nrstarted;
+	cpumask_var_t oldmask;
+	rtdm_sem_t start;
+	u64 nrops;
+	void *mem;
+
+	ret = rtdm_safe_copy_from_user(fd, &parms, u_parms, sizeof(parms));
+	if (ret)
+		return ret;
+
+	if (parms.nrcpus <= 0 || parms.nrcpus > num_online_cpus() ||
+	    parms.loops <= 0 ||
+	    parms.nrblocks <= 0 || parms.nrblocks > SMP_MAX_BLOCKS ||
+	    parms.block_size == 0 || parms.heap_size == 0)
+		return -EINVAL;
+
+	if (!IS_ENABLED(CONFIG_XENO_OPT_HEAP_MAGAZINES))
+		parms.flags &= ~RTTST_HEAPCHECK_MAGAZINES;
+
+	mem = vmalloc(parms.heap_size);
+	if (mem == NULL)
+		return -ENOMEM;
+
+	ret = xnheap_init(&test_heap, mem, parms.heap_size);
+	if (ret)
+		goto out;
+
+	if (parms.flags & RTTST_HEAPCHECK_MAGAZINES) {
+		ret = xnheap_enable_magazines(&test_heap);
+		if (ret)
+			goto no_workers;
+	}
+
+	workers = vzalloc(sizeof(*workers) * parms.nrcpus);
+	if (workers == NULL) {
+		ret = -ENOMEM;
+		goto no_workers;
+	}
+
+	if (!alloc_cpumask_var(&oldmask, GFP_KERNEL)) {
+		ret = -ENOMEM;
+		goto no_mask;
+	}
+
+	cpumask_copy(oldmask, current->cpus_ptr);
+	rtdm_sem_init(&start, 0);
+
+	nrstarted = 0;
+	for_each_online_cpu(cpu) {
+		if (nrstarted >= parms.nrcpus)
+			break;
+		if (!xnsched_supported_cpu(cpu))
+			continue;
+		w = workers + nrstarted;
+		w->start = &start;
+		w->block_size = parms.block_size;
+		w->loops = parms.loops;
+		w->nrblocks = parms.nrblocks;
+		ret = start_worker(w, cpu);
+		if (ret)
+			break;
+		nrstarted++;
+	}
+
+	/* Release all workers at once, their bursts should overlap. */
+	for (n = 0; n < nrstarted; n++)
+		rtdm_sem_up(&start);
+
+	for (n = 0; n < nrstarted; n++) {
+		w = workers + n;
+		xnthread_join(&w->thread, true);
+		if (w->status && ret == 0)
+			ret = w->status;
+		alloc_sum += w->alloc_ns;
+		free_sum += w->free_ns;
+		if (w->elapsed_ns > max_elapsed)
+			max_elapsed = w->elapsed_ns;
+	}
+
+	rtdm_sem_destroy(&start);
+	set_cpus_allowed_ptr(current, oldmask);
+	free_cpumask_var(oldmask);
+
+	if (ret == 0 && nrstarted < parms.nrcpus)
+		ret = -EINVAL;	/* Not enough real-time CPUs. */
+
+	if (ret == 0) {
+		nrops = (u64)nrstarted * parms.loops * parms.nrblocks;
+		parms.alloc_avg_ns = div64_u64(alloc_sum, nrops);
+		parms.free_avg_ns = div64_u64(free_sum, nrops);
+		parms.ops_per_sec = max_elapsed > 0 ?
+			div64_u64(nrops * 1000000000ULL, max_elapsed) : 0;
+		ret = rtdm_safe_copy_to_user(fd, u_parms, &parms,
+					     sizeof(parms));
+	}
+no_mask:
+	vfree(workers);
+no_workers:
+	xnheap_destroy(&test_heap);
+out:
+	vfree(mem);
+
+	return ret;
+}
+
 static int collect_stats(struct rtdm_fd *fd,
 			 struct rttst_heap_stats __user *buf, int nr)
 {
@@ -476,6 +676,9 @@ static int heapcheck_ioctl(struct rtdm_fd *fd,
 		parms.nrstats = nrstats;
 		ret = rtdm_copy_to_user(fd, arg, &parms, sizeof(parms));
 		break;
+	case RTTST_RTIOC_HEAP_CHECK_SMP:
+		ret = test_smp(fd, arg);
+		break;
 	case RTTST_RTIOC_HEAP_STAT_COLLECT:
 		sthdr.buf = NULL;
 #ifdef CONFIG_XENO_ARCH_SYS3264
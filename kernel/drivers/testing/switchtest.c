@@ -17,6 +17,7 @@
  */
 #include <linux/module.h>
 #include <linux/vmalloc.h>
+#include <linux/slab.h>
 #include <linux/semaphore.h>
 #include <cobalt/kernel/sched.h>
 #include <cobalt/kernel/synch.h>
@@ -25,6 +26,7 @@
 #include <rtdm/testing.h>
 #include <rtdm/driver.h>
 #include <asm/xenomai/fptest.h>
+#include "lcg.h"
 
 MODULE_DESCRIPTION("Cobalt context switch test helper");
 MODULE_AUTHOR("Gilles Chanteperdrix <gilles.chanteperdrix@xenomai.org>");
@@ -547,6 +549,112 @@ static void rtswitch_close(struct rtdm_fd *fd)
 	}
 }
 
+#if IS_BUILTIN(CONFIG_XENO_DRIVERS_SWITCHTEST)
+
+static inline int pick_prio(unsigned int *seed)
+{
+	return XNSCHED_FIFO_MIN_PRIO + (rttst_lcg_next(seed) >> 8) %
+		(XNSCHED_FIFO_MAX_PRIO - XNSCHED_FIFO_MIN_PRIO + 1);
+}
+
+/*
+ * Measure the cost of picking the next thread to run from a
+ * runnable queue holding a given number of ready threads at mixed
+ * priorities, then putting it back at some other priority level.
+ * The queue is private and only populated with placeholder
+ * threads, timings are taken under nklock so that only the queue
+ * overhead is accounted for. The queue routines are internal to the
+ * core, so this is only available when built into the kernel.
+ */
+static int rtswitch_pick_bench(struct rtdm_fd *fd,
+			       struct rttst_schedq_parms __user *u_parms)
+{
+	s64 pick_sum = 0, requeue_sum = 0, dt;
+	struct rttst_schedq_parms parms;
+	nanosecs_abs_t start, end;
+	struct xnthread *threads, *thread;
+	unsigned int n, loop, seed = 1;
+	struct {
+		XNSCHED_MLQ(runnable, XNSCHED_MLQ_LEVELS);
+	} *rq;
+	xnsched_queue_t *q;
+	spl_t s;
+	int ret;
+
+	ret = rtdm_safe_copy_from_user(fd, &parms, u_parms, sizeof(parms));
+	if (ret)
+		return ret;
+
+	if (parms.nrthreads == 0 ||
+	    parms.nrthreads > RTTST_SCHEDQ_MAX_THREADS ||
+	    parms.loops == 0)
+		return -EINVAL;
+
+	rq = kmalloc(sizeof(*rq), GFP_KERNEL);
+	if (rq == NULL)
+		return -ENOMEM;
+
+	threads = vzalloc(sizeof(*threads) * parms.nrthreads);
+	if (threads == NULL) {
+		kfree(rq);
+		return -ENOMEM;
+	}
+
+	/* Same layout as the runnable queue of the RT class. */
+	q = &rq->runnable;
+	xnsched_initq(q, XNSCHED_MLQ_LEVELS);
+
+	for (n = 0; n < parms.nrthreads; n++) {
+		threads[n].cprio = pick_prio(&seed);
+		xnsched_addq_tail(q, threads + n);
+	}
+
+	parms.pick_max_ns = 0;
+	parms.requeue_max_ns = 0;
+
+	for (loop = 0; loop < parms.loops; loop++) {
+		cobalt_atomic_enter(s);
+		start = rtdm_clock_read_monotonic();
+		thread = xnsched_getq(q);
+		end = rtdm_clock_read_monotonic();
+		dt = end - start;
+		pick_sum += dt;
+		if (dt > parms.pick_max_ns)
+			parms.pick_max_ns = dt;
+
+		thread->cprio = pick_prio(&seed);
+		start = rtdm_clock_read_monotonic();
+		xnsched_addq_tail(q, thread);
+		end = rtdm_clock_read_monotonic();
+		cobalt_atomic_leave(s);
+		dt = end - start;
+		requeue_sum += dt;
+		if (dt > parms.requeue_max_ns)
+			parms.requeue_max_ns = dt;
+
+		if ((loop % 1000) == 0)
+			cond_resched();
+	}
+
+	vfree(threads);
+	kfree(rq);
+
+	parms.pick_avg_ns = div_s64(pick_sum, parms.loops);
+	parms.requeue_avg_ns = div_s64(requeue_sum, parms.loops);
+
+	return rtdm_safe_copy_to_user(fd, u_parms, &parms, sizeof(parms));
+}
+
+#else /* !IS_BUILTIN(CONFIG_XENO_DRIVERS_SWITCHTEST) */
+
+static int rtswitch_pick_bench(struct rtdm_fd *fd,
+			       struct rttst_schedq_parms __user *u_parms)
+{
+	return -ENOSYS;
+}
+
+#endif /* !IS_BUILTIN(CONFIG_XENO_DRIVERS_SWITCHTEST) */
+
 static int rtswitch_ioctl_nrt(struct rtdm_fd *fd,
 			      unsigned int request,
 			      void *arg)
@@ -649,6 +757,9 @@ static int rtswitch_ioctl_nrt(struct rtdm_fd *fd,
 
 		return 0;
 
+	case RTTST_RTIOC_SWTEST_PICK_BENCH:
+		return rtswitch_pick_bench(fd, arg);
+
 	default:
 		return -ENOSYS;
 	}
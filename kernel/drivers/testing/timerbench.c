@@ -18,12 +18,15 @@
 
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/semaphore.h>
+#include <linux/delay.h>
 #include <cobalt/kernel/trace.h>
 #include <cobalt/kernel/arith.h>
 #include <rtdm/testing.h>
 #include <rtdm/driver.h>
 #include <rtdm/compat.h>
+#include "lcg.h"
 
 MODULE_DESCRIPTION("Timer latency test helper");
 MODULE_AUTHOR("Jan Kiszka <jan.kiszka@web.de>");
@@ -436,6 +439,215 @@ static int rt_tmbench_stop(struct rt_tmbench_context *ctx, void *u_res)
 	return ret;
 }
 
+struct tmqueue_timer {
+	rtdm_timer_t timer;
+	nanosecs_abs_t date;
+	struct tmqueue_check *check;
+	bool armed;
+};
+
+struct tmqueue_check {
+	nanosecs_abs_t last;
+	bool running;
+	unsigned int misordered;
+	unsigned int stray;
+};
+
+static void tmqueue_handler(rtdm_timer_t *timer)
+{
+	struct tmqueue_timer *t = container_of(timer, struct tmqueue_timer,
+					       timer);
+	struct tmqueue_check *check = t->check;
+
+	/*
+	 * Runs from the core tick under nklock. All timers are queued
+	 * to the same CPU, so they must fire in date order.
+	 */
+	if (!check->running || !t->armed) {
+		check->stray++;
+		return;
+	}
+
+	t->armed = false;
+	if (t->date < check->last)
+		check->misordered++;
+	else
+		check->last = t->date;
+}
+
+static inline nanosecs_abs_t tmqueue_date(nanosecs_abs_t base,
+					  unsigned int *seed)
+{
+	/* Pick a date within [base, base + ~4s) at ~1us granularity. */
+	return base + ((nanosecs_abs_t)(rttst_lcg_next(seed) >> 10) << 10);
+}
+
+/*
+ * Re-arm all timers at random dates in the near future, stop some
+ * of them at random, then let the others expire. Every armed timer
+ * must fire once in date order, stopped ones must not fire.
+ */
+static int tmqueue_check_expiry(struct tmqueue_timer *timers,
+				struct rttst_tmqueue_parms *parms,
+				unsigned int *seed)
+{
+	struct tmqueue_check *check = timers[0].check;
+	unsigned int n, window, missed = 0;
+	nanosecs_abs_t base;
+	spl_t s;
+	int ret;
+
+	/* Some 10us per timer, so that expiries don't storm. */
+	window = parms->nrtimers * 10000;
+	base = rtdm_clock_read_monotonic() + 100000000;
+
+	cobalt_atomic_enter(s);
+	check->last = 0;
+	check->running = true;
+	cobalt_atomic_leave(s);
+
+	for (n = 0; n < parms->nrtimers; n++) {
+		cobalt_atomic_enter(s);
+		rtdm_timer_stop_in_handler(&timers[n].timer);
+		timers[n].date = base + rttst_lcg_next(seed) % window;
+		ret = rtdm_timer_start_in_handler(&timers[n].timer,
+						  timers[n].date, 0,
+						  RTDM_TIMERMODE_ABSOLUTE);
+		timers[n].armed = ret == 0;
+		cobalt_atomic_leave(s);
+		if (ret)
+			return ret;
+	}
+
+	for (n = 0; n < parms->nrtimers; n++) {
+		if (rttst_lcg_next(seed) & 0x300)
+			continue;
+		cobalt_atomic_enter(s);
+		rtdm_timer_stop_in_handler(&timers[n].timer);
+		timers[n].armed = false;
+		cobalt_atomic_leave(s);
+	}
+
+	/*
+	 * A timer armed once the first ones have fired could be due
+	 * earlier than them, the ordering check would not hold.
+	 */
+	if (rtdm_clock_read_monotonic() >= base)
+		return -ETIME;
+
+	msleep(div_u64(base + window - rtdm_clock_read_monotonic(),
+		       1000000) + 100);
+
+	cobalt_atomic_enter(s);
+	check->running = false;
+	for (n = 0; n < parms->nrtimers; n++) {
+		if (timers[n].armed)
+			missed++;
+	}
+	parms->missed = missed;
+	parms->misordered = check->misordered;
+	parms->stray = check->stray;
+	cobalt_atomic_leave(s);
+
+	return 0;
+}
+
+/*
+ * Measure the cost of inserting and removing timers to/from the
+ * per-CPU timer queue, with a given number of timers outstanding.
+ * Queue operations are timed under nklock, so that only the
+ * indexing overhead is accounted for. The queue is then checked for
+ * ordering and expiry.
+ */
+static int rt_tmbench_queue(struct rtdm_fd *fd,
+			    struct rttst_tmqueue_parms __user *u_parms)
+{
+	nanosecs_abs_t base, start, end, date;
+	struct rttst_tmqueue_parms parms;
+	s64 ins_sum = 0, rm_sum = 0, dt;
+	unsigned int n, loop, seed = 1;
+	struct tmqueue_check check;
+	struct tmqueue_timer *timers;
+	rtdm_timer_t *timer;
+	spl_t s;
+	int ret;
+
+	ret = rtdm_safe_copy_from_user(fd, &parms, u_parms, sizeof(parms));
+	if (ret)
+		return ret;
+
+	if (parms.nrtimers == 0 ||
+	    parms.nrtimers > RTTST_TMQUEUE_MAX_TIMERS ||
+	    parms.loops == 0)
+		return -EINVAL;
+
+	timers = vzalloc(sizeof(*timers) * parms.nrtimers);
+	if (timers == NULL)
+		return -ENOMEM;
+
+	memset(&check, 0, sizeof(check));
+
+	for (n = 0; n < parms.nrtimers; n++) {
+		timers[n].check = &check;
+		rtdm_timer_init(&timers[n].timer, tmqueue_handler, "tmqueue");
+	}
+
+	base = rtdm_clock_read_monotonic() + 10000000000ULL;
+
+	for (n = 0; n < parms.nrtimers; n++) {
+		date = tmqueue_date(base, &seed);
+		cobalt_atomic_enter(s);
+		rtdm_timer_start_in_handler(&timers[n].timer, date, 0,
+					    RTDM_TIMERMODE_ABSOLUTE);
+		cobalt_atomic_leave(s);
+	}
+
+	parms.insert_max_ns = 0;
+	parms.remove_max_ns = 0;
+
+	for (loop = 0; loop < parms.loops; loop++) {
+		timer = &timers[rttst_lcg_next(&seed) % parms.nrtimers].timer;
+		date = tmqueue_date(base, &seed);
+
+		cobalt_atomic_enter(s);
+		start = rtdm_clock_read_monotonic();
+		rtdm_timer_stop_in_handler(timer);
+		end = rtdm_clock_read_monotonic();
+		dt = end - start;
+		rm_sum += dt;
+		if (dt > parms.remove_max_ns)
+			parms.remove_max_ns = dt;
+
+		start = rtdm_clock_read_monotonic();
+		rtdm_timer_start_in_handler(timer, date, 0,
+					    RTDM_TIMERMODE_ABSOLUTE);
+		end = rtdm_clock_read_monotonic();
+		cobalt_atomic_leave(s);
+		dt = end - start;
+		ins_sum += dt;
+		if (dt > parms.insert_max_ns)
+			parms.insert_max_ns = dt;
+
+		if ((loop % 1000) == 0)
+			cond_resched();
+	}
+
+	ret = tmqueue_check_expiry(timers, &parms, &seed);
+
+	for (n = 0; n < parms.nrtimers; n++)
+		rtdm_timer_destroy(&timers[n].timer);
+
+	vfree(timers);
+
+	if (ret)
+		return ret;
+
+	parms.insert_avg_ns = div_s64(ins_sum, parms.loops);
+	parms.remove_avg_ns = div_s64(rm_sum, parms.loops);
+
+	return rtdm_safe_copy_to_user(fd, u_parms, &parms, sizeof(parms));
+}
+
 static int rt_tmbench_ioctl_nrt(struct rtdm_fd *fd,
 				unsigned int request, void __user *arg)
 {
@@ -452,6 +664,10 @@ static int rt_tmbench_ioctl_nrt(struct rtdm_fd *fd,
 	COMPAT_CASE(RTTST_RTIOC_TMBENCH_STOP):
 		err = rt_tmbench_stop(ctx, arg);
 		break;
+
+	case RTTST_RTIOC_TMBENCH_QUEUE:
+		err = rt_tmbench_queue(fd, arg);
+		break;
 	default:
 		err = -ENOSYS;
 	}
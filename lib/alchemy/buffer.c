@@ -135,10 +135,38 @@ static int buffer_registry_open(struct fsobj *fsobj, void *priv)
 	return 0;
 }
 
+static void collect_buffer_state(void *p, struct fsobj *fsobj)
+{
+	struct regsnap_alchemy_buffer *state = p;
+	struct alchemy_buffer *bcb;
+
+	bcb = container_of(fsobj, struct alchemy_buffer, fsobj);
+	state->bufsz = bcb->bufsz;
+	state->fillsz = bcb->fillsz;
+	state->mode = bcb->mode;
+}
+
+/* Input waiters are on the grant side, output waiters on the drain side. */
+static const struct fssnapshot_syncops snapshot_ops = {
+	.class = REGSNAP_ALCHEMY_BUFFER,
+	.state_size = sizeof(struct regsnap_alchemy_buffer),
+	.collect_state = collect_buffer_state,
+};
+
+static int buffer_registry_snapshot(struct fsobj *fsobj, struct fssnapshot *s)
+{
+	struct alchemy_buffer *bcb;
+
+	bcb = container_of(fsobj, struct alchemy_buffer, fsobj);
+
+	return fssnapshot_grab_syncobj(s, fsobj, &bcb->sobj, &snapshot_ops);
+}
+
 static struct registry_operations registry_ops = {
 	.open		= buffer_registry_open,
 	.release	= fsobj_obstack_release,
-	.read		= fsobj_obstack_read
+	.read		= fsobj_obstack_read,
+	.snapshot	= buffer_registry_snapshot
 };
 
 #else /* !CONFIG_XENO_REGISTRY */
@@ -165,9 +193,10 @@ fnref_register(libalchemy, buffer_finalize);
  * This routine creates an IPC object that allows tasks to send and
  * receive data asynchronously via a memory buffer. Data may be of an
  * arbitrary length, albeit this IPC is best suited for small to
- * medium-sized messages, since data always have to be copied to the
- * buffer during transit. Large messages may be more efficiently
- * handled by message queues (RT_QUEUE).
+ * medium-sized messages, since data have to be copied to the buffer
+ * during transit, unless they are built and consumed in place (see
+ * rt_buffer_reserve() and rt_buffer_peek()). Large messages may be
+ * more efficiently handled by message queues (RT_QUEUE).
  *
  * @param bf The address of a buffer descriptor which can be later
  * used to identify uniquely the created object, upon success of this
@@ -246,6 +275,8 @@ int rt_buffer_create(RT_BUFFER *bf, const char *name,
 	bcb->rdoff = 0;
 	bcb->wroff = 0;
 	bcb->fillsz = 0;
+	bcb->resvsz = 0;
+	bcb->peeksz = 0;
 	if (mode & B_PRIO)
 		sobj_flags = SYNCOBJ_PRIO;
 
@@ -490,9 +521,10 @@ redo:
 	for (;;) {
 		/*
 		 * We should be able to read a complete message of the
-		 * requested length, or block.
+		 * requested length, or block. Data loaned to a
+		 * consumer must be released first.
 		 */
-		if (bcb->fillsz < len)
+		if (bcb->peeksz > 0 || bcb->fillsz < len)
 			goto wait;
 
 		/* Read from the buffer in a circular way. */
@@ -525,7 +557,7 @@ redo:
 			goto done;
 
 		wait = threadobj_get_wait(thobj);
-		if (wait->size + bcb->fillsz <= bcb->bufsz)
+		if (wait->size + bcb->fillsz + bcb->resvsz <= bcb->bufsz)
 			syncobj_drain(&bcb->sobj);
 
 		goto done;
@@ -542,7 +574,8 @@ redo:
 		 * pathological use of the buffer. We must allow for a
 		 * short read to prevent a deadlock.
 		 */
-		if (bcb->fillsz > 0 && syncobj_count_drain(&bcb->sobj)) {
+		if (bcb->peeksz == 0 && bcb->fillsz > 0 &&
+		    syncobj_count_drain(&bcb->sobj)) {
 			len = bcb->fillsz;
 			goto redo;
 		}
@@ -709,9 +742,10 @@ ssize_t rt_buffer_write_timed(RT_BUFFER *bf,
 	for (;;) {
 		/*
 		 * We should be able to write the entire message at
-		 * once, or block.
+		 * once, or block. Space loaned to a producer must be
+		 * committed first.
 		 */
-		if (bcb->fillsz + len > bcb->bufsz)
+		if (bcb->resvsz > 0 || bcb->fillsz + len > bcb->bufsz)
 			goto wait;
 
 		/* Write to the buffer in a circular way. */
@@ -795,11 +829,526 @@ out:
 	return ret;
 }
 
+static void get_ring_iov(struct alchemy_buffer *bcb,
+			 size_t off, size_t len, struct iovec iov[2])
+{
+	void *base = __mptr(bcb->buf);
+	size_t n;
+
+	n = bcb->bufsz - off;
+	if (n > len)
+		n = len;
+
+	iov[0].iov_base = base + off;
+	iov[0].iov_len = n;
+	iov[1].iov_base = base;
+	iov[1].iov_len = len - n;
+}
+
+/**
+ * @fn ssize_t rt_buffer_reserve(RT_BUFFER *bf, size_t size, struct iovec iov[2], RTIME timeout)
+ * @brief Reserve buffer space for writing in place (with relative scalar timeout).
+ *
+ * This routine is a variant of rt_buffer_reserve_timed() accepting a
+ * relative timeout specification expressed as a scalar value.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param size The length in bytes of the space to reserve.
+ *
+ * @param iov The two-segment vector describing the reserved space.
+ *
+ * @param timeout A delay expressed in clock ticks. Passing
+ * TM_INFINITE causes the caller to block indefinitely until enough
+ * buffer space is available. Passing TM_NONBLOCK causes the service
+ * to return immediately without blocking in case of buffer space
+ * shortage.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+
+/**
+ * @fn ssize_t rt_buffer_reserve_until(RT_BUFFER *bf, size_t size, struct iovec iov[2], RTIME abs_timeout)
+ * @brief Reserve buffer space for writing in place (with absolute scalar timeout).
+ *
+ * This routine is a variant of rt_buffer_reserve_timed() accepting an
+ * absolute timeout specification expressed as a scalar value.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param size The length in bytes of the space to reserve.
+ *
+ * @param iov The two-segment vector describing the reserved space.
+ *
+ * @param abs_timeout An absolute date expressed in clock ticks.
+ * Passing TM_INFINITE causes the caller to block indefinitely until
+ * enough buffer space is available. Passing TM_NONBLOCK causes the
+ * service to return immediately without blocking in case of buffer
+ * space shortage.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+
+/**
+ * @fn ssize_t rt_buffer_reserve_timed(RT_BUFFER *bf, size_t size, struct iovec iov[2], const struct timespec *abs_timeout)
+ * @brief Reserve buffer space for writing in place.
+ *
+ * This routine loans @a size bytes of free space from the buffer to
+ * the caller, which may then build a message directly into it
+ * instead of having rt_buffer_write() copy it. The message is
+ * published by a subsequent call to rt_buffer_commit(). If not
+ * enough buffer space is available on entry, the caller is allowed
+ * to block until enough room is freed, or a timeout elapses,
+ * whichever comes first, exactly like rt_buffer_write_timed() does.
+ *
+ * Since the buffer is circular, the reserved space may wrap around
+ * its end. Therefore it is described by two segments, the second one
+ * being empty (i.e. iov[1].iov_len is zero) unless the space
+ * wraps.
+ *
+ * Only a single reservation may be pending on a buffer at any point
+ * in time. Until it is committed, rt_buffer_write() blocks, so the
+ * caller must not write to the buffer by other means meanwhile.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param size The length in bytes of the space to reserve.
+ *
+ * @param iov The two-segment vector describing the reserved space
+ * upon success.
+ *
+ * @param abs_timeout An absolute date expressed in seconds / nanoseconds,
+ * based on the Alchemy clock, specifying a time limit to wait for enough
+ * buffer space to be available. Passing NULL causes the caller to
+ * block indefinitely until enough buffer space is available. Passing
+ * { .tv_sec = 0, .tv_nsec = 0 } causes the service to return
+ * immediately without blocking in case of buffer space shortage.
+ *
+ * @return The number of bytes reserved is returned upon
+ * success. Otherwise:
+ *
+ * - -ETIMEDOUT is returned if the absolute @a abs_timeout date is
+ * reached before enough buffer space is available.
+ *
+ * - -EWOULDBLOCK is returned if @a abs_timeout is { .tv_sec = 0,
+ * .tv_nsec = 0 } and not enough buffer space is immediately
+ * available on entry.
+ *
+ * - -EINTR is returned if rt_task_unblock() was called for the
+ * current task before enough buffer space became available.
+ *
+ * - -EBUSY is returned if a reservation is already pending on the
+ * buffer.
+ *
+ * - -EINVAL is returned if @a bf is not a valid buffer descriptor, or
+ * @a size is greater than the actual buffer length.
+ *
+ * - -EIDRM is returned if @a bf is deleted while the caller was
+ * waiting for buffer space. In such event, @a bf is no more valid
+ * upon return of this service.
+ *
+ * - -EPERM is returned if this service should block, but was not
+ * called from a Xenomai thread.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+ssize_t rt_buffer_reserve_timed(RT_BUFFER *bf,
+				size_t size, struct iovec iov[2],
+				const struct timespec *abs_timeout)
+{
+	struct alchemy_buffer_wait *wait = NULL;
+	struct alchemy_buffer *bcb;
+	struct syncstate syns;
+	struct service svc;
+	int ret = 0;
+
+	if (size == 0)
+		return 0;
+
+	if (!threadobj_current_p() && !alchemy_poll_mode(abs_timeout))
+		return -EPERM;
+
+	CANCEL_DEFER(svc);
+
+	bcb = get_alchemy_buffer(bf, &syns, &ret);
+	if (bcb == NULL)
+		goto out;
+
+	if (size > bcb->bufsz) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	for (;;) {
+		if (bcb->resvsz > 0) {
+			ret = -EBUSY;
+			goto done;
+		}
+
+		if (bcb->fillsz + size <= bcb->bufsz)
+			break;
+
+		if (alchemy_poll_mode(abs_timeout)) {
+			ret = -EWOULDBLOCK;
+			goto done;
+		}
+
+		if (wait == NULL)
+			wait = threadobj_prepare_wait(struct alchemy_buffer_wait);
+
+		wait->size = size;
+
+		/* Same deadlock prevention as rt_buffer_write_timed(). */
+		if (bcb->fillsz > 0 && syncobj_count_grant(&bcb->sobj))
+			syncobj_grant_all(&bcb->sobj);
+
+		ret = syncobj_wait_drain(&bcb->sobj, abs_timeout, &syns);
+		if (ret) {
+			if (ret == -EIDRM)
+				goto out;
+			goto done;
+		}
+	}
+
+	get_ring_iov(bcb, bcb->wroff, size, iov);
+	bcb->resvsz = size;
+	ret = (ssize_t)size;
+done:
+	put_alchemy_buffer(bcb, &syns);
+out:
+	if (wait)
+		threadobj_finish_wait();
+
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
+/**
+ * @fn int rt_buffer_commit(RT_BUFFER *bf, size_t size)
+ * @brief Publish data written in place.
+ *
+ * This routine ends the reservation obtained from a previous call to
+ * rt_buffer_reserve(), making the first @a size bytes of the
+ * reserved space available to readers as a single message. The rest
+ * of the reserved space, if any, is returned to the buffer.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param size The length in bytes of the message, which may not be
+ * greater than the reserved size. Zero cancels the reservation.
+ *
+ * @return Zero is returned upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a bf is not a valid buffer descriptor, or
+ * @a size is greater than the reserved size.
+ *
+ * @apitags{unrestricted, switch-primary}
+ */
+int rt_buffer_commit(RT_BUFFER *bf, size_t size)
+{
+	struct alchemy_buffer_wait *wait;
+	struct alchemy_buffer *bcb;
+	struct threadobj *thobj;
+	struct syncstate syns;
+	struct service svc;
+	int ret = 0;
+
+	CANCEL_DEFER(svc);
+
+	bcb = get_alchemy_buffer(bf, &syns, &ret);
+	if (bcb == NULL)
+		goto out;
+
+	if (size > bcb->resvsz) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	bcb->fillsz += size;
+	bcb->wroff = (bcb->wroff + size) % bcb->bufsz;
+	bcb->resvsz = 0;
+
+	/* Writers may have waited for the reservation to end. */
+	thobj = syncobj_peek_drain(&bcb->sobj);
+	if (thobj) {
+		wait = threadobj_get_wait(thobj);
+		if (wait->size + bcb->fillsz <= bcb->bufsz)
+			syncobj_drain(&bcb->sobj);
+	}
+
+	thobj = syncobj_peek_grant(&bcb->sobj);
+	if (thobj) {
+		wait = threadobj_get_wait(thobj);
+		if (wait->size <= bcb->fillsz)
+			syncobj_grant_all(&bcb->sobj);
+	}
+done:
+	put_alchemy_buffer(bcb, &syns);
+out:
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
+/**
+ * @fn ssize_t rt_buffer_peek(RT_BUFFER *bf, size_t size, struct iovec iov[2], RTIME timeout)
+ * @brief Access buffer data in place (with relative scalar timeout).
+ *
+ * This routine is a variant of rt_buffer_peek_timed() accepting a
+ * relative timeout specification expressed as a scalar value.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param size The length in bytes of the message to access.
+ *
+ * @param iov The two-segment vector describing the message data.
+ *
+ * @param timeout A delay expressed in clock ticks. Passing
+ * TM_INFINITE causes the caller to block indefinitely until enough
+ * data is available. Passing TM_NONBLOCK causes the service
+ * to return immediately without blocking in case not enough data is
+ * available.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+
+/**
+ * @fn ssize_t rt_buffer_peek_until(RT_BUFFER *bf, size_t size, struct iovec iov[2], RTIME abs_timeout)
+ * @brief Access buffer data in place (with absolute scalar timeout).
+ *
+ * This routine is a variant of rt_buffer_peek_timed() accepting an
+ * absolute timeout specification expressed as a scalar value.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param size The length in bytes of the message to access.
+ *
+ * @param iov The two-segment vector describing the message data.
+ *
+ * @param abs_timeout An absolute date expressed in clock ticks.
+ * Passing TM_INFINITE causes the caller to block indefinitely until
+ * enough data is available. Passing TM_NONBLOCK causes the service
+ * to return immediately without blocking in case not enough data is
+ * available.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+
+/**
+ * @fn ssize_t rt_buffer_peek_timed(RT_BUFFER *bf, size_t size, struct iovec iov[2], const struct timespec *abs_timeout)
+ * @brief Access buffer data in place.
+ *
+ * This routine loans the next message of @a size bytes from the
+ * buffer to the caller, which may then process the data directly
+ * from the buffer memory instead of having rt_buffer_read() copy
+ * it. The message is consumed by a subsequent call to
+ * rt_buffer_release(). If not enough data is available on entry, the
+ * caller is allowed to block until enough data is written to the
+ * buffer, or a timeout elapses, exactly like rt_buffer_read_timed()
+ * does, including with respect to short reads.
+ *
+ * Since the buffer is circular, the message data may wrap around its
+ * end. Therefore it is described by two segments, the second one
+ * being empty (i.e. iov[1].iov_len is zero) unless the data wraps.
+ *
+ * Only a single message may be loaned from a buffer at any point in
+ * time. Until it is released, rt_buffer_read() blocks, so the caller
+ * must not read from the buffer by other means meanwhile.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param size The length in bytes of the message to access.
+ *
+ * @param iov The two-segment vector describing the message data upon
+ * success.
+ *
+ * @param abs_timeout An absolute date expressed in seconds / nanoseconds,
+ * based on the Alchemy clock, specifying a time limit to wait for a
+ * message to be available from the buffer. Passing NULL causes the caller
+ * to block indefinitely until enough data is available. Passing
+ * { .tv_sec = 0, .tv_nsec = 0 } causes the service to return immediately
+ * without blocking in case not enough data is available.
+ *
+ * @return The number of bytes available from @a iov is returned upon
+ * success. Otherwise:
+ *
+ * - -ETIMEDOUT is returned if @a abs_timeout is reached before a
+ * complete message arrives.
+ *
+ * - -EWOULDBLOCK is returned if @a abs_timeout is { .tv_sec = 0,
+ * .tv_nsec = 0 } and not enough data is immediately available on
+ * entry to form a complete message.
+ *
+ * - -EINTR is returned if rt_task_unblock() was called for the
+ * current task before enough data became available to form a complete
+ * message.
+ *
+ * - -EBUSY is returned if a message is already loaned from the
+ * buffer.
+ *
+ * - -EINVAL is returned if @a bf is not a valid buffer descriptor, or
+ * @a size is greater than the actual buffer length.
+ *
+ * - -EIDRM is returned if @a bf is deleted while the caller was
+ * waiting for data. In such event, @a bf is no more valid upon return
+ * of this service.
+ *
+ * - -EPERM is returned if this service should block, but was not
+ * called from a Xenomai thread.
+ *
+ * @apitags{xthread-nowait, switch-primary}
+ */
+ssize_t rt_buffer_peek_timed(RT_BUFFER *bf,
+			     size_t size, struct iovec iov[2],
+			     const struct timespec *abs_timeout)
+{
+	struct alchemy_buffer_wait *wait = NULL;
+	struct alchemy_buffer *bcb;
+	struct syncstate syns;
+	struct service svc;
+	int ret = 0;
+	size_t len;
+
+	len = size;
+	if (len == 0)
+		return 0;
+
+	if (!threadobj_current_p() && !alchemy_poll_mode(abs_timeout))
+		return -EPERM;
+
+	CANCEL_DEFER(svc);
+
+	bcb = get_alchemy_buffer(bf, &syns, &ret);
+	if (bcb == NULL)
+		goto out;
+
+	if (len > bcb->bufsz) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	for (;;) {
+		if (bcb->peeksz > 0) {
+			ret = -EBUSY;
+			goto done;
+		}
+
+		if (bcb->fillsz >= len)
+			break;
+
+		if (alchemy_poll_mode(abs_timeout)) {
+			ret = -EWOULDBLOCK;
+			goto done;
+		}
+
+		/* Same deadlock prevention as rt_buffer_read_timed(). */
+		if (bcb->fillsz > 0 && syncobj_count_drain(&bcb->sobj)) {
+			len = bcb->fillsz;
+			break;
+		}
+
+		if (wait == NULL)
+			wait = threadobj_prepare_wait(struct alchemy_buffer_wait);
+
+		wait->size = len;
+
+		ret = syncobj_wait_grant(&bcb->sobj, abs_timeout, &syns);
+		if (ret) {
+			if (ret == -EIDRM)
+				goto out;
+			goto done;
+		}
+	}
+
+	get_ring_iov(bcb, bcb->rdoff, len, iov);
+	bcb->peeksz = len;
+	ret = (ssize_t)len;
+done:
+	put_alchemy_buffer(bcb, &syns);
+out:
+	if (wait)
+		threadobj_finish_wait();
+
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
+/**
+ * @fn int rt_buffer_release(RT_BUFFER *bf, size_t size)
+ * @brief Consume data accessed in place.
+ *
+ * This routine ends the loan obtained from a previous call to
+ * rt_buffer_peek(), removing the first @a size bytes of the loaned
+ * message from the buffer. The rest of the message, if any, remains
+ * available to readers.
+ *
+ * @param bf The buffer descriptor.
+ *
+ * @param size The number of bytes to consume, which may not be
+ * greater than the loaned size. Zero leaves the buffer untouched.
+ *
+ * @return Zero is returned upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a bf is not a valid buffer descriptor, or
+ * @a size is greater than the loaned size.
+ *
+ * @apitags{unrestricted, switch-primary}
+ */
+int rt_buffer_release(RT_BUFFER *bf, size_t size)
+{
+	struct alchemy_buffer_wait *wait;
+	struct alchemy_buffer *bcb;
+	struct threadobj *thobj;
+	struct syncstate syns;
+	struct service svc;
+	int ret = 0;
+
+	CANCEL_DEFER(svc);
+
+	bcb = get_alchemy_buffer(bf, &syns, &ret);
+	if (bcb == NULL)
+		goto out;
+
+	if (size > bcb->peeksz) {
+		ret = -EINVAL;
+		goto done;
+	}
+
+	bcb->fillsz -= size;
+	bcb->rdoff = (bcb->rdoff + size) % bcb->bufsz;
+	bcb->peeksz = 0;
+
+	thobj = syncobj_peek_drain(&bcb->sobj);
+	if (thobj) {
+		wait = threadobj_get_wait(thobj);
+		if (wait->size + bcb->fillsz + bcb->resvsz <= bcb->bufsz)
+			syncobj_drain(&bcb->sobj);
+	}
+
+	/* Readers may have waited for the loan to end. */
+	thobj = syncobj_peek_grant(&bcb->sobj);
+	if (thobj) {
+		wait = threadobj_get_wait(thobj);
+		if (wait->size <= bcb->fillsz)
+			syncobj_grant_all(&bcb->sobj);
+	}
+done:
+	put_alchemy_buffer(bcb, &syns);
+out:
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
 /**
  * @fn int rt_buffer_clear(RT_BUFFER *bf)
  * @brief Clear an IPC buffer.
  *
- * This routine empties a buffer from any data.
+ * This routine empties a buffer from any data. Pending loans
+ * obtained from rt_buffer_reserve() or rt_buffer_peek() are
+ * cancelled, so that committing or releasing them fails afterwards.
  *
  * @param bf The buffer descriptor.
  *
@@ -825,6 +1374,8 @@ int rt_buffer_clear(RT_BUFFER *bf)
 	bcb->wroff = 0;
 	bcb->rdoff = 0;
 	bcb->fillsz = 0;
+	bcb->resvsz = 0;
+	bcb->peeksz = 0;
 	syncobj_drain(&bcb->sobj);
 
 	put_alchemy_buffer(bcb, &syns);
@@ -869,7 +1420,7 @@ int rt_buffer_inquire(RT_BUFFER *bf, RT_BUFFER_INFO *info)
 	info->iwaiters = syncobj_count_grant(&bcb->sobj);
 	info->owaiters = syncobj_count_drain(&bcb->sobj);
 	info->totalmem = bcb->bufsz;
-	info->availmem = bcb->bufsz - bcb->fillsz;
+	info->availmem = bcb->bufsz - bcb->fillsz - bcb->resvsz;
 	strcpy(info->name, bcb->name);
 
 	put_alchemy_buffer(bcb, &syns);
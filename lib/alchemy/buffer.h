@@ -35,6 +35,8 @@ struct alchemy_buffer {
 	size_t rdoff;
 	size_t wroff;
 	size_t fillsz;
+	size_t resvsz;	/* Loaned to a producer, not committed yet. */
+	size_t peeksz;	/* Loaned to a consumer, not released yet. */
 	struct fsobj fsobj;
 };
 
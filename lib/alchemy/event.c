@@ -57,25 +57,54 @@ DEFINE_LOOKUP_PRIVATE(event, RT_EVENT);
 
 #ifdef CONFIG_XENO_REGISTRY
 
+/*
+ * Fetch the complete wait list, growing the buffer until every
+ * waiter fits. The caller releases it.
+ */
+static int collect_event_waiters(struct alchemy_event *evcb,
+				 struct eventobj_waitentry **waitlist_r,
+				 unsigned int *val_r)
+{
+	struct eventobj_waitentry *waitlist;
+	int ret, nmax = 64;
+
+	for (;;) {
+		waitlist = __STD(malloc(sizeof(*waitlist) * nmax));
+		if (waitlist == NULL)
+			return -ENOMEM;
+
+		ret = eventobj_inquire(&evcb->evobj, sizeof(*waitlist) * nmax,
+				       waitlist, val_r);
+		if (ret < nmax)
+			break;
+
+		__STD(free(waitlist));
+		nmax *= 2;
+	}
+
+	if (ret < 0) {
+		__STD(free(waitlist));
+		return ret;
+	}
+
+	*waitlist_r = waitlist;
+
+	return ret;
+}
+
 static int event_registry_open(struct fsobj *fsobj, void *priv)
 {
 	struct eventobj_waitentry *waitlist, *p;
 	struct fsobstack *o = priv;
 	struct alchemy_event *evcb;
 	unsigned int val;
-	size_t waitsz;
 	int ret;
 
 	evcb = container_of(fsobj, struct alchemy_event, fsobj);
 
-	waitsz = sizeof(*p) * 256;
-	waitlist = __STD(malloc(waitsz));
-	if (waitlist == NULL)
-		return -ENOMEM;
-
-	ret = eventobj_inquire(&evcb->evobj, waitsz, waitlist, &val);
+	ret = collect_event_waiters(evcb, &waitlist, &val);
 	if (ret < 0)
-		goto out;
+		return ret;
 
 	fsobstack_init(o);
 
@@ -91,6 +120,41 @@ static int event_registry_open(struct fsobj *fsobj, void *priv)
 	}
 
 	fsobstack_finish(o);
+	__STD(free(waitlist));
+
+	return ret;
+}
+
+static int event_registry_snapshot(struct fsobj *fsobj, struct fssnapshot *s)
+{
+	struct eventobj_waitentry *waitlist, *p;
+	struct regsnap_alchemy_event *state;
+	struct alchemy_event *evcb;
+	struct regsnap_waiter *w;
+	unsigned int val;
+	int ret, n;
+
+	evcb = container_of(fsobj, struct alchemy_event, fsobj);
+
+	ret = collect_event_waiters(evcb, &waitlist, &val);
+	if (ret < 0)
+		return ret;
+
+	n = ret;
+	ret = fssnapshot_alloc(s, REGSNAP_ALCHEMY_EVENT, sizeof(*state), n);
+	if (ret)
+		goto out;
+
+	state = fssnapshot_state(s);
+	state->value = val;
+
+	for (p = waitlist, w = fssnapshot_waiters(s); p < waitlist + n; p++, w++) {
+		strncpy(w->name, p->name, sizeof(w->name) - 1);
+		w->pid = p->pid;
+		w->prio = -1;
+	}
+
+	fssnapshot_finish(s, n);
 out:
 	__STD(free(waitlist));
 
@@ -100,7 +164,8 @@ out:
 static struct registry_operations registry_ops = {
 	.open		= event_registry_open,
 	.release	= fsobj_obstack_release,
-	.read		= fsobj_obstack_read
+	.read		= fsobj_obstack_read,
+	.snapshot	= event_registry_snapshot
 };
 
 #else /* !CONFIG_XENO_REGISTRY */
@@ -127,10 +127,46 @@ static int heap_registry_open(struct fsobj *fsobj, void *priv)
 	return 0;
 }
 
+static void collect_heap_state(void *p, struct fsobj *fsobj)
+{
+	struct regsnap_alchemy_heap *state = p;
+	struct alchemy_heap *hcb;
+
+	hcb = container_of(fsobj, struct alchemy_heap, fsobj);
+	state->totalmem = heapobj_size(&hcb->hobj);
+	state->usedmem = heapobj_inquire(&hcb->hobj);
+	state->mode = hcb->mode;
+}
+
+static void collect_heap_waiter(struct regsnap_waiter *w,
+				struct threadobj *thobj)
+{
+	struct alchemy_heap_wait *wait = threadobj_get_wait(thobj);
+
+	w->reqsz = wait->size;
+}
+
+static const struct fssnapshot_syncops snapshot_ops = {
+	.class = REGSNAP_ALCHEMY_HEAP,
+	.state_size = sizeof(struct regsnap_alchemy_heap),
+	.collect_state = collect_heap_state,
+	.collect_waiter = collect_heap_waiter,
+};
+
+static int heap_registry_snapshot(struct fsobj *fsobj, struct fssnapshot *s)
+{
+	struct alchemy_heap *hcb;
+
+	hcb = container_of(fsobj, struct alchemy_heap, fsobj);
+
+	return fssnapshot_grab_syncobj(s, fsobj, &hcb->sobj, &snapshot_ops);
+}
+
 static struct registry_operations registry_ops = {
 	.open		= heap_registry_open,
 	.release	= fsobj_obstack_release,
-	.read		= fsobj_obstack_read
+	.read		= fsobj_obstack_read,
+	.snapshot	= heap_registry_snapshot
 };
 
 #else /* !CONFIG_XENO_REGISTRY */
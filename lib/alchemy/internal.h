@@ -41,8 +41,13 @@ get_alchemy_ ## __name(__dsctype *desc,					\
 		return NULL;						\
 	}								\
 									\
-	if (syncobj_lock(&cb->sobj, syns) ||				\
-	    cb->magic != __name ## _magic) {				\
+	if (syncobj_lock(&cb->sobj, syns)) {				\
+		*err_r = -EINVAL;					\
+		return NULL;						\
+	}								\
+									\
+	if (cb->magic != __name ## _magic) {				\
+		syncobj_unlock(&cb->sobj, syns);			\
 		*err_r = -EINVAL;					\
 		return NULL;						\
 	}								\
@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <string.h>
+#include <boilerplate/atomic.h>
 #include <copperplate/threadobj.h>
 #include <copperplate/registry-obstack.h>
 #include "reference.h"
@@ -46,6 +47,299 @@ static DEFINE_NAME_GENERATOR(queue_namegen, "queue",
 
 DEFINE_SYNC_LOOKUP(queue, RT_QUEUE);
 
+DEFINE_LOOKUP_PRIVATE(queue, RT_QUEUE);
+
+/*
+ * Q_SLAB queues draw messages from an array of fixed-size slots
+ * first, linked into a lock-free free list. The list head is tagged
+ * with a generation count to prevent ABA issues, and links are slot
+ * indices, so that the slab can be shared between processes.
+ */
+static inline struct alchemy_queue_slot *
+slab_slot(struct alchemy_queue *qcb, uint32_t n)
+{
+	return __mptr(qcb->slab) + n * qcb->slotsz;
+}
+
+/*
+ * The Q_SPSC and Q_SLAB fast paths access the queue without locking
+ * it, so they pin it for the duration instead. rt_queue_delete()
+ * invalidates the queue first, then waits for the pins to drop
+ * before releasing anything.
+ */
+static inline int queue_pin(struct alchemy_queue *qcb)
+{
+	/* Full barrier, pairs with the one in rt_queue_delete(). */
+	__sync_add_and_fetch(&qcb->pins, 1);
+	if (ACCESS_ONCE(qcb->magic) == queue_magic)
+		return 0;
+
+	__sync_sub_and_fetch(&qcb->pins, 1);
+
+	return -EINVAL;
+}
+
+static inline void queue_unpin(struct alchemy_queue *qcb)
+{
+	__sync_sub_and_fetch(&qcb->pins, 1);
+}
+
+static inline int slab_msg_p(struct alchemy_queue *qcb,
+			     struct alchemy_queue_msg *msg)
+{
+	uintptr_t base = (uintptr_t)__mptr(qcb->slab);
+
+	return (qcb->mode & Q_SLAB) && (uintptr_t)msg >= base &&
+		(uintptr_t)msg < base + qcb->nslots * qcb->slotsz;
+}
+
+static struct alchemy_queue_msg *slab_alloc(struct alchemy_queue *qcb,
+					    size_t size)
+{
+	struct alchemy_queue_slot *slot;
+	uint64_t old, new, prev;
+	uint32_t n;
+
+	if (size > qcb->maxmsgsz)
+		return NULL;
+
+	old = qcb->freeslots;
+	for (;;) {
+		n = (uint32_t)old;
+		if (n == QUEUE_SLOT_NIL) {
+			__sync_add_and_fetch(&qcb->slabmisses, 1);
+			return NULL;
+		}
+		/* We might have read a torn value, check it. */
+		if (n >= qcb->nslots) {
+			old = __sync_val_compare_and_swap(&qcb->freeslots, 0, 0);
+			continue;
+		}
+		slot = slab_slot(qcb, n);
+		new = (((old >> 32) + 1) << 32) | ACCESS_ONCE(slot->next);
+		prev = __sync_val_compare_and_swap(&qcb->freeslots, old, new);
+		if (prev == old)
+			break;
+		old = prev;
+	}
+
+	__sync_add_and_fetch(&qcb->usedslots, 1);
+
+	return &slot->msg;
+}
+
+static void slab_free(struct alchemy_queue *qcb,
+		      struct alchemy_queue_msg *msg)
+{
+	struct alchemy_queue_slot *slot;
+	uint64_t old, new, prev;
+	uint32_t n;
+
+	slot = container_of(msg, struct alchemy_queue_slot, msg);
+	n = ((void *)slot - __mptr(qcb->slab)) / qcb->slotsz;
+
+	old = qcb->freeslots;
+	for (;;) {
+		slot->next = (uint32_t)old;
+		smp_wmb();
+		new = (((old >> 32) + 1) << 32) | n;
+		prev = __sync_val_compare_and_swap(&qcb->freeslots, old, new);
+		if (prev == old)
+			break;
+		old = prev;
+	}
+
+	__sync_sub_and_fetch(&qcb->usedslots, 1);
+}
+
+static struct alchemy_queue_msg *queue_alloc_msg(struct alchemy_queue *qcb,
+						 size_t size)
+{
+	struct alchemy_queue_msg *msg = NULL;
+
+	if (qcb->mode & Q_SLAB)
+		msg = slab_alloc(qcb, size);
+
+	if (msg == NULL)
+		msg = heapobj_alloc(&qcb->hobj, size + sizeof(*msg));
+
+	return msg;
+}
+
+static void queue_free_msg(struct alchemy_queue *qcb,
+			   struct alchemy_queue_msg *msg)
+{
+	if (slab_msg_p(qcb, msg))
+		slab_free(qcb, msg);
+	else
+		heapobj_free(&qcb->hobj, msg);
+}
+
+static int slab_init(struct alchemy_queue *qcb,
+		     size_t poolsize, size_t qlimit)
+{
+	struct alchemy_queue_slot *slot;
+	void *slab;
+	uint32_t n;
+
+	qcb->maxmsgsz = poolsize / qlimit;
+	qcb->slotsz = __align_to(sizeof(*slot) + qcb->maxmsgsz,
+				 sizeof(uint64_t));
+	slab = xnmalloc(qcb->slotsz * qlimit);
+	if (slab == NULL)
+		return -ENOMEM;
+
+	qcb->slab = __moff(slab);
+	qcb->nslots = qlimit;
+
+	for (n = 0; n < qlimit; n++) {
+		slot = slab_slot(qcb, n);
+		slot->next = n + 1 < qlimit ? n + 1 : QUEUE_SLOT_NIL;
+	}
+
+	qcb->freeslots = 0;
+
+	return 0;
+}
+
+/*
+ * Q_SPSC queues carry messages through a ring of references, which
+ * the producer fills and the consumer drains without locking. The
+ * syncobj is only entered by the consumer to sleep on an empty ring,
+ * and by the producer to wake it up.
+ */
+static inline uintptr_t *spsc_ring(struct alchemy_queue *qcb)
+{
+	return __mptr(qcb->ring);
+}
+
+static inline unsigned int spsc_count(struct alchemy_queue *qcb)
+{
+	return ACCESS_ONCE(qcb->tail) - ACCESS_ONCE(qcb->head);
+}
+
+static int spsc_push(struct alchemy_queue *qcb,
+		     struct alchemy_queue_msg *msg)
+{
+	struct syncstate syns;
+	unsigned int tail;
+	int ret = 0;
+
+	tail = qcb->tail;
+	if (tail - ACCESS_ONCE(qcb->head) >= qcb->limit)
+		return -ENOMEM;
+
+	spsc_ring(qcb)[tail & qcb->ringmask] = (uintptr_t)__moff(msg);
+	smp_wmb();
+	ACCESS_ONCE(qcb->tail) = tail + 1;
+
+	/*
+	 * Pairs with the barrier in spsc_wait(): either the consumer
+	 * finds the message we just posted, or we find it sleeping.
+	 */
+	smp_mb();
+	if (!ACCESS_ONCE(qcb->sleeping))
+		return 0;
+
+	if (syncobj_lock(&qcb->sobj, &syns))
+		return 0;
+
+	if (syncobj_grant_one(&qcb->sobj))
+		ret = 1;
+
+	syncobj_unlock(&qcb->sobj, &syns);
+
+	return ret;
+}
+
+static struct alchemy_queue_msg *spsc_pop(struct alchemy_queue *qcb)
+{
+	unsigned int head = qcb->head;
+	uintptr_t ref;
+
+	if (ACCESS_ONCE(qcb->tail) == head)
+		return NULL;
+
+	smp_rmb();
+	ref = spsc_ring(qcb)[head & qcb->ringmask];
+	/* Fetch the slot before the producer may reuse it. */
+	smp_mb();
+	ACCESS_ONCE(qcb->head) = head + 1;
+
+	return __mptr((dref_type(struct alchemy_queue_msg *))ref);
+}
+
+static struct alchemy_queue_msg *spsc_wait(RT_QUEUE *queue,
+					   const struct timespec *abs_timeout,
+					   int *err_r)
+{
+	struct alchemy_queue_msg *msg = NULL;
+	struct alchemy_queue *qcb;
+	struct syncstate syns;
+	struct service svc;
+	int ret = 0;
+
+	CANCEL_DEFER(svc);
+
+	qcb = get_alchemy_queue(queue, &syns, &ret);
+	if (qcb == NULL)
+		goto out;
+
+	for (;;) {
+		qcb->sleeping = 1;
+		smp_mb();
+		msg = spsc_pop(qcb);
+		if (msg) {
+			/*
+			 * Deletion cannot complete while we hold the
+			 * lock, pin the queue for our caller.
+			 */
+			__sync_add_and_fetch(&qcb->pins, 1);
+			break;
+		}
+		ret = syncobj_wait_grant(&qcb->sobj, abs_timeout, &syns);
+		if (ret) {
+			if (ret == -EIDRM)
+				goto out;
+			break;
+		}
+	}
+
+	qcb->sleeping = 0;
+	put_alchemy_queue(qcb, &syns);
+out:
+	CANCEL_RESTORE(svc);
+
+	*err_r = ret;
+
+	return msg;
+}
+
+/*
+ * Called with @qcb pinned. Returns a message with @qcb still pinned,
+ * or NULL with @qcb unpinned.
+ */
+static struct alchemy_queue_msg *spsc_receive(RT_QUEUE *queue,
+					      struct alchemy_queue *qcb,
+					      const struct timespec *abs_timeout,
+					      int *err_r)
+{
+	struct alchemy_queue_msg *msg;
+
+	msg = spsc_pop(qcb);
+	if (msg)
+		return msg;
+
+	queue_unpin(qcb);
+
+	if (alchemy_poll_mode(abs_timeout)) {
+		*err_r = -EWOULDBLOCK;
+		return NULL;
+	}
+
+	return spsc_wait(queue, abs_timeout, err_r);
+}
+
 #ifdef CONFIG_XENO_REGISTRY
 
 static int prepare_waiter_cache(struct fsobstack *o,
@@ -82,6 +376,7 @@ static int queue_registry_open(struct fsobj *fsobj, void *priv)
 	struct alchemy_queue *qcb;
 	struct syncstate syns;
 	unsigned int mcount;
+	const char *type;
 	int mode, ret;
 
 	qcb = container_of(fsobj, struct alchemy_queue, fsobj);
@@ -93,8 +388,8 @@ static int queue_registry_open(struct fsobj *fsobj, void *priv)
 	usable_mem = heapobj_size(&qcb->hobj);
 	used_mem = heapobj_inquire(&qcb->hobj);
 	limit = qcb->limit;
-	mcount = qcb->mcount;
 	mode = qcb->mode;
+	mcount = mode & Q_SPSC ? spsc_count(qcb) : qcb->mcount;
 
 	syncobj_unlock(&qcb->sobj, &syns);
 
@@ -102,8 +397,13 @@ static int queue_registry_open(struct fsobj *fsobj, void *priv)
 
 	fsobstack_grow_format(o, "%6s  %10s  %9s  %8s  %s\n",
 			      "[TYPE]", "[TOTALMEM]", "[USEDMEM]", "[QLIMIT]", "[MCOUNT]");
+	if (mode & Q_SPSC)
+		type = "SPSC";
+	else
+		type = mode & Q_PRIO ? "PRIO" : "FIFO";
+
 	fsobstack_grow_format(o, " %s   %9Zu  %9Zu  %8Zu  %8u\n",
-			      mode & Q_PRIO ? "PRIO" : "FIFO",
+			      type,
 			      usable_mem,
 			      used_mem,
 			      limit,
@@ -116,10 +416,39 @@ static int queue_registry_open(struct fsobj *fsobj, void *priv)
 	return 0;
 }
 
+static void collect_queue_state(void *p, struct fsobj *fsobj)
+{
+	struct regsnap_alchemy_queue *state = p;
+	struct alchemy_queue *qcb;
+
+	qcb = container_of(fsobj, struct alchemy_queue, fsobj);
+	state->totalmem = heapobj_size(&qcb->hobj);
+	state->usedmem = heapobj_inquire(&qcb->hobj);
+	state->limit = qcb->limit;
+	state->mode = qcb->mode;
+	state->mcount = qcb->mode & Q_SPSC ? spsc_count(qcb) : qcb->mcount;
+}
+
+static const struct fssnapshot_syncops snapshot_ops = {
+	.class = REGSNAP_ALCHEMY_QUEUE,
+	.state_size = sizeof(struct regsnap_alchemy_queue),
+	.collect_state = collect_queue_state,
+};
+
+static int queue_registry_snapshot(struct fsobj *fsobj, struct fssnapshot *s)
+{
+	struct alchemy_queue *qcb;
+
+	qcb = container_of(fsobj, struct alchemy_queue, fsobj);
+
+	return fssnapshot_grab_syncobj(s, fsobj, &qcb->sobj, &snapshot_ops);
+}
+
 static struct registry_operations registry_ops = {
 	.open		= queue_registry_open,
 	.release	= fsobj_obstack_release,
-	.read		= fsobj_obstack_read
+	.read		= fsobj_obstack_read,
+	.snapshot	= queue_registry_snapshot
 };
 
 #else /* !CONFIG_XENO_REGISTRY */
@@ -135,6 +464,10 @@ static void queue_finalize(struct syncobj *sobj)
 	qcb = container_of(sobj, struct alchemy_queue, sobj);
 	registry_destroy_file(&qcb->fsobj);
 	heapobj_destroy(&qcb->hobj);
+	if (qcb->mode & Q_SPSC)
+		xnfree(spsc_ring(qcb));
+	if (qcb->mode & Q_SLAB)
+		xnfree(__mptr(qcb->slab));
 	xnfree(qcb);
 }
 fnref_register(libalchemy, queue_finalize);
@@ -172,9 +505,27 @@ fnref_register(libalchemy, queue_finalize);
  *
  * - Q_PRIO makes tasks pend in priority order on the queue.
  *
+ * - Q_SPSC tells the queue that a single task at a time sends
+ * messages to it, and a single task at a time receives them. Messages
+ * are then passed through a lock-free ring of @a qlimit slots, and
+ * the queue lock is only grabbed when the receiver has to wait for a
+ * message, or the sender has to wake it up. Q_URGENT and Q_BROADCAST
+ * sends are not available in this mode, and rt_queue_flush() may
+ * only be called by the receiver.
+ *
+ * - Q_SLAB adds @a qlimit fixed-size message slots to the queue,
+ * each of them able to hold @a poolsize / @a qlimit bytes of
+ * payload. Messages are obtained from these slots first, without
+ * locking, and rt_queue_free() returns them there the same way. The
+ * buffer pool is only used for larger messages, or when all slots are
+ * busy. This doubles the memory reserved for messages, but is best
+ * suited to queues carrying fixed-size messages.
+ *
  * @return Zero is returned upon success. Otherwise:
  *
- * - -EINVAL is returned if @a mode is invalid or @a poolsize is zero.
+ * - -EINVAL is returned if @a mode is invalid or @a poolsize is zero,
+ * or Q_SPSC or Q_SLAB is set in @a mode and @a qlimit is
+ * Q_UNLIMITED.
  *
  * - -ENOMEM is returned if the system fails to get memory from the
  * main heap in order to create the queue.
@@ -206,12 +557,18 @@ int rt_queue_create(RT_QUEUE *queue, const char *name,
 {
 	struct alchemy_queue *qcb;
 	int sobj_flags = 0, ret;
+	unsigned int ringsz;
 	struct service svc;
+	uintptr_t *ring;
 
 	if (threadobj_irq_p())
 		return -EPERM;
 
-	if (poolsize == 0 || (mode & ~Q_PRIO) != 0)
+	if (poolsize == 0 || (mode & ~(Q_PRIO|Q_SPSC|Q_SLAB)) != 0)
+		return -EINVAL;
+
+	if ((mode & (Q_SPSC|Q_SLAB)) &&
+	    (qlimit == Q_UNLIMITED || qlimit > 0x10000000))
 		return -EINVAL;
 
 	CANCEL_DEFER(svc);
@@ -245,6 +602,31 @@ int rt_queue_create(RT_QUEUE *queue, const char *name,
 	qcb->limit = qlimit;
 	list_init(&qcb->mq);
 	qcb->mcount = 0;
+	qcb->head = 0;
+	qcb->tail = 0;
+	qcb->sleeping = 0;
+
+	if (mode & Q_SPSC) {
+		for (ringsz = 1; ringsz < qlimit; ringsz <<= 1)
+			;
+		ring = xnmalloc(ringsz * sizeof(*ring));
+		if (ring == NULL) {
+			ret = -ENOMEM;
+			goto fail_ringalloc;
+		}
+		qcb->ring = __moff(ring);
+		qcb->ringmask = ringsz - 1;
+	}
+
+	qcb->pins = 0;
+	qcb->nslots = 0;
+	qcb->usedslots = 0;
+	qcb->slabmisses = 0;
+	if (mode & Q_SLAB) {
+		ret = slab_init(qcb, poolsize, qlimit);
+		if (ret)
+			goto fail_slaballoc;
+	}
 
 	if (mode & Q_PRIO)
 		sobj_flags = SYNCOBJ_PRIO;
@@ -277,6 +659,12 @@ fail_register:
 	registry_destroy_file(&qcb->fsobj);
 	syncobj_uninit(&qcb->sobj);
 fail_syncinit:
+	if (mode & Q_SLAB)
+		xnfree(__mptr(qcb->slab));
+fail_slaballoc:
+	if (mode & Q_SPSC)
+		xnfree(spsc_ring(qcb));
+fail_ringalloc:
 	heapobj_destroy(&qcb->hobj);
 fail_bufalloc:
 	xnfree(qcb);
@@ -307,6 +695,7 @@ fail_cballoc:
  */
 int rt_queue_delete(RT_QUEUE *queue)
 {
+	struct timespec nap = { .tv_sec = 0, .tv_nsec = 100000 };
 	struct alchemy_queue *qcb;
 	struct syncstate syns;
 	struct service svc;
@@ -323,6 +712,25 @@ int rt_queue_delete(RT_QUEUE *queue)
 
 	syncluster_delobj(&alchemy_queue_table, &qcb->cobj);
 	qcb->magic = ~queue_magic;
+	/* Pairs with the barrier in queue_pin(). */
+	smp_mb();
+
+	/*
+	 * Wait for the lockless accesses in flight to complete. The
+	 * fast paths may grab the lock, so we have to drop it
+	 * meanwhile; only a lock holder may pin the invalidated
+	 * queue, so check again once relocked.
+	 */
+	while (qcb->pins) {
+		put_alchemy_queue(qcb, &syns);
+		do
+			__RT(clock_nanosleep(CLOCK_COPPERPLATE, 0, &nap, NULL));
+		while (ACCESS_ONCE(qcb->pins));
+		ret = syncobj_lock(&qcb->sobj, &syns);
+		if (ret)
+			goto out;
+	}
+
 	syncobj_destroy(&qcb->sobj, &syns);
 out:
 	CANCEL_RESTORE(svc);
@@ -358,6 +766,23 @@ void *rt_queue_alloc(RT_QUEUE *queue, size_t size)
 	struct service svc;
 	int ret;
 
+	qcb = find_alchemy_queue(queue, &ret);
+	if (qcb == NULL)
+		return NULL;
+
+	if (qcb->mode & Q_SLAB) {
+		/* Lockless allocation from the slab. */
+		if (queue_pin(qcb))
+			return NULL;
+		msg = slab_alloc(qcb, size);
+		queue_unpin(qcb);
+		if (msg) {
+			msg->size = size;
+			msg->refcount = 1;
+			return msg + 1;
+		}
+	}
+
 	CANCEL_DEFER(svc);
 
 	qcb = get_alchemy_queue(queue, &syns, &ret);
@@ -408,6 +833,7 @@ int rt_queue_free(RT_QUEUE *queue, void *buf)
 {
 	struct alchemy_queue_msg *msg;
 	struct alchemy_queue *qcb;
+	unsigned int refcount;
 	struct syncstate syns;
 	struct service svc;
 	int ret = 0;
@@ -417,6 +843,35 @@ int rt_queue_free(RT_QUEUE *queue, void *buf)
 
 	msg = (struct alchemy_queue_msg *)buf - 1;
 
+	qcb = find_alchemy_queue(queue, &ret);
+	if (qcb == NULL)
+		return ret;
+
+	if (qcb->mode & Q_SLAB) {
+		ret = queue_pin(qcb);
+		if (ret)
+			return ret;
+		if (slab_msg_p(qcb, msg)) {
+			/*
+			 * Slab messages are released without locking,
+			 * drop our reference atomically.
+			 */
+			do {
+				refcount = ACCESS_ONCE(msg->refcount);
+				if (refcount == 0) { /* Mm, double-free? */
+					ret = -EINVAL;
+					break;
+				}
+			} while (__sync_val_compare_and_swap(&msg->refcount,
+				refcount, refcount - 1) != refcount);
+			if (refcount == 1)
+				slab_free(qcb, msg);
+			queue_unpin(qcb);
+			return ret;
+		}
+		queue_unpin(qcb);
+	}
+
 	CANCEL_DEFER(svc);
 
 	qcb = get_alchemy_queue(queue, &syns, &ret);
@@ -491,7 +946,8 @@ out:
  * codes is returned:
  *
  * - -EINVAL is returned if @a q is not a message queue descriptor, @a
- * mode is invalid, or @a buf is NULL.
+ * mode is invalid, or @a buf is NULL. Q_URGENT and Q_BROADCAST are
+ * invalid with Q_SPSC queues.
  *
  * - -ENOMEM is returned if queuing the message would exceed the limit
  * defined for the queue at creation.
@@ -514,6 +970,25 @@ int rt_queue_send(RT_QUEUE *queue,
 
 	msg = (struct alchemy_queue_msg *)buf - 1;
 
+	qcb = find_alchemy_queue(queue, &ret);
+	if (qcb == NULL)
+		return ret;
+
+	if (qcb->mode & Q_SPSC) {
+		if (mode || msg->refcount == 0)
+			return -EINVAL;
+		ret = queue_pin(qcb);
+		if (ret)
+			return ret;
+		msg->refcount--;
+		msg->size = size;
+		ret = spsc_push(qcb, msg);
+		if (ret < 0)
+			msg->refcount++;
+		queue_unpin(qcb);
+		return ret;
+	}
+
 	CANCEL_DEFER(svc);
 
 	qcb = get_alchemy_queue(queue, &syns, &ret);
@@ -606,7 +1081,8 @@ out:
  * codes is returned:
  *
  * - -EINVAL is returned if @a mode is invalid, @a buf is NULL with a
- * non-zero @a size, or @a q is not a essage queue descriptor.
+ * non-zero @a size, or @a q is not a essage queue descriptor. Q_URGENT
+ * and Q_BROADCAST are invalid with Q_SPSC queues.
  *
  * - -ENOMEM is returned if queuing the message would exceed the limit
  * defined for the queue at creation, or if no memory can be obtained
@@ -632,6 +1108,32 @@ int rt_queue_write(RT_QUEUE *queue,
 	if (buf == NULL && size > 0)
 		return -EINVAL;
 
+	qcb = find_alchemy_queue(queue, &ret);
+	if (qcb == NULL)
+		return ret;
+
+	if (qcb->mode & Q_SPSC) {
+		if (mode)
+			return -EINVAL;
+		ret = queue_pin(qcb);
+		if (ret)
+			return ret;
+		msg = queue_alloc_msg(qcb, size);
+		if (msg == NULL) {
+			queue_unpin(qcb);
+			return -ENOMEM;
+		}
+		msg->size = size;
+		msg->refcount = 0;
+		if (size > 0)
+			memcpy(msg + 1, buf, size);
+		ret = spsc_push(qcb, msg);
+		if (ret < 0)
+			queue_free_msg(qcb, msg);
+		queue_unpin(qcb);
+		return ret;
+	}
+
 	CANCEL_DEFER(svc);
 
 	qcb = get_alchemy_queue(queue, &syns, &ret);
@@ -673,7 +1175,7 @@ enqueue:
 	if (qcb->limit && qcb->mcount >= qcb->limit)
 		goto done;
 
-	msg = heapobj_alloc(&qcb->hobj, size + sizeof(*msg));
+	msg = queue_alloc_msg(qcb, size);
 	if (msg == NULL)
 		goto done;
 
@@ -811,6 +1313,24 @@ ssize_t rt_queue_receive_timed(RT_QUEUE *queue, void **bufp,
 	if (!threadobj_current_p() && !alchemy_poll_mode(abs_timeout))
 		return -EPERM;
 
+	qcb = find_alchemy_queue(queue, &err);
+	if (qcb == NULL)
+		return err;
+
+	if (qcb->mode & Q_SPSC) {
+		err = queue_pin(qcb);
+		if (err)
+			return err;
+		msg = spsc_receive(queue, qcb, abs_timeout, &err);
+		if (msg == NULL)
+			return err;
+		msg->refcount++;
+		*bufp = msg + 1;
+		ret = (ssize_t)msg->size;
+		queue_unpin(qcb);
+		return ret;
+	}
+
 	CANCEL_DEFER(svc);
 
 	qcb = get_alchemy_queue(queue, &syns, &err);
@@ -975,6 +1495,25 @@ ssize_t rt_queue_read_timed(RT_QUEUE *queue,
 	if (size == 0)
 		return 0;
 
+	qcb = find_alchemy_queue(queue, &err);
+	if (qcb == NULL)
+		return err;
+
+	if (qcb->mode & Q_SPSC) {
+		err = queue_pin(qcb);
+		if (err)
+			return err;
+		msg = spsc_receive(queue, qcb, abs_timeout, &err);
+		if (msg == NULL)
+			return err;
+		ret = (ssize_t)(msg->size > size ? size : msg->size);
+		if (ret > 0)
+			memcpy(buf, msg + 1, ret);
+		queue_free_msg(qcb, msg);
+		queue_unpin(qcb);
+		return ret;
+	}
+
 	CANCEL_DEFER(svc);
 
 	qcb = get_alchemy_queue(queue, &syns, &err);
@@ -1012,7 +1551,7 @@ wait:
 		ret = (ssize_t)(msg->size > size ? size : msg->size);
 		if (ret > 0) 
 			memcpy(buf, msg + 1, ret);
-		heapobj_free(&qcb->hobj, msg);
+		queue_free_msg(qcb, msg);
 	} else	/* A direct copy took place. */
 		ret = (ssize_t)wait->local_bufsz;
 
@@ -1054,6 +1593,13 @@ int rt_queue_flush(RT_QUEUE *queue)
 	if (qcb == NULL)
 		goto out;
 
+	if (qcb->mode & Q_SPSC) {
+		/* We are the consumer, drain the ring. */
+		for (ret = 0; (msg = spsc_pop(qcb)) != NULL; ret++)
+			queue_free_msg(qcb, msg);
+		goto done;
+	}
+
 	ret = qcb->mcount;
 	qcb->mcount = 0;
 
@@ -1066,10 +1612,10 @@ int rt_queue_flush(RT_QUEUE *queue)
 	if (!list_empty(&qcb->mq)) {
 		list_for_each_entry_safe(msg, tmp, &qcb->mq, next) {
 			list_remove(&msg->next);
-			heapobj_free(&qcb->hobj, msg);
+			queue_free_msg(qcb, msg);
 		}
 	}
-
+done:
 	put_alchemy_queue(qcb, &syns);
 out:
 	CANCEL_RESTORE(svc);
@@ -1110,7 +1656,7 @@ int rt_queue_inquire(RT_QUEUE *queue, RT_QUEUE_INFO *info)
 		goto out;
 
 	info->nwaiters = syncobj_count_grant(&qcb->sobj);
-	info->nmessages = qcb->mcount;
+	info->nmessages = qcb->mode & Q_SPSC ? spsc_count(qcb) : qcb->mcount;
 	info->mode = qcb->mode;
 	info->qlimit = qcb->limit;
 	info->poolsize = heapobj_size(&qcb->hobj);
@@ -1124,6 +1670,50 @@ out:
 	return ret;
 }
 
+/**
+ * @fn int rt_queue_inquire_slab(RT_QUEUE *q, RT_QUEUE_SLAB_INFO *info)
+ * @brief Query the message slots of a queue.
+ *
+ * This routine returns the usage information about the fixed-size
+ * message slots of the specified queue (see Q_SLAB). All counters
+ * are zero for a queue created without Q_SLAB.
+ *
+ * @param q The queue descriptor.
+ *
+ * @param info A pointer to the @ref RT_QUEUE_SLAB_INFO "return
+ * buffer" to copy the information to.
+ *
+ * @return Zero is returned and slot usage information is written to
+ * the structure pointed at by @a info upon success. Otherwise:
+ *
+ * - -EINVAL is returned if @a q is not a valid queue descriptor.
+ *
+ * @apitags{unrestricted, switch-primary}
+ */
+int rt_queue_inquire_slab(RT_QUEUE *queue, RT_QUEUE_SLAB_INFO *info)
+{
+	struct alchemy_queue *qcb;
+	struct syncstate syns;
+	struct service svc;
+	int ret = 0;
+
+	CANCEL_DEFER(svc);
+
+	qcb = get_alchemy_queue(queue, &syns, &ret);
+	if (qcb == NULL)
+		goto out;
+
+	info->nslots = qcb->nslots;
+	info->usedslots = qcb->usedslots;
+	info->slabmisses = qcb->slabmisses;
+
+	put_alchemy_queue(qcb, &syns);
+out:
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
+
 /**
  * @fn int rt_queue_bind(RT_QUEUE *q, const char *name, RTIME timeout)
  * @brief Bind to a message queue.
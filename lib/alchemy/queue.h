@@ -37,6 +37,21 @@ struct alchemy_queue {
 	struct listobj mq;
 	unsigned int mcount;
 	struct fsobj fsobj;
+	/* Q_SPSC mode: lock-free ring of message references. */
+	dref_type(uintptr_t *) ring;
+	unsigned int ringmask;
+	unsigned int head;	/* Next slot to consume. */
+	unsigned int tail;	/* Next slot to fill. */
+	int sleeping;		/* Consumer waits for messages. */
+	/* Q_SLAB mode: fixed-size message slots. */
+	dref_type(void *) slab;
+	size_t slotsz;		/* Stride between slots. */
+	size_t maxmsgsz;	/* Largest payload fitting in a slot. */
+	unsigned int nslots;
+	unsigned int usedslots;
+	unsigned long slabmisses;
+	uint64_t freeslots;	/* ABA tag << 32 | first free slot. */
+	unsigned int pins;	/* Lockless accesses in flight. */
 };
 
 #define queue_magic	0x8787ebeb
@@ -48,6 +63,13 @@ struct alchemy_queue_msg {
 	/* Payload data follows. */
 };
 
+struct alchemy_queue_slot {
+	uint32_t next;		/* Next free slot. */
+	struct alchemy_queue_msg msg;
+};
+
+#define QUEUE_SLOT_NIL	((uint32_t)-1)
+
 struct alchemy_queue_wait {
 	dref_type(struct alchemy_queue_msg *) msg;
 	void *local_buf;
@@ -62,24 +62,53 @@ DEFINE_LOOKUP_PRIVATE(sem, RT_SEM);
 
 #ifdef CONFIG_XENO_REGISTRY
 
+/*
+ * Fetch the complete wait list, growing the buffer until every
+ * waiter fits. The caller releases it.
+ */
+static int collect_sem_waiters(struct alchemy_sem *scb,
+			       struct semobj_waitentry **waitlist_r,
+			       int *val_r)
+{
+	struct semobj_waitentry *waitlist;
+	int ret, nmax = 64;
+
+	for (;;) {
+		waitlist = __STD(malloc(sizeof(*waitlist) * nmax));
+		if (waitlist == NULL)
+			return -ENOMEM;
+
+		ret = semobj_inquire(&scb->smobj, sizeof(*waitlist) * nmax,
+				     waitlist, val_r);
+		if (ret < nmax)
+			break;
+
+		__STD(free(waitlist));
+		nmax *= 2;
+	}
+
+	if (ret < 0) {
+		__STD(free(waitlist));
+		return ret;
+	}
+
+	*waitlist_r = waitlist;
+
+	return ret;
+}
+
 static int sem_registry_open(struct fsobj *fsobj, void *priv)
 {
 	struct semobj_waitentry *waitlist, *p;
 	struct fsobstack *o = priv;
 	struct alchemy_sem *scb;
-	size_t waitsz;
 	int ret, val;
 
 	scb = container_of(fsobj, struct alchemy_sem, fsobj);
 
-	waitsz = sizeof(*p) * 256;
-	waitlist = __STD(malloc(waitsz));
-	if (waitlist == NULL)
-		return -ENOMEM;
-
-	ret = semobj_inquire(&scb->smobj, waitsz, waitlist, &val);
+	ret = collect_sem_waiters(scb, &waitlist, &val);
 	if (ret < 0)
-		goto out;
+		return ret;
 
 	fsobstack_init(o);
 
@@ -98,6 +127,40 @@ static int sem_registry_open(struct fsobj *fsobj, void *priv)
 	}
 
 	fsobstack_finish(o);
+	__STD(free(waitlist));
+
+	return ret;
+}
+
+static int sem_registry_snapshot(struct fsobj *fsobj, struct fssnapshot *s)
+{
+	struct semobj_waitentry *waitlist, *p;
+	struct regsnap_alchemy_sem *state;
+	struct regsnap_waiter *w;
+	struct alchemy_sem *scb;
+	int ret, val, n;
+
+	scb = container_of(fsobj, struct alchemy_sem, fsobj);
+
+	ret = collect_sem_waiters(scb, &waitlist, &val);
+	if (ret < 0)
+		return ret;
+
+	n = ret;
+	ret = fssnapshot_alloc(s, REGSNAP_ALCHEMY_SEM, sizeof(*state), n);
+	if (ret)
+		goto out;
+
+	state = fssnapshot_state(s);
+	state->value = val < 0 ? 0 : val;
+
+	for (p = waitlist, w = fssnapshot_waiters(s); p < waitlist + n; p++, w++) {
+		strncpy(w->name, p->name, sizeof(w->name) - 1);
+		w->pid = p->pid;
+		w->prio = -1;
+	}
+
+	fssnapshot_finish(s, n);
 out:
 	__STD(free(waitlist));
 
@@ -107,7 +170,8 @@ out:
 static struct registry_operations registry_ops = {
 	.open		= sem_registry_open,
 	.release	= fsobj_obstack_release,
-	.read		= fsobj_obstack_read
+	.read		= fsobj_obstack_read,
+	.snapshot	= sem_registry_snapshot
 };
 
 #else /* !CONFIG_XENO_REGISTRY */
@@ -16,11 +16,18 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
+#include "boilerplate/atomic.h"
 #include "boilerplate/lock.h"
 #include "boilerplate/hash.h"
+#include "boilerplate/ancillaries.h"
 
 /*
  * Crunching routine borrowed from:
@@ -51,6 +58,20 @@ static inline int store_key(struct hashobj *obj,
 static inline void drop_key(struct hashobj *obj,
 			    const struct hash_operations *hops);
 
+static inline void *alloc_block(size_t size,
+				const struct hash_operations *hops);
+
+static inline void free_block(void *block,
+			      const struct hash_operations *hops);
+
+#define HASH_READ_RETRIES  4
+
+struct hash_retired {
+	dref_type(struct hash_retired *) next;
+	dref_type(void *) mem;
+	unsigned int epoch;
+};
+
 #define GOLDEN_HASH_RATIO  0x9e3779b9  /* Arbitrary value. */
 
 unsigned int __hash_key(const void *key, size_t length, unsigned int c)
@@ -96,8 +117,23 @@ void __hash_init(void *heap, struct hash_table *t)
 	pthread_mutexattr_t mattr;
 	int n;
 
-	for (n = 0; n < HASHSLOTS; n++)
+	for (n = 0; n < HASHSLOTS; n++) {
 		__list_init(heap, &t->table[n].obj_list);
+		t->table[n].seq = 0;
+	}
+
+	t->buckets = __memoff(heap, t->table);
+	t->mask = HASHSLOTS - 1;
+	t->count = 0;
+	t->seq = 0;
+	t->epoch = 1;
+	t->retired = __moff_nullable(NULL);
+
+	for (n = 0; n < HASH_READERS; n++) {
+		atomic_set(&t->readers[n].tid, 0);
+		t->readers[n].pid = 0;
+		t->readers[n].epoch = 0;
+	}
 
 	pthread_mutexattr_init(&mattr);
 	pthread_mutexattr_settype(&mattr, mutex_type_attribute);
@@ -112,11 +148,345 @@ void hash_destroy(struct hash_table *t)
 	__RT(pthread_mutex_destroy(&t->lock));
 }
 
-static struct hash_bucket *do_hash(struct hash_table *t,
-				   const void *key, size_t len)
+/*
+ * Writers are serialized by the table lock, readers may run
+ * lockless. Any change to a bucket list is bracketed by the bucket
+ * sequence count, moving entries to a new bucket array is bracketed
+ * by the table sequence count.
+ */
+static inline void bucket_write_begin(struct hash_bucket *bucket)
 {
-	unsigned int hash = __hash_key(key, len, 0);
-	return &t->table[hash & (HASHSLOTS-1)];
+	bucket->seq++;
+	smp_wmb();
+}
+
+static inline void bucket_write_end(struct hash_bucket *bucket)
+{
+	smp_wmb();
+	bucket->seq++;
+}
+
+/*
+ * Lockless readers hold a slot of the table while they search,
+ * recording the epoch they entered in. Memory they might still refer
+ * to is never released on the spot: writers stamp it with the
+ * current epoch, move to the next one, and release it once no reader
+ * which entered before is left. Slots are owned by threads, so that
+ * those of readers which died in their read section can be found and
+ * recycled. When all slots are busy, readers take the lock instead.
+ */
+#ifdef HAVE_TLS
+
+static __thread __attribute__ ((tls_model (CONFIG_XENO_TLS_MODEL)))
+pid_t reader_tid;
+
+static __thread __attribute__ ((tls_model (CONFIG_XENO_TLS_MODEL)))
+pid_t reader_pid;
+
+static pthread_once_t reader_once = PTHREAD_ONCE_INIT;
+
+static void reset_reader_ids(void)
+{
+	reader_tid = 0;
+}
+
+static void init_reader_ids(void)
+{
+	pthread_atfork(NULL, NULL, reset_reader_ids);
+}
+
+static inline pid_t get_reader_ids(pid_t *pid_r)
+{
+	if (reader_tid == 0) {
+		pthread_once(&reader_once, init_reader_ids);
+		reader_pid = getpid();
+		reader_tid = get_thread_pid();
+	}
+
+	*pid_r = reader_pid;
+
+	return reader_tid;
+}
+
+#else /* !HAVE_TLS */
+
+static inline pid_t get_reader_ids(pid_t *pid_r)
+{
+	*pid_r = getpid();
+
+	return get_thread_pid();
+}
+
+#endif /* !HAVE_TLS */
+
+static struct hash_reader *read_begin(struct hash_table *t)
+{
+	struct hash_reader *r;
+	pid_t tid, pid;
+	int n;
+
+	tid = get_reader_ids(&pid);
+
+	for (n = 0; n < HASH_READERS; n++) {
+		r = t->readers + (tid + n) % HASH_READERS;
+		if (atomic_read(&r->tid) == 0 &&
+		    atomic_cmpxchg(&r->tid, 0, tid) == 0) {
+			r->pid = pid;
+			smp_wmb();
+			ACCESS_ONCE(r->epoch) = ACCESS_ONCE(t->epoch);
+			smp_mb();
+			return r;
+		}
+	}
+
+	return NULL;
+}
+
+static inline void read_end(struct hash_reader *r)
+{
+	smp_mb();
+	ACCESS_ONCE(r->epoch) = 0;
+	smp_wmb();
+	atomic_set(&r->tid, 0);
+}
+
+/* Table lock held. Returns the stamp of what was unlinked so far. */
+static unsigned int advance_epoch(struct hash_table *t)
+{
+	unsigned int epoch = t->epoch;
+
+	smp_mb();
+	ACCESS_ONCE(t->epoch) = epoch + 1 ?: 1;
+
+	return epoch;
+}
+
+static inline int epoch_after(unsigned int a, unsigned int b)
+{
+	return (int)(a - b) > 0;
+}
+
+/*
+ * Returns the earliest epoch a reader is still searching in, zero
+ * if none is. A slot which was claimed but has no epoch yet does not
+ * count: its owner did not look at the table so far, and will see
+ * the current state when it does.
+ */
+static unsigned int oldest_reader(struct hash_table *t)
+{
+	unsigned int epoch, oldest = 0;
+	struct hash_reader *r;
+	pid_t tid;
+	int n;
+
+	smp_mb();
+
+	for (n = 0; n < HASH_READERS; n++) {
+		r = t->readers + n;
+		epoch = ACCESS_ONCE(r->epoch);
+		if (epoch == 0)
+			continue;
+		smp_rmb();
+		tid = atomic_read(&r->tid);
+		if (tid > 0 && syscall(__NR_tgkill, r->pid, tid, 0) &&
+		    errno == ESRCH) {
+			/* The owner died in its read section. */
+			if (atomic_cmpxchg(&r->tid, tid, -1) == tid) {
+				ACCESS_ONCE(r->epoch) = 0;
+				smp_wmb();
+				atomic_set(&r->tid, 0);
+			}
+			continue;
+		}
+		if (oldest == 0 || epoch_after(oldest, epoch))
+			oldest = epoch;
+	}
+
+	return oldest;
+}
+
+/* Table lock held. */
+static void retire(struct hash_table *t, void *mem,
+		   const struct hash_operations *hops)
+{
+	struct hash_retired *rt;
+
+	rt = alloc_block(sizeof(*rt), hops);
+	if (rt == NULL)
+		return;	/* Leak it rather than risk a stale access. */
+
+	rt->mem = __moff(mem);
+	rt->epoch = advance_epoch(t);
+	rt->next = t->retired;
+	t->retired = __moff(rt);
+}
+
+/* Table lock held. Release what no reader may refer to anymore. */
+static void reclaim(struct hash_table *t, const struct hash_operations *hops)
+{
+	dref_type(struct hash_retired *) *link = &t->retired;
+	struct hash_retired *rt;
+	unsigned int oldest;
+
+	if (*link == __moff_nullable(NULL))
+		return;
+
+	oldest = oldest_reader(t);
+
+	while (*link != __moff_nullable(NULL)) {
+		rt = __mptr(*link);
+		if (oldest && !epoch_after(oldest, rt->epoch)) {
+			link = &rt->next;
+			continue;
+		}
+		*link = rt->next;
+		free_block(__mptr(rt->mem), hops);
+		free_block(rt, hops);
+	}
+}
+
+/*
+ * Wait for the readers which may still refer to what was unlinked
+ * before @stamp was issued. Never call with the table lock held: a
+ * read section is only a few loads long, but its owner may have been
+ * preempted by the caller.
+ */
+static void wait_readers(struct hash_table *t, unsigned int stamp)
+{
+	struct timespec nap = { .tv_sec = 0, .tv_nsec = 10000 };
+	unsigned int oldest;
+
+	for (;;) {
+		oldest = oldest_reader(t);
+		if (oldest == 0 || epoch_after(oldest, stamp))
+			break;
+		__RT(clock_nanosleep(CLOCK_MONOTONIC, 0, &nap, NULL));
+	}
+}
+
+static inline struct hash_bucket *do_hash(struct hash_table *t,
+					  unsigned int hash)
+{
+	struct hash_bucket *buckets = __mptr(t->buckets);
+	return &buckets[hash & t->mask];
+}
+
+/*
+ * Double the bucket array once the average chain length exceeds two
+ * entries. The former array is retired, lockless readers may still
+ * be walking it. Failing to allocate the new array is not an error,
+ * the table just keeps its current size.
+ */
+static void grow_table(struct hash_table *t,
+		       const struct hash_operations *hops)
+{
+	struct hash_bucket *obuckets, *nbuckets, *bucket;
+	unsigned int nslots, n;
+	struct hashobj *obj;
+
+	nslots = t->mask + 1;
+	if (t->count <= nslots * 2 || nslots >= HASHSLOTS_MAX)
+		return;
+
+	nbuckets = alloc_block(nslots * 2 * sizeof(*nbuckets), hops);
+	if (nbuckets == NULL)
+		return;
+
+	for (n = 0; n < nslots * 2; n++) {
+		list_init(&nbuckets[n].obj_list);
+		nbuckets[n].seq = 0;
+	}
+
+	t->seq++;
+	smp_wmb();
+
+	obuckets = __mptr(t->buckets);
+	for (n = 0; n < nslots; n++) {
+		bucket = &obuckets[n];
+		while (!list_empty(&bucket->obj_list)) {
+			obj = list_pop_entry(&bucket->obj_list,
+					     struct hashobj, link);
+			list_append(&obj->link, &nbuckets[obj->hash &
+						(nslots * 2 - 1)].obj_list);
+		}
+	}
+
+	t->buckets = __moff(nbuckets);
+	t->mask = nslots * 2 - 1;
+	smp_wmb();
+	t->seq++;
+
+	if (obuckets != t->table)
+		retire(t, obuckets, hops);
+}
+
+/*
+ * Lockless lookup, between read_begin() and read_end(). Every
+ * pointer read from the table is validated by checking that no
+ * writer updated the bucket or rehashed the table in the meantime,
+ * before it is dereferenced. The memory it refers to stays around
+ * until read_end(), even if the object is removed meanwhile. Returns
+ * -EAGAIN if we could not get a stable view, in which case the
+ * caller should search under the table lock instead.
+ */
+static int search_lockless(struct hash_table *t,
+			   const void *key, size_t len, unsigned int hash,
+			   const struct hash_operations *hops,
+			   struct hashobj **objp)
+{
+	unsigned int tseq, bseq, tries;
+	struct hash_bucket *bucket;
+	struct holder *head, *pos;
+	struct hashobj *obj;
+	const void *okey;
+
+#define table_changed()						\
+	({							\
+		smp_rmb();					\
+		ACCESS_ONCE(bucket->seq) != bseq ||		\
+			ACCESS_ONCE(t->seq) != tseq;		\
+	})
+
+	for (tries = 0; tries < HASH_READ_RETRIES; tries++) {
+		tseq = ACCESS_ONCE(t->seq);
+		if (tseq & 1)
+			continue;
+		smp_rmb();
+		bucket = do_hash(t, hash);
+		bseq = ACCESS_ONCE(bucket->seq);
+		if (bseq & 1 || ACCESS_ONCE(t->seq) != tseq)
+			continue;
+		smp_rmb();
+		head = &bucket->obj_list.head;
+		pos = __hptr(__main_heap, ACCESS_ONCE(head->next));
+		for (;;) {
+			if (table_changed())
+				goto retry;
+			if (pos == head) {
+				*objp = NULL;
+				return 0;
+			}
+			obj = container_of(pos, struct hashobj, link);
+			if (obj->hash == hash && obj->len == len) {
+				okey = __mptr(obj->key);
+				if (table_changed())
+					goto retry;
+				if (hops->compare(okey, key, len) == 0) {
+					if (table_changed())
+						goto retry;
+					*objp = obj;
+					return 0;
+				}
+			}
+			pos = __hptr(__main_heap, ACCESS_ONCE(pos->next));
+		}
+	retry:
+		;
+	}
+
+#undef table_changed
+
+	return -EAGAIN;
 }
 
 int __hash_enter(struct hash_table *t,
@@ -134,12 +504,14 @@ int __hash_enter(struct hash_table *t,
 	if (ret)
 		return ret;
 
-	bucket = do_hash(t, key, len);
+	newobj->hash = __hash_key(key, len, 0);
 	write_lock_nocancel(&t->lock);
 
+	bucket = do_hash(t, newobj->hash);
 	if (nodup && !list_empty(&bucket->obj_list)) {
 		list_for_each_entry(obj, &bucket->obj_list, link) {
-			if (obj->len != newobj->len)
+			if (obj->hash != newobj->hash ||
+			    obj->len != newobj->len)
 				continue;
 			if (hops->compare(__mptr(obj->key), __mptr(newobj->key),
 					  obj->len) == 0) {
@@ -150,8 +522,13 @@ int __hash_enter(struct hash_table *t,
 		}
 	}
 
+	bucket_write_begin(bucket);
 	list_append(&newobj->link, &bucket->obj_list);
+	bucket_write_end(bucket);
+	t->count++;
+	grow_table(t, hops);
 out:
+	reclaim(t, hops);
 	write_unlock(&t->lock);
 
 	return ret;
@@ -161,42 +538,66 @@ int hash_remove(struct hash_table *t, struct hashobj *delobj,
 		const struct hash_operations *hops)
 {
 	struct hash_bucket *bucket;
+	unsigned int stamp = 0;
 	struct hashobj *obj;
 	int ret = -ESRCH;
 
-	bucket = do_hash(t, __mptr(delobj->key), delobj->len);
-
 	write_lock_nocancel(&t->lock);
 
+	bucket = do_hash(t, delobj->hash);
 	if (!list_empty(&bucket->obj_list)) {
 		list_for_each_entry(obj, &bucket->obj_list, link) {
 			if (obj == delobj) {
+				bucket_write_begin(bucket);
 				list_remove_init(&obj->link);
-				drop_key(obj, hops);
+				bucket_write_end(bucket);
+				t->count--;
+				stamp = advance_epoch(t);
 				ret = 0;
-				goto out;
+				break;
 			}
 		}
 	}
-out:
+
+	reclaim(t, hops);
 	write_unlock(&t->lock);
 
+	/*
+	 * The caller may release the object on return, which we
+	 * cannot defer. Wait for the readers which may still be
+	 * looking at it, out of the lock.
+	 */
+	if (ret == 0) {
+		wait_readers(t, stamp);
+		drop_key(delobj, hops);
+	}
+
 	return __bt(ret);
 }
 
 struct hashobj *hash_search(struct hash_table *t, const void *key,
 			    size_t len, const struct hash_operations *hops)
 {
+	unsigned int hash = __hash_key(key, len, 0);
 	struct hash_bucket *bucket;
+	struct hash_reader *r;
 	struct hashobj *obj;
+	int ret;
 
-	bucket = do_hash(t, key, len);
+	r = read_begin(t);
+	if (r) {
+		ret = search_lockless(t, key, len, hash, hops, &obj);
+		read_end(r);
+		if (ret == 0)
+			return obj;
+	}
 
 	read_lock_nocancel(&t->lock);
 
+	bucket = do_hash(t, hash);
 	if (!list_empty(&bucket->obj_list)) {
 		list_for_each_entry(obj, &bucket->obj_list, link) {
-			if (obj->len != len)
+			if (obj->hash != hash || obj->len != len)
 				continue;
 			if (hops->compare(__mptr(obj->key), key, len) == 0)
 				goto out;
@@ -217,8 +618,8 @@ int hash_walk(struct hash_table *t, hash_walk_op walk, void *arg)
 
 	read_lock_nocancel(&t->lock);
 
-	for (n = 0; n < HASHSLOTS; n++) {
-		bucket = &t->table[n];
+	for (n = 0; n <= t->mask; n++) {
+		bucket = &((struct hash_bucket *)__mptr(t->buckets))[n];
 		if (list_empty(&bucket->obj_list))
 			continue;
 		list_for_each_entry_safe(obj, tmp, &bucket->obj_list, link) {
@@ -269,6 +670,27 @@ static inline void drop_key(struct hashobj *obj,
 		hops->free((void *)key);
 }
 
+static inline void retire_key(struct hash_table *t, struct hashobj *obj,
+			      const struct hash_operations *hops)
+{
+	const void *key = __mptr(obj->key);
+
+	if (key != obj->static_key)
+		retire(t, (void *)key, hops);
+}
+
+static inline void *alloc_block(size_t size,
+				const struct hash_operations *hops)
+{
+	return hops->alloc(size);
+}
+
+static inline void free_block(void *block,
+			      const struct hash_operations *hops)
+{
+	hops->free(block);
+}
+
 int __hash_enter_probe(struct hash_table *t,
 		       const void *key, size_t len,
 		       struct hashobj *newobj,
@@ -285,13 +707,17 @@ int __hash_enter_probe(struct hash_table *t,
 	if (ret)
 		return ret;
 
-	bucket = do_hash(t, key, len);
+	newobj->hash = __hash_key(key, len, 0);
 	CANCEL_DEFER(svc);
 	write_lock(&t->lock);
 
+	bucket = do_hash(t, newobj->hash);
+	bucket_write_begin(bucket);
+
 	if (!list_empty(&bucket->obj_list)) {
 		list_for_each_entry_safe(obj, tmp, &bucket->obj_list, link) {
-			if (obj->len != newobj->len)
+			if (obj->hash != newobj->hash ||
+			    obj->len != newobj->len)
 				continue;
 			if (hops->compare(__mptr(obj->key),
 					  __mptr(newobj->key), obj->len) == 0) {
@@ -304,13 +730,19 @@ int __hash_enter_probe(struct hash_table *t,
 					continue;
 				}
 				list_remove_init(&obj->link);
-				drop_key(obj, hops);
+				t->count--;
+				retire_key(t, obj, hops);
 			}
 		}
 	}
 
 	list_append(&newobj->link, &bucket->obj_list);
+	t->count++;
 out:
+	bucket_write_end(bucket);
+	if (ret == 0)
+		grow_table(t, hops);
+	reclaim(t, hops);
 	write_unlock(&t->lock);
 	CANCEL_RESTORE(svc);
 
@@ -321,23 +753,44 @@ struct hashobj *hash_search_probe(struct hash_table *t,
 				  const void *key, size_t len,
 				  const struct hash_operations *hops)
 {
+	unsigned int hash = __hash_key(key, len, 0);
 	struct hash_bucket *bucket;
 	struct hashobj *obj, *tmp;
+	struct hash_reader *r;
 	struct service svc;
+	int ret;
 
-	bucket = do_hash(t, key, len);
+	/*
+	 * Lookups of live objects, and misses, do not need the
+	 * lock. Dropping stale entries does. The object must be
+	 * probed before leaving the read section, it might be
+	 * released right after.
+	 */
+	r = read_begin(t);
+	if (r) {
+		ret = search_lockless(t, key, len, hash, hops, &obj);
+		if (ret == 0 && (obj == NULL || hops->probe(obj))) {
+			read_end(r);
+			return obj;
+		}
+		read_end(r);
+	}
 
 	CANCEL_DEFER(svc);
 	write_lock(&t->lock);
 
+	bucket = do_hash(t, hash);
+	bucket_write_begin(bucket);
+
 	if (!list_empty(&bucket->obj_list)) {
 		list_for_each_entry_safe(obj, tmp, &bucket->obj_list, link) {
-			if (obj->len != len)
+			if (obj->hash != hash || obj->len != len)
 				continue;
 			if (hops->compare(__mptr(obj->key), key, len) == 0) {
 				if (!hops->probe(obj)) {
 					list_remove_init(&obj->link);
-					drop_key(obj, hops);
+					t->count--;
+					retire_key(t, obj, hops);
 					continue;
 				}
 				goto out;
@@ -346,6 +799,8 @@ struct hashobj *hash_search_probe(struct hash_table *t,
 	}
 	obj = NULL;
 out:
+	bucket_write_end(bucket);
+	reclaim(t, hops);
 	write_unlock(&t->lock);
 	CANCEL_RESTORE(svc);
 
@@ -504,4 +959,16 @@ static inline void drop_key(struct hashobj *obj,
 			    const struct hash_operations *hops)
 { }
 
+static inline void *alloc_block(size_t size,
+				const struct hash_operations *hops)
+{
+	return malloc(size);
+}
+
+static inline void free_block(void *block,
+			      const struct hash_operations *hops)
+{
+	free(block);
+}
+
 #endif /* !CONFIG_XENO_PSHARED */
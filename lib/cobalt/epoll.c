@@ -0,0 +1,282 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <asm/xenomai/syscall.h>
+#include "internal.h"
+
+/**
+ * @ingroup cobalt_api
+ * @defgroup cobalt_api_epoll Event-based I/O multiplexing
+ *
+ * Cobalt poll sets, for waiting on RTDM file descriptors
+ *
+ * Cobalt poll sets follow the Linux epoll interface, for a subset of
+ * its features: only the EPOLLIN, EPOLLOUT and EPOLLPRI events are
+ * monitored, with level-triggered semantics. The cost of
+ * epoll_wait() depends on the number of ready descriptors, not on
+ * the size of the set.
+ *
+ * A poll set is homogeneous, the first descriptor added to it
+ * decides its kind. A set started with a regular Linux descriptor is
+ * backed by a Linux epoll set which receives all subsequent requests,
+ * so that it may only contain regular descriptors as well. Adding a
+ * descriptor of the other kind to a set fails with EPERM.
+ * epoll_ctl() and epoll_wait() hand over the request to the regular
+ * Linux services when @a epfd does not refer to a Cobalt poll set.
+ *@{
+ */
+
+/*
+ * The kind of each poll set, looked up by descriptor from a sparse
+ * table. Linux sets are given a shadow Linux epoll descriptor.
+ */
+#define EPOLL_MAP_L1SIZE	64
+#define EPOLL_MAP_L2SHIFT	10
+#define EPOLL_MAP_L2SIZE	(1 << EPOLL_MAP_L2SHIFT)
+
+enum {
+	EPOLL_MAP_NONE = 0,
+	EPOLL_MAP_RT,
+	EPOLL_MAP_LINUX,
+};
+
+struct epoll_map {
+	int mode;
+	int sfd;
+};
+
+static struct epoll_map *epoll_maps[EPOLL_MAP_L1SIZE];
+
+static pthread_mutex_t epoll_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline struct epoll_map *epoll_map_slot(int epfd)
+{
+	struct epoll_map *chunk;
+
+	if ((unsigned int)epfd >= EPOLL_MAP_L1SIZE * EPOLL_MAP_L2SIZE)
+		return NULL;
+
+	chunk = epoll_maps[epfd >> EPOLL_MAP_L2SHIFT];
+	if (chunk == NULL)
+		return NULL;
+
+	return chunk + (epfd & (EPOLL_MAP_L2SIZE - 1));
+}
+
+static struct epoll_map *epoll_map_get(int epfd)
+{
+	struct epoll_map *chunk;
+
+	if ((unsigned int)epfd >= EPOLL_MAP_L1SIZE * EPOLL_MAP_L2SIZE)
+		return NULL;
+
+	if (epoll_maps[epfd >> EPOLL_MAP_L2SHIFT] == NULL) {
+		chunk = calloc(EPOLL_MAP_L2SIZE, sizeof(*chunk));
+		if (chunk == NULL)
+			return NULL;
+		if (!__sync_bool_compare_and_swap(&epoll_maps[epfd >> EPOLL_MAP_L2SHIFT],
+						  NULL, chunk))
+			free(chunk);
+	}
+
+	return epoll_map_slot(epfd);
+}
+
+static inline struct epoll_map *epoll_map_linux(int epfd)
+{
+	struct epoll_map *map = epoll_map_slot(epfd);
+
+	return map && map->mode == EPOLL_MAP_LINUX ? map : NULL;
+}
+
+/* The set holds real-time descriptors from now on. */
+static void epoll_map_set_rt(int epfd)
+{
+	struct epoll_map *map = epoll_map_get(epfd);
+
+	/* Without a map, mixed sets are only caught by the core. */
+	if (map)
+		__sync_bool_compare_and_swap(&map->mode, EPOLL_MAP_NONE,
+					     EPOLL_MAP_RT);
+}
+
+/*
+ * The core refused a regular descriptor: turn a set which did not
+ * receive any real-time descriptor into a Linux set.
+ */
+static struct epoll_map *epoll_map_set_linux(int epfd, int *errp)
+{
+	struct epoll_map *map;
+	int sfd;
+
+	map = epoll_map_get(epfd);
+	if (map == NULL) {
+		*errp = EPERM;
+		return NULL;
+	}
+
+	pthread_mutex_lock(&epoll_map_lock);
+
+	if (map->mode == EPOLL_MAP_LINUX)
+		goto out;
+
+	if (map->mode == EPOLL_MAP_RT) {
+		*errp = EPERM;
+		map = NULL;
+		goto out;
+	}
+
+	sfd = __STD(epoll_create1(EPOLL_CLOEXEC));
+	if (sfd < 0) {
+		*errp = errno;
+		map = NULL;
+		goto out;
+	}
+
+	map->sfd = sfd;
+	__sync_synchronize();
+	if (!__sync_bool_compare_and_swap(&map->mode, EPOLL_MAP_NONE,
+					  EPOLL_MAP_LINUX)) {
+		/* A real-time descriptor went in meanwhile. */
+		__STD(close(sfd));
+		*errp = EPERM;
+		map = NULL;
+	}
+out:
+	pthread_mutex_unlock(&epoll_map_lock);
+
+	return map;
+}
+
+/* Called once the core has closed @fd, which may be a poll set. */
+void cobalt_epoll_drop(int fd)
+{
+	struct epoll_map *map = epoll_map_slot(fd);
+	int mode;
+
+	if (map == NULL || map->mode == EPOLL_MAP_NONE)
+		return;
+
+	pthread_mutex_lock(&epoll_map_lock);
+	mode = map->mode;
+	map->mode = EPOLL_MAP_NONE;
+	if (mode == EPOLL_MAP_LINUX)
+		__STD(close(map->sfd));
+	pthread_mutex_unlock(&epoll_map_lock);
+}
+
+/* Layout of struct __kernel_timespec. */
+struct cobalt_epoll_timeout {
+	int64_t tv_sec;
+	int64_t tv_nsec;
+};
+
+COBALT_IMPL(int, epoll_create1, (int flags))
+{
+	int fd;
+
+	fd = XENOMAI_SYSCALL1(sc_cobalt_epoll_create, flags);
+	if (fd < 0) {
+		errno = -fd;
+		return -1;
+	}
+
+	return fd;
+}
+
+COBALT_IMPL(int, epoll_create, (int size))
+{
+	if (size <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return __RT(epoll_create1(0));
+}
+
+COBALT_IMPL(int, epoll_ctl, (int epfd, int op, int fd,
+			     struct epoll_event *event))
+{
+	struct epoll_map *map;
+	int ret;
+
+	map = epoll_map_linux(epfd);
+	if (map)
+		return __STD(epoll_ctl(map->sfd, op, fd, event));
+
+	ret = XENOMAI_SYSCALL4(sc_cobalt_epoll_ctl, epfd, op, fd, event);
+	if (ret == -EADV || ret == -ENOSYS)
+		return __STD(epoll_ctl(epfd, op, fd, event));
+
+	if (ret == 0) {
+		if (op == EPOLL_CTL_ADD)
+			epoll_map_set_rt(epfd);
+		return 0;
+	}
+
+	if (ret == -EPERM && op == EPOLL_CTL_ADD) {
+		/* Not an RTDM descriptor. */
+		map = epoll_map_set_linux(epfd, &ret);
+		if (map)
+			return __STD(epoll_ctl(map->sfd, op, fd, event));
+		errno = ret;
+		return -1;
+	}
+
+	errno = -ret;
+	return -1;
+}
+
+COBALT_IMPL(int, epoll_wait, (int epfd, struct epoll_event *events,
+			      int maxevents, int timeout))
+{
+	struct cobalt_epoll_timeout ts;
+	struct epoll_map *map;
+	int ret, oldtype;
+
+	map = epoll_map_linux(epfd);
+	if (map)
+		return __STD(epoll_wait(map->sfd, events, maxevents, timeout));
+
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
+	}
+
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
+
+	ret = XENOMAI_SYSCALL4(sc_cobalt_epoll_wait, epfd, events,
+			       maxevents, timeout >= 0 ? &ts : NULL);
+
+	pthread_setcanceltype(oldtype, NULL);
+
+	if (ret == -EADV || ret == -EPERM || ret == -ENOSYS)
+		return __STD(epoll_wait(epfd, events, maxevents, timeout));
+
+	if (ret >= 0)
+		return ret;
+
+	errno = -ret;
+	return -1;
+}
+
+/** @} */
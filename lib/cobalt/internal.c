@@ -159,6 +159,20 @@ struct cobalt_monitor_state *get_monitor_state(cobalt_monitor_t *mon)
 		cobalt_umm_private + mon->state_offset;
 }
 
+/*
+ * True if a signal pending on the monitor may unblock a sleeper. The
+ * kernel tells us which kind of waiters are sleeping.
+ */
+static inline bool monitor_wakeup_p(struct cobalt_monitor_state *state)
+{
+	__u32 flags = state->flags;
+
+	return ((flags & COBALT_MONITOR_GRANTED) &&
+		(flags & COBALT_MONITOR_PENDED_GRANT)) ||
+		((flags & COBALT_MONITOR_DRAINED) &&
+		 (flags & COBALT_MONITOR_PENDED_DRAIN));
+}
+
 int cobalt_monitor_init(cobalt_monitor_t *mon, clockid_t clk_id, int flags)
 {
 	struct cobalt_monitor_state *state;
@@ -229,8 +243,7 @@ int cobalt_monitor_exit(cobalt_monitor_t *mon)
 	__sync_synchronize();
 
 	state = get_monitor_state(mon);
-	if ((state->flags & COBALT_MONITOR_PENDED) &&
-	    (state->flags & COBALT_MONITOR_SIGNALED))
+	if (monitor_wakeup_p(state))
 		goto syscall;
 
 	status = cobalt_get_current_mode();
@@ -267,9 +280,10 @@ int cobalt_monitor_wait(cobalt_monitor_t *mon, int event,
 	/*
 	 * If we got interrupted while trying to re-enter the monitor,
 	 * we need to redo. In the meantime, any pending linux signal
-	 * has been processed.
+	 * has been processed. Don't if the monitor went away while we
+	 * slept, its shadow may live in memory which is gone as well.
 	 */
-	if (opret == -EINTR)
+	if (ret == 0 && opret == -EINTR)
 		ret = cobalt_monitor_enter(mon);
 
 	return ret ?: opret;
@@ -292,7 +306,7 @@ int cobalt_monitor_grant_sync(cobalt_monitor_t *mon,
 
 	cobalt_monitor_grant(mon, u_window);
 
-	if ((state->flags & COBALT_MONITOR_PENDED) == 0)
+	if ((state->flags & COBALT_MONITOR_PENDED_GRANT) == 0)
 		return 0;
 
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
@@ -321,7 +335,7 @@ int cobalt_monitor_grant_all_sync(cobalt_monitor_t *mon)
 
 	cobalt_monitor_grant_all(mon);
 
-	if ((state->flags & COBALT_MONITOR_PENDED) == 0)
+	if ((state->flags & COBALT_MONITOR_PENDED_GRANT) == 0)
 		return 0;
 
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
@@ -350,7 +364,7 @@ int cobalt_monitor_drain_sync(cobalt_monitor_t *mon)
 
 	cobalt_monitor_drain(mon);
 
-	if ((state->flags & COBALT_MONITOR_PENDED) == 0)
+	if ((state->flags & COBALT_MONITOR_PENDED_DRAIN) == 0)
 		return 0;
 
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
@@ -379,7 +393,7 @@ int cobalt_monitor_drain_all_sync(cobalt_monitor_t *mon)
 
 	cobalt_monitor_drain_all(mon);
 
-	if ((state->flags & COBALT_MONITOR_PENDED) == 0)
+	if ((state->flags & COBALT_MONITOR_PENDED_DRAIN) == 0)
 		return 0;
 
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
@@ -466,7 +480,9 @@ int cobalt_event_post(cobalt_event_t *event, unsigned int bits)
 
 	__sync_or_and_fetch(&state->value, bits); /* full barrier. */
 
-	if ((state->flags & COBALT_EVENT_PENDED) == 0)
+	/* Only wake up sleepers which might wait for these bits. */
+	if ((state->flags & COBALT_EVENT_PENDED) == 0 ||
+	    (state->waitbits & bits) == 0)
 		return 0;
 
 	return XENOMAI_SYSCALL1(sc_cobalt_event_sync, event);
@@ -476,8 +492,31 @@ int cobalt_event_wait(cobalt_event_t *event,
 		      unsigned int bits, unsigned int *bits_r,
 		      int mode, const struct timespec *timeout)
 {
+	struct cobalt_event_state *state = get_event_state(event);
+	unsigned int rbits, testval;
 	int ret, oldtype;
 
+	/*
+	 * Waiting does not consume the event bits, so there is no
+	 * need to enter the kernel if the condition is already
+	 * satisfied, or cannot be satisfied without blocking.
+	 */
+	rbits = state->value;
+	if (bits == 0) {
+		*bits_r = rbits;
+		return 0;
+	}
+
+	rbits &= bits;
+	testval = mode & COBALT_EVENT_ANY ? rbits : bits;
+	if (rbits && rbits == testval) {
+		*bits_r = rbits;
+		return 0;
+	}
+
+	if (timeout && timeout->tv_sec == 0 && timeout->tv_nsec == 0)
+		return -EWOULDBLOCK;
+
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
 
 #ifdef __USE_TIME_BITS64
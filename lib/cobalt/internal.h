@@ -88,6 +88,10 @@ void cobalt_mutex_init(void);
 
 void cobalt_default_condattr_init(void);
 
+void cobalt_epoll_drop(int fd);
+
+void cobalt_mq_setfl(int fd, int flags);
+
 int cobalt_xlate_schedparam(int policy,
 			    const struct sched_param_ex *param_ex,
 			    struct sched_param *param);
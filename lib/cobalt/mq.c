@@ -18,11 +18,15 @@
 
 #include <errno.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <mqueue.h>
 #include <asm/xenomai/syscall.h>
+#include "internal.h"
 
 /**
  * @ingroup cobalt_api
@@ -38,6 +42,300 @@
  *@{
  */
 
+/*
+ * Shared queues (COBALT_MQ_SHARED) are looked up by descriptor from
+ * a sparse table, which is populated the first time the kernel
+ * refuses to send or receive over a descriptor, telling us to use
+ * the shared ring instead.
+ */
+#define MQ_MAP_L1SIZE	64
+#define MQ_MAP_L2SHIFT	10
+#define MQ_MAP_L2SIZE	(1 << MQ_MAP_L2SHIFT)
+
+struct mq_map {
+	unsigned long state_offset;
+	int oflags;
+	int active;
+};
+
+static struct mq_map *mq_maps[MQ_MAP_L1SIZE];
+
+static inline struct mq_map *mq_map_slot(mqd_t q)
+{
+	struct mq_map *chunk;
+
+	if ((unsigned int)q >= MQ_MAP_L1SIZE * MQ_MAP_L2SIZE)
+		return NULL;
+
+	chunk = mq_maps[q >> MQ_MAP_L2SHIFT];
+	if (chunk == NULL)
+		return NULL;
+
+	return chunk + (q & (MQ_MAP_L2SIZE - 1));
+}
+
+static inline struct mq_map *mq_map_lookup(mqd_t q)
+{
+	struct mq_map *map = mq_map_slot(q);
+
+	return map && map->active ? map : NULL;
+}
+
+static struct mq_map *mq_map_fetch(mqd_t q, int *errp)
+{
+	struct cobalt_mq_map smap;
+	struct mq_map *chunk;
+	int ret;
+
+	if ((unsigned int)q >= MQ_MAP_L1SIZE * MQ_MAP_L2SIZE) {
+		*errp = -EMFILE;
+		return NULL;
+	}
+
+	ret = XENOMAI_SYSCALL2(sc_cobalt_mq_map, q, &smap);
+	if (ret) {
+		*errp = ret;
+		return NULL;
+	}
+
+	if (mq_maps[q >> MQ_MAP_L2SHIFT] == NULL) {
+		chunk = calloc(MQ_MAP_L2SIZE, sizeof(*chunk));
+		if (chunk == NULL) {
+			*errp = -ENOMEM;
+			return NULL;
+		}
+		if (!__sync_bool_compare_and_swap(&mq_maps[q >> MQ_MAP_L2SHIFT],
+						  NULL, chunk))
+			free(chunk);
+	}
+
+	chunk = mq_map_slot(q);
+	chunk->state_offset = smap.state_offset;
+	chunk->oflags = smap.oflags;
+	__sync_synchronize();
+	chunk->active = 1;
+
+	return chunk;
+}
+
+static inline void mq_map_drop(mqd_t q)
+{
+	struct mq_map *map = mq_map_slot(q);
+
+	if (map)
+		map->active = 0;
+}
+
+/*
+ * Called once the core has changed the file status flags of @fd, so
+ * that the fast path honours O_NONBLOCK set by fcntl(F_SETFL) too.
+ */
+void cobalt_mq_setfl(int fd, int flags)
+{
+	struct mq_map *map = mq_map_lookup(fd);
+
+	if (map)
+		map->oflags = (map->oflags & ~O_NONBLOCK) |
+			(flags & O_NONBLOCK);
+}
+
+static inline struct cobalt_mq_state *mq_map_state(struct mq_map *map)
+{
+	return cobalt_umm_shared + map->state_offset;
+}
+
+static inline struct cobalt_mq_slot *
+mq_get_slot(struct cobalt_mq_state *state, __u32 n)
+{
+	return (void *)state + state->slots + n * state->slotsize;
+}
+
+static inline int mq_check_timeout(const struct timespec *timeout)
+{
+	if (timeout &&
+	    ((unsigned long)timeout->tv_nsec >= 1000000000UL ||
+	     timeout->tv_sec < 0))
+		return -EINVAL;
+
+	return 0;
+}
+
+/* Gate held. Messages of equal priority are kept in FIFO order. */
+static void mq_link_slot(struct cobalt_mq_state *state, __u32 n)
+{
+	struct cobalt_mq_slot *slot = mq_get_slot(state, n), *prev;
+
+	slot->next = COBALT_MQ_NIL;
+
+	if (state->tail == COBALT_MQ_NIL) {
+		state->head = state->tail = n;
+		return;
+	}
+
+	prev = mq_get_slot(state, state->tail);
+	if (prev->prio >= slot->prio) {
+		prev->next = n;
+		state->tail = n;
+		return;
+	}
+
+	prev = mq_get_slot(state, state->head);
+	if (prev->prio < slot->prio) {
+		slot->next = state->head;
+		state->head = n;
+		return;
+	}
+
+	while (mq_get_slot(state, prev->next)->prio >= slot->prio)
+		prev = mq_get_slot(state, prev->next);
+
+	slot->next = prev->next;
+	prev->next = n;
+}
+
+/*
+ * The wait counters may only be overestimated, e.g. if a waiter gets
+ * cancelled. This would only cause spurious wakeup calls.
+ */
+static int mq_shared_send(mqd_t q, struct mq_map *map,
+			  const char *buffer, size_t len, unsigned int prio,
+			  const struct timespec *timeout)
+{
+	struct cobalt_mq_state *state = mq_map_state(map);
+	struct cobalt_mq_slot *slot;
+	int ret, kick;
+	__u32 n;
+
+	if ((map->oflags & O_ACCMODE) == O_RDONLY)
+		return -EBADF;
+
+	if (len > state->msgsize)
+		return -EMSGSIZE;
+
+	if (prio >= MQ_PRIO_MAX)
+		return -EINVAL;
+
+	ret = mq_check_timeout(timeout);
+	if (ret)
+		return ret;
+
+	ret = cobalt_monitor_enter(&state->monitor);
+	if (ret)
+		return ret == -EINVAL ? -EBADF : ret;
+
+	while (state->free == COBALT_MQ_NIL) {
+		if (map->oflags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto out;
+		}
+		state->nrsenders++;
+		ret = cobalt_monitor_wait(&state->monitor,
+					  COBALT_MONITOR_WAITGRANT, timeout);
+		if (ret == -EINVAL)
+			return -EBADF; /* The queue went away. */
+		state->nrsenders--;
+		if (ret)
+			goto out;
+	}
+
+	n = state->free;
+	slot = mq_get_slot(state, n);
+	state->free = slot->next;
+	memcpy(slot + 1, buffer, len);
+	slot->len = len;
+	slot->prio = prio;
+	mq_link_slot(state, n);
+	state->nrqueued++;
+
+	/* Receivers are woken up one at a time, by priority. */
+	if (state->nrreceivers > 0)
+		cobalt_monitor_drain(&state->monitor);
+
+	/* Pairs with the kernel raising the report flags. */
+	__sync_synchronize();
+	kick = ((state->flags & COBALT_MQ_NOTIFY) &&
+		state->nrqueued == 1 && state->nrreceivers == 0) ||
+		((state->flags & COBALT_MQ_SELECT) &&
+		 (state->nrqueued == 1 || state->nrqueued == state->maxmsg));
+out:
+	cobalt_monitor_exit(&state->monitor);
+
+	if (ret == 0 && kick)
+		XENOMAI_SYSCALL1(sc_cobalt_mq_kick, q);
+
+	return ret;
+}
+
+static int mq_shared_receive(mqd_t q, struct mq_map *map,
+			     char *buffer, ssize_t *lenp, unsigned int *prio,
+			     const struct timespec *timeout)
+{
+	struct cobalt_mq_state *state = mq_map_state(map);
+	struct cobalt_mq_slot *slot;
+	int ret, kick;
+	__u32 n;
+
+	if ((map->oflags & O_ACCMODE) == O_WRONLY)
+		return -EBADF;
+
+	if (*lenp < (ssize_t)state->msgsize)
+		return -EMSGSIZE;
+
+	ret = mq_check_timeout(timeout);
+	if (ret)
+		return ret;
+
+	ret = cobalt_monitor_enter(&state->monitor);
+	if (ret)
+		return ret == -EINVAL ? -EBADF : ret;
+
+	while (state->head == COBALT_MQ_NIL) {
+		if (map->oflags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto out;
+		}
+		state->nrreceivers++;
+		ret = cobalt_monitor_wait(&state->monitor,
+					  COBALT_MONITOR_WAITDRAIN, timeout);
+		if (ret == -EINVAL)
+			return -EBADF;
+		state->nrreceivers--;
+		if (ret)
+			goto out;
+	}
+
+	n = state->head;
+	slot = mq_get_slot(state, n);
+	state->head = slot->next;
+	if (state->head == COBALT_MQ_NIL)
+		state->tail = COBALT_MQ_NIL;
+	memcpy(buffer, slot + 1, slot->len);
+	*lenp = slot->len;
+	if (prio)
+		*prio = slot->prio;
+	slot->next = state->free;
+	state->free = n;
+	state->nrqueued--;
+
+	/*
+	 * Blocked senders compete for the released slot, the highest
+	 * priority one grabs the gate first.
+	 */
+	if (state->nrsenders > 0)
+		cobalt_monitor_grant_all(&state->monitor);
+
+	__sync_synchronize();
+	kick = (state->flags & COBALT_MQ_SELECT) &&
+		(state->nrqueued == 0 || state->nrqueued == state->maxmsg - 1);
+out:
+	cobalt_monitor_exit(&state->monitor);
+
+	if (ret == 0 && kick)
+		XENOMAI_SYSCALL1(sc_cobalt_mq_kick, q);
+
+	return ret;
+}
+
 /**
  * @brief Open a message queue
  *
@@ -69,7 +367,18 @@
  * are used when creating a message queue:
  * - @a mq_maxmsg is the maximum number of messages in the queue (128 by
  *   default);
- * - @a mq_msgsize is the maximum size of each message (128 by default).
+ * - @a mq_msgsize is the maximum size of each message (128 by default);
+ * - @a mq_flags may contain COBALT_MQ_SHARED, for creating a shared
+ *   queue.
+ *
+ * The messages sent to a shared queue are stored into a ring living
+ * in the Cobalt shared memory heap, which is mapped into the address
+ * space of every Cobalt process. Senders and receivers access this
+ * ring directly, so that mq_send() and mq_receive() only issue a
+ * system call when some thread has to be woken up, or when mq_notify()
+ * or select() have to be told about the state of the queue. Shared
+ * queues may only be used by Cobalt threads, and their size is
+ * limited by CONFIG_XENO_OPT_SHARED_HEAPSZ.
  *
  * @a name may be any arbitrary string, in which slashes have no particular
  * meaning. However, for portability, using a name which starts with a slash and
@@ -147,6 +456,8 @@ COBALT_IMPL(int, mq_close, (mqd_t mqd))
 {
 	int err;
 
+	mq_map_drop(mqd);
+
 	err = XENOMAI_SYSCALL1(sc_cobalt_mq_close, mqd);
 	if (err) {
 		errno = -err;
@@ -296,8 +607,22 @@ static inline int __do_mq_timesend(mqd_t q, const char *buffer, size_t len,
 #else
 	long sc_nr = sc_cobalt_mq_timedsend;
 #endif
+	struct mq_map *map;
+	int ret;
+
+	map = mq_map_lookup(q);
+	if (map)
+		return mq_shared_send(q, map, buffer, len, prio, to);
+
+	ret = XENOMAI_SYSCALL5(sc_nr, q, buffer, len, prio, to);
+	if (ret != -EOPNOTSUPP)
+		return ret;
 
-	return XENOMAI_SYSCALL5(sc_nr, q, buffer, len, prio, to);
+	map = mq_map_fetch(q, &ret);
+	if (map == NULL)
+		return ret;
+
+	return mq_shared_send(q, map, buffer, len, prio, to);
 }
 
 /**
@@ -421,8 +746,22 @@ static inline int __do_mq_timedreceive(mqd_t q, char *buffer, ssize_t *len,
 #else
 	long sc_nr = sc_cobalt_mq_timedreceive;
 #endif
+	struct mq_map *map;
+	int ret;
+
+	map = mq_map_lookup(q);
+	if (map)
+		return mq_shared_receive(q, map, buffer, len, prio, timeout);
+
+	ret = XENOMAI_SYSCALL5(sc_nr, q, buffer, len, prio, timeout);
+	if (ret != -EOPNOTSUPP)
+		return ret;
+
+	map = mq_map_fetch(q, &ret);
+	if (map == NULL)
+		return ret;
 
-	return XENOMAI_SYSCALL5(sc_nr, q, buffer, len, prio, timeout);
+	return mq_shared_receive(q, map, buffer, len, prio, timeout);
 }
 
 /**
@@ -29,6 +29,7 @@
 #include <rtdm/rtdm.h>
 #include <cobalt/uapi/syscall.h>
 #include <asm/xenomai/syscall.h>
+#include "internal.h"
 
 /* support for very old c libraries not supporting O_TMPFILE */
 #ifndef O_TMPFILE
@@ -154,6 +155,9 @@ COBALT_IMPL(int, close, (int fd))
 
 	pthread_setcanceltype(oldtype, NULL);
 
+	if (ret == 0)
+		cobalt_epoll_drop(fd);
+
 	if (ret != -EADV && ret != -ENOSYS)
 		return set_errno(ret);
 
@@ -184,6 +188,8 @@ COBALT_IMPL(int, fcntl, (int fd, int cmd, ...))
 	va_end(ap);
 
 	ret = XENOMAI_SYSCALL3(sc_cobalt_fcntl, fd, cmd, arg);
+	if (ret == 0 && cmd == F_SETFL)
+		cobalt_mq_setfl(fd, arg);
 
 	if (ret != -EADV && ret != -ENOSYS)
 		return set_errno(ret);
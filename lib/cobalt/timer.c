@@ -139,9 +139,16 @@ COBALT_IMPL(int, timer_delete, (timer_t timerid))
  * Expiration date and reload value are rounded to an integer count of
  * nanoseconds.
  *
+ * If TIMER_SLACK_NP(usecs) is or'ed to @a flags, the timer may fire
+ * up to @a usecs microseconds past each expiration date, so that the
+ * core can serve it from the clock shot programmed for a neighbouring
+ * timer instead of reprogramming the hardware. Without this flag, the
+ * timer is fired as close as possible to its expiration dates.
+ *
  * @param timerid identifier of the timer to be started or stopped;
  *
- * @param flags one of 0 or TIMER_ABSTIME;
+ * @param flags one of 0 or TIMER_ABSTIME, optionally or'ed with
+ * TIMER_SLACK_NP(usecs);
  *
  * @param value address where the specified timer expiration date and reload
  * value are read;
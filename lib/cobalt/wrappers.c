@@ -26,6 +26,7 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/mman.h>
@@ -384,6 +385,31 @@ int __real_select (int __nfds, fd_set *__restrict __readfds,
 	return select(__nfds, __readfds, __writefds, __exceptfds, __timeout);
 }
 
+__weak
+int __real_epoll_create(int size)
+{
+	return epoll_create(size);
+}
+
+__weak
+int __real_epoll_create1(int flags)
+{
+	return epoll_create1(flags);
+}
+
+__weak
+int __real_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+	return epoll_ctl(epfd, op, fd, event);
+}
+
+__weak
+int __real_epoll_wait(int epfd, struct epoll_event *events,
+		      int maxevents, int timeout)
+{
+	return epoll_wait(epfd, events, maxevents, timeout);
+}
+
 __weak
 void *__real_mmap(void *addr, size_t length, int prot, int flags,
 		  int fd, off_t offset)
@@ -346,6 +346,18 @@ int syncluster_findobj(struct syncluster *sc,
 	struct hashobj *hobj;
 	int ret = 0;
 
+	/*
+	 * Fast path: the object is most often there already, in
+	 * which case we don't need to hold the syncobj lock, the
+	 * dictionary supports lockless lookups.
+	 */
+	hobj = hash_search_probe(&sc->d->table, name, strlen(name),
+				 &hash_operations);
+	if (hobj) {
+		*cobjp = container_of(hobj, struct clusterobj, hobj);
+		return 0;
+	}
+
 	ret = syncobj_lock(&sc->d->sobj, &syns);
 	if (ret)
 		return ret;
@@ -562,6 +574,13 @@ int pvsyncluster_findobj(struct pvsyncluster *sc,
 	struct syncstate syns;
 	int ret = 0;
 
+	/* Same fast path as syncluster_findobj(). */
+	cobj = pvcluster_findobj(&sc->c, name);
+	if (cobj) {
+		*cobjp = cobj;
+		return 0;
+	}
+
 	ret = syncobj_lock(&sc->sobj, &syns);
 	if (ret)
 		return ret;
@@ -310,15 +310,19 @@ int eventobj_inquire(struct eventobj *evobj, size_t waitsz,
 {
 	struct threadobj *thobj;
 	struct syncstate syns;
-	int ret, nrwait;
+	int ret, nrwait, n;
 
 	ret = syncobj_lock(&evobj->core.sobj, &syns);
 	if (ret)
 		return ret;
 
+	/* Count all waiters, only report those which fit. */
 	nrwait = syncobj_count_grant(&evobj->core.sobj);
-	if (nrwait > 0) {
+	n = waitsz / sizeof(*waitlist);
+	if (nrwait > 0 && n > 0) {
 		syncobj_for_each_grant_waiter(&evobj->core.sobj, thobj) {
+			if (n-- == 0)
+				break;
 			waitlist->pid = threadobj_get_pid(thobj);
 			strcpy(waitlist->name, threadobj_get_name(thobj));
 			waitlist++;
@@ -62,6 +62,7 @@ static struct shavl_searchops addr_search_ops;
 struct session_heap {
 	struct shared_heap_memory heap;
 	int cpid;
+	uint32_t heapgen;
 	memoff_t maplen;
 	struct hash_table catalog;
 	struct sysgroup sysgroup;
@@ -468,107 +469,62 @@ found:
 			   (bsize >> SHEAPMEM_PAGE_SHIFT) - 1, page_cont);
 	}
 
-	heap->used_size += bsize;
-
 	return pagenr_to_addr(ext, pg);
 }
 
-static void *sheapmem_alloc(struct shared_heap_memory *heap, size_t size)
+static void *alloc_bucket_block(struct shared_heap_memory *heap,
+				int log2size, size_t bsize) /* heap->lock held */
 {
 	struct sheapmem_extent *ext;
-	int log2size, ilog, pg, b;
+	int ilog, pg, b;
 	uint32_t bmask;
-	size_t bsize;
 	void *block;
 
-	if (size == 0)
-		return NULL;
-
-	if (size < SHEAPMEM_MIN_ALIGN) {
-		bsize = size = SHEAPMEM_MIN_ALIGN;
-		log2size = SHEAPMEM_MIN_LOG2;
-	} else {
-		log2size = sizeof(size) * CHAR_BIT - 1 -
-			xenomai_count_leading_zeros(size);
-		if (log2size < SHEAPMEM_PAGE_SHIFT) {
-			if (size & (size - 1))
-				log2size++;
-			bsize = 1 << log2size;
-		} else
-			bsize = __align_to(size, SHEAPMEM_PAGE_SIZE);
-	}
-	
-	/*
-	 * Allocate entire pages directly from the pool whenever the
-	 * block is larger or equal to SHEAPMEM_PAGE_SIZE.  Otherwise,
-	 * use bucketed memory.
-	 *
-	 * NOTE: Fully busy pages from bucketed memory are moved back
-	 * at the end of the per-bucket page list, so that we may
-	 * always assume that either the heading page has some room
-	 * available, or no room is available from any page linked to
-	 * this list, in which case we should immediately add a fresh
-	 * page.
-	 */
-	if (bsize < SHEAPMEM_PAGE_SIZE) {
-		ilog = log2size - SHEAPMEM_MIN_LOG2;
-		assert(ilog >= 0 && ilog < SHEAPMEM_MAX);
+	ilog = log2size - SHEAPMEM_MIN_LOG2;
+	assert(ilog >= 0 && ilog < SHEAPMEM_MAX);
 
-		write_lock_nocancel(&heap->lock);
+	__list_for_each_entry(main_base, ext, &heap->extents, next) {
+		pg = heap->buckets[ilog];
+		if (pg < 0) /* Empty page list? */
+			continue;
 
-		__list_for_each_entry(main_base, ext, &heap->extents, next) {
-			pg = heap->buckets[ilog];
-			if (pg < 0) /* Empty page list? */
-				continue;
-
-			/*
-			 * Find a block in the heading page. If there
-			 * is none, there won't be any down the list:
-			 * add a new page right away.
-			 */
-			bmask = ext->pagemap[pg].map;
-			if (bmask == -1U)
-				break;
-			b = xenomai_count_trailing_zeros(~bmask);
-
-			/*
-			 * Got one block from the heading per-bucket
-			 * page, tag it as busy in the per-page
-			 * allocation map.
-			 */
-			ext->pagemap[pg].map |= (1U << b);
-			heap->used_size += bsize;
-			block = __shref(main_base, ext->membase) +
-				(pg << SHEAPMEM_PAGE_SHIFT) +
-				(b << log2size);
-			if (ext->pagemap[pg].map == -1U)
-				move_page_back(heap, ext, pg, log2size);
-			goto out;
-		}
+		/*
+		 * Find a block in the heading page. If there is none,
+		 * there won't be any down the list: add a new page
+		 * right away.
+		 */
+		bmask = ext->pagemap[pg].map;
+		if (bmask == -1U)
+			break;
+		b = xenomai_count_trailing_zeros(~bmask);
 
-		/* No free block in bucketed memory, add one page. */
-		block = add_free_range(heap, bsize, log2size);
-	} else {
-		write_lock_nocancel(&heap->lock);
-		/* Add a range of contiguous free pages. */
-		block = add_free_range(heap, bsize, 0);
+		/*
+		 * Got one block from the heading per-bucket page, tag
+		 * it as busy in the per-page allocation map.
+		 */
+		ext->pagemap[pg].map |= (1U << b);
+		block = __shref(main_base, ext->membase) +
+			(pg << SHEAPMEM_PAGE_SHIFT) +
+			(b << log2size);
+		if (ext->pagemap[pg].map == -1U)
+			move_page_back(heap, ext, pg, log2size);
+
+		return block;
 	}
-out:
-	write_unlock(&heap->lock);
 
-	return block;
+	/* No free block in bucketed memory, add one page. */
+	return add_free_range(heap, bsize, log2size);
 }
 
-static int sheapmem_free(struct shared_heap_memory *heap, void *block)
+static int release_block(struct shared_heap_memory *heap, void *block,
+			 size_t *bsize_r) /* heap->lock held */
 {
-	int log2size, ret = 0, pg, n;
 	struct sheapmem_extent *ext;
 	memoff_t pgoff, boff;
+	int log2size, pg, n;
 	uint32_t oldmap;
 	size_t bsize;
 
-	write_lock_nocancel(&heap->lock);
-
 	/*
 	 * Find the extent from which the returned block is
 	 * originating from.
@@ -579,15 +535,19 @@ static int sheapmem_free(struct shared_heap_memory *heap, void *block)
 			goto found;
 	}
 
-	goto bad;
+	return -EINVAL;
 found:
 	/* Compute the heading page number in the page map. */
 	pgoff = __shoff(main_base, block) - ext->membase;
 	pg = pgoff >> SHEAPMEM_PAGE_SHIFT;
 	if (!page_is_valid(ext, pg))
-		goto bad;
-	
+		return -EINVAL;
+
 	switch (ext->pagemap[pg].type) {
+	case page_free:	/* Not allocated. */
+	case page_cont:	/* Not at range start. */
+		return -EINVAL;
+
 	case page_list:
 		bsize = ext->pagemap[pg].bsize;
 		assert((bsize & (SHEAPMEM_PAGE_SIZE - 1)) == 0);
@@ -600,10 +560,12 @@ found:
 		assert(bsize < SHEAPMEM_PAGE_SIZE);
 		boff = pgoff & ~SHEAPMEM_PAGE_MASK;
 		if ((boff & (bsize - 1)) != 0) /* Not at block start? */
-			goto bad;
+			return -EINVAL;
 
 		n = boff >> log2size; /* Block position in page. */
 		oldmap = ext->pagemap[pg].map;
+		if ((oldmap & (1U << n)) == 0) /* Not busy, double free? */
+			return -EINVAL;
 		ext->pagemap[pg].map &= ~(1U << n);
 
 		/*
@@ -621,14 +583,378 @@ found:
 			move_page_front(heap, ext, pg, log2size);
 	}
 
-	heap->used_size -= bsize;
+	*bsize_r = bsize;
+
+	return 0;
+}
+
+#ifdef HAVE_TLS
+
+/*
+ * Per-thread caches of free bucketed blocks, so that most small
+ * allocations and deallocations do not have to grab the heap lock,
+ * which is shared by all processes attached to the session.
+ *
+ * A thread caches blocks for up to SHEAPMEM_CACHE_HEAPS heaps at
+ * once, a heap is hashed by address to a single cache slot. Blocks
+ * always go to the cache of the thread releasing them, regardless of
+ * which thread allocated them. Cached blocks are accounted as free
+ * in heap->used_size, although only the caching thread may reuse
+ * them until they are drained back to the extent, which happens in
+ * batches when a bucket overflows, when an allocation from the
+ * caching thread fails, or when the thread exits.
+ *
+ * Therefore, the blocks cached by other threads do reduce the memory
+ * available to an allocation, by up to SHEAPMEM_CACHE_DEPTH blocks
+ * per bucket and thread. A process leaving with _exit() or killed
+ * by a signal never drains the caches of its threads, their blocks
+ * are lost until the heap is destroyed.
+ */
+#define SHEAPMEM_CACHE_HEAPS	4
+#define SHEAPMEM_CACHE_DEPTH	16
+#define SHEAPMEM_CACHE_BATCH	4
+
+struct sheapmem_cache {
+	struct shared_heap_memory *heap;
+	uint32_t cookie;
+	int count[SHEAPMEM_MAX];
+	void *blocks[SHEAPMEM_MAX]; /* LIFO linked through the free blocks. */
+};
+
+static __thread __attribute__ ((tls_model (CONFIG_XENO_TLS_MODEL)))
+struct sheapmem_cache sheapmem_caches[SHEAPMEM_CACHE_HEAPS];
+
+static __thread __attribute__ ((tls_model (CONFIG_XENO_TLS_MODEL)))
+int sheapmem_cache_active;
+
+static pthread_key_t sheapmem_cache_key;
+
+static int sheapmem_cache_enabled;
+
+static inline void cache_push(struct sheapmem_cache *c, int ilog, void *block)
+{
+	*(void **)block = c->blocks[ilog];
+	c->blocks[ilog] = block;
+	c->count[ilog]++;
+}
+
+static inline void *cache_pop(struct sheapmem_cache *c, int ilog)
+{
+	void *block = c->blocks[ilog];
+
+	c->blocks[ilog] = *(void **)block;
+	c->count[ilog]--;
+
+	return block;
+}
+
+static inline bool cache_valid(struct sheapmem_cache *c)
+{
+	/* A destroyed or reinitialized heap has a different cookie. */
+	return c->heap && c->heap->cookie == c->cookie;
+}
+
+static struct sheapmem_cache *get_cache(struct shared_heap_memory *heap)
+{
+	struct sheapmem_cache *c;
+
+	if (!sheapmem_cache_enabled)
+		return NULL;
+
+	c = sheapmem_caches + ((uintptr_t)heap >> 6) % SHEAPMEM_CACHE_HEAPS;
+	if (c->heap == heap && c->cookie == heap->cookie)
+		return c;
+
+	/* Slot busy with another live heap, don't cache. */
+	if (cache_valid(c))
+		return NULL;
+
+	/*
+	 * Free or stale slot: any block left there belonged to a
+	 * defunct heap, forget about them.
+	 */
+	memset(c, 0, sizeof(*c));
+	c->heap = heap;
+	c->cookie = heap->cookie;
+
+	if (!sheapmem_cache_active) {
+		sheapmem_cache_active = 1;
+		pthread_setspecific(sheapmem_cache_key, sheapmem_caches);
+	}
+
+	return c;
+}
+
+static int flush_cache(struct sheapmem_cache *c)
+{
+	struct shared_heap_memory *heap = c->heap;
+	int ilog, nr = 0;
+	size_t bsize;
+
+	if (!cache_valid(c))
+		return 0;
+
+	write_lock_nocancel(&heap->lock);
+
+	for (ilog = 0; ilog < SHEAPMEM_MAX; ilog++) {
+		while (c->count[ilog] > 0) {
+			release_block(heap, cache_pop(c, ilog), &bsize);
+			nr++;
+		}
+	}
+
+	write_unlock(&heap->lock);
+
+	return nr;
+}
+
+static void flush_thread_caches(void)
+{
+	int n;
+
+	/* Leave the blocks alone if the session is unmapped. */
+	for (n = 0; sheapmem_cache_enabled && n < SHEAPMEM_CACHE_HEAPS; n++)
+		flush_cache(sheapmem_caches + n);
+
+	memset(sheapmem_caches, 0, sizeof(sheapmem_caches));
+}
+
+static void finalize_thread_caches(void *arg)
+{
+	flush_thread_caches();
+}
+
+static void reset_child_caches(void)
+{
+	/*
+	 * The parent still owns the cached blocks, we must not reuse
+	 * them.
+	 */
+	memset(sheapmem_caches, 0, sizeof(sheapmem_caches));
+}
+
+static int init_thread_caches(void)
+{
+	if (pthread_key_create(&sheapmem_cache_key, finalize_thread_caches))
+		return -EAGAIN;
+
+	pthread_atfork(NULL, NULL, reset_child_caches);
+	atexit(flush_thread_caches);
+	sheapmem_cache_enabled = 1;
+
+	return 0;
+}
+
+static void disable_thread_caches(void)
+{
+	sheapmem_cache_enabled = 0;
+}
+
+/*
+ * Return the log2 size of a bucketed block, without locking. This
+ * is safe for blocks from the first extent, which stays until the
+ * heap is destroyed, since the type of a page cannot change while
+ * some block it contains is busy.
+ */
+static int get_block_log2size(struct shared_heap_memory *heap, void *block)
+{
+	struct sheapmem_extent *ext;
+	memoff_t pgoff, boff;
+	int pg, type;
+
+	ext = __list_first_entry(main_base, &heap->extents,
+				 struct sheapmem_extent, next);
+	if (__shoff(main_base, block) < ext->membase ||
+	    __shoff(main_base, block) >= ext->memlim)
+		return -1;
+
+	pgoff = __shoff(main_base, block) - ext->membase;
+	pg = pgoff >> SHEAPMEM_PAGE_SHIFT;
+	if (!page_is_valid(ext, pg))
+		return -1;
+
+	/*
+	 * Only busy blocks from bucketed pages may be cached, leave
+	 * anything else to release_block(), which also detects
+	 * invalid requests.
+	 */
+	type = ext->pagemap[pg].type;
+	if (type < SHEAPMEM_MIN_LOG2 || type >= SHEAPMEM_PAGE_SHIFT)
+		return -1;
+
+	boff = pgoff & ~SHEAPMEM_PAGE_MASK;
+	if ((boff & ((1 << type) - 1)) != 0 ||
+	    (ext->pagemap[pg].map & (1U << (boff >> type))) == 0)
+		return -1;
+
+	return type;
+}
+
+/* Cached blocks are still busy in the page map. */
+static bool cache_holds(struct sheapmem_cache *c, int ilog, void *block)
+{
+	void *p;
+
+	for (p = c->blocks[ilog]; p; p = *(void **)p) {
+		if (p == block)
+			return true;
+	}
+
+	return false;
+}
+
+#else /* !HAVE_TLS */
+
+struct sheapmem_cache;
+
+static inline struct sheapmem_cache *
+get_cache(struct shared_heap_memory *heap)
+{
+	return NULL;
+}
+
+static inline int flush_cache(struct sheapmem_cache *c)
+{
+	return 0;
+}
+
+static inline int init_thread_caches(void)
+{
+	return 0;
+}
+
+static inline void disable_thread_caches(void)
+{
+}
+
+#endif /* !HAVE_TLS */
+
+static void *sheapmem_alloc(struct shared_heap_memory *heap, size_t size)
+{
+	struct sheapmem_cache *c;
+	int log2size;
+	size_t bsize;
+	void *block;
+
+	if (size == 0)
+		return NULL;
+
+	if (size < SHEAPMEM_MIN_ALIGN) {
+		bsize = size = SHEAPMEM_MIN_ALIGN;
+		log2size = SHEAPMEM_MIN_LOG2;
+	} else {
+		log2size = sizeof(size) * CHAR_BIT - 1 -
+			xenomai_count_leading_zeros(size);
+		if (log2size < SHEAPMEM_PAGE_SHIFT) {
+			if (size & (size - 1))
+				log2size++;
+			bsize = 1 << log2size;
+		} else
+			bsize = __align_to(size, SHEAPMEM_PAGE_SIZE);
+	}
+
+	c = get_cache(heap);
+retry:
+	/*
+	 * Allocate entire pages directly from the pool whenever the
+	 * block is larger or equal to SHEAPMEM_PAGE_SIZE.  Otherwise,
+	 * use bucketed memory, from the cache of the current thread
+	 * first.
+	 *
+	 * NOTE: Fully busy pages from bucketed memory are moved back
+	 * at the end of the per-bucket page list, so that we may
+	 * always assume that either the heading page has some room
+	 * available, or no room is available from any page linked to
+	 * this list, in which case we should immediately add a fresh
+	 * page.
+	 */
+	if (bsize < SHEAPMEM_PAGE_SIZE) {
+#ifdef HAVE_TLS
+		int ilog = log2size - SHEAPMEM_MIN_LOG2, n;
+		void *extra;
+
+		if (c && c->count[ilog] > 0) {
+			block = cache_pop(c, ilog);
+			goto out;
+		}
+
+		write_lock_nocancel(&heap->lock);
+		block = alloc_bucket_block(heap, log2size, bsize);
+		/* Refill the cache in the same move. */
+		for (n = 0; c && block && n < SHEAPMEM_CACHE_BATCH; n++) {
+			extra = alloc_bucket_block(heap, log2size, bsize);
+			if (extra == NULL)
+				break;
+			cache_push(c, ilog, extra);
+		}
+#else
+		write_lock_nocancel(&heap->lock);
+		block = alloc_bucket_block(heap, log2size, bsize);
+#endif
+	} else {
+		write_lock_nocancel(&heap->lock);
+		/* Add a range of contiguous free pages. */
+		block = add_free_range(heap, bsize, 0);
+	}
+
+	write_unlock(&heap->lock);
+
+	/*
+	 * Blocks held in our cache may prevent the request from
+	 * being satisfied, drain them all before giving up.
+	 */
+	if (block == NULL && c && flush_cache(c) > 0)
+		goto retry;
+#ifdef HAVE_TLS
 out:
+#endif
+	if (block)
+		__sync_add_and_fetch(&heap->used_size, bsize);
+
+	return block;
+}
+
+static int sheapmem_free(struct shared_heap_memory *heap, void *block)
+{
+	struct sheapmem_cache *c;
+	size_t bsize;
+	int ret;
+
+	c = get_cache(heap);
+#ifdef HAVE_TLS
+	if (c) {
+		int log2size, ilog, n;
+
+		log2size = get_block_log2size(heap, block);
+		if (log2size > 0) {
+			ilog = log2size - SHEAPMEM_MIN_LOG2;
+			if (cache_holds(c, ilog, block))
+				return __bt(-EINVAL);
+			if (c->count[ilog] >= SHEAPMEM_CACHE_DEPTH) {
+				/* Drain a batch back to the extent. */
+				write_lock_nocancel(&heap->lock);
+				for (n = 0; n < SHEAPMEM_CACHE_BATCH; n++)
+					release_block(heap, cache_pop(c, ilog),
+						      &bsize);
+				write_unlock(&heap->lock);
+			}
+			cache_push(c, ilog, block);
+			__sync_sub_and_fetch(&heap->used_size, 1 << log2size);
+			return 0;
+		}
+	}
+#else
+	(void)c;
+#endif
+
+	write_lock_nocancel(&heap->lock);
+	ret = release_block(heap, block, &bsize);
 	write_unlock(&heap->lock);
 
+	if (ret == 0)
+		__sync_sub_and_fetch(&heap->used_size, bsize);
+
 	return __bt(ret);
-bad:
-	ret = -EINVAL;
-	goto out;
 }
 
 static inline int compare_range_by_size(const struct shavlh *l, const struct shavlh *r)
@@ -745,10 +1071,13 @@ static int sheapmem_init(struct shared_heap_memory *heap, void *base,
 			 const char *name,
 			 void *mem, size_t size)
 {
+	struct session_heap *s_heap = base;
 	pthread_mutexattr_t mattr;
 	int ret, n;
 
 	namecpy(heap->name, name);
+	/* Tell per-thread caches apart from any previous incarnation. */
+	heap->cookie = __sync_add_and_fetch(&s_heap->heapgen, 1);
 	heap->used_size = 0;
 	heap->usable_size = 0;
 	heap->arena_size = 0;
@@ -1135,12 +1464,14 @@ void heapobj_destroy(struct heapobj *hobj)
 	int cpid;
 
 	if (hobj != &main_pool) {
+		heap->cookie = 0;
 		__RT(pthread_mutex_destroy(&heap->lock));
 		sysgroup_remove(heap, &heap->memspec);
 		sheapmem_free(&main_heap.heap, heap);
 		return;
 	}
 
+	disable_thread_caches();
 	cpid = main_heap.cpid;
 	if (cpid != 0 && cpid != get_thread_pid() &&
 	    copperplate_probe_tid(cpid) == 0) {
@@ -1237,8 +1568,10 @@ int heapobj_pkg_init_shared(void)
 	if (ret == -EEXIST)
 		warning("session %s is still active (pid %d)\n",
 			__copperplate_setup_data.session_label, cnode);
+	if (ret)
+		return __bt(ret);
 
-	return __bt(ret);
+	return __bt(init_thread_caches());
 }
 
 int heapobj_bind_session(const char *session)
@@ -1251,6 +1584,7 @@ void heapobj_unbind_session(void)
 {
 	size_t len = main_heap.maplen;
 
+	disable_thread_caches();
 	munmap(&main_heap, len);
 }
 
@@ -39,6 +39,7 @@ struct copperplate_setup_data __copperplate_setup_data = {
 	.session_label = NULL,
 	.session_root = NULL,
 	.session_gid = USHRT_MAX,
+	.timer_servers = 1,
 };
 
 #ifdef CONFIG_XENO_COBALT
@@ -75,6 +76,11 @@ static const struct option copperplate_options[] = {
 		.flag = &__copperplate_setup_data.shared_registry,
 		.val = 1,
 	},
+	{
+#define timer_servers_opt	5
+		.name = "timer-servers",
+		.has_arg = required_argument,
+	},
 	{ /* Sentinel */ }
 };
 
@@ -279,6 +285,11 @@ static int copperplate_parse_option(int optnum, const char *optarg)
 	case regroot_opt:
 		__copperplate_setup_data.registry_root = strdup(optarg);
 		break;
+	case timer_servers_opt:
+		__copperplate_setup_data.timer_servers = atoi(optarg);
+		if (__copperplate_setup_data.timer_servers < 0)
+			return -EINVAL;
+		break;
 	case shared_registry_opt:
 	case no_registry_opt:
 		break;
@@ -297,6 +308,7 @@ static void copperplate_help(void)
         fprintf(stderr, "--shared-registry		enable public access to registry\n");
         fprintf(stderr, "--registry-root=<path>		root path of registry\n");
         fprintf(stderr, "--session=<label>[/<group>]	enable shared session\n");
+        fprintf(stderr, "--timer-servers=<nr>		timer server threads (0=one per CPU)\n");
 }
 
 static struct setup_descriptor copperplate_interface = {
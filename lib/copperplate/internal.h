@@ -121,6 +121,8 @@ struct shared_heap_memory {
 	size_t arena_size;
 	size_t usable_size;
 	size_t used_size;
+	/* Identifies this heap incarnation to per-thread caches. */
+	uint32_t cookie;
 	/* Heads of page lists for log2-sized blocks. */
 	uint32_t buckets[SHEAPMEM_MAX];
 	struct sysgroup_memspec memspec;
@@ -67,6 +67,8 @@ struct regfs_data {
 	pthread_mutex_t lock;
 	struct pvhash_table files;
 	struct pvhash_table dirs;
+	pthread_mutex_t pending_lock;
+	struct pvlistobj pending;
 };
 
 static inline struct regfs_data *regfs_get_context(void)
@@ -174,6 +176,7 @@ int registry_init_file(struct fsobj *fsobj,
 		return 0;
 
 	fsobj->path = NULL;
+	fsobj->dir = NULL;
 	fsobj->ops = ops;
 	fsobj->privsz = privsz;
 	pvholder_init(&fsobj->link);
@@ -188,13 +191,18 @@ int registry_init_file(struct fsobj *fsobj,
 	return ret;
 }
 
+/*
+ * Exporting a file only queues its descriptor to the pending list,
+ * so that object creation does not contend with the FUSE thread
+ * browsing the tree. The pending files are hashed and linked to
+ * their parent directory by regfs_sync(), the next time the
+ * filesystem is looked up.
+ */
 int registry_add_file(struct fsobj *fsobj, int mode, const char *fmt, ...)
 {
 	struct regfs_data *p = regfs_get_context();
-	char path[PATH_MAX], *basename, *dir;
-	struct pvhashobj *hobj;
-	struct regfs_dir *d;
-	int ret, state;
+	char path[PATH_MAX], *basename;
+	int state;
 	va_list ap;
 
 	if (__copperplate_setup_data.no_registry)
@@ -213,37 +221,76 @@ int registry_add_file(struct fsobj *fsobj, int mode, const char *fmt, ...)
 		return __bt(-ENOMEM);
 	fsobj->basename = fsobj->path + (basename - path) + 1;
 	fsobj->mode = mode & O_ACCMODE;
+	fsobj->dir = NULL;
 	__RT(clock_gettime(CLOCK_COPPERPLATE, &fsobj->ctime));
 	fsobj->mtime = fsobj->ctime;
 
-	write_lock_safe(&p->lock, state);
+	write_lock_safe(&p->pending_lock, state);
+	pvlist_append(&fsobj->link, &p->pending);
+	write_unlock_safe(&p->pending_lock, state);
+
+	return 0;
+}
+
+static int export_file(struct regfs_data *p, struct fsobj *fsobj)
+{
+	char path[PATH_MAX], *basename, *dir;
+	struct pvhashobj *hobj;
+	struct regfs_dir *d;
+	int ret;
 
 	ret = pvhash_enter(&p->files, fsobj->path, strlen(fsobj->path),
 			   &fsobj->hobj, &pvhash_operations);
 	if (ret)
-		goto fail;
+		return ret;
 
+	strcpy(path, fsobj->path);
+	basename = path + (fsobj->basename - fsobj->path) - 1;
 	*basename = '\0';
 	dir = basename == path ? "/" : path;
 	hobj = pvhash_search(&p->dirs, dir, strlen(dir),
 			     &pvhash_operations);
 	if (hobj == NULL) {
-		ret = -ENOENT;
-	fail:
 		pvhash_remove(&p->files, &fsobj->hobj, &pvhash_operations);
-		pvfree(fsobj->path);
-		fsobj->path = NULL;
-		goto done;
+		return -ENOENT;
 	}
 
 	d = container_of(hobj, struct regfs_dir, hobj);
 	pvlist_append(&fsobj->link, &d->file_list);
 	d->nfiles++;
 	fsobj->dir = d;
-done:
-	write_unlock_safe(&p->lock, state);
 
-	return __bt(ret);
+	return 0;
+}
+
+static void regfs_sync(struct regfs_data *p)
+{
+	struct fsobj *fsobj, *tmp;
+	int state, pstate, ret;
+
+	/*
+	 * Racing with registry_add_file() is harmless, a file queued
+	 * after this test shows up on the next lookup.
+	 */
+	if (pvlist_empty(&p->pending))
+		return;
+
+	write_lock_safe(&p->lock, state);
+	write_lock_safe(&p->pending_lock, pstate);
+
+	pvlist_for_each_entry_safe(fsobj, tmp, &p->pending, link) {
+		pvlist_remove_init(&fsobj->link);
+		ret = export_file(p, fsobj);
+		if (ret) {
+			warning("failed to export %s to registry, %s",
+				fsobj->path, symerror(ret));
+			pvfree(fsobj->path);
+			fsobj->path = NULL;
+		}
+	}
+
+	write_unlock_safe(&p->pending_lock, pstate);
+	write_unlock_safe(&p->lock, state);
 }
 
 void registry_destroy_file(struct fsobj *fsobj)
@@ -255,6 +302,19 @@ void registry_destroy_file(struct fsobj *fsobj)
 	if (__copperplate_setup_data.no_registry)
 		return;
 
+	write_lock_safe(&p->pending_lock, state);
+
+	if (fsobj->path && fsobj->dir == NULL) {
+		/* Never looked up, drop the descriptor. */
+		pvlist_remove(&fsobj->link);
+		pvfree(fsobj->path);
+		write_unlock_safe(&p->pending_lock, state);
+		__RT(pthread_mutex_destroy(&fsobj->lock));
+		return;
+	}
+
+	write_unlock_safe(&p->pending_lock, state);
+
 	write_lock_safe(&p->lock, state);
 
 	if (fsobj->path == NULL)
@@ -285,16 +345,65 @@ void registry_touch_file(struct fsobj *fsobj)
 	__RT(clock_gettime(CLOCK_COPPERPLATE, &fsobj->mtime));
 }
 
+/*
+ * Snapshot handles are tagged, so that they can be released even
+ * once the file they were taken from is gone.
+ */
+#define REGFS_FH_SNAPSHOT  1UL
+
+static inline void *regfs_fh_priv(struct fuse_file_info *fi)
+{
+	return (void *)(uintptr_t)(fi->fh & ~REGFS_FH_SNAPSHOT);
+}
+
+/*
+ * Look up a registry file by path. "<file>.bin" resolves to <file>
+ * when the latter has a snapshot handler, in which case *snapshot is
+ * set.
+ */
+static struct fsobj *find_file(struct regfs_data *p, const char *path,
+			       int *snapshot)
+{
+	size_t len = strlen(path), slen = strlen(REGSNAP_SUFFIX);
+	struct pvhashobj *hobj;
+	struct fsobj *fsobj;
+
+	*snapshot = 0;
+
+	hobj = pvhash_search(&p->files, path, len, &pvhash_operations);
+	if (hobj)
+		return container_of(hobj, struct fsobj, hobj);
+
+	if (len <= slen || strcmp(path + len - slen, REGSNAP_SUFFIX))
+		return NULL;
+
+	hobj = pvhash_search(&p->files, path, len - slen, &pvhash_operations);
+	if (hobj == NULL)
+		return NULL;
+
+	fsobj = container_of(hobj, struct fsobj, hobj);
+	if (fsobj->ops->snapshot == NULL)
+		return NULL;
+
+	*snapshot = 1;
+
+	return fsobj;
+}
+
 static int regfs_getattr(const char *path, struct stat *sbuf)
 {
 	struct regfs_data *p = regfs_get_context();
 	struct pvhashobj *hobj;
+	struct fssnapshot s;
 	struct regfs_dir *d;
 	struct fsobj *fsobj;
-	int ret = 0;
+	int ret = 0, snapshot;
+	struct service svc;
 
 	memset(sbuf, 0, sizeof(*sbuf));
 
+	regfs_sync(p);
+
 	read_lock_nocancel(&p->lock);
 
 	hobj = pvhash_search(&p->dirs, path, strlen(path),
@@ -309,12 +418,10 @@ static int regfs_getattr(const char *path, struct stat *sbuf)
 		goto done;
 	}
 
-	hobj = pvhash_search(&p->files, path, strlen(path),
-			     &pvhash_operations);
-	if (hobj) {
-		fsobj = container_of(hobj, struct fsobj, hobj);
+	fsobj = find_file(p, path, &snapshot);
+	if (fsobj) {
 		sbuf->st_mode = S_IFREG;
-		switch (fsobj->mode) {
+		switch (snapshot ? O_RDONLY : fsobj->mode) {
 		case O_RDONLY:
 			sbuf->st_mode |= 0444;
 			break;
@@ -326,7 +433,16 @@ static int regfs_getattr(const char *path, struct stat *sbuf)
 			break;
 		}
 		sbuf->st_nlink = 1;
-		sbuf->st_size = 32768; /* XXX: this should be dynamic. */
+		if (snapshot) {
+			CANCEL_DEFER(svc);
+			ret = __bt(fsobj->ops->snapshot(fsobj, &s));
+			CANCEL_RESTORE(svc);
+			if (ret)
+				goto done;
+			sbuf->st_size = s.len;
+			fssnapshot_destroy(&s);
+		} else
+			sbuf->st_size = 32768; /* XXX: this should be dynamic. */
 		sbuf->st_atim = fsobj->mtime;
 		sbuf->st_ctim = fsobj->ctime;
 		sbuf->st_mtim = fsobj->mtime;
@@ -344,8 +460,11 @@ static int regfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 	struct regfs_data *p = regfs_get_context();
 	struct regfs_dir *d, *subd;
 	struct pvhashobj *hobj;
+	char name[PATH_MAX];
 	struct fsobj *fsobj;
 
+	regfs_sync(p);
+
 	read_lock_nocancel(&p->lock);
 
 	hobj = pvhash_search(&p->dirs, path, strlen(path),
@@ -371,9 +490,16 @@ static int regfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 	}
 
 	if (!pvlist_empty(&d->file_list)) {
-		pvlist_for_each_entry(fsobj, &d->file_list, link)
+		pvlist_for_each_entry(fsobj, &d->file_list, link) {
 			if (filler(buf, fsobj->basename, NULL, 0))
 				break;
+			if (fsobj->ops->snapshot == NULL)
+				continue;
+			snprintf(name, sizeof(name), "%s%s",
+				 fsobj->basename, REGSNAP_SUFFIX);
+			if (filler(buf, name, NULL, 0))
+				break;
+		}
 	}
 
 	read_unlock(&p->lock);
@@ -384,23 +510,41 @@ static int regfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 static int regfs_open(const char *path, struct fuse_file_info *fi)
 {
 	struct regfs_data *p = regfs_get_context();
-	struct pvhashobj *hobj;
+	int ret = 0, snapshot;
 	struct fsobj *fsobj;
 	struct service svc;
-	int ret = 0;
 	void *priv;
 
+	regfs_sync(p);
+
 	push_cleanup_lock(&p->lock);
 	read_lock(&p->lock);
 
-	hobj = pvhash_search(&p->files, path, strlen(path),
-			     &pvhash_operations);
-	if (hobj == NULL) {
+	fsobj = find_file(p, path, &snapshot);
+	if (fsobj == NULL) {
 		ret = -ENOENT;
 		goto done;
 	}
 
-	fsobj = container_of(hobj, struct fsobj, hobj);
+	if (snapshot) {
+		if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+			ret = -EACCES;
+			goto done;
+		}
+		priv = malloc(sizeof(struct fssnapshot));
+		if (priv == NULL) {
+			ret = -ENOMEM;
+			goto done;
+		}
+		fi->fh = (uintptr_t)priv | REGFS_FH_SNAPSHOT;
+		CANCEL_DEFER(svc);
+		ret = __bt(fsobj->ops->snapshot(fsobj, priv));
+		CANCEL_RESTORE(svc);
+		if (ret)
+			free(priv);
+		goto done;
+	}
+
 	if (((fi->flags + 1) & (fsobj->mode + 1)) == 0) {
 		ret = -EACCES;
 		goto done;
@@ -431,24 +575,27 @@ done:
 static int regfs_release(const char *path, struct fuse_file_info *fi)
 {
 	struct regfs_data *p = regfs_get_context();
-	struct pvhashobj *hobj;
+	int ret = 0, snapshot;
 	struct fsobj *fsobj;
 	struct service svc;
-	int ret = 0;
 	void *priv;
 
+	priv = regfs_fh_priv(fi);
+	if (fi->fh & REGFS_FH_SNAPSHOT) {
+		fssnapshot_destroy(priv);
+		free(priv);
+		return 0;
+	}
+
 	push_cleanup_lock(&p->lock);
 	read_lock(&p->lock);
 
-	hobj = pvhash_search(&p->files, path, strlen(path),
-			     &pvhash_operations);
-	if (hobj == NULL) {
+	fsobj = find_file(p, path, &snapshot);
+	if (fsobj == NULL) {
 		ret = -ENOENT;
 		goto done;
 	}
 
-	fsobj = container_of(hobj, struct fsobj, hobj);
-	priv = (void *)(uintptr_t)fi->fh;
 	if (fsobj->ops->release) {
 		CANCEL_DEFER(svc);
 		ret = __bt(fsobj->ops->release(fsobj, priv));
@@ -467,22 +614,27 @@ static int regfs_read(const char *path, char *buf, size_t size, off_t offset,
 		      struct fuse_file_info *fi)
 {
 	struct regfs_data *p = regfs_get_context();
-	struct pvhashobj *hobj;
 	struct fsobj *fsobj;
 	struct service svc;
+	int ret, snapshot;
 	void *priv;
-	int ret;
 
 	read_lock_nocancel(&p->lock);
 
-	hobj = pvhash_search(&p->files, path, strlen(path),
-			     &pvhash_operations);
-	if (hobj == NULL) {
+	fsobj = find_file(p, path, &snapshot);
+	if (fsobj == NULL) {
 		read_unlock(&p->lock);
 		return __bt(-EIO);
 	}
 
-	fsobj = container_of(hobj, struct fsobj, hobj);
+	priv = regfs_fh_priv(fi);
+
+	/* The snapshot is private to the opener, no locking. */
+	if (snapshot) {
+		read_unlock(&p->lock);
+		return fssnapshot_pull(priv, buf, size, offset);
+	}
+
 	if (fsobj->ops->read == NULL) {
 		read_unlock(&p->lock);
 		return __bt(-ENOSYS);
@@ -491,7 +643,6 @@ static int regfs_read(const char *path, char *buf, size_t size, off_t offset,
 	push_cleanup_lock(&fsobj->lock);
 	read_lock(&fsobj->lock);
 	read_unlock(&p->lock);
-	priv = (void *)(uintptr_t)fi->fh;
 	CANCEL_DEFER(svc);
 	ret = fsobj->ops->read(fsobj, buf, size, offset, priv);
 	CANCEL_RESTORE(svc);
@@ -505,23 +656,20 @@ static int regfs_write(const char *path, const char *buf, size_t size, off_t off
 		       struct fuse_file_info *fi)
 {
 	struct regfs_data *p = regfs_get_context();
-	struct pvhashobj *hobj;
 	struct fsobj *fsobj;
 	struct service svc;
+	int ret, snapshot;
 	void *priv;
-	int ret;
 
 	read_lock_nocancel(&p->lock);
 
-	hobj = pvhash_search(&p->files, path, strlen(path),
-			     &pvhash_operations);
-	if (hobj == NULL) {
+	fsobj = find_file(p, path, &snapshot);
+	if (fsobj == NULL) {
 		read_unlock(&p->lock);
 		return __bt(-EIO);
 	}
 
-	fsobj = container_of(hobj, struct fsobj, hobj);
-	if (fsobj->ops->write == NULL) {
+	if (snapshot || fsobj->ops->write == NULL) {
 		read_unlock(&p->lock);
 		return __bt(-ENOSYS);
 	}
@@ -772,8 +920,18 @@ int __registry_pkg_init(const char *arg0, char *mountpt, int flags)
 	if (ret)
 		return ret;
 
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_settype(&mattr, mutex_type_attribute);
+	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_PRIVATE);
+	ret = __bt(-__RT(pthread_mutex_init(&p->pending_lock, &mattr)));
+	pthread_mutexattr_destroy(&mattr);
+	if (ret)
+		return ret;
+
 	pvhash_init(&p->files);
 	pvhash_init(&p->dirs);
+	pvlist_init(&p->pending);
 
 	registry_add_dir("/");	/* Create the fs root. */
 
@@ -1027,3 +1185,125 @@ int fsobstack_grow_syncobj_drain(struct fsobstack *o, struct syncobj *sobj,
 	return collect_wait_list(o, sobj, &sobj->drain_list,
 				 &sobj->drain_count, ops);
 }
+
+int fssnapshot_alloc(struct fssnapshot *s, int class,
+		     size_t state_size, int nwaiters)
+{
+	struct regsnap_header *hdr;
+	size_t state_offset, waiter_offset;
+
+	state_offset = sizeof(*hdr);
+	waiter_offset = state_offset + ((state_size + 7) & ~7);
+	s->len = waiter_offset + nwaiters * sizeof(struct regsnap_waiter);
+	hdr = malloc(s->len);
+	if (hdr == NULL)
+		return -ENOMEM;
+
+	memset(hdr, 0, s->len);
+	hdr->magic = REGSNAP_MAGIC;
+	hdr->version = REGSNAP_VERSION;
+	hdr->class = class;
+	hdr->state_offset = state_offset;
+	hdr->state_size = state_size;
+	hdr->waiter_offset = waiter_offset;
+	hdr->waiter_size = sizeof(struct regsnap_waiter);
+	s->hdr = hdr;
+
+	return 0;
+}
+
+void fssnapshot_finish(struct fssnapshot *s, int nwaiters)
+{
+	struct regsnap_header *hdr = s->hdr;
+	struct timespec now;
+
+	__RT(clock_gettime(CLOCK_COPPERPLATE, &now));
+	hdr->date = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	hdr->nwaiters = nwaiters;
+	s->len = hdr->waiter_offset + nwaiters * hdr->waiter_size;
+	hdr->size = s->len;
+}
+
+ssize_t fssnapshot_pull(struct fssnapshot *s,
+			char *buf, size_t size, off_t offset)
+{
+	if (offset >= s->len)
+		return 0;
+
+	if (size > s->len - offset)
+		size = s->len - offset;
+
+	memcpy(buf, (void *)s->hdr + offset, size);
+
+	return size;
+}
+
+static void collect_waiter(struct regsnap_waiter *w,
+			   struct threadobj *thobj, int flags,
+			   const struct fssnapshot_syncops *ops)
+{
+	strncpy(w->name, threadobj_get_name(thobj), sizeof(w->name) - 1);
+	w->pid = threadobj_get_pid(thobj);
+	w->prio = threadobj_get_priority(thobj);
+	w->flags = flags;
+	if (ops->collect_waiter)
+		ops->collect_waiter(w, thobj);
+}
+
+/*
+ * Unlike the text dumps, the state and the waiter list are copied
+ * verbatim under the object lock into a buffer sized beforehand,
+ * leaving any formatting to the reader.
+ */
+int fssnapshot_grab_syncobj(struct fssnapshot *s,
+			    struct fsobj *fsobj,
+			    struct syncobj *sobj,
+			    const struct fssnapshot_syncops *ops)
+{
+	struct regsnap_waiter *w;
+	struct threadobj *thobj;
+	struct syncstate syns;
+	int ngrant, ndrain, ret;
+	struct service svc;
+
+	CANCEL_DEFER(svc);
+redo:
+	smp_rmb();
+	ngrant = sobj->grant_count;
+	ndrain = sobj->drain_count;
+
+	/* Pre-allocate the snapshot without holding any lock. */
+	ret = fssnapshot_alloc(s, ops->class, ops->state_size,
+			       ngrant + ndrain);
+	if (ret)
+		goto out;
+
+	ret = syncobj_lock(sobj, &syns);
+	if (ret) {
+		fssnapshot_destroy(s);
+		goto out;
+	}
+
+	/* Re-validate the previous waiter counts under lock. */
+	if (ngrant != sobj->grant_count || ndrain != sobj->drain_count) {
+		syncobj_unlock(sobj, &syns);
+		fssnapshot_destroy(s);
+		goto redo;
+	}
+
+	ops->collect_state(fssnapshot_state(s), fsobj);
+
+	w = fssnapshot_waiters(s);
+	list_for_each_entry(thobj, &sobj->grant_list, wait_link)
+		collect_waiter(w++, thobj, 0, ops);
+	list_for_each_entry(thobj, &sobj->drain_list, wait_link)
+		collect_waiter(w++, thobj, REGSNAP_WAIT_DRAIN, ops);
+
+	syncobj_unlock(sobj, &syns);
+
+	fssnapshot_finish(s, ngrant + ndrain);
+out:
+	CANCEL_RESTORE(svc);
+
+	return ret;
+}
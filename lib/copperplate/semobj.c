@@ -329,15 +329,19 @@ int semobj_inquire(struct semobj *smobj, size_t waitsz,
 {
 	struct threadobj *thobj;
 	struct syncstate syns;
-	int ret, nrwait;
+	int ret, nrwait, n;
 
 	ret = syncobj_lock(&smobj->core.sobj, &syns);
 	if (ret)
 		return ret;
 
+	/* Count all waiters, only report those which fit. */
 	nrwait = syncobj_count_grant(&smobj->core.sobj);
-	if (nrwait > 0) {
+	n = waitsz / sizeof(*waitlist);
+	if (nrwait > 0 && n > 0) {
 		syncobj_for_each_grant_waiter(&smobj->core.sobj, thobj) {
+			if (n-- == 0)
+				break;
 			waitlist->pid = threadobj_get_pid(thobj);
 			strcpy(waitlist->name, threadobj_get_name(thobj));
 			waitlist++;
@@ -45,8 +45,7 @@
  *
  * The syncobj abstraction is based on a complex monitor object to
  * wait for resources, either implemented natively by Cobalt or
- * emulated via a mutex and two condition variables over Mercury (one
- * of which being hosted by the thread object implementation).
+ * emulated via a mutex and per-thread futex words over Mercury.
  *
  * NOTE: we don't do error backtracing in this file, since error
  * returns when locking, pending or deleting sync objects usually
@@ -99,12 +98,24 @@ void monitor_grant(struct syncobj *sobj, struct threadobj *thobj)
 			     threadobj_get_window(&thobj->core));
 }
 
+static inline
+void monitor_drain(struct syncobj *sobj, struct threadobj *thobj)
+{
+	/* Drain waiters are released all at once. */
+}
+
 static inline
 void monitor_drain_all(struct syncobj *sobj)
 {
 	cobalt_monitor_drain_all(&sobj->core.monitor);
 }
 
+static inline
+void monitor_cleanup_enter(struct syncobj *sobj, struct threadobj *thobj)
+{
+	/* Cobalt grabs the monitor back before unwinding. */
+}
+
 static inline int syncobj_init_corespec(struct syncobj *sobj,
 					clockid_t clk_id)
 {
@@ -124,6 +135,24 @@ static inline void syncobj_cleanup_corespec(struct syncobj *sobj)
 
 #else /* CONFIG_XENO_MERCURY */
 
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "boilerplate/time.h"
+
+#ifdef CONFIG_XENO_PSHARED
+#define SYNCOBJ_FUTEX_PRIVATE	0
+#else
+#define SYNCOBJ_FUTEX_PRIVATE	FUTEX_PRIVATE_FLAG
+#endif
+
+static inline int do_futex(int *uaddr, int op, int val,
+			   const struct timespec *timeout)
+{
+	return syscall(__NR_futex, uaddr, op | SYNCOBJ_FUTEX_PRIVATE,
+		       val, timeout, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
 static inline
 int monitor_enter(struct syncobj *sobj)
 {
@@ -138,16 +167,75 @@ void monitor_exit(struct syncobj *sobj)
 	assert(ret == 0); (void)ret;
 }
 
+/*
+ * Park the caller on its own futex word until some thread grants it
+ * by clearing the word, or the absolute timeout elapses. The word is
+ * armed with the monitor lock held, so a grant issued between
+ * unlocking and sleeping cannot be missed.
+ */
+static int monitor_park(struct syncobj *sobj,
+			struct threadobj *current,
+			const struct timespec *timeout)
+{
+	struct timespec now, delay, *tp = NULL;
+	int *word = &current->core.wait_word;
+	int op = FUTEX_WAIT, ret, oldtype;
+
+	if (timeout) {
+		switch (sobj->core.clk_id) {
+		case CLOCK_REALTIME:
+			op = FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME;
+			tp = (struct timespec *)timeout;
+			break;
+		case CLOCK_MONOTONIC:
+			op = FUTEX_WAIT_BITSET;
+			tp = (struct timespec *)timeout;
+			break;
+		default:
+			/* The kernel knows no other clock, go relative. */
+			__RT(clock_gettime(sobj->core.clk_id, &now));
+			timespec_sub(&delay, timeout, &now);
+			if (delay.tv_sec < 0)
+				return -ETIMEDOUT;
+			tp = &delay;
+		}
+	}
+
+	*word = 1;
+	current->core.wait_parked = 1;
+	monitor_exit(sobj);
+
+	/*
+	 * Unlike pthread_cond_wait(), a raw futex call is not a
+	 * cancellation point, make it one. A cancelled thread leaves
+	 * wait_parked set, which tells __syncobj_cleanup_wait() that
+	 * the monitor has to be grabbed back.
+	 */
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
+	ret = do_futex(word, op, 1, tp);
+	pthread_setcanceltype(oldtype, NULL);
+	if (ret && errno == ETIMEDOUT)
+		ret = -ETIMEDOUT;
+	else
+		/*
+		 * Woken up, already granted (EAGAIN) or interrupted
+		 * by a signal: the caller checks whether it was
+		 * actually granted, and waits again otherwise.
+		 */
+		ret = 0;
+
+	monitor_enter(sobj);
+	current->core.wait_parked = 0;
+
+	return ret;
+}
+
 static inline
 int monitor_wait_grant(struct syncobj *sobj,
 		       struct threadobj *current,
 		       const struct timespec *timeout)
 {
-	if (timeout)
-		return -threadobj_cond_timedwait(&current->core.grant_sync,
-						 &sobj->core.lock, timeout);
-
-	return -threadobj_cond_wait(&current->core.grant_sync, &sobj->core.lock);
+	return monitor_park(sobj, current, timeout);
 }
 
 static inline
@@ -155,36 +243,49 @@ int monitor_wait_drain(struct syncobj *sobj,
 		       struct threadobj *current,
 		       const struct timespec *timeout)
 {
-	if (timeout)
-		return -threadobj_cond_timedwait(&sobj->core.drain_sync,
-						 &sobj->core.lock,
-						 timeout);
-
-	return -threadobj_cond_wait(&sobj->core.drain_sync, &sobj->core.lock);
+	return monitor_park(sobj, current, timeout);
 }
 
 static inline
 void monitor_grant(struct syncobj *sobj, struct threadobj *thobj)
 {
-	threadobj_cond_signal(&thobj->core.grant_sync);
+	/* Wake up the granted thread only, not a whole condvar. */
+	thobj->core.wait_word = 0;
+	do_futex(&thobj->core.wait_word, FUTEX_WAKE, 1, NULL);
+}
+
+static inline
+void monitor_drain(struct syncobj *sobj, struct threadobj *thobj)
+{
+	monitor_grant(sobj, thobj);
 }
 
 static inline
 void monitor_drain_all(struct syncobj *sobj)
 {
-	threadobj_cond_broadcast(&sobj->core.drain_sync);
+	/* Each drain waiter was woken up individually. */
+}
+
+static inline
+void monitor_cleanup_enter(struct syncobj *sobj, struct threadobj *thobj)
+{
+	if (thobj->core.wait_parked) {
+		thobj->core.wait_parked = 0;
+		monitor_enter(sobj);
+	}
 }
 
 /*
- * Over Mercury, we implement a complex monitor via a mutex and a
- * couple of condvars, one in the syncobj and the other owned by the
- * thread object.
+ * Over Mercury, we implement a complex monitor via a PI mutex, and a
+ * futex word owned by each thread object on which the latter parks
+ * while waiting for a grant or drain signal. This way, the waker
+ * always knows which thread it readies, and the wait queues keep
+ * the FIFO or priority order the syncobj imposes.
  */
 static inline int syncobj_init_corespec(struct syncobj *sobj,
 					clockid_t clk_id)
 {
 	pthread_mutexattr_t mattr;
-	pthread_condattr_t cattr;
 	int ret;
 
 	pthread_mutexattr_init(&mattr);
@@ -201,19 +302,7 @@ static inline int syncobj_init_corespec(struct syncobj *sobj,
 	if (ret)
 		return ret;
 
-	pthread_condattr_init(&cattr);
-	pthread_condattr_setpshared(&cattr, mutex_scope_attribute);
-	ret = __bt(pthread_condattr_setclock(&cattr, clk_id));
-	if (ret)
-		goto fail;
-
-	ret = __bt(-pthread_cond_init(&sobj->core.drain_sync, &cattr));
-	pthread_condattr_destroy(&cattr);
-	if (ret) {
-	fail:
-		pthread_mutex_destroy(&sobj->core.lock);
-		return ret;
-	}
+	sobj->core.clk_id = clk_id;
 
 	return 0;
 }
@@ -221,7 +310,6 @@ static inline int syncobj_init_corespec(struct syncobj *sobj,
 static inline void syncobj_cleanup_corespec(struct syncobj *sobj)
 {
 	monitor_exit(sobj);
-	pthread_cond_destroy(&sobj->core.drain_sync);
 	pthread_mutex_destroy(&sobj->core.lock);
 }
 
@@ -326,6 +414,7 @@ int __syncobj_broadcast_drain(struct syncobj *sobj, int reason)
 				       struct threadobj, wait_link);
 		thobj->wait_sobj = NULL;
 		thobj->wait_status |= reason;
+		monitor_drain(sobj, thobj);
 	} while (!list_empty(&sobj->drain_list));
 
 	monitor_drain_all(sobj);
@@ -383,6 +472,7 @@ void __syncobj_cleanup_wait(struct syncobj *sobj, struct threadobj *thobj)
 	 * because the caller got cancelled while sleeping on the
 	 * GRANT/DRAIN condition.
 	 */
+	monitor_cleanup_enter(sobj, thobj);
 	dequeue_waiter(sobj, thobj);
 
 	if (--sobj->wait_count == 0 && sobj->magic != SYNCOBJ_MAGIC) {
@@ -281,6 +281,8 @@ static inline int threadobj_setup_corespec(struct threadobj *thobj)
 
 static inline void threadobj_cleanup_corespec(struct threadobj *thobj)
 {
+	if (thobj->status & __THREAD_S_PERIODIC)
+		__RT(timer_delete(thobj->periodic_timer));
 }
 
 static inline void threadobj_run_corespec(struct threadobj *thobj)
@@ -489,6 +491,9 @@ int threadobj_stat(struct threadobj *thobj, struct threadobj_stat *p) /* thobj->
 
 #else /* CONFIG_XENO_MERCURY */
 
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
 static int threadobj_lock_prio;
 
 static void unblock_sighandler(int sig)
@@ -588,34 +593,23 @@ static inline void pkg_init_corespec(void)
 
 static inline int threadobj_init_corespec(struct threadobj *thobj)
 {
-	pthread_condattr_t cattr;
-	int ret;
-
 	thobj->core.rr_timer = NULL;
 	/*
-	 * Over Mercury, we need an additional per-thread condvar to
-	 * implement the complex monitor for the syncobj abstraction.
+	 * Over Mercury, the thread parks on its own futex word when
+	 * waiting on the complex monitor of the syncobj abstraction.
 	 */
-	pthread_condattr_init(&cattr);
-	pthread_condattr_setpshared(&cattr, mutex_scope_attribute);
-	ret = __bt(-pthread_condattr_setclock(&cattr, CLOCK_COPPERPLATE));
-	if (ret)
-		warning("failed setting condvar clock, %s"
-			"(try --disable-clock-monotonic-raw)",
-			symerror(ret));
-	else
-		ret = __bt(-pthread_cond_init(&thobj->core.grant_sync, &cattr));
-	pthread_condattr_destroy(&cattr);
+	thobj->core.wait_word = 0;
+	thobj->core.wait_parked = 0;
+	thobj->core.periodic_gen = 0;
 
 #ifdef CONFIG_XENO_WORKAROUND_CONDVAR_PI
 	thobj->core.policy_unboosted = -1;
 #endif
-	return ret;
+	return 0;
 }
 
 static inline void threadobj_uninit_corespec(struct threadobj *thobj)
 {
-	pthread_cond_destroy(&thobj->core.grant_sync);
 }
 
 static inline int threadobj_setup_corespec(struct threadobj *thobj)
@@ -1194,8 +1188,6 @@ static void uninit_thread(struct threadobj *thobj)
 static void destroy_thread(struct threadobj *thobj)
 {
 	threadobj_cleanup_corespec(thobj);
-	if (thobj->status & __THREAD_S_PERIODIC)
-		__RT(timer_delete(thobj->periodic_timer));
 	uninit_thread(thobj);
 }
 
@@ -1619,6 +1611,8 @@ int threadobj_sleep(const struct timespec *ts)
 	return -ret;
 }
 
+#ifdef CONFIG_XENO_COBALT
+
 int threadobj_set_periodic(struct threadobj *thobj,
 			   const struct timespec *__restrict__ idate,
 			   const struct timespec *__restrict__ period)
@@ -1711,6 +1705,192 @@ int threadobj_wait_period(unsigned long *overruns_r)
 	return 0;
 }
 
+#else /* CONFIG_XENO_MERCURY */
+
+/*
+ * Over Mercury, periodic threads are driven by absolute sleeps on
+ * the copperplate clock instead of a POSIX timer signaling the
+ * thread. The release points are computed from the initial date and
+ * the period only, so the timeline does not drift, and no signal has
+ * to be delivered and dequeued at each period. Overruns are derived
+ * from the current time when the thread comes back waiting.
+ *
+ * The sleep is a futex wait on the timeline generation, so that
+ * reprogramming the timeline of a thread takes effect immediately,
+ * like timer_settime() would: the sleeper is woken up and restarts
+ * waiting on the new timeline.
+ */
+#ifdef CONFIG_XENO_PSHARED
+#define PERIOD_FUTEX_PRIVATE	0
+#else
+#define PERIOD_FUTEX_PRIVATE	FUTEX_PRIVATE_FLAG
+#endif
+
+#if CLOCK_COPPERPLATE == CLOCK_REALTIME
+#define PERIOD_FUTEX_WAIT	(FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME)
+#else
+#define PERIOD_FUTEX_WAIT	FUTEX_WAIT_BITSET
+#endif
+
+static inline int period_futex(unsigned int *gen, int op, unsigned int val,
+			       const struct timespec *date)
+{
+	return syscall(__NR_futex, gen, op | PERIOD_FUTEX_PRIVATE,
+		       val, date, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+int threadobj_set_periodic(struct threadobj *thobj,
+			   const struct timespec *__restrict__ idate,
+			   const struct timespec *__restrict__ period)
+{				/* thobj->lock held */
+	__threadobj_check_locked(thobj);
+
+	thobj->core.periodic_gen++;
+
+	if (!timespec_scalar(idate) && !timespec_scalar(period))
+		thobj->status &= ~__THREAD_S_PERIODIC;
+	else {
+		/* Like a POSIX timer, a null period means a one-shot release. */
+		thobj->core.periodic_date = *idate;
+		thobj->core.periodic_period = *period;
+		thobj->status |= __THREAD_S_PERIODIC;
+	}
+
+	/* Have the target restart waiting on the new timeline. */
+	if (thobj != threadobj_current())
+		period_futex(&thobj->core.periodic_gen, FUTEX_WAKE, 1, NULL);
+
+	return 0;
+}
+
+/*
+ * Wait for @date unless the timeline moves past @gen. Returns zero
+ * when @date has elapsed, -EAGAIN if woken up early, or -EINTR upon
+ * threadobj_unblock(). Linux signals are transparent.
+ */
+static int wait_release(struct threadobj *current, unsigned int gen,
+			const struct timespec *date)
+{
+	int ret, oldtype;
+
+	/* A raw futex call is not a cancellation point, make it one. */
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &oldtype);
+
+	do
+		ret = period_futex(&current->core.periodic_gen,
+				   PERIOD_FUTEX_WAIT, gen, date) ? errno : 0;
+	while (ret == EINTR && !threadobj_unblocked_corespec(current));
+
+	pthread_setcanceltype(oldtype, NULL);
+
+	switch (ret) {
+	case ETIMEDOUT:
+		return 0;
+	case 0:
+	case EAGAIN:
+		return -EAGAIN;
+	case EINTR:
+		return -EINTR;
+	default:
+		panic("cannot wait for next period, %s", symerror(-ret));
+	}
+}
+
+int threadobj_get_periodic(struct threadobj *thobj,
+			   struct timespec *__restrict__ idate,
+			   struct timespec *__restrict__ period)
+{				/* thobj->lock held */
+	struct timespec now;
+
+	__threadobj_check_locked(thobj);
+
+	if (!(thobj->status & __THREAD_S_PERIODIC))
+		return __bt(-EINVAL);
+
+	/* Same as timer_gettime(), the next date is relative. */
+	__RT(clock_gettime(CLOCK_COPPERPLATE, &now));
+	if (timespec_before(&now, &thobj->core.periodic_date))
+		timespec_sub(idate, &thobj->core.periodic_date, &now);
+	else {
+		idate->tv_sec = 0;
+		idate->tv_nsec = 0;
+	}
+	*period = thobj->core.periodic_period;
+
+	return 0;
+}
+
+int threadobj_wait_period(unsigned long *overruns_r)
+{
+	struct threadobj *current = threadobj_current();
+	struct timespec date, period, now;
+	unsigned long overruns = 0;
+	unsigned int gen;
+	ticks_t late, pns;
+	int ret;
+
+	for (;;) {
+		threadobj_lock(current);
+
+		if (!(current->status & __THREAD_S_PERIODIC)) {
+			threadobj_unlock(current);
+			return -EWOULDBLOCK;
+		}
+
+		date = current->core.periodic_date;
+		period = current->core.periodic_period;
+		gen = current->core.periodic_gen;
+		current->run_state = __THREAD_S_DELAYED;
+
+		threadobj_unlock(current);
+
+		ret = wait_release(current, gen, &date);
+
+		current->run_state = __THREAD_S_RUNNING;
+		if (ret == -EINTR)
+			return -EINTR;
+
+		threadobj_lock(current);
+		/*
+		 * Restart on the new timeline if reprogrammed
+		 * meanwhile, keep waiting if woken up spuriously.
+		 */
+		if (current->core.periodic_gen == gen && ret == 0)
+			break;
+		threadobj_unlock(current);
+	}
+
+	pns = timespec_scalar(&period);
+	if (pns == 0)
+		/* One-shot release, the timeline ends here. */
+		current->status &= ~__THREAD_S_PERIODIC;
+	else {
+		/*
+		 * Count the release points which elapsed since the
+		 * one we waited for, and move to the next one ahead.
+		 */
+		__RT(clock_gettime(CLOCK_COPPERPLATE, &now));
+		if (!timespec_before(&now, &date)) {
+			late = timespec_scalar(&now) - timespec_scalar(&date);
+			overruns = late / pns;
+		}
+		timespec_adds(&current->core.periodic_date, &date,
+			      pns * (overruns + 1));
+	}
+
+	threadobj_unlock(current);
+
+	if (overruns) {
+		if (overruns_r)
+			*overruns_r = overruns;
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+#endif /* CONFIG_XENO_MERCURY */
+
 void threadobj_spin(ticks_t ns)
 {
 	ticks_t end;
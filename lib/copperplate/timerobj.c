@@ -18,6 +18,7 @@
  * Timer object abstraction.
  */
 
+#include <sched.h>
 #include <signal.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -32,16 +33,34 @@
 #include "copperplate/threadobj.h"
 #include "copperplate/timerobj.h"
 #include "copperplate/clockobj.h"
+#include "copperplate/tunables.h"
 #include "copperplate/debug.h"
 #include "internal.h"
 
-static pthread_mutex_t svlock;
+/*
+ * Armed timers are indexed by a hashed timing wheel per server
+ * thread: each slot spans 2^TIMER_WHEEL_SHIFT nanoseconds and links
+ * all timers expiring within that time frame modulo the wheel
+ * period, in no particular order. Enqueuing is O(1), and a server
+ * only visits the slots elapsed since its previous pass, which keeps
+ * dispatching cheap with hundreds of outstanding timers.
+ */
+#define TIMER_WHEEL_SHIFT	20	/* ~1ms per slot */
+#define TIMER_WHEEL_SLOTS	256
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SLOTS - 1)
 
-static pthread_t svthread;
+struct timerobj_server {
+	pthread_mutex_t lock;
+	pthread_t tid;
+	pid_t pid;
+	int cpu;		/* -1 if not pinned. */
+	sticks_t cursor;	/* Last slot tick visited. */
+	struct pvlistobj wheel[TIMER_WHEEL_SLOTS];
+};
 
-static pid_t svpid;
+static struct timerobj_server *servers;
 
-static DEFINE_PRIVATE_LIST(svtimers);
+static int nrservers;
 
 #ifdef CONFIG_XENO_COBALT
 
@@ -60,39 +79,66 @@ static inline void timersv_init_corespec(void)
 
 #endif /* CONFIG_XENO_MERCURY */
 
-/*
- * XXX: at some point, we may consider using a timer wheel instead of
- * a simple linked list to index timers. The latter method is
- * efficient for up to ten outstanding timers or so, which should be
- * enough for most applications. However, there exist poorly designed
- * apps involving dozens of active timers, particularly in the legacy
- * embedded world.
- */
-static void timerobj_enqueue(struct timerobj *tmobj)
+static inline sticks_t wheel_tick(const struct timespec *ts)
 {
-	struct timerobj *__tmobj;
+	return timespec_scalar(ts) >> TIMER_WHEEL_SHIFT;
+}
 
-	if (pvlist_empty(&svtimers)) {
-		pvlist_append(&tmobj->next, &svtimers);
-		return;
-	}
+static void timerobj_enqueue(struct timerobj *tmobj) /* sv->lock held */
+{
+	struct timerobj_server *sv = tmobj->server;
+	sticks_t tick;
 
-	pvlist_for_each_entry_reverse(__tmobj, &svtimers, next) {
-		if (timespec_before_or_same(&__tmobj->itspec.it_value,
-					    &tmobj->itspec.it_value))
-			break;
+	/*
+	 * A timer which should have elapsed already goes to the
+	 * current slot, which the server visits on its next pass.
+	 */
+	tick = wheel_tick(&tmobj->itspec.it_value);
+	if (tick < sv->cursor)
+		tick = sv->cursor;
+
+	pvlist_append(&tmobj->next, &sv->wheel[tick & TIMER_WHEEL_MASK]);
+}
+
+static int collect_slot(struct timerobj_server *sv, sticks_t tick,
+			const struct timespec *now,
+			struct pvlistobj *expired)
+{
+	struct pvlistobj *slot = &sv->wheel[tick & TIMER_WHEEL_MASK];
+	struct timerobj *tmobj, *tmp;
+	int nr = 0;
+
+	if (pvlist_empty(slot))
+		return 0;
+
+	pvlist_for_each_entry_safe(tmobj, tmp, slot, next) {
+		if (timespec_after(&tmobj->itspec.it_value, now))
+			continue;
+		pvlist_remove(&tmobj->next);
+		pvlist_append(&tmobj->next, expired);
+		nr++;
 	}
 
-	atpvh(&__tmobj->next, &tmobj->next);
+	return nr;
 }
 
 static int server_prologue(void *arg)
 {
-	svpid = get_thread_pid();
+	struct timerobj_server *sv = arg;
+	cpu_set_t cpuset;
+
+	sv->pid = get_thread_pid();
 	copperplate_set_current_name("timer-internal");
 	timersv_init_corespec();
 	threadobj_set_current(THREADOBJ_IRQCONTEXT);
 
+	if (sv->cpu >= 0) {
+		CPU_ZERO(&cpuset);
+		CPU_SET(sv->cpu, &cpuset);
+		if (sched_setaffinity(0, sizeof(cpuset), &cpuset))
+			warning("cannot pin timer server to CPU%d", sv->cpu);
+	}
+
 	return 0;
 }
 
@@ -100,70 +146,115 @@ static void *timerobj_server(void *arg)
 {
 	void (*handler)(struct timerobj *tmobj);
 	struct timespec now, value, interval;
+	struct timerobj_server *sv = arg;
 	struct timerobj *tmobj;
+	struct pvlistobj expired;
+	sticks_t tick, last;
 	sigset_t set;
 	int sig, ret;
 
 	sigemptyset(&set);
 	sigaddset(&set, SIGALRM);
+	pvlist_init(&expired);
 
 	for (;;) {
 		ret = __RT(sigwait(&set, &sig));
 		if (ret && ret != -EINTR)
 			break;
+
 		/*
-		 * We have a single server thread for now, so handlers
-		 * are fully serialized.
+		 * Handlers attached to the same server are fully
+		 * serialized, those of distinct servers may run in
+		 * parallel.
 		 */
-		write_lock_nocancel(&svlock);
+		write_lock_nocancel(&sv->lock);
 
 		__RT(clock_gettime(CLOCK_COPPERPLATE, &now));
 
-		while (!pvlist_empty(&svtimers)) {
-			tmobj = pvlist_first_entry(&svtimers, typeof(*tmobj),
-						   next);
-
+		last = wheel_tick(&now);
+		tick = sv->cursor;
+		if (last - tick >= TIMER_WHEEL_SLOTS)
+			tick = last - TIMER_WHEEL_SLOTS + 1;
+		for (; tick <= last; tick++)
+			collect_slot(sv, tick, &now, &expired);
+		sv->cursor = last;
+	again:
+		while (!pvlist_empty(&expired)) {
+			tmobj = pvlist_pop_entry(&expired, typeof(*tmobj),
+						 next);
+			pvholder_init(&tmobj->next);
 			value = tmobj->itspec.it_value;
 			interval = tmobj->itspec.it_interval;
 			handler = tmobj->handler;
-			if (timespec_after(&value, &now))
-				break;
-			pvlist_remove_init(&tmobj->next);
 			if (interval.tv_sec > 0 || interval.tv_nsec > 0) {
 				timespec_add(&tmobj->itspec.it_value,
 					     &value, &interval);
 				timerobj_enqueue(tmobj);
 			}
-			write_unlock(&svlock);
+			write_unlock(&sv->lock);
 			handler(tmobj);
-			write_lock_nocancel(&svlock);
+			write_lock_nocancel(&sv->lock);
 		}
 
-		write_unlock(&svlock);
+		/*
+		 * Periodic timers reloaded with an elapsed date went
+		 * to the current slot, fire them until they catch up.
+		 */
+		if (collect_slot(sv, last, &now, &expired))
+			goto again;
+
+		write_unlock(&sv->lock);
 	}
 
 	return NULL;
 }
 
-static void timerobj_spawn_server(void)
+static void timerobj_spawn_servers(void)
 {
 	struct corethread_attributes cta;
+	struct timerobj_server *sv;
+	int n;
 
 	cta.policy = SCHED_CORE;
 	cta.param_ex.sched_priority = threadobj_irq_prio;
 	cta.prologue = server_prologue;
 	cta.run = timerobj_server;
-	cta.arg = NULL;
 	cta.stacksize = PTHREAD_STACK_DEFAULT;
 	cta.detachstate = PTHREAD_CREATE_DETACHED;
 
-	__bt(copperplate_create_thread(&cta, &svthread));
+	for (n = 0; n < nrservers; n++) {
+		sv = servers + n;
+		cta.arg = sv;
+		if (__bt(copperplate_create_thread(&cta, &sv->tid)))
+			sv->tid = 0;
+	}
+}
+
+static struct timerobj_server *pick_server(void)
+{
+	int cpu, n;
+
+	if (nrservers == 1)
+		return servers;
+
+	/* Prefer the server pinned to the CPU we run on. */
+	cpu = sched_getcpu();
+	if (cpu < 0)
+		return servers;
+
+	for (n = 0; n < nrservers; n++) {
+		if (servers[n].cpu == cpu)
+			return servers + n;
+	}
+
+	return servers + cpu % nrservers;
 }
 
 int timerobj_init(struct timerobj *tmobj)
 {
 	static pthread_once_t spawn_once;
 	pthread_mutexattr_t mattr;
+	struct timerobj_server *sv;
 	struct sigevent sev;
 	int ret;
 
@@ -178,17 +269,19 @@ int timerobj_init(struct timerobj *tmobj)
 	 * very least), and spawning a short-lived thread at each
 	 * timeout expiration to run the handler is just overkill.
 	 */
-	pthread_once(&spawn_once, timerobj_spawn_server);
-	if (!svthread)
+	pthread_once(&spawn_once, timerobj_spawn_servers);
+	sv = pick_server();
+	if (!sv->tid)
 		return __bt(-EAGAIN);
 
 	tmobj->handler = NULL;
+	tmobj->server = sv;
 	pvholder_init(&tmobj->next); /* so we may use pvholder_linked() */
 
 	memset(&sev, 0, sizeof(sev));
 	sev.sigev_notify = SIGEV_THREAD_ID;
 	sev.sigev_signo = SIGALRM;
-	sev.sigev_notify_thread_id = svpid;
+	sev.sigev_notify_thread_id = sv->pid;
 
 	ret = __RT(timer_create(CLOCK_COPPERPLATE, &sev, &tmobj->timer));
 	if (ret)
@@ -207,12 +300,14 @@ int timerobj_init(struct timerobj *tmobj)
 
 void timerobj_destroy(struct timerobj *tmobj) /* lock held, dropped */
 {
-	write_lock_nocancel(&svlock);
+	struct timerobj_server *sv = tmobj->server;
+
+	write_lock_nocancel(&sv->lock);
 
 	if (pvholder_linked(&tmobj->next))
 		pvlist_remove_init(&tmobj->next);
 
-	write_unlock(&svlock);
+	write_unlock(&sv->lock);
 
 	__RT(timer_delete(tmobj->timer));
 	__RT(pthread_mutex_unlock(&tmobj->lock));
@@ -223,6 +318,7 @@ int timerobj_start(struct timerobj *tmobj,
 		   void (*handler)(struct timerobj *tmobj),
 		   struct itimerspec *it) /* lock held, dropped */
 {
+	struct timerobj_server *sv = tmobj->server;
 	int ret = 0;
 
 	/*
@@ -234,10 +330,10 @@ int timerobj_start(struct timerobj *tmobj,
 	 * happens to check the return code then drop the timer
 	 * (again).
 	 */
-	write_lock_nocancel(&svlock);
+	write_lock_nocancel(&sv->lock);
 
-       if (pvholder_linked(&tmobj->next))
-               pvlist_remove_init(&tmobj->next);
+	if (pvholder_linked(&tmobj->next))
+		pvlist_remove_init(&tmobj->next);
 
 	tmobj->handler = handler;
 	tmobj->itspec = *it;
@@ -249,7 +345,7 @@ int timerobj_start(struct timerobj *tmobj,
 
 	timerobj_enqueue(tmobj);
 fail:
-	write_unlock(&svlock);
+	write_unlock(&sv->lock);
 	timerobj_unlock(tmobj);
 
 	return ret;
@@ -258,15 +354,16 @@ fail:
 int timerobj_stop(struct timerobj *tmobj) /* lock held, dropped */
 {
 	static const struct itimerspec itimer_stop;
+	struct timerobj_server *sv = tmobj->server;
 
-	write_lock_nocancel(&svlock);
+	write_lock_nocancel(&sv->lock);
 
 	if (pvholder_linked(&tmobj->next))
 		pvlist_remove_init(&tmobj->next);
 
 	__RT(timer_settime(tmobj->timer, 0, &itimer_stop, NULL));
 	tmobj->handler = NULL;
-	write_unlock(&svlock);
+	write_unlock(&sv->lock);
 	timerobj_unlock(tmobj);
 
 	return 0;
@@ -275,13 +372,51 @@ int timerobj_stop(struct timerobj *tmobj) /* lock held, dropped */
 int timerobj_pkg_init(void)
 {
 	pthread_mutexattr_t mattr;
-	int ret;
+	struct timespec now;
+	int n, cpu, slot, ret;
+	cpu_set_t cpuset;
+
+	/*
+	 * Either run the number of servers specified by
+	 * --timer-servers, or one server pinned to each CPU
+	 * available to us if zero.
+	 */
+	if (sched_getaffinity(0, sizeof(cpuset), &cpuset))
+		CPU_ZERO(&cpuset);
+
+	if (CPU_COUNT(&__base_setup_data.cpu_affinity) > 0)
+		CPU_AND(&cpuset, &cpuset, &__base_setup_data.cpu_affinity);
+
+	nrservers = __copperplate_setup_data.timer_servers;
+	if (nrservers <= 0)
+		nrservers = CPU_COUNT(&cpuset) ?: 1;
+
+	servers = calloc(nrservers, sizeof(*servers));
+	if (servers == NULL)
+		return -ENOMEM;
+
+	__RT(clock_gettime(CLOCK_COPPERPLATE, &now));
 
 	pthread_mutexattr_init(&mattr);
 	pthread_mutexattr_settype(&mattr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
 	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_PRIVATE);
-	ret = __bt(-__RT(pthread_mutex_init(&svlock, &mattr)));
+
+	for (n = 0, cpu = -1, ret = 0; n < nrservers && ret == 0; n++) {
+		servers[n].cpu = -1;
+		if (nrservers > 1 && CPU_COUNT(&cpuset) > 0) {
+			/* Pin round-robin over the available CPUs. */
+			do
+				cpu = (cpu + 1) % CPU_SETSIZE;
+			while (!CPU_ISSET(cpu, &cpuset));
+			servers[n].cpu = cpu;
+		}
+		servers[n].cursor = wheel_tick(&now);
+		for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+			pvlist_init(&servers[n].wheel[slot]);
+		ret = __bt(-__RT(pthread_mutex_init(&servers[n].lock, &mattr)));
+	}
+
 	pthread_mutexattr_destroy(&mattr);
 
 	return ret;
@@ -6,17 +6,22 @@
 static const char * const tests[] = {
 	"alchemytests_alarm1",
 	"alchemytests_buffer1",
+	"alchemytests_buffer2",
 	"alchemytests_event1",
 	"alchemytests_heap1",
 	"alchemytests_heap2",
 	"alchemytests_mq1",
 	"alchemytests_mq2",
 	"alchemytests_mq3",
+	"alchemytests_mq4",
+	"alchemytests_mq5",
 	"alchemytests_mutex1",
 	"alchemytests_mutex2",
 	"alchemytests_pipe1",
 	"alchemytests_sem1",
 	"alchemytests_sem2",
+	"alchemytests_sem3",
+	"alchemytests_sem4",
 	"alchemytests_task1",
 	"alchemytests_task2",
 	"alchemytests_task3",
@@ -27,7 +32,8 @@ static const char * const tests[] = {
 	"alchemytests_task8",
 	"alchemytests_task9",
 	"alchemytests_task10",
-	"alchemytests_task11"
+	"alchemytests_task11",
+	"alchemytests_task12"
 };
 
 static int run_alchemytests(struct smokey_test *t, int argc, char *const argv[])
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/buffer.h>
+
+#define FRAME_SIZE	32768
+#define RING_SIZE	(16 * FRAME_SIZE)
+#define NR_FRAMES	5000
+
+static struct traceobj trobj;
+
+static RT_TASK t_consumer;
+
+static RT_BUFFER buffer;
+
+static int loaned;
+
+static uint64_t checksum;
+
+/* Frame storage for the copy mode, too large for task stacks. */
+static uint64_t wframe[FRAME_SIZE / sizeof(uint64_t)];
+
+static uint64_t rframe[FRAME_SIZE / sizeof(uint64_t)];
+
+static void fill_segment(void *p, size_t len, uint64_t *seq)
+{
+	uint64_t *w = p;
+	size_t n;
+
+	for (n = 0; n < len / sizeof(*w); n++)
+		w[n] = (*seq)++;
+}
+
+static uint64_t sum_segment(const void *p, size_t len)
+{
+	const uint64_t *w = p;
+	uint64_t sum = 0;
+	size_t n;
+
+	for (n = 0; n < len / sizeof(*w); n++)
+		sum += w[n];
+
+	return sum;
+}
+
+static void consumer_task(void *arg)
+{
+	struct iovec iov[2];
+	uint64_t sum = 0;
+	ssize_t ret;
+	int n;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < NR_FRAMES; n++) {
+		if (loaned) {
+			ret = rt_buffer_peek(&buffer, FRAME_SIZE, iov,
+					     TM_INFINITE);
+			traceobj_assert(&trobj, ret == FRAME_SIZE);
+			sum += sum_segment(iov[0].iov_base, iov[0].iov_len);
+			sum += sum_segment(iov[1].iov_base, iov[1].iov_len);
+			ret = rt_buffer_release(&buffer, FRAME_SIZE);
+			traceobj_check(&trobj, ret, 0);
+		} else {
+			ret = rt_buffer_read(&buffer, rframe, FRAME_SIZE,
+					     TM_INFINITE);
+			traceobj_assert(&trobj, ret == FRAME_SIZE);
+			sum += sum_segment(rframe, FRAME_SIZE);
+		}
+	}
+
+	checksum = sum;
+
+	traceobj_exit(&trobj);
+}
+
+static RTIME stream_frames(int mode)
+{
+	struct iovec iov[2];
+	uint64_t seq = 0, sum;
+	RTIME start, end;
+	ssize_t ret;
+	int n;
+
+	loaned = mode;
+
+	ret = rt_task_create(&t_consumer, "CONSUMER", 0, 20, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_start(&t_consumer, consumer_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	start = rt_timer_read();
+
+	for (n = 0; n < NR_FRAMES; n++) {
+		if (loaned) {
+			ret = rt_buffer_reserve(&buffer, FRAME_SIZE, iov,
+						TM_INFINITE);
+			traceobj_assert(&trobj, ret == FRAME_SIZE);
+			fill_segment(iov[0].iov_base, iov[0].iov_len, &seq);
+			fill_segment(iov[1].iov_base, iov[1].iov_len, &seq);
+			ret = rt_buffer_commit(&buffer, FRAME_SIZE);
+			traceobj_check(&trobj, ret, 0);
+		} else {
+			fill_segment(wframe, FRAME_SIZE, &seq);
+			ret = rt_buffer_write(&buffer, wframe, FRAME_SIZE,
+					      TM_INFINITE);
+			traceobj_assert(&trobj, ret == FRAME_SIZE);
+		}
+	}
+
+	ret = rt_task_join(&t_consumer);
+	traceobj_check(&trobj, ret, 0);
+
+	end = rt_timer_read();
+
+	/* Sum of 0..seq-1, the consumer must have seen every word. */
+	sum = seq * (seq - 1) / 2;
+	traceobj_assert(&trobj, checksum == sum);
+
+	return rt_timer_ticks2ns(end - start) / NR_FRAMES;
+}
+
+static void check_loans(void)
+{
+	char data[6] = "abcdef", out[6];
+	struct iovec iov[2];
+	RT_BUFFER_INFO info;
+	RT_BUFFER bf;
+	ssize_t ret;
+
+	ret = rt_buffer_create(&bf, NULL, 8, B_FIFO);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Move the ring offsets close to the end. */
+	ret = rt_buffer_write(&bf, data, 6, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == 6);
+	ret = rt_buffer_read(&bf, out, 6, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == 6);
+
+	/* A reservation wrapping around the end of the ring. */
+	ret = rt_buffer_reserve(&bf, 4, iov, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == 4);
+	traceobj_assert(&trobj, iov[0].iov_len == 2 && iov[1].iov_len == 2);
+	memcpy(iov[0].iov_base, "wx", 2);
+	memcpy(iov[1].iov_base, "yz", 2);
+
+	ret = rt_buffer_reserve(&bf, 1, iov, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == -EBUSY);
+	ret = rt_buffer_write(&bf, data, 1, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == -EWOULDBLOCK);
+	ret = rt_buffer_inquire(&bf, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.availmem == 4);
+	ret = rt_buffer_commit(&bf, 5);
+	traceobj_assert(&trobj, ret == -EINVAL);
+	ret = rt_buffer_commit(&bf, 4);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Data loaned to the consumer, in the same two segments. */
+	ret = rt_buffer_peek(&bf, 4, iov, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == 4);
+	traceobj_assert(&trobj, iov[0].iov_len == 2 && iov[1].iov_len == 2);
+	traceobj_assert(&trobj, memcmp(iov[0].iov_base, "wx", 2) == 0);
+	traceobj_assert(&trobj, memcmp(iov[1].iov_base, "yz", 2) == 0);
+
+	ret = rt_buffer_read(&bf, out, 1, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == -EWOULDBLOCK);
+
+	/* Partial release, the rest is still there for readers. */
+	ret = rt_buffer_release(&bf, 3);
+	traceobj_check(&trobj, ret, 0);
+	ret = rt_buffer_read(&bf, out, 1, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == 1 && out[0] == 'z');
+	ret = rt_buffer_release(&bf, 1);
+	traceobj_assert(&trobj, ret == -EINVAL);
+
+	ret = rt_buffer_delete(&bf);
+	traceobj_check(&trobj, ret, 0);
+}
+
+int main(int argc, char *const argv[])
+{
+	RTIME copy_ns, loan_ns;
+	int ret;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = rt_task_shadow(NULL, "main_task", 20, 0);
+	traceobj_check(&trobj, ret, 0);
+
+	check_loans();
+
+	ret = rt_buffer_create(&buffer, NULL, RING_SIZE, B_FIFO);
+	traceobj_check(&trobj, ret, 0);
+
+	copy_ns = stream_frames(0);
+	loan_ns = stream_frames(1);
+
+	printf("%d-byte frames: copy %llu ns/frame, in place %llu ns/frame\n",
+	       FRAME_SIZE, (unsigned long long)copy_ns,
+	       (unsigned long long)loan_ns);
+
+	ret = rt_buffer_delete(&buffer);
+	traceobj_check(&trobj, ret, 0);
+
+	exit(0);
+}
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/queue.h>
+
+#define QLIMIT		64
+#define NR_MESSAGES	200000
+
+static struct traceobj trobj;
+
+static RT_TASK t_consumer;
+
+static RT_QUEUE q;
+
+static void consumer_task(void *arg)
+{
+	int n, ret;
+	void *buf;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < NR_MESSAGES; n++) {
+		ret = rt_queue_receive(&q, &buf, TM_INFINITE);
+		traceobj_assert(&trobj, ret == sizeof(int));
+		traceobj_assert(&trobj, *(int *)buf == n);
+		ret = rt_queue_free(&q, buf);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static RTIME stream_messages(int mode)
+{
+	RTIME start, end;
+	int n, ret;
+	void *buf;
+
+	ret = rt_queue_create(&q, "QUEUE", QLIMIT * sizeof(int), QLIMIT, mode);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_create(&t_consumer, "CONSUMER", 0, 20, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_start(&t_consumer, consumer_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	start = rt_timer_read();
+
+	for (n = 0; n < NR_MESSAGES; n++) {
+		/* Back off whenever the queue is full. */
+		while ((buf = rt_queue_alloc(&q, sizeof(int))) == NULL)
+			rt_task_yield();
+		*(int *)buf = n;
+		while ((ret = rt_queue_send(&q, buf, sizeof(int),
+					    Q_NORMAL)) == -ENOMEM)
+			rt_task_yield();
+		traceobj_assert(&trobj, ret >= 0);
+	}
+
+	ret = rt_task_join(&t_consumer);
+	traceobj_check(&trobj, ret, 0);
+
+	end = rt_timer_read();
+
+	ret = rt_queue_delete(&q);
+	traceobj_check(&trobj, ret, 0);
+
+	return rt_timer_ticks2ns(end - start) / NR_MESSAGES;
+}
+
+static void check_spsc(void)
+{
+	RT_QUEUE_INFO info;
+	int n, msg, ret;
+	void *buf;
+
+	ret = rt_queue_create(&q, "QUEUE", 4096, Q_UNLIMITED, Q_SPSC);
+	traceobj_check(&trobj, ret, -EINVAL);
+
+	ret = rt_queue_create(&q, "QUEUE", 4096, 3, Q_SPSC);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_queue_write(&q, &n, sizeof(n), Q_URGENT);
+	traceobj_check(&trobj, ret, -EINVAL);
+
+	for (n = 0; n < 3; n++) {
+		ret = rt_queue_write(&q, &n, sizeof(n), Q_NORMAL);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	ret = rt_queue_write(&q, &n, sizeof(n), Q_NORMAL);
+	traceobj_check(&trobj, ret, -ENOMEM);
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.nmessages == 3);
+
+	ret = rt_queue_read(&q, &msg, sizeof(msg), TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == sizeof(msg) && msg == 0);
+
+	ret = rt_queue_receive(&q, &buf, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == sizeof(msg) && *(int *)buf == 1);
+	ret = rt_queue_free(&q, buf);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_queue_flush(&q);
+	traceobj_check(&trobj, ret, 1);
+
+	ret = rt_queue_read(&q, &msg, sizeof(msg), TM_NONBLOCK);
+	traceobj_check(&trobj, ret, -EWOULDBLOCK);
+
+	ret = rt_queue_read(&q, &msg, sizeof(msg), 1000000);
+	traceobj_check(&trobj, ret, -ETIMEDOUT);
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.nmessages == 0 && info.usedmem == 0);
+
+	ret = rt_queue_delete(&q);
+	traceobj_check(&trobj, ret, 0);
+}
+
+int main(int argc, char *const argv[])
+{
+	RTIME fifo_ns, spsc_ns;
+	int ret;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = rt_task_shadow(NULL, "main_task", 20, 0);
+	traceobj_check(&trobj, ret, 0);
+
+	check_spsc();
+
+	fifo_ns = stream_messages(Q_FIFO);
+	spsc_ns = stream_messages(Q_SPSC);
+
+	printf("send+receive: Q_FIFO %llu ns/msg, Q_SPSC %llu ns/msg\n",
+	       (unsigned long long)fifo_ns, (unsigned long long)spsc_ns);
+
+	exit(0);
+}
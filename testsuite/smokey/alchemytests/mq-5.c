@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/queue.h>
+
+#define QLIMIT		8
+#define MSGSIZE		64
+#define NR_LOOPS	200000
+
+static struct traceobj trobj;
+
+static RT_TASK t_worker;
+
+static RT_QUEUE q;
+
+static void check_slab(void)
+{
+	void *bufs[QLIMIT], *extra, *large, *buf;
+	RT_QUEUE_SLAB_INFO slab;
+	RT_QUEUE_INFO info;
+	int n, ret;
+
+	ret = rt_queue_create(&q, "QUEUE", QLIMIT * MSGSIZE, Q_UNLIMITED, Q_SLAB);
+	traceobj_check(&trobj, ret, -EINVAL);
+
+	ret = rt_queue_create(&q, "QUEUE", QLIMIT * MSGSIZE, QLIMIT, Q_SLAB);
+	traceobj_check(&trobj, ret, 0);
+
+	for (n = 0; n < QLIMIT; n++) {
+		bufs[n] = rt_queue_alloc(&q, MSGSIZE);
+		traceobj_assert(&trobj, bufs[n] != NULL);
+	}
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.usedmem == 0);
+	ret = rt_queue_inquire_slab(&q, &slab);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, slab.nslots == QLIMIT);
+	traceobj_assert(&trobj, slab.usedslots == QLIMIT);
+	traceobj_assert(&trobj, slab.slabmisses == 0);
+
+	/* Slots exhausted, the next one comes from the pool. */
+	extra = rt_queue_alloc(&q, MSGSIZE);
+	traceobj_assert(&trobj, extra != NULL);
+	/* Too large for a slot, does not count as a miss. */
+	large = rt_queue_alloc(&q, MSGSIZE + 1);
+	traceobj_assert(&trobj, large != NULL);
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.usedmem > 0);
+	ret = rt_queue_inquire_slab(&q, &slab);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, slab.slabmisses == 1);
+
+	ret = rt_queue_free(&q, extra);
+	traceobj_check(&trobj, ret, 0);
+	ret = rt_queue_free(&q, large);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Slot messages travel through the queue as usual. */
+	*(int *)bufs[0] = 0xdeadbeef;
+	ret = rt_queue_send(&q, bufs[0], sizeof(int), Q_NORMAL);
+	traceobj_check(&trobj, ret, 0);
+	ret = rt_queue_receive(&q, &buf, TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == sizeof(int));
+	traceobj_assert(&trobj, buf == bufs[0] && *(int *)buf == 0xdeadbeef);
+
+	for (n = 0; n < QLIMIT; n++) {
+		ret = rt_queue_free(&q, bufs[n]);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	ret = rt_queue_free(&q, bufs[0]);
+	traceobj_check(&trobj, ret, -EINVAL);
+
+	/* rt_queue_write() and rt_queue_read() use the slots too. */
+	ret = rt_queue_write(&q, &n, sizeof(n), Q_NORMAL);
+	traceobj_check(&trobj, ret, 0);
+	ret = rt_queue_inquire_slab(&q, &slab);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, slab.usedslots == 1);
+	ret = rt_queue_read(&q, &n, sizeof(n), TM_NONBLOCK);
+	traceobj_assert(&trobj, ret == sizeof(n) && n == QLIMIT);
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.usedmem == 0);
+	ret = rt_queue_inquire_slab(&q, &slab);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, slab.usedslots == 0);
+
+	ret = rt_queue_delete(&q);
+	traceobj_check(&trobj, ret, 0);
+}
+
+static void worker_task(void *arg)
+{
+	void *bufs[QLIMIT / 2];
+	int n, k, ret;
+
+	traceobj_enter(&trobj);
+
+	for (n = 0; n < NR_LOOPS; n++) {
+		for (k = 0; k < QLIMIT / 2; k++) {
+			bufs[k] = rt_queue_alloc(&q, MSGSIZE);
+			traceobj_assert(&trobj, bufs[k] != NULL);
+		}
+		for (k = 0; k < QLIMIT / 2; k++) {
+			ret = rt_queue_free(&q, bufs[k]);
+			traceobj_check(&trobj, ret, 0);
+		}
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static RTIME run_allocs(int mode)
+{
+	RT_QUEUE_SLAB_INFO slab;
+	RT_QUEUE_INFO info;
+	RTIME start, end;
+	int ret;
+
+	/* Leave room for the pool allocator overhead with Q_FIFO. */
+	ret = rt_queue_create(&q, "QUEUE", QLIMIT * MSGSIZE * 4, QLIMIT, mode);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Two tasks hammering the same slots concurrently. */
+	ret = rt_task_create(&t_worker, "WORKER", 0, 20, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+
+	start = rt_timer_read();
+
+	ret = rt_task_start(&t_worker, worker_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	worker_task(NULL);
+
+	ret = rt_task_join(&t_worker);
+	traceobj_check(&trobj, ret, 0);
+
+	end = rt_timer_read();
+
+	ret = rt_queue_inquire(&q, &info);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, info.usedmem == 0);
+	ret = rt_queue_inquire_slab(&q, &slab);
+	traceobj_check(&trobj, ret, 0);
+	traceobj_assert(&trobj, slab.usedslots == 0 && slab.slabmisses == 0);
+
+	ret = rt_queue_delete(&q);
+	traceobj_check(&trobj, ret, 0);
+
+	return rt_timer_ticks2ns(end - start) / (NR_LOOPS * QLIMIT);
+}
+
+int main(int argc, char *const argv[])
+{
+	RTIME heap_ns, slab_ns;
+	int ret;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = rt_task_shadow(NULL, "main_task", 20, 0);
+	traceobj_check(&trobj, ret, 0);
+
+	check_slab();
+
+	heap_ns = run_allocs(Q_FIFO);
+	slab_ns = run_allocs(Q_SLAB);
+
+	printf("alloc+free: pool %llu ns/msg, slab %llu ns/msg\n",
+	       (unsigned long long)heap_ns, (unsigned long long)slab_ns);
+
+	exit(0);
+}
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/sem.h>
+
+#define NR_SEMS		1024
+#define NR_LOOKUPS	200000
+
+static struct traceobj trobj;
+
+static RT_TASK t_creator;
+
+static RT_SEM sems[NR_SEMS];
+
+static volatile int done;
+
+static volatile int inserts;
+
+static void creator_task(void *arg)
+{
+	char name[XNOBJECT_NAME_LEN];
+	RT_SEM sem;
+	int ret;
+
+	traceobj_enter(&trobj);
+
+	/* Keep the dictionary busy while lookups are going on. */
+	while (!done) {
+		snprintf(name, sizeof(name), "new%d", inserts++);
+		ret = rt_sem_create(&sem, name, 0, S_FIFO);
+		traceobj_check(&trobj, ret, 0);
+		ret = rt_sem_delete(&sem);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	traceobj_exit(&trobj);
+}
+
+static unsigned long long bind_sems(void)
+{
+	char name[XNOBJECT_NAME_LEN];
+	RTIME start, end;
+	int n, ret;
+	RT_SEM sem;
+
+	start = rt_timer_read();
+
+	for (n = 0; n < NR_LOOKUPS; n++) {
+		snprintf(name, sizeof(name), "sem%d", (n * 7) % NR_SEMS);
+		ret = rt_sem_bind(&sem, name, TM_NONBLOCK);
+		traceobj_check(&trobj, ret, 0);
+		traceobj_assert(&trobj,
+				sem.handle == sems[(n * 7) % NR_SEMS].handle);
+	}
+
+	end = rt_timer_read();
+
+	return NR_LOOKUPS * 1000000000ULL / rt_timer_ticks2ns(end - start);
+}
+
+int main(int argc, char *const argv[])
+{
+	char name[XNOBJECT_NAME_LEN];
+	unsigned long long idle_rate, busy_rate;
+	RT_SEM sem;
+	int n, ret;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = rt_task_shadow(NULL, "main_task", 20, 0);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Enough entries to have the dictionary grow. */
+	for (n = 0; n < NR_SEMS; n++) {
+		snprintf(name, sizeof(name), "sem%d", n);
+		ret = rt_sem_create(&sems[n], name, 0, S_FIFO);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	ret = rt_sem_bind(&sem, "nosem", TM_NONBLOCK);
+	traceobj_check(&trobj, ret, -EWOULDBLOCK);
+
+	idle_rate = bind_sems();
+
+	ret = rt_task_create(&t_creator, "CREATOR", 0, 19, T_JOINABLE);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_start(&t_creator, creator_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	while (inserts == 0)
+		rt_task_sleep(1000000);
+
+	busy_rate = bind_sems();
+
+	done = 1;
+	ret = rt_task_join(&t_creator);
+	traceobj_check(&trobj, ret, 0);
+
+	for (n = 0; n < NR_SEMS; n++) {
+		ret = rt_sem_delete(&sems[n]);
+		traceobj_check(&trobj, ret, 0);
+	}
+
+	printf("bind lookups/s: %llu idle, %llu with concurrent inserts (%d)\n",
+	       idle_rate, busy_rate, inserts);
+
+	exit(0);
+}
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/sem.h>
+
+#define NR_OBJECTS	100000
+#define BATCH		1000
+
+static struct traceobj trobj;
+
+static RT_SEM sems[BATCH];
+
+static RTIME create_sems(void)
+{
+	char name[XNOBJECT_NAME_LEN];
+	RTIME start, elapsed = 0;
+	int n, k, ret;
+
+	/* Keep the main heap usage bounded, only a batch is alive. */
+	for (n = 0; n < NR_OBJECTS; n += BATCH) {
+		start = rt_timer_read();
+		for (k = 0; k < BATCH; k++) {
+			snprintf(name, sizeof(name), "sem%d", n + k);
+			ret = rt_sem_create(&sems[k], name, 0, S_FIFO);
+			traceobj_check(&trobj, ret, 0);
+		}
+		elapsed += rt_timer_read() - start;
+		for (k = 0; k < BATCH; k++) {
+			ret = rt_sem_delete(&sems[k]);
+			traceobj_check(&trobj, ret, 0);
+		}
+	}
+
+	return rt_timer_ticks2ns(elapsed) / NR_OBJECTS;
+}
+
+int main(int argc, char *const argv[])
+{
+	int ret, status, child;
+	RTIME ns;
+	pid_t pid;
+
+	child = getenv("ALCHEMYTESTS_SEM4_NOREG") != NULL;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	if (!child) {
+		/* Run the same load with object registration disabled. */
+		setenv("ALCHEMYTESTS_SEM4_NOREG", "1", 1);
+		pid = fork();
+		if (pid == 0) {
+			execl(argv[0], argv[0], "--no-registry", NULL);
+			_exit(1);
+		}
+		traceobj_assert(&trobj, pid > 0);
+		ret = waitpid(pid, &status, 0);
+		traceobj_assert(&trobj, ret == pid);
+		traceobj_assert(&trobj, WIFEXITED(status) &&
+				WEXITSTATUS(status) == 0);
+	}
+
+	ret = rt_task_shadow(NULL, "main_task", 20, 0);
+	traceobj_check(&trobj, ret, 0);
+
+	ns = create_sems();
+
+	printf("%d semaphores, registry %s: %llu ns/object\n", NR_OBJECTS,
+#ifdef CONFIG_XENO_REGISTRY
+	       child ? "disabled" : "enabled",
+#else
+	       "not built",
+#endif
+	       (unsigned long long)ns);
+
+	exit(0);
+}
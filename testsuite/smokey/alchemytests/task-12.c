@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <boilerplate/signal.h>
+#include <copperplate/traceobj.h>
+#include <alchemy/task.h>
+#include <alchemy/timer.h>
+
+#define PERIOD		1000000
+#define NR_CYCLES	1000
+
+static struct traceobj trobj;
+
+static RT_TASK t_cyclic;
+
+static int on_vm;
+
+struct jitter {
+	RTIME min, max, sum;
+};
+
+static void account(struct jitter *j, RTIME date, RTIME expected)
+{
+	RTIME lat = date > expected ? date - expected : 0;
+
+	lat = rt_timer_ticks2ns(lat);
+	if (lat < j->min)
+		j->min = lat;
+	if (lat > j->max)
+		j->max = lat;
+	j->sum += lat;
+}
+
+static void print_jitter(const char *label, struct jitter *j)
+{
+	printf("%s: min %llu ns, avg %llu ns, max %llu ns\n", label,
+	       (unsigned long long)j->min,
+	       (unsigned long long)(j->sum / NR_CYCLES),
+	       (unsigned long long)j->max);
+}
+
+static void check_overruns(void)
+{
+	unsigned long overruns = 0;
+	int ret;
+
+	ret = rt_task_set_periodic(NULL, TM_NOW, PERIOD);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_wait_period(NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	/* Miss the next release point, and two more after it. */
+	rt_timer_spin(PERIOD * 3 + PERIOD / 2);
+
+	ret = rt_task_wait_period(&overruns);
+	traceobj_check(&trobj, ret, -ETIMEDOUT);
+	traceobj_assert(&trobj, overruns == 2 || on_vm);
+
+	/* Back on the timeline. */
+	ret = rt_task_wait_period(NULL);
+	traceobj_assert(&trobj, ret == 0 || on_vm);
+
+	ret = rt_task_set_periodic(NULL, TM_NOW, TM_INFINITE);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_wait_period(NULL);
+	traceobj_check(&trobj, ret, -EWOULDBLOCK);
+}
+
+static void wait_period_cycles(struct jitter *j)
+{
+	unsigned long overruns;
+	RTIME expected;
+	int n, ret;
+
+	expected = rt_timer_read() + rt_timer_ns2ticks(PERIOD);
+	ret = rt_task_set_periodic(NULL, expected, PERIOD);
+	traceobj_check(&trobj, ret, 0);
+
+	for (n = 0; n < NR_CYCLES; n++) {
+		overruns = 0;
+		ret = rt_task_wait_period(&overruns);
+		account(j, rt_timer_read(), expected);
+		traceobj_assert(&trobj, ret == 0 || ret == -ETIMEDOUT);
+		expected += rt_timer_ns2ticks(PERIOD) * (overruns + 1);
+	}
+
+	ret = rt_task_set_periodic(NULL, TM_NOW, TM_INFINITE);
+	traceobj_check(&trobj, ret, 0);
+}
+
+/* The thread-directed timer signal scheme Mercury used formerly. */
+static void timer_signal_cycles(struct jitter *j)
+{
+	struct itimerspec its;
+	struct sigevent sev;
+	RTIME expected;
+	sigset_t set;
+	siginfo_t si;
+	timer_t tm;
+	int n, ret;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGRTMIN);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_signo = SIGRTMIN;
+	sev.sigev_notify = SIGEV_SIGNAL|SIGEV_THREAD_ID;
+	sev.sigev_notify_thread_id = syscall(SYS_gettid);
+	ret = timer_create(CLOCK_MONOTONIC, &sev, &tm);
+	traceobj_check(&trobj, ret, 0);
+
+	expected = rt_timer_read() + rt_timer_ns2ticks(PERIOD);
+	clock_gettime(CLOCK_MONOTONIC, &its.it_value);
+	its.it_value.tv_nsec += PERIOD;
+	if (its.it_value.tv_nsec >= 1000000000) {
+		its.it_value.tv_nsec -= 1000000000;
+		its.it_value.tv_sec++;
+	}
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = PERIOD;
+	ret = timer_settime(tm, TIMER_ABSTIME, &its, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	for (n = 0; n < NR_CYCLES; n++) {
+		ret = sigwaitinfo(&set, &si);
+		account(j, rt_timer_read(), expected);
+		traceobj_assert(&trobj, ret == SIGRTMIN);
+		expected += rt_timer_ns2ticks(PERIOD) * (si.si_overrun + 1);
+	}
+
+	timer_delete(tm);
+}
+
+static void cyclic_task(void *arg)
+{
+	struct jitter wp = { .min = ~0ULL }, ts = { .min = ~0ULL };
+
+	traceobj_enter(&trobj);
+
+	check_overruns();
+
+	timer_signal_cycles(&ts);
+	wait_period_cycles(&wp);
+
+	print_jitter("timer signal", &ts);
+	print_jitter("wait period ", &wp);
+
+	traceobj_exit(&trobj);
+}
+
+int main(int argc, char *const argv[])
+{
+	int ret;
+
+	on_vm = argc > 1 && strcmp(argv[1], "--vm") == 0;
+
+	traceobj_init(&trobj, argv[0], 0);
+
+	ret = rt_task_create(&t_cyclic, "cyclic_task", 0, 99, 0);
+	traceobj_check(&trobj, ret, 0);
+
+	ret = rt_task_start(&t_cyclic, cyclic_task, NULL);
+	traceobj_check(&trobj, ret, 0);
+
+	traceobj_join(&trobj);
+
+	exit(0);
+}
@@ -0,0 +1,296 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <cobalt/sys/cobalt.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(event_post,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Check the userland fast paths of Cobalt events and monitors,\n"
+		   "\tmeasuring posts per second.\n"
+		   "\tloops=<count>\tnumber of operations per measurement"
+);
+
+#define WAKEUP_BIT	0x80000000
+
+struct waiter {
+	cobalt_event_t *event;
+	unsigned int bits;
+	unsigned int rbits;
+	int mode;
+	int status;
+};
+
+static long long diff_ns(const struct timespec *t0, const struct timespec *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		t1->tv_nsec - t0->tv_nsec;
+}
+
+static void *event_waiter(void *arg)
+{
+	struct waiter *w = arg;
+
+	w->status = cobalt_event_wait(w->event, w->bits, &w->rbits,
+				      w->mode, NULL);
+	return NULL;
+}
+
+static int wait_sleepers(cobalt_event_t *event, int count)
+{
+	struct cobalt_event_info info;
+	int n, ret;
+
+	for (n = 0; n < 1000; n++) {
+		ret = cobalt_event_inquire(event, &info, NULL, 0);
+		if (ret < 0)
+			return ret;
+		if (info.nrwait == count)
+			return 0;
+		usleep(1000);
+	}
+
+	return -ETIMEDOUT;
+}
+
+static int check_event(void)
+{
+	struct timespec ts = { 0, 0 };
+	struct waiter w = { .status = -EINVAL };
+	cobalt_event_t event;
+	unsigned int rbits;
+	pthread_t tid;
+	int ret;
+
+	ret = smokey_check_status(cobalt_event_init(&event, 0,
+						    COBALT_EVENT_PRIO));
+	if (ret)
+		return ret;
+
+	if (!smokey_assert(cobalt_event_wait(&event, 0x1, &rbits,
+					     COBALT_EVENT_ANY,
+					     &ts) == -EWOULDBLOCK)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	w.event = &event;
+	w.bits = 0x3;
+	w.mode = COBALT_EVENT_ALL;
+	ret = smokey_check_status(pthread_create(&tid, NULL,
+						 event_waiter, &w));
+	if (ret)
+		goto out;
+
+	ret = wait_sleepers(&event, 1);
+	if (ret)
+		goto join;
+
+	/* One out of two bits, the waiter must keep sleeping. */
+	cobalt_event_post(&event, 0x1);
+	usleep(10000);
+	ret = wait_sleepers(&event, 1);
+	if (ret)
+		goto join;
+
+	cobalt_event_post(&event, 0x4);
+	cobalt_event_post(&event, 0x2);
+join:
+	if (ret)
+		cobalt_event_post(&event, 0x3);
+	pthread_join(tid, NULL);
+	if (ret)
+		goto out;
+
+	if (!smokey_assert(w.status == 0) || !smokey_assert(w.rbits == 0x3)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* Satisfied wait, no consumption. */
+	ret = cobalt_event_wait(&event, 0x6, &rbits, COBALT_EVENT_ALL, NULL);
+	if (!smokey_assert(ret == 0) || !smokey_assert(rbits == 0x6))
+		ret = -EINVAL;
+	else if (!smokey_assert(cobalt_event_clear(&event, 0x7) == 0x7))
+		ret = -EINVAL;
+out:
+	cobalt_event_destroy(&event);
+
+	return ret;
+}
+
+static int bench_event(int loops)
+{
+	struct waiter w = { .status = -EINVAL };
+	struct timespec t0, t1;
+	cobalt_event_t event;
+	unsigned int rbits;
+	pthread_t tid;
+	long long ns;
+	int n, ret;
+
+	ret = smokey_check_status(cobalt_event_init(&event, 0,
+						    COBALT_EVENT_PRIO));
+	if (ret)
+		return ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < loops; n++) {
+		cobalt_event_post(&event, 0x1);
+		cobalt_event_clear(&event, 0x1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = diff_ns(&t0, &t1);
+	smokey_trace("post+clear, no sleeper:      %6lld ns, %9lld posts/s",
+		     ns / loops, loops * 1000000000LL / ns);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	cobalt_event_post(&event, 0x1);
+	for (n = 0; n < loops; n++) {
+		ret = cobalt_event_wait(&event, 0x1, &rbits,
+					COBALT_EVENT_ANY, NULL);
+		if (ret)
+			goto out;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	cobalt_event_clear(&event, 0x1);
+	ns = diff_ns(&t0, &t1);
+	smokey_trace("satisfied wait:              %6lld ns, %9lld waits/s",
+		     ns / loops, loops * 1000000000LL / ns);
+
+	w.event = &event;
+	w.bits = WAKEUP_BIT;
+	w.mode = COBALT_EVENT_ANY;
+	ret = smokey_check_status(pthread_create(&tid, NULL,
+						 event_waiter, &w));
+	if (ret)
+		goto out;
+
+	ret = wait_sleepers(&event, 1);
+	if (ret == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (n = 0; n < loops; n++) {
+			cobalt_event_post(&event, 0x1);
+			cobalt_event_clear(&event, 0x1);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ns = diff_ns(&t0, &t1);
+		smokey_trace("post+clear, unrelated sleeper: %4lld ns, %9lld posts/s",
+			     ns / loops, loops * 1000000000LL / ns);
+	}
+
+	cobalt_event_post(&event, WAKEUP_BIT);
+	pthread_join(tid, NULL);
+	if (ret == 0 && !smokey_assert(w.status == 0))
+		ret = -EINVAL;
+out:
+	cobalt_event_destroy(&event);
+
+	return ret;
+}
+
+static void *monitor_waiter(void *arg)
+{
+	cobalt_monitor_t *mon = arg;
+	long ret;
+
+	ret = cobalt_monitor_enter(mon);
+	if (ret == 0) {
+		ret = cobalt_monitor_wait(mon, COBALT_MONITOR_WAITGRANT, NULL);
+		cobalt_monitor_exit(mon);
+	}
+
+	return (void *)ret;
+}
+
+static int bench_monitor(int loops)
+{
+	struct timespec t0, t1;
+	cobalt_monitor_t mon;
+	pthread_t tid;
+	void *status;
+	long long ns;
+	int n, ret;
+
+	ret = smokey_check_status(cobalt_monitor_init(&mon, CLOCK_MONOTONIC, 0));
+	if (ret)
+		return ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < loops; n++) {
+		ret = cobalt_monitor_enter(&mon);
+		if (ret)
+			goto out;
+		cobalt_monitor_exit(&mon);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = diff_ns(&t0, &t1);
+	smokey_trace("monitor enter+exit:          %6lld ns, %9lld ops/s",
+		     ns / loops, loops * 1000000000LL / ns);
+
+	ret = smokey_check_status(pthread_create(&tid, NULL,
+						 monitor_waiter, &mon));
+	if (ret)
+		goto out;
+
+	usleep(10000);
+
+	/* Drain signals with a grant waiter only, no wakeup needed. */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < loops; n++) {
+		ret = cobalt_monitor_enter(&mon);
+		if (ret)
+			break;
+		cobalt_monitor_drain(&mon);
+		cobalt_monitor_exit(&mon);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = diff_ns(&t0, &t1);
+	if (ret == 0)
+		smokey_trace("monitor drain, grant waiter: %6lld ns, %9lld ops/s",
+			     ns / loops, loops * 1000000000LL / ns);
+
+	if (cobalt_monitor_enter(&mon) == 0) {
+		cobalt_monitor_grant_all(&mon);
+		cobalt_monitor_exit(&mon);
+	}
+	pthread_join(tid, &status);
+	if (ret == 0 && !smokey_assert(status == NULL))
+		ret = -EINVAL;
+out:
+	if (cobalt_monitor_enter(&mon) == 0)
+		cobalt_monitor_destroy(&mon);
+
+	return ret;
+}
+
+static int run_event_post(struct smokey_test *t, int argc, char *const argv[])
+{
+	int loops = 1000000, ret;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(event_post, loops))
+		loops = SMOKEY_ARG_INT(event_post, loops);
+
+	if (loops <= 0)
+		return -EINVAL;
+
+	ret = check_event();
+	if (ret)
+		return ret;
+
+	ret = bench_event(loops);
+	if (ret)
+		return ret;
+
+	return bench_monitor(loops);
+}
@@ -0,0 +1,172 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(fd_lookup,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Measure the scalability of RTDM file descriptor lookups\n"
+		   "\twith one real-time thread per CPU issuing fcntl() calls.\n"
+		   "\tloops=<count>\tnumber of calls per thread and run"
+);
+
+struct lookup_context {
+	pthread_t tid;
+	int cpu;
+	int loops;
+	sem_t *start;
+	long long elapsed_ns;
+	int status;
+};
+
+static long long diff_ns(const struct timespec *t0, const struct timespec *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		t1->tv_nsec - t0->tv_nsec;
+}
+
+static void *lookup_thread(void *arg)
+{
+	struct lookup_context *p = arg;
+	struct timespec t0, t1;
+	int fd, n, ret;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	sem_wait(p->start);
+	if (fd < 0) {
+		p->status = -errno;
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < p->loops; n++) {
+		ret = fcntl(fd, F_GETFL);
+		if (ret < 0) {
+			p->status = -errno;
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	p->elapsed_ns = diff_ns(&t0, &t1);
+	close(fd);
+
+	return NULL;
+}
+
+static int run_lookups(int *cpus, int nrthreads, int loops)
+{
+	struct lookup_context *ctx;
+	struct sched_param param;
+	sem_t start;
+	long long sum_ns = 0, max_ns = 0;
+	pthread_attr_t attr;
+	cpu_set_t set;
+	int n, nrstarted, ret = 0;
+
+	ctx = calloc(nrthreads, sizeof(*ctx));
+	if (ctx == NULL)
+		return -ENOMEM;
+
+	sem_init(&start, 0, 0);
+
+	for (n = 0; n < nrthreads; n++) {
+		ctx[n].cpu = cpus[n];
+		ctx[n].loops = loops;
+		ctx[n].start = &start;
+		pthread_attr_init(&attr);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		param.sched_priority = 10;
+		pthread_attr_setschedparam(&attr, &param);
+		CPU_ZERO(&set);
+		CPU_SET(cpus[n], &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+		ret = pthread_create(&ctx[n].tid, &attr, lookup_thread, &ctx[n]);
+		pthread_attr_destroy(&attr);
+		if (ret) {
+			ret = -ret;
+			break;
+		}
+	}
+
+	/* Release all threads at once, the lookup loops should overlap. */
+	nrstarted = n;
+	for (n = 0; n < nrstarted; n++)
+		sem_post(&start);
+
+	for (n = 0; n < nrstarted; n++) {
+		pthread_join(ctx[n].tid, NULL);
+		if (ctx[n].status) {
+			ret = ctx[n].status;
+			continue;
+		}
+		sum_ns += ctx[n].elapsed_ns;
+		if (ctx[n].elapsed_ns > max_ns)
+			max_ns = ctx[n].elapsed_ns;
+	}
+
+	sem_destroy(&start);
+
+	if (ret == 0 && max_ns > 0)
+		smokey_trace("%3d thread(s): %6lld ns/call, %10lld calls/s",
+			     nrthreads, sum_ns / ((long long)nrthreads * loops),
+			     (long long)nrthreads * loops * 1000000000LL / max_ns);
+
+	free(ctx);
+
+	return ret;
+}
+
+static int run_fd_lookup(struct smokey_test *t, int argc, char *const argv[])
+{
+	int loops = 100000, nrcpus = 0, cpu, n, ret = 0;
+	cpu_set_t online;
+	int *cpus;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(fd_lookup, loops))
+		loops = SMOKEY_ARG_INT(fd_lookup, loops);
+
+	if (loops <= 0)
+		return -EINVAL;
+
+	if (sched_getaffinity(0, sizeof(online), &online))
+		return -errno;
+
+	cpus = malloc(CPU_COUNT(&online) * sizeof(*cpus));
+	if (cpus == NULL)
+		return -ENOMEM;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &online))
+			cpus[nrcpus++] = cpu;
+	}
+
+	for (n = 1; n <= nrcpus; n++) {
+		ret = run_lookups(cpus, n, loops);
+		if (ret) {
+			smokey_warning("lookup run with %d thread(s) failed: %s",
+				       n, strerror(-ret));
+			break;
+		}
+	}
+
+	free(cpus);
+
+	return ret;
+}
@@ -23,6 +23,9 @@ smokey_test_plugin(iddp,
 
 #define IDDP_SVPORT 12
 #define IDDP_CLPORT 13
+#define IDDP_RXPORT 14
+#define IDDP_TXPORT 15
+#define IDDP_BATCH  16
 
 static pthread_t svtid, cltid;
 
@@ -136,6 +139,117 @@ static void *client(void *arg)
 	return NULL;
 }
 
+static int bind_port(int port)
+{
+	struct sockaddr_ipc saddr;
+	int ret, s;
+
+	s = socket(AF_RTIPC, SOCK_DGRAM, IPCPROTO_IDDP);
+	if (s < 0)
+		fail("socket");
+
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = port;
+	ret = bind(s, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		fail("bind");
+
+	return s;
+}
+
+/*
+ * The kernel writes back the residual length of each I/O vector,
+ * restore them before every batch.
+ */
+static void reset_iov(struct iovec *iov, long *data, int count)
+{
+	int n;
+
+	for (n = 0; n < count; n++)
+		iov[n].iov_len = sizeof(data[n]);
+}
+
+static int check_mmsg(void)
+{
+	struct mmsghdr msgvec[IDDP_BATCH];
+	struct iovec iov[IDDP_BATCH];
+	long data[IDDP_BATCH];
+	struct sockaddr_ipc saddr;
+	struct timespec ts;
+	int ret, rx, tx, n;
+
+	rx = bind_port(IDDP_RXPORT);
+	tx = bind_port(IDDP_TXPORT);
+
+	saddr.sipc_family = AF_RTIPC;
+	saddr.sipc_port = IDDP_RXPORT;
+	ret = connect(tx, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (ret)
+		fail("connect");
+
+	memset(msgvec, 0, sizeof(msgvec));
+	for (n = 0; n < IDDP_BATCH; n++) {
+		data[n] = n + 1;
+		iov[n].iov_base = &data[n];
+		msgvec[n].msg_hdr.msg_iov = &iov[n];
+		msgvec[n].msg_hdr.msg_iovlen = 1;
+	}
+
+	reset_iov(iov, data, IDDP_BATCH);
+	ret = sendmmsg(tx, msgvec, IDDP_BATCH, 0);
+	if (!smokey_assert(ret == IDDP_BATCH))
+		return ret < 0 ? -errno : -EINVAL;
+
+	memset(data, 0, sizeof(data));
+
+	/* The whole batch is pending, should not wait. */
+	ts.tv_sec = 1;
+	ts.tv_nsec = 0;
+	reset_iov(iov, data, IDDP_BATCH);
+	ret = recvmmsg(rx, msgvec, IDDP_BATCH, 0, &ts);
+	if (!smokey_assert(ret == IDDP_BATCH))
+		return ret < 0 ? -errno : -EINVAL;
+
+	for (n = 0; n < IDDP_BATCH; n++) {
+		if (!smokey_assert(data[n] == n + 1 &&
+				   msgvec[n].msg_len == sizeof(data[n])))
+			return -EINVAL;
+	}
+
+	/* A partial batch should be returned with MSG_WAITFORONE. */
+	reset_iov(iov, data, 3);
+	ret = sendmmsg(tx, msgvec, 3, 0);
+	if (!smokey_assert(ret == 3))
+		return ret < 0 ? -errno : -EINVAL;
+
+	memset(data, 0, sizeof(data));
+	reset_iov(iov, data, IDDP_BATCH);
+	ret = recvmmsg(rx, msgvec, IDDP_BATCH, MSG_WAITFORONE, NULL);
+	if (!smokey_assert(ret == 3))
+		return ret < 0 ? -errno : -EINVAL;
+
+	for (n = 0; n < 3; n++) {
+		if (!smokey_assert(data[n] == n + 1 &&
+				   msgvec[n].msg_len == sizeof(data[n])))
+			return -EINVAL;
+	}
+
+	/* Nothing pending, the timeout should elapse. */
+	ts.tv_sec = 0;
+	ts.tv_nsec = 10000000; /* 10 ms */
+	reset_iov(iov, data, IDDP_BATCH);
+	ret = recvmmsg(rx, msgvec, IDDP_BATCH, 0, &ts);
+	if (!smokey_assert(ret < 0 && errno == ETIMEDOUT))
+		return -EINVAL;
+
+	smokey_trace("%s: batched send/receive ok", __func__);
+
+	close(tx);
+	close(rx);
+
+	return 0;
+}
+
 static int run_iddp(struct smokey_test *t, int argc, char *const argv[])
 {
 	struct sched_param svparam = {.sched_priority = 71 };
@@ -174,5 +288,5 @@ static int run_iddp(struct smokey_test *t, int argc, char *const argv[])
 	pthread_cancel(svtid);
 	pthread_join(svtid, NULL);
 
-	return 0;
+	return check_mmsg();
 }
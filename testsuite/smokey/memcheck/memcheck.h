@@ -59,14 +59,17 @@ struct memcheck_descriptor {
 #define HEAP_USED_T(__p)    ((size_t (*)(void *heap))(__p))
 #define HEAP_USABLE_T(__p)  ((size_t (*)(void *heap))(__p))
 
-#define MEMCHECK_ARGS					\
+#define MEMCHECK_ARGLIST(__args...)			\
 	SMOKEY_ARGLIST(					\
 		SMOKEY_SIZE(seq_heap_size),		\
 		SMOKEY_SIZE(pattern_heap_size),		\
 		SMOKEY_INT(random_alloc_rounds),	\
 		SMOKEY_INT(pattern_check_rounds),	\
 		SMOKEY_INT(max_results),		\
+		##__args				\
 	)
+
+#define MEMCHECK_ARGS  MEMCHECK_ARGLIST()
   
 #define MEMCHECK_HELP_STRINGS						\
 	"\tseq_heap_size=<size[K|M|G]>\tmax. heap size for sequential alloc tests\n" \
@@ -8,6 +8,9 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <sys/sysinfo.h>
 #include <rtdm/testing.h>
 #include "memcheck/memcheck.h"
 
@@ -91,6 +94,77 @@ out:
 	return ret;
 }
 
+#define SMP_HEAP_SIZE   (1024 * 1024)
+#define SMP_BLOCK_SIZE  128
+#define SMP_NRBLOCKS    16
+#define SMP_LOOPS       20000
+
+static int kernel_smp_run(int fd, int nrcpus, int flags)
+{
+	struct rttst_heap_smp_parms parms;
+	int ret;
+
+	parms.heap_size = SMP_HEAP_SIZE;
+	parms.block_size = SMP_BLOCK_SIZE;
+	parms.flags = flags;
+	parms.nrcpus = nrcpus;
+	parms.loops = SMP_LOOPS;
+	parms.nrblocks = SMP_NRBLOCKS;
+	ret = __RT(ioctl(fd, RTTST_RTIOC_HEAP_CHECK_SMP, &parms));
+	if (ret)
+		return -errno;
+
+	if ((flags & RTTST_HEAPCHECK_MAGAZINES) &&
+	    !(parms.flags & RTTST_HEAPCHECK_MAGAZINES))
+		return -EOPNOTSUPP;
+
+	smokey_trace("%3d CPU(s), %s: alloc %4Ld ns, free %4Ld ns, %10Lu ops/s",
+		     nrcpus, flags & RTTST_HEAPCHECK_MAGAZINES ?
+		     "magazines" : "heap lock",
+		     (long long)parms.alloc_avg_ns,
+		     (long long)parms.free_avg_ns,
+		     (unsigned long long)parms.ops_per_sec);
+
+	return 0;
+}
+
+/*
+ * Measure the allocation throughput with concurrent users on
+ * multiple CPUs, through the heap lock then using per-CPU
+ * magazines if the core supports them.
+ */
+static int kernel_smp_test(void)
+{
+	int fd, ret = 0, nrcpus, n;
+	bool magazines = true;
+
+	nrcpus = get_nprocs();
+
+	fd = __RT(open("/dev/rtdm/heapcheck", O_RDWR));
+	if (fd < 0)
+		return -ENOSYS;
+
+	for (n = 1; n <= nrcpus; n++) {
+		ret = kernel_smp_run(fd, n, 0);
+		if (ret)
+			break;
+		if (!magazines)
+			continue;
+		ret = kernel_smp_run(fd, n, RTTST_HEAPCHECK_MAGAZINES);
+		if (ret == -EOPNOTSUPP) {
+			smokey_note("heap magazines not supported by the core");
+			magazines = false;
+			ret = 0;
+		} else if (ret)
+			break;
+	}
+
+	__RT(close(fd));
+
+	/* Some CPUs may not be available for real-time duties. */
+	return ret == -EINVAL && n > 1 ? 0 : ret;
+}
+
 static struct memcheck_descriptor coreheap_descriptor = {
 	.name = "coreheap",
 	.seq_min_heap_size = MIN_HEAP_SIZE,
@@ -105,5 +179,11 @@ static struct memcheck_descriptor coreheap_descriptor = {
 static int run_memory_coreheap(struct smokey_test *t,
 			       int argc, char *const argv[])
 {
-	return memcheck_run(&coreheap_descriptor, t, argc, argv);
+	int ret;
+
+	ret = memcheck_run(&coreheap_descriptor, t, argc, argv);
+	if (ret)
+		return ret;
+
+	return kernel_smp_test();
 }
@@ -4,15 +4,27 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <xenomai/init.h>
 #include <xenomai/tunables.h>
 #include <copperplate/heapobj.h>
 #include "memcheck/memcheck.h"
 
 smokey_test_plugin(memory_pshared,
-		   MEMCHECK_ARGS,
+		   MEMCHECK_ARGLIST(
+			   SMOKEY_INT(bench_workers),
+			   SMOKEY_INT(bench_loops),
+		   ),
 		   "Check for the pshared allocator sanity.\n"
 		   MEMCHECK_HELP_STRINGS
+		   "\tbench_workers=<N>\t# of threads/processes for throughput test\n"
+		   "\tbench_loops=<N>\t# of alloc/free bursts per worker\n"
 	);
 
 #define MIN_HEAP_SIZE  8192
@@ -22,6 +34,9 @@ smokey_test_plugin(memory_pshared,
 #define PATTERN_HEAP_SIZE  (128*1024)
 #define PATTERN_ROUNDS     128
 
+#define BENCH_HEAP_SIZE    (512 * 1024)
+#define BENCH_BURST        8
+
 static struct heapobj heap;
 
 static int do_pshared_init(void *heap, void *mem, size_t arena_size)
@@ -97,10 +112,208 @@ static struct memcheck_descriptor pshared_descriptor = {
 	.heap = &heap,
 };
 
+struct bench_worker {
+	struct heapobj *heap;
+	int loops;
+	long long elapsed_ns;
+	int status;
+};
+
+static long long diff_ns(const struct timespec *t0, const struct timespec *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		t1->tv_nsec - t0->tv_nsec;
+}
+
+static void do_bench_loop(struct bench_worker *w)
+{
+	static const size_t sizes[BENCH_BURST] = {
+		16, 32, 64, 128, 24, 48, 96, 200,
+	};
+	struct timespec t0, t1;
+	void *blocks[BENCH_BURST];
+	int n, k;
+
+	w->status = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (n = 0; n < w->loops; n++) {
+		for (k = 0; k < BENCH_BURST; k++) {
+			blocks[k] = heapobj_alloc(w->heap, sizes[k]);
+			if (blocks[k] == NULL) {
+				w->status = -ENOMEM;
+				break;
+			}
+		}
+		while (--k >= 0)
+			heapobj_free(w->heap, blocks[k]);
+		if (w->status)
+			break;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	w->elapsed_ns = diff_ns(&t0, &t1);
+}
+
+static void *bench_thread(void *arg)
+{
+	do_bench_loop(arg);
+
+	return NULL;
+}
+
+static int report_bench(const char *kind, struct bench_worker *workers,
+			int nrworkers)
+{
+	long long max_ns = 0;
+	int n;
+
+	for (n = 0; n < nrworkers; n++) {
+		if (workers[n].status)
+			return workers[n].status;
+		if (workers[n].elapsed_ns > max_ns)
+			max_ns = workers[n].elapsed_ns;
+	}
+
+	if (max_ns > 0)
+		smokey_trace("%-9s x %2d: %10lld alloc+free/s", kind, nrworkers,
+			     2LL * BENCH_BURST * workers[0].loops * nrworkers *
+			     1000000000LL / max_ns);
+
+	return 0;
+}
+
+static int bench_threads(struct heapobj *h, int nrworkers, int loops)
+{
+	struct bench_worker *workers;
+	pthread_t *tids;
+	int n, ret = 0;
+
+	workers = calloc(nrworkers, sizeof(*workers));
+	tids = calloc(nrworkers, sizeof(*tids));
+	if (workers == NULL || tids == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (n = 0; n < nrworkers; n++) {
+		workers[n].heap = h;
+		workers[n].loops = loops;
+		ret = -pthread_create(tids + n, NULL, bench_thread, workers + n);
+		if (ret)
+			break;
+	}
+
+	while (--n >= 0)
+		pthread_join(tids[n], NULL);
+
+	if (ret == 0)
+		ret = report_bench("threads", workers, nrworkers);
+out:
+	free(tids);
+	free(workers);
+
+	return ret;
+}
+
+static int bench_processes(struct heapobj *h, int nrworkers, int loops)
+{
+	struct bench_worker *workers;
+	int n, status, ret = 0;
+	pthread_t tid;
+	pid_t *pids;
+
+	/* Workers report through a shared mapping. */
+	workers = mmap(NULL, nrworkers * sizeof(*workers),
+		       PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (workers == MAP_FAILED)
+		return -ENOMEM;
+
+	pids = calloc(nrworkers, sizeof(*pids));
+	if (pids == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (n = 0; n < nrworkers; n++) {
+		workers[n].heap = h;
+		workers[n].loops = loops;
+		workers[n].status = -ESRCH;
+		pids[n] = fork();
+		if (pids[n] < 0) {
+			ret = -errno;
+			break;
+		}
+		if (pids[n] == 0) {
+			/*
+			 * _exit() skips the process exit hooks, run
+			 * from a thread which drains its heap cache
+			 * when it returns.
+			 */
+			if (pthread_create(&tid, NULL, bench_thread,
+					   workers + n) == 0)
+				pthread_join(tid, NULL);
+			_exit(0);
+		}
+	}
+
+	while (--n >= 0)
+		waitpid(pids[n], &status, 0);
+
+	if (ret == 0)
+		ret = report_bench("processes", workers, nrworkers);
+
+	free(pids);
+out:
+	munmap(workers, nrworkers * sizeof(*workers));
+
+	return ret;
+}
+
+static int run_bench(void)
+{
+	int nrworkers = 4, loops = 100000, n, ret;
+	struct heapobj h;
+
+	if (SMOKEY_ARG_ISSET(memory_pshared, bench_workers))
+		nrworkers = SMOKEY_ARG_INT(memory_pshared, bench_workers);
+
+	if (SMOKEY_ARG_ISSET(memory_pshared, bench_loops))
+		loops = SMOKEY_ARG_INT(memory_pshared, bench_loops);
+
+	if (nrworkers <= 0 || loops <= 0)
+		return 0;
+
+	ret = heapobj_init(&h, "bench", BENCH_HEAP_SIZE);
+	if (ret)
+		return ret;
+
+	for (n = 1; n <= nrworkers; n *= 2) {
+		ret = bench_threads(&h, n, loops);
+		if (ret == 0)
+			ret = bench_processes(&h, n, loops);
+		if (ret) {
+			smokey_warning("throughput test with %d workers failed: %s",
+				       n, strerror(-ret));
+			break;
+		}
+	}
+
+	heapobj_destroy(&h);
+
+	return ret;
+}
+
 static int run_memory_pshared(struct smokey_test *t,
 			      int argc, char *const argv[])
 {
-	return memcheck_run(&pshared_descriptor, t, argc, argv);
+	int ret;
+
+	ret = memcheck_run(&pshared_descriptor, t, argc, argv);
+	if (ret)
+		return ret;
+
+	return run_bench();
 }
 
 static int memcheck_pshared_tune(void)
@@ -109,7 +322,8 @@ static int memcheck_pshared_tune(void)
 	 * We create test pools from the main one: make sure the
 	 * latter is large enough.
 	 */
-	set_config_tunable(mem_pool_size, MAX_HEAP_SIZE + 1024 * 1024);
+	set_config_tunable(mem_pool_size,
+			   MAX_HEAP_SIZE + BENCH_HEAP_SIZE + 1024 * 1024);
 
 	return 0;
 }
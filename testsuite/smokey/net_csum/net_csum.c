@@ -0,0 +1,76 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <smokey/smokey.h>
+#include <rtdm/testing.h>
+
+smokey_test_plugin(net_csum,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Compare the copy and checksum routines of RTnet on\n"
+		   "\tsmall, MTU-sized and jumbo payloads, aligned or not.\n"
+		   "\tloops=<count>\tnumber of copies per measurement"
+);
+
+static const unsigned int lengths[] = { 64, 1472, 8972, 65507 };
+
+static const unsigned int offsets[] = { 0, 1 };
+
+static int run_net_csum(struct smokey_test *t, int argc, char *const argv[])
+{
+	struct rttst_csum_parms parms;
+	unsigned int l, o, variant;
+	int fd, ret = 0, loops = 1000;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(net_csum, loops))
+		loops = SMOKEY_ARG_INT(net_csum, loops);
+
+	if (loops <= 0)
+		return -EINVAL;
+
+	fd = open("/dev/rtdm/csumbench", O_RDWR);
+	if (fd < 0) {
+		smokey_warning("csumbench driver not available");
+		return -ENOSYS;
+	}
+
+	for (variant = 0; ret == 0; variant++) {
+		for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+			for (o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+				parms.variant = variant;
+				parms.len = lengths[l];
+				parms.offset = offsets[o];
+				parms.loops = loops;
+				if (ioctl(fd, RTTST_RTIOC_CSUM_BENCH, &parms)) {
+					ret = -errno;
+					goto done;
+				}
+				smokey_trace("%-10s %6u bytes, offset %u: "
+					     "%8Lu ns, %6Lu MB/s",
+					     parms.name, parms.len,
+					     parms.offset,
+					     (unsigned long long)parms.avg_ns,
+					     parms.avg_ns ?
+					     (unsigned long long)parms.len *
+					     1000 / parms.avg_ns : 0ULL);
+			}
+		}
+	}
+done:
+	/* Past the last variant. */
+	if (ret == -ENOENT && variant > 0)
+		ret = 0;
+	else
+		smokey_assert(ret == 0);
+
+	close(fd);
+
+	return ret;
+}
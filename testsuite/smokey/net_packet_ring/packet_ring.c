@@ -0,0 +1,384 @@
+/*
+ * RTnet AF_PACKET memory-mapped ring test over the loopback interface
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <sys/cobalt.h>
+#include <rtdm/net.h>
+#include <smokey/smokey.h>
+#include "smokey_net.h"
+
+smokey_test_plugin(net_packet_ring,
+	SMOKEY_ARGLIST(
+		SMOKEY_INT(rtnet_frames),
+		SMOKEY_INT(rtnet_batch),
+	),
+	"Measure RTnet raw packet throughput and latency over rtlo,\n"
+	"\texchanging frames through memory-mapped socket rings,\n"
+	"\tthe rtnet_frames parameter allows choosing the number of frames\n"
+	"\tthe rtnet_batch parameter allows choosing the frames per kick"
+);
+
+#define RING_FRAME_SIZE	128
+#define RING_RX_FRAMES	256
+#define RING_TX_FRAMES	64
+#define RING_PROTO	(ETH_P_802_EX1 + 2)
+
+struct ring_frame {
+	struct ethhdr header;
+	struct smokey_net_payload payload;
+} __attribute__((packed));
+
+struct ring {
+	int sock;
+	void *base;
+	struct rtnet_packet_ring_req req;
+	struct ethhdr header;
+	unsigned int received;
+	unsigned int lost;
+	unsigned long long lat_min, lat_max, lat_sum;
+	int err;
+};
+
+static unsigned int nr_frames = 100000;
+static unsigned int batch = 16;
+
+static inline struct rtnet_packet_slot *
+ring_slot(struct ring *r, unsigned int offset, unsigned int n)
+{
+	return r->base + offset + n * r->req.frame_size;
+}
+
+static inline unsigned int slot_status(struct rtnet_packet_slot *slot)
+{
+	return __atomic_load_n(&slot->status, __ATOMIC_ACQUIRE);
+}
+
+static inline void slot_release(struct rtnet_packet_slot *slot,
+				unsigned int status)
+{
+	__atomic_store_n(&slot->status, status, __ATOMIC_RELEASE);
+}
+
+static unsigned long long ts_diff(const struct timespec *end,
+				  const struct timespec *start)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000000ULL +
+		end->tv_nsec - start->tv_nsec;
+}
+
+static void *ring_receiver(void *arg)
+{
+	struct rtnet_packet_slot *slot;
+	struct smokey_net_payload payload;
+	unsigned int head = 0, expected = 0;
+	unsigned long long lat;
+	struct ring *r = arg;
+	struct timespec now;
+	int ret;
+
+	while (expected < nr_frames) {
+		slot = ring_slot(r, r->req.rx_offset, head);
+		if ((slot_status(slot) & RTNET_PACKET_RX_USER) == 0) {
+			ret = __RT(ioctl(r->sock, RTNET_RTIOC_PACKET_WAIT,
+					 &head));
+			if (ret < 0) {
+				/* Timed out, the rest was dropped. */
+				if (errno != ETIMEDOUT)
+					r->err = -errno;
+				break;
+			}
+			continue;
+		}
+
+		__RT(clock_gettime(CLOCK_MONOTONIC, &now));
+
+		if (slot->len < sizeof(struct ring_frame)) {
+			r->err = -EPROTO;
+			break;
+		}
+		memcpy(&payload,
+		       (void *)slot + RTNET_PACKET_SLOT_HDRLEN +
+		       sizeof(struct ethhdr), sizeof(payload));
+		slot_release(slot, RTNET_PACKET_RX_KERNEL);
+		if (++head == r->req.rx_frames)
+			head = 0;
+
+		if (payload.seq < expected) {
+			r->err = -EPROTO;
+			break;
+		}
+		r->lost += payload.seq - expected;
+		expected = payload.seq + 1;
+		r->received++;
+
+		lat = ts_diff(&now, &payload.ts);
+		if (lat < r->lat_min)
+			r->lat_min = lat;
+		if (lat > r->lat_max)
+			r->lat_max = lat;
+		r->lat_sum += lat;
+	}
+
+	return NULL;
+}
+
+static int ring_kick(struct ring *r)
+{
+	int ret;
+
+	for (;;) {
+		ret = __RT(ioctl(r->sock, RTNET_RTIOC_PACKET_KICK));
+		if (ret >= 0)
+			return 0;
+		if (errno != ENOBUFS)
+			return -errno;
+		/* Let the stack drain the pool. */
+		sched_yield();
+	}
+}
+
+static int ring_send(struct ring *r)
+{
+	struct rtnet_packet_slot *slot;
+	unsigned int seq, head = 0;
+	struct ring_frame frame;
+	struct timespec now;
+	int err;
+
+	frame.header = r->header;
+
+	for (seq = 0; seq < nr_frames; seq++) {
+		slot = ring_slot(r, r->req.tx_offset, head);
+		while (slot_status(slot) != RTNET_PACKET_TX_AVAILABLE) {
+			if (slot_status(slot) == RTNET_PACKET_TX_WRONG_FORMAT)
+				return -EPROTO;
+			err = ring_kick(r);
+			if (err)
+				return err;
+		}
+
+		frame.payload.seq = seq;
+		__RT(clock_gettime(CLOCK_MONOTONIC, &now));
+		frame.payload.ts = now;
+		memcpy((void *)slot + RTNET_PACKET_SLOT_HDRLEN, &frame,
+		       sizeof(frame));
+		slot->len = sizeof(frame);
+		slot_release(slot, RTNET_PACKET_TX_SEND_REQUEST);
+		if (++head == r->req.tx_frames)
+			head = 0;
+
+		if ((seq + 1) % batch == 0) {
+			err = ring_kick(r);
+			if (err)
+				return err;
+		}
+	}
+
+	return ring_kick(r);
+}
+
+static int check_ring_options(struct ring *r)
+{
+	struct rtnet_packet_ring_req req;
+	int ret, err = 0;
+
+	req = r->req;
+	ret = __RT(ioctl(r->sock, RTNET_RTIOC_PACKET_RING, &req));
+	if (!smokey_assert(ret < 0 && errno == EBUSY))
+		err = -EINVAL;
+
+	return err;
+}
+
+static int open_ring(struct ring *r, const struct sockaddr_ll *peer)
+{
+	int64_t timeout = 100000000;	/* 100 ms */
+	struct rtnet_packet_ring_req req;
+	struct sockaddr_ll addr;
+	struct ifreq ifr;
+	int err, ret;
+
+	r->sock = smokey_check_errno(
+		__RT(socket(PF_PACKET, SOCK_RAW, htons(RING_PROTO))));
+	if (r->sock < 0)
+		return r->sock;
+
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_ifindex = peer->sll_ifindex;
+	err = smokey_check_errno(__RT(ioctl(r->sock, SIOCGIFNAME, &ifr)));
+	if (err < 0)
+		goto fail;
+	err = smokey_check_errno(__RT(ioctl(r->sock, SIOCGIFHWADDR, &ifr)));
+	if (err < 0)
+		goto fail;
+	memcpy(r->header.h_dest, peer->sll_addr, ETH_ALEN);
+	memcpy(r->header.h_source, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	r->header.h_proto = htons(RING_PROTO);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons(RING_PROTO);
+	addr.sll_ifindex = peer->sll_ifindex;
+	err = smokey_check_errno(
+		__RT(bind(r->sock, (struct sockaddr *)&addr, sizeof(addr))));
+	if (err < 0)
+		goto fail;
+
+	err = smokey_check_errno(
+		__RT(ioctl(r->sock, RTNET_RTIOC_TIMEOUT, &timeout)));
+	if (err < 0)
+		goto fail;
+
+	/* Slots must be a multiple of RTNET_PACKET_SLOT_ALIGN. */
+	memset(&req, 0, sizeof(req));
+	req.frame_size = RING_FRAME_SIZE + 1;
+	req.rx_frames = RING_RX_FRAMES;
+	ret = __RT(ioctl(r->sock, RTNET_RTIOC_PACKET_RING, &req));
+	if (!smokey_assert(ret < 0 && errno == EINVAL)) {
+		err = -EINVAL;
+		goto fail;
+	}
+
+	memset(&r->req, 0, sizeof(r->req));
+	r->req.frame_size = RING_FRAME_SIZE;
+	r->req.rx_frames = RING_RX_FRAMES;
+	r->req.tx_frames = RING_TX_FRAMES;
+	err = smokey_check_errno(
+		__RT(ioctl(r->sock, RTNET_RTIOC_PACKET_RING, &r->req)));
+	if (err < 0)
+		goto fail;
+
+	r->base = __RT(mmap(NULL, r->req.map_len, PROT_READ | PROT_WRITE,
+			    MAP_SHARED, r->sock, 0));
+	if (r->base == MAP_FAILED) {
+		err = -errno;
+		smokey_warning("mmap: %s", strerror(errno));
+		goto fail;
+	}
+
+	return 0;
+fail:
+	__RT(close(r->sock));
+
+	return err;
+}
+
+static void close_ring(struct ring *r)
+{
+	munmap(r->base, r->req.map_len);
+	__RT(close(r->sock));
+}
+
+static int run_ring(const struct sockaddr_ll *peer)
+{
+	struct sched_param param = { .sched_priority = 11 };
+	struct rtnet_packet_ring_hdr *hdr;
+	struct timespec start, end;
+	struct ring r;
+	pthread_attr_t attr;
+	pthread_t receiver;
+	unsigned long long ns;
+	int err;
+
+	memset(&r, 0, sizeof(r));
+	r.lat_min = ~0ULL;
+
+	err = open_ring(&r, peer);
+	if (err)
+		return err;
+
+	err = check_ring_options(&r);
+	if (err)
+		goto out;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+	err = smokey_check_status(
+		__RT(pthread_create(&receiver, &attr, ring_receiver, &r)));
+	pthread_attr_destroy(&attr);
+	if (err)
+		goto out;
+
+	__RT(clock_gettime(CLOCK_MONOTONIC, &start));
+	err = ring_send(&r);
+	__RT(pthread_join(receiver, NULL));
+	__RT(clock_gettime(CLOCK_MONOTONIC, &end));
+
+	if (err == 0)
+		err = r.err;
+	if (err)
+		goto out;
+
+	ns = ts_diff(&end, &start);
+	hdr = r.base;
+
+	smokey_trace("%u/%u frames received, %.0f fps, %u lost, "
+		     "%u ring drops", r.received, nr_frames,
+		     r.received / (ns / 1000000000.0), r.lost, hdr->rx_drops);
+	if (r.received)
+		smokey_trace("latency min %.3f us, avg %.3f us, max %.3f us",
+			     r.lat_min / 1000.0,
+			     r.lat_sum / 1000.0 / r.received,
+			     r.lat_max / 1000.0);
+
+	if (r.received == 0) {
+		smokey_warning("no frame received");
+		err = -ENODATA;
+	}
+out:
+	close_ring(&r);
+
+	return err;
+}
+
+static int run_net_packet_ring(struct smokey_test *t,
+			       int argc, char *const argv[])
+{
+	struct sockaddr_ll peer;
+	int err, tmp;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(net_packet_ring, rtnet_frames))
+		nr_frames = SMOKEY_ARG_INT(net_packet_ring, rtnet_frames);
+	if (SMOKEY_ARG_ISSET(net_packet_ring, rtnet_batch))
+		batch = SMOKEY_ARG_INT(net_packet_ring, rtnet_batch);
+
+	if (nr_frames < 1 || batch < 1 || batch > RING_TX_FRAMES)
+		return -EINVAL;
+
+	memset(&peer, 0, sizeof(peer));
+	peer.sll_family = AF_PACKET;
+
+	err = smokey_net_setup("rt_loopback", "rtlo",
+			       _CC_COBALT_NET_AF_PACKET, &peer);
+	if (err < 0)
+		return err;
+
+	err = run_ring(&peer);
+
+	tmp = smokey_net_teardown("rt_loopback", "rtlo",
+				  _CC_COBALT_NET_AF_PACKET);
+	if (err == 0)
+		err = tmp;
+
+	return err;
+}
@@ -0,0 +1,340 @@
+/*
+ * RTnet UDP multi-flow throughput test over the loopback interface
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <sys/cobalt.h>
+#include <rtdm/net.h>
+#include <smokey/smokey.h>
+#include "smokey_net.h"
+
+smokey_test_plugin(net_udp_flows,
+	SMOKEY_ARGLIST(
+		SMOKEY_INT(rtnet_flows),
+		SMOKEY_INT(rtnet_packets),
+		SMOKEY_INT(rtnet_queues),
+	),
+	"Measure RTnet UDP throughput over rtlo with concurrent flows,\n"
+	"\tchecking that each flow is received in order, including\n"
+	"\twhen fragmented and unfragmented datagrams are mixed,\n"
+	"\tthe rtnet_flows parameter allows choosing the number of flows\n"
+	"\tthe rtnet_packets parameter allows choosing the packets per flow\n"
+	"\tthe rtnet_queues parameter pins flow n to TX queue n % rtnet_queues\n"
+	"\tLoad rt_loopback with rx_deferred=1 beforehand for packets to\n"
+	"\tgo through the stack manager tasks, and queues=<rtnet_queues>\n"
+	"\tfor software TX/RX queues."
+);
+
+#define FLOW_PORT_BASE	40000
+#define MAX_FLOWS	64
+#define MIXED_PACKETS	2000
+#define MIXED_SIZE	3000	/* fragmented over the 1500 bytes MTU */
+
+struct flow {
+	int index;
+	int rx_sock;
+	int tx_sock;
+	pthread_t sender;
+	pthread_t receiver;
+	unsigned int received;
+	unsigned int reordered;
+	int err;
+};
+
+static struct flow flows[MAX_FLOWS];
+static struct sockaddr_in loopback_addr;
+static unsigned int nr_packets = 100000;
+static int nr_queues;
+/* Size of every other datagram, zero to send payloads only. */
+static size_t large_size;
+
+static void *flow_receiver(void *arg)
+{
+	struct flow *f = arg;
+	struct smokey_net_payload payload;
+	unsigned int last = 0;
+	char buf[MIXED_SIZE];
+	int ret;
+
+	while (f->received < nr_packets) {
+		ret = __RT(recv(f->rx_sock, buf, sizeof(buf), 0));
+		if (ret < 0) {
+			/* Timed out, the rest was dropped. */
+			if (errno != ETIMEDOUT)
+				f->err = -errno;
+			break;
+		}
+		memcpy(&payload, buf, sizeof(payload));
+		if (f->received > 0 && payload.seq <= last)
+			f->reordered++;
+		last = payload.seq;
+		f->received++;
+	}
+
+	return NULL;
+}
+
+static void *flow_sender(void *arg)
+{
+	struct flow *f = arg;
+	struct smokey_net_payload payload;
+	char buf[MIXED_SIZE];
+	struct sockaddr_in to;
+	unsigned int seq;
+	size_t len;
+	int ret;
+
+	to = loopback_addr;
+	to.sin_port = htons(FLOW_PORT_BASE + f->index);
+	memset(&payload, 0, sizeof(payload));
+	memset(buf, 0, sizeof(buf));
+
+	for (seq = 0; seq < nr_packets; seq++) {
+		payload.seq = seq;
+		memcpy(buf, &payload, sizeof(payload));
+		len = large_size && (seq & 1) ? large_size : sizeof(payload);
+		ret = __RT(sendto(f->tx_sock, buf, len, 0,
+				  (struct sockaddr *)&to, sizeof(to)));
+		if (ret < 0) {
+			if (errno == ENOBUFS || errno == EAGAIN) {
+				/* Let the stack drain the pools. */
+				sched_yield();
+				seq--;
+				continue;
+			}
+			f->err = -errno;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int open_flow(struct flow *f, int index)
+{
+	int64_t timeout = 100000000;	/* 100 ms */
+	struct sockaddr_in addr;
+	int err, queue;
+
+	f->index = index;
+	f->received = f->reordered = 0;
+	f->err = 0;
+
+	f->rx_sock = smokey_check_errno(
+		__RT(socket(PF_INET, SOCK_DGRAM, 0)));
+	if (f->rx_sock < 0)
+		return f->rx_sock;
+
+	addr = loopback_addr;
+	addr.sin_port = htons(FLOW_PORT_BASE + index);
+	err = smokey_check_errno(
+		__RT(bind(f->rx_sock, (struct sockaddr *)&addr, sizeof(addr))));
+	if (err < 0)
+		goto fail_rx;
+
+	err = smokey_check_errno(
+		__RT(ioctl(f->rx_sock, RTNET_RTIOC_TIMEOUT, &timeout)));
+	if (err < 0)
+		goto fail_rx;
+
+	f->tx_sock = smokey_check_errno(
+		__RT(socket(PF_INET, SOCK_DGRAM, 0)));
+	if (f->tx_sock < 0) {
+		err = f->tx_sock;
+		goto fail_rx;
+	}
+
+	if (nr_queues > 0) {
+		queue = index % nr_queues;
+		err = smokey_check_errno(
+			__RT(ioctl(f->tx_sock, RTNET_RTIOC_TXQUEUE, &queue)));
+		if (err < 0)
+			goto fail_tx;
+	}
+
+	return 0;
+
+fail_tx:
+	__RT(close(f->tx_sock));
+fail_rx:
+	__RT(close(f->rx_sock));
+
+	return err;
+}
+
+static void close_flow(struct flow *f)
+{
+	__RT(close(f->tx_sock));
+	__RT(close(f->rx_sock));
+}
+
+static int start_thread(pthread_t *tid, int prio, void *(*fn)(void *),
+			struct flow *f)
+{
+	struct sched_param param = { .sched_priority = prio };
+	pthread_attr_t attr;
+	int err;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+	err = smokey_check_status(__RT(pthread_create(tid, &attr, fn, f)));
+	pthread_attr_destroy(&attr);
+
+	return err;
+}
+
+static int check_txqueue_option(void)
+{
+	int s, queue, ret, err = 0;
+
+	s = smokey_check_errno(__RT(socket(PF_INET, SOCK_DGRAM, 0)));
+	if (s < 0)
+		return s;
+
+	queue = 1 << 16;
+	ret = __RT(ioctl(s, RTNET_RTIOC_TXQUEUE, &queue));
+	if (!smokey_assert(ret < 0 && errno == EINVAL))
+		err = -EINVAL;
+
+	queue = SOCK_TXQUEUE_AUTO;
+	ret = smokey_check_errno(__RT(ioctl(s, RTNET_RTIOC_TXQUEUE, &queue)));
+	if (ret < 0 && err == 0)
+		err = ret;
+
+	__RT(close(s));
+
+	return err;
+}
+
+static int run_flows(int nr_flows)
+{
+	unsigned long long total = 0, reordered = 0, ns;
+	struct timespec start, end;
+	int n, opened, err = 0;
+
+	for (opened = 0; opened < nr_flows; opened++) {
+		err = open_flow(flows + opened, opened);
+		if (err)
+			goto out;
+	}
+
+	for (n = 0; n < nr_flows; n++) {
+		err = start_thread(&flows[n].receiver, 11, flow_receiver,
+				   flows + n);
+		if (err)
+			goto out;
+	}
+
+	__RT(clock_gettime(CLOCK_MONOTONIC, &start));
+
+	for (n = 0; n < nr_flows; n++) {
+		err = start_thread(&flows[n].sender, 10, flow_sender,
+				   flows + n);
+		if (err)
+			goto out;
+	}
+
+	for (n = 0; n < nr_flows; n++) {
+		__RT(pthread_join(flows[n].sender, NULL));
+		__RT(pthread_join(flows[n].receiver, NULL));
+		total += flows[n].received;
+		reordered += flows[n].reordered;
+		if (flows[n].err && err == 0)
+			err = flows[n].err;
+	}
+
+	__RT(clock_gettime(CLOCK_MONOTONIC, &end));
+
+	ns = (end.tv_sec - start.tv_sec) * 1000000000ULL +
+		end.tv_nsec - start.tv_nsec;
+
+	smokey_trace("%d flows: %llu/%llu packets received, %.0f pps, "
+		     "%llu reordered",
+		     nr_flows, total, (unsigned long long)nr_flows * nr_packets,
+		     total / (ns / 1000000000.0), reordered);
+
+	if (reordered) {
+		smokey_warning("packets delivered out of order");
+		err = -EPROTO;
+	}
+out:
+	while (opened-- > 0)
+		close_flow(flows + opened);
+
+	return err;
+}
+
+/*
+ * A socket receiving both fragmented and unfragmented datagrams must
+ * get them in order, which requires the stack to steer both kinds of
+ * frames to the same stack manager task.
+ */
+static int check_mixed_sizes(void)
+{
+	unsigned int saved_packets = nr_packets;
+	int err;
+
+	nr_packets = MIXED_PACKETS;
+	large_size = MIXED_SIZE;
+	err = run_flows(1);
+	large_size = 0;
+	nr_packets = saved_packets;
+
+	return err;
+}
+
+static int run_net_udp_flows(struct smokey_test *t,
+			     int argc, char *const argv[])
+{
+	int nr_flows = 4, err, tmp;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(net_udp_flows, rtnet_flows))
+		nr_flows = SMOKEY_ARG_INT(net_udp_flows, rtnet_flows);
+	if (SMOKEY_ARG_ISSET(net_udp_flows, rtnet_packets))
+		nr_packets = SMOKEY_ARG_INT(net_udp_flows, rtnet_packets);
+	if (SMOKEY_ARG_ISSET(net_udp_flows, rtnet_queues))
+		nr_queues = SMOKEY_ARG_INT(net_udp_flows, rtnet_queues);
+
+	if (nr_flows < 1 || nr_flows > MAX_FLOWS || nr_packets < 1 ||
+	    nr_queues < 0)
+		return -EINVAL;
+
+	memset(&loopback_addr, 0, sizeof(loopback_addr));
+	loopback_addr.sin_family = AF_INET;
+	loopback_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	err = smokey_net_setup("rt_loopback", "rtlo", _CC_COBALT_NET_UDP,
+			       &loopback_addr);
+	if (err < 0)
+		return err;
+
+	err = check_txqueue_option();
+	if (err == 0)
+		err = run_flows(1);
+	if (err == 0 && nr_flows > 1)
+		err = run_flows(nr_flows);
+	if (err == 0)
+		err = check_mixed_sizes();
+
+	tmp = smokey_net_teardown("rt_loopback", "rtlo", _CC_COBALT_NET_UDP);
+	if (err == 0)
+		err = tmp;
+
+	return err;
+}
@@ -0,0 +1,299 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(posix_epoll,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(fds),
+			   SMOKEY_INT(loops),
+		   ),
+		   "Check Cobalt poll sets (epoll), compare with select().\n"
+		   "\tfds=<count>\tnumber of descriptors in the benchmark set\n"
+		   "\tloops=<count>\tnumber of wait calls per measurement"
+);
+
+#define NR_CHECK_FDS	16
+
+static long long diff_ns(const struct timespec *t0, const struct timespec *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		t1->tv_nsec - t0->tv_nsec;
+}
+
+static int arm_timer(int fd, long ns)
+{
+	struct itimerspec its = {
+		.it_value = { .tv_sec = 0, .tv_nsec = ns },
+	};
+
+	return smokey_check_errno(timerfd_settime(fd, 0, &its, NULL));
+}
+
+static int ack_timer(int fd)
+{
+	uint64_t ticks;
+
+	return smokey_check_errno(read(fd, &ticks, sizeof(ticks)));
+}
+
+static int close_fds(int *fds, int nfds)
+{
+	int n;
+
+	for (n = 0; n < nfds; n++)
+		if (fds[n] >= 0)
+			close(fds[n]);
+
+	return 0;
+}
+
+static int open_fds(int epfd, int *fds, int nfds)
+{
+	struct epoll_event ev;
+	int n, ret;
+
+	for (n = 0; n < nfds; n++)
+		fds[n] = -1;
+
+	for (n = 0; n < nfds; n++) {
+		fds[n] = smokey_check_errno(timerfd_create(CLOCK_MONOTONIC,
+							   TFD_NONBLOCK));
+		if (fds[n] < 0)
+			return fds[n];
+		ev.events = EPOLLIN;
+		ev.data.u32 = n;
+		ret = smokey_check_errno(epoll_ctl(epfd, EPOLL_CTL_ADD,
+						   fds[n], &ev));
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int check_events(int epfd, int *fds)
+{
+	struct epoll_event ev, evs[NR_CHECK_FDS];
+	int ret, n, seen;
+
+	/* Nothing armed, nothing ready. */
+	ret = smokey_check_errno(epoll_wait(epfd, evs, NR_CHECK_FDS, 0));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(ret == 0))
+		return -EINVAL;
+
+	/* One expiry, exactly one event reported until acknowledged. */
+	ret = arm_timer(fds[5], 1000000);
+	if (ret)
+		return ret;
+	ret = smokey_check_errno(epoll_wait(epfd, evs, NR_CHECK_FDS, 1000));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(ret == 1) ||
+	    !smokey_assert(evs[0].data.u32 == 5) ||
+	    !smokey_assert(evs[0].events == EPOLLIN))
+		return -EINVAL;
+	ret = smokey_check_errno(epoll_wait(epfd, evs, NR_CHECK_FDS, 0));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(ret == 1))
+		return -EINVAL;
+	ret = ack_timer(fds[5]);
+	if (ret < 0)
+		return ret;
+	ret = smokey_check_errno(epoll_wait(epfd, evs, NR_CHECK_FDS, 0));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(ret == 0))
+		return -EINVAL;
+
+	/* Three ready descriptors collected two at a time. */
+	for (n = 1; n <= 3; n++) {
+		ret = arm_timer(fds[n], 1000000);
+		if (ret)
+			return ret;
+	}
+	usleep(10000);
+	ret = smokey_check_errno(epoll_wait(epfd, evs, 2, 0));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(ret == 2))
+		return -EINVAL;
+	seen = 0;
+	for (n = 0; n < ret; n++) {
+		seen |= 1 << evs[n].data.u32;
+		ack_timer(fds[evs[n].data.u32]);
+	}
+	ret = smokey_check_errno(epoll_wait(epfd, evs, 2, 0));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(ret == 1))
+		return -EINVAL;
+	seen |= 1 << evs[0].data.u32;
+	ack_timer(fds[evs[0].data.u32]);
+	if (!smokey_assert(seen == 0xe))
+		return -EINVAL;
+
+	/* Control operations. */
+	ev.events = EPOLLIN;
+	ev.data.u32 = 0;
+	if (!smokey_assert(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev) < 0 &&
+			   errno == EEXIST))
+		return -EINVAL;
+	ret = smokey_check_errno(epoll_ctl(epfd, EPOLL_CTL_DEL, fds[0], NULL));
+	if (ret)
+		return ret;
+	if (!smokey_assert(epoll_ctl(epfd, EPOLL_CTL_DEL, fds[0], NULL) < 0 &&
+			   errno == ENOENT))
+		return -EINVAL;
+	ret = arm_timer(fds[0], 1000000);
+	if (ret)
+		return ret;
+	usleep(10000);
+	ret = smokey_check_errno(epoll_wait(epfd, evs, NR_CHECK_FDS, 0));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(ret == 0))
+		return -EINVAL;
+	ret = smokey_check_errno(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev));
+	if (ret)
+		return ret;
+	ret = smokey_check_errno(epoll_wait(epfd, evs, NR_CHECK_FDS, 0));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(ret == 1) || !smokey_assert(evs[0].data.u32 == 0))
+		return -EINVAL;
+	ack_timer(fds[0]);
+
+	/* A closed descriptor leaves the set. */
+	close(fds[7]);
+	fds[7] = smokey_check_errno(timerfd_create(CLOCK_MONOTONIC,
+						   TFD_NONBLOCK));
+	if (fds[7] < 0)
+		return fds[7];
+	ev.data.u32 = 7;
+	ret = smokey_check_errno(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[7], &ev));
+	if (ret)
+		return ret;
+
+	/* Timeout. */
+	ret = smokey_check_errno(epoll_wait(epfd, evs, NR_CHECK_FDS, 10));
+	if (ret < 0)
+		return ret;
+	if (!smokey_assert(ret == 0))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int bench_wait(int epfd, int *fds, int nfds, int loops)
+{
+	struct timeval tv, tv0 = { 0, 0 };
+	struct timespec t0, t1;
+	struct epoll_event evs[4];
+	fd_set rfds, in;
+	int n, ret, maxfd;
+
+	/* Leave the last descriptor of the set ready. */
+	ret = arm_timer(fds[nfds - 1], 1000);
+	if (ret)
+		return ret;
+	usleep(1000);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < loops; n++) {
+		ret = epoll_wait(epfd, evs, 4, 0);
+		if (!smokey_assert(ret == 1))
+			return ret < 0 ? -errno : -EINVAL;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	smokey_trace("epoll_wait(), %4d fds: %6lld ns/call",
+		     nfds, diff_ns(&t0, &t1) / loops);
+
+	FD_ZERO(&in);
+	for (n = 0, maxfd = 0; n < nfds; n++) {
+		FD_SET(fds[n], &in);
+		if (fds[n] > maxfd)
+			maxfd = fds[n];
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < loops; n++) {
+		rfds = in;
+		tv = tv0;
+		ret = select(maxfd + 1, &rfds, NULL, NULL, &tv);
+		if (!smokey_assert(ret == 1))
+			return ret < 0 ? -errno : -EINVAL;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	smokey_trace("select(),     %4d fds: %6lld ns/call",
+		     nfds, diff_ns(&t0, &t1) / loops);
+
+	return ack_timer(fds[nfds - 1]) < 0 ? -EINVAL : 0;
+}
+
+static int run_posix_epoll(struct smokey_test *t, int argc, char *const argv[])
+{
+	int epfd, ret, *fds, nfds = 512, loops = 10000, sizes[] = { 16, 64, 0 };
+	int n;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(posix_epoll, fds))
+		nfds = SMOKEY_ARG_INT(posix_epoll, fds);
+	if (SMOKEY_ARG_ISSET(posix_epoll, loops))
+		loops = SMOKEY_ARG_INT(posix_epoll, loops);
+	if (nfds < NR_CHECK_FDS || nfds > FD_SETSIZE - 64 || loops <= 0)
+		return -EINVAL;
+
+	fds = malloc(nfds * sizeof(*fds));
+	if (fds == NULL)
+		return -ENOMEM;
+
+	epfd = smokey_check_errno(epoll_create1(0));
+	if (epfd < 0) {
+		ret = epfd;
+		goto out;
+	}
+
+	ret = open_fds(epfd, fds, NR_CHECK_FDS);
+	if (ret == 0)
+		ret = check_events(epfd, fds);
+	close_fds(fds, NR_CHECK_FDS);
+	close(epfd);
+	if (ret)
+		goto out;
+
+	sizes[2] = nfds;
+	for (n = 0; n < 3; n++) {
+		if (sizes[n] > nfds || (n > 0 && sizes[n] <= sizes[n - 1]))
+			continue;
+		epfd = smokey_check_errno(epoll_create1(0));
+		if (epfd < 0) {
+			ret = epfd;
+			break;
+		}
+		ret = open_fds(epfd, fds, sizes[n]);
+		if (ret == 0)
+			ret = bench_wait(epfd, fds, sizes[n], loops);
+		close_fds(fds, sizes[n]);
+		close(epfd);
+		if (ret)
+			break;
+	}
+out:
+	free(fds);
+
+	return ret;
+}
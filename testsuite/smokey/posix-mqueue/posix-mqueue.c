@@ -0,0 +1,375 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <mqueue.h>
+#include <sys/select.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(posix_mqueue,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Check POSIX message queues, regular and shared (zero-copy).\n"
+		   "\tloops=<count>\tnumber of messages per measurement"
+);
+
+#define MQ_NAME		"/smokey-mqueue"
+#define MQ_MAXMSG	8
+#define MQ_MSGSIZE	64
+
+struct receiver {
+	mqd_t mqd;
+	char buf[MQ_MSGSIZE];
+	int status;
+};
+
+static long long diff_ns(const struct timespec *t0, const struct timespec *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		t1->tv_nsec - t0->tv_nsec;
+}
+
+static mqd_t open_queue(int oflags, long flags, long maxmsg, long msgsize)
+{
+	struct mq_attr attr = {
+		.mq_flags = flags,
+		.mq_maxmsg = maxmsg,
+		.mq_msgsize = msgsize,
+	};
+
+	mq_unlink(MQ_NAME);
+
+	return smokey_check_errno(mq_open(MQ_NAME, oflags | O_CREAT | O_EXCL,
+					  0600, &attr));
+}
+
+static void close_queue(mqd_t mqd)
+{
+	mq_close(mqd);
+	mq_unlink(MQ_NAME);
+}
+
+static int check_ordering(long flags)
+{
+	static const unsigned int prios[] = { 1, 5, 3, 5, 0 };
+	static const char *order[] = { "b", "d", "c", "a", "e" };
+	char buf[MQ_MSGSIZE], msg[2] = "a";
+	struct mq_attr attr;
+	unsigned int prio;
+	int n, ret = 0;
+	mqd_t mqd;
+
+	mqd = open_queue(O_RDWR | O_NONBLOCK, flags, MQ_MAXMSG, MQ_MSGSIZE);
+	if (mqd < 0)
+		return mqd;
+
+	for (n = 0; n < 5; n++, msg[0]++) {
+		ret = smokey_check_errno(mq_send(mqd, msg, 2, prios[n]));
+		if (ret)
+			goto out;
+	}
+
+	ret = smokey_check_errno(mq_getattr(mqd, &attr));
+	if (ret)
+		goto out;
+	if (!smokey_assert(attr.mq_curmsgs == 5) ||
+	    !smokey_assert(attr.mq_maxmsg == MQ_MAXMSG) ||
+	    !smokey_assert(attr.mq_msgsize == MQ_MSGSIZE)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* Higher priorities first, FIFO order among equals. */
+	for (n = 0; n < 5; n++) {
+		ret = smokey_check_errno(mq_receive(mqd, buf, sizeof(buf), &prio));
+		if (ret < 0)
+			goto out;
+		if (!smokey_assert(ret == 2) ||
+		    !smokey_assert(strcmp(buf, order[n]) == 0)) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	if (!smokey_assert(mq_receive(mqd, buf, sizeof(buf), &prio) < 0 &&
+			   errno == EAGAIN)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (n = 0; n < MQ_MAXMSG; n++) {
+		ret = smokey_check_errno(mq_send(mqd, buf, 1, 0));
+		if (ret)
+			goto out;
+	}
+
+	if (!smokey_assert(mq_send(mqd, buf, 1, 0) < 0 && errno == EAGAIN) ||
+	    !smokey_assert(mq_receive(mqd, buf, MQ_MSGSIZE - 1, &prio) < 0 &&
+			   errno == EMSGSIZE)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = smokey_check_errno(mq_receive(mqd, buf, sizeof(buf), &prio));
+	if (ret < 0)
+		goto out;
+
+	if (!smokey_assert(mq_send(mqd, buf, MQ_MSGSIZE + 1, 0) < 0 &&
+			   errno == EMSGSIZE))
+		ret = -EINVAL;
+	else
+		ret = 0;
+out:
+	close_queue(mqd);
+
+	return ret;
+}
+
+static void *receiver_thread(void *arg)
+{
+	struct receiver *r = arg;
+	int ret;
+
+	ret = mq_receive(r->mqd, r->buf, sizeof(r->buf), NULL);
+	r->status = ret < 0 ? -errno : 0;
+
+	return NULL;
+}
+
+static int check_blocking(long flags)
+{
+	struct receiver r = { .status = -EINVAL };
+	struct timespec ts;
+	char buf[MQ_MSGSIZE];
+	pthread_t tid;
+	int ret;
+
+	r.mqd = open_queue(O_RDWR, flags, MQ_MAXMSG, MQ_MSGSIZE);
+	if (r.mqd < 0)
+		return r.mqd;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += 10000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_nsec -= 1000000000;
+		ts.tv_sec++;
+	}
+	if (!smokey_assert(mq_timedreceive(r.mqd, buf, sizeof(buf),
+					   NULL, &ts) < 0 &&
+			   errno == ETIMEDOUT)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = smokey_check_status(pthread_create(&tid, NULL,
+						 receiver_thread, &r));
+	if (ret)
+		goto out;
+
+	usleep(10000);
+	ret = smokey_check_errno(mq_send(r.mqd, "wakeup", 7, 0));
+	pthread_join(tid, NULL);
+	if (ret)
+		goto out;
+
+	if (!smokey_assert(r.status == 0) ||
+	    !smokey_assert(strcmp(r.buf, "wakeup") == 0))
+		ret = -EINVAL;
+out:
+	close_queue(r.mqd);
+
+	return ret;
+}
+
+static int check_notify(long flags)
+{
+	struct timespec ts = { .tv_sec = 1, .tv_nsec = 0 };
+	struct sigevent sev;
+	char buf[MQ_MSGSIZE];
+	sigset_t set;
+	siginfo_t si;
+	int ret, sig;
+	mqd_t mqd;
+
+	mqd = open_queue(O_RDWR | O_NONBLOCK, flags, MQ_MAXMSG, MQ_MSGSIZE);
+	if (mqd < 0)
+		return mqd;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = SIGUSR1;
+	sev.sigev_value.sival_int = 42;
+	ret = smokey_check_errno(mq_notify(mqd, &sev));
+	if (ret)
+		goto out;
+
+	ret = smokey_check_errno(mq_send(mqd, "notify", 7, 0));
+	if (ret)
+		goto out;
+
+	sig = sigtimedwait(&set, &si, &ts);
+	if (!smokey_assert(sig == SIGUSR1) ||
+	    !smokey_assert(si.si_code == SI_MESGQ) ||
+	    !smokey_assert(si.si_value.sival_int == 42)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* One-shot: the next arrival into an empty queue is silent. */
+	ret = smokey_check_errno(mq_receive(mqd, buf, sizeof(buf), NULL));
+	if (ret < 0)
+		goto out;
+	ret = smokey_check_errno(mq_send(mqd, "notify", 7, 0));
+	if (ret)
+		goto out;
+	ts.tv_sec = 0;
+	ts.tv_nsec = 10000000;
+	if (!smokey_assert(sigtimedwait(&set, &si, &ts) < 0))
+		ret = -EINVAL;
+out:
+	pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+	close_queue(mqd);
+
+	return ret;
+}
+
+static int check_select(long flags)
+{
+	struct timeval tv = { 0, 0 };
+	fd_set rfds, wfds;
+	char buf[MQ_MSGSIZE];
+	int n, ret;
+	mqd_t mqd;
+
+	mqd = open_queue(O_RDWR | O_NONBLOCK, flags, 2, MQ_MSGSIZE);
+	if (mqd < 0)
+		return mqd;
+
+	for (n = 0; n <= 2; n++) {
+		FD_ZERO(&rfds);
+		FD_SET(mqd, &rfds);
+		FD_ZERO(&wfds);
+		FD_SET(mqd, &wfds);
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		ret = smokey_check_errno(select(mqd + 1, &rfds, &wfds,
+						NULL, &tv));
+		if (ret < 0)
+			goto out;
+		if (!smokey_assert(!!FD_ISSET(mqd, &rfds) == (n > 0)) ||
+		    !smokey_assert(!!FD_ISSET(mqd, &wfds) == (n < 2))) {
+			ret = -EINVAL;
+			goto out;
+		}
+		if (n < 2) {
+			ret = smokey_check_errno(mq_send(mqd, "x", 1, 0));
+			if (ret)
+				goto out;
+		}
+	}
+
+	for (n = 0; n < 2; n++) {
+		ret = smokey_check_errno(mq_receive(mqd, buf, sizeof(buf), NULL));
+		if (ret < 0)
+			goto out;
+	}
+
+	FD_ZERO(&rfds);
+	FD_SET(mqd, &rfds);
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	ret = smokey_check_errno(select(mqd + 1, &rfds, NULL, NULL, &tv));
+	if (ret < 0)
+		goto out;
+	if (!smokey_assert(ret == 0))
+		ret = -EINVAL;
+out:
+	close_queue(mqd);
+
+	return ret;
+}
+
+static int bench_queue(long flags, int loops, long long *ns)
+{
+	char buf[MQ_MSGSIZE];
+	struct timespec t0, t1;
+	int n, ret = 0;
+	mqd_t mqd;
+
+	mqd = open_queue(O_RDWR | O_NONBLOCK, flags, MQ_MAXMSG, MQ_MSGSIZE);
+	if (mqd < 0)
+		return mqd;
+
+	memset(buf, 0xa5, sizeof(buf));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < loops; n++) {
+		if (mq_send(mqd, buf, sizeof(buf), n & 7) ||
+		    mq_receive(mqd, buf, sizeof(buf), NULL) < 0) {
+			ret = -errno;
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	close_queue(mqd);
+
+	*ns = diff_ns(&t0, &t1) / loops;
+
+	return ret;
+}
+
+static int run_posix_mqueue(struct smokey_test *t, int argc, char *const argv[])
+{
+	static const struct {
+		const char *name;
+		long flags;
+	} kinds[] = {
+		{ "regular", 0 },
+		{ "shared", COBALT_MQ_SHARED },
+	};
+	long long ns[2] = { 0, 0 };
+	int loops = 100000, n, ret;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(posix_mqueue, loops))
+		loops = SMOKEY_ARG_INT(posix_mqueue, loops);
+
+	if (loops <= 0)
+		return -EINVAL;
+
+	for (n = 0; n < 2; n++) {
+		smokey_trace("checking %s queues", kinds[n].name);
+		ret = check_ordering(kinds[n].flags);
+		if (ret == 0)
+			ret = check_blocking(kinds[n].flags);
+		if (ret == 0)
+			ret = check_notify(kinds[n].flags);
+		if (ret == 0)
+			ret = check_select(kinds[n].flags);
+		if (ret == 0)
+			ret = bench_queue(kinds[n].flags, loops, ns + n);
+		if (ret) {
+			smokey_warning("%s queue check failed: %s",
+				       kinds[n].name, strerror(-ret));
+			return ret;
+		}
+		smokey_trace("%-8s send+receive: %6lld ns/msg",
+			     kinds[n].name, ns[n]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <smokey/smokey.h>
+#include <rtdm/testing.h>
+
+smokey_test_plugin(timer_queue,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Measure the cost of timer queue insertion and removal\n"
+		   "\twith 10, 1k and 100k outstanding timers, then check that\n"
+		   "\tthe timers expire in date order, stopped ones excepted.\n"
+		   "\tloops=<count>\tnumber of remove/insert cycles per run"
+);
+
+smokey_test_plugin(sched_pick,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Measure the cost of picking the next thread to run from\n"
+		   "\ta runnable queue with 1, 10, 100 and 1000 ready threads.\n"
+		   "\tloops=<count>\tnumber of pick/requeue cycles per run"
+);
+
+/*
+ * Both benchmarks run the same loop in a testing driver, for an
+ * increasing number of queued items.
+ */
+struct queue_bench {
+	const char *device;
+	const unsigned int *sizes;
+	unsigned int nrsizes;
+	int (*run)(int fd, unsigned int size, int loops);
+};
+
+static int run_queue_bench(const struct queue_bench *b, int loops)
+{
+	int fd, ret = 0;
+	unsigned int n;
+
+	if (loops <= 0)
+		return -EINVAL;
+
+	fd = open(b->device, O_RDWR);
+	if (fd < 0) {
+		smokey_warning("%s not available", b->device);
+		return -ENOSYS;
+	}
+
+	for (n = 0; n < b->nrsizes; n++) {
+		ret = b->run(fd, b->sizes[n], loops);
+		if (ret)
+			break;
+	}
+
+	close(fd);
+
+	return ret;
+}
+
+static int run_timer_queue_size(int fd, unsigned int size, int loops)
+{
+	struct rttst_tmqueue_parms parms;
+
+	parms.nrtimers = size;
+	parms.loops = loops;
+	if (!smokey_assert(ioctl(fd, RTTST_RTIOC_TMBENCH_QUEUE, &parms) == 0))
+		return -errno;
+
+	smokey_trace("%6u timers: insert avg %Ld ns, max %Ld ns | "
+		     "remove avg %Ld ns, max %Ld ns",
+		     parms.nrtimers,
+		     (long long)parms.insert_avg_ns,
+		     (long long)parms.insert_max_ns,
+		     (long long)parms.remove_avg_ns,
+		     (long long)parms.remove_max_ns);
+
+	if (!smokey_assert(parms.missed == 0) ||
+	    !smokey_assert(parms.misordered == 0) ||
+	    !smokey_assert(parms.stray == 0)) {
+		smokey_warning("%u timers: %u missed, %u misordered, "
+			       "%u stray expiries", parms.nrtimers,
+			       parms.missed, parms.misordered, parms.stray);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static const unsigned int nrtimers[] = { 10, 1000, 100000 };
+
+static int run_timer_queue(struct smokey_test *t, int argc, char *const argv[])
+{
+	static const struct queue_bench bench = {
+		.device = "/dev/rtdm/timerbench",
+		.sizes = nrtimers,
+		.nrsizes = sizeof(nrtimers) / sizeof(nrtimers[0]),
+		.run = run_timer_queue_size,
+	};
+	int loops = 100000;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(timer_queue, loops))
+		loops = SMOKEY_ARG_INT(timer_queue, loops);
+
+	return run_queue_bench(&bench, loops);
+}
+
+static int run_sched_pick_size(int fd, unsigned int size, int loops)
+{
+	struct rttst_schedq_parms parms;
+	int ret;
+
+	parms.nrthreads = size;
+	parms.loops = loops;
+	ret = ioctl(fd, RTTST_RTIOC_SWTEST_PICK_BENCH, &parms);
+	if (ret && errno == ENOSYS) {
+		smokey_warning("switchtest is not built into the kernel");
+		return -ENOSYS;
+	}
+	if (!smokey_assert(ret == 0))
+		return -errno;
+
+	smokey_trace("%4u threads: pick avg %Ld ns, max %Ld ns | "
+		     "requeue avg %Ld ns, max %Ld ns",
+		     parms.nrthreads,
+		     (long long)parms.pick_avg_ns,
+		     (long long)parms.pick_max_ns,
+		     (long long)parms.requeue_avg_ns,
+		     (long long)parms.requeue_max_ns);
+
+	return 0;
+}
+
+static const unsigned int nrthreads[] = { 1, 10, 100, 1000 };
+
+static int run_sched_pick(struct smokey_test *t, int argc, char *const argv[])
+{
+	static const struct queue_bench bench = {
+		.device = "/dev/rtdm/switchtest",
+		.sizes = nrthreads,
+		.nrsizes = sizeof(nrthreads) / sizeof(nrthreads[0]),
+		.run = run_sched_pick_size,
+	};
+	int loops = 100000;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(sched_pick, loops))
+		loops = SMOKEY_ARG_INT(sched_pick, loops);
+
+	return run_queue_bench(&bench, loops);
+}
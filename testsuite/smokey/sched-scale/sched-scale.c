@@ -0,0 +1,306 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/cobalt.h>
+#include <smokey/smokey.h>
+#include <rtdm/testing.h>
+
+smokey_test_plugin(sched_scale,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(loops),
+		   ),
+		   "Measure the scalability of context switches, running one\n"
+		   "\tindependent pair of threads per CPU, each pair switching\n"
+		   "\tthrough its own switchtest context. Wakeups are serialized\n"
+		   "\tby nklock, this gives the contention baseline of the core lock.\n"
+		   "\tloops=<count>\tnumber of round-trips per pair and run"
+);
+
+struct pair_context {
+	pthread_t ping_tid;
+	pthread_t pong_tid;
+	int cpu;
+	int loops;
+	int fd;
+	struct rttst_swtest_task ping;
+	struct rttst_swtest_task pong;
+	pid_t pong_pid;
+	sem_t *start;
+	sem_t ready;
+	long long elapsed_ns;
+	int status;
+};
+
+static long long diff_ns(const struct timespec *t0, const struct timespec *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		t1->tv_nsec - t0->tv_nsec;
+}
+
+static void *pong_thread(void *arg)
+{
+	struct pair_context *p = arg;
+	struct rttst_swtest_dir rtsw;
+	int err;
+
+	rtsw.from = p->pong.index;
+	rtsw.to = p->ping.index;
+	rtsw.switch_mode = 0;
+
+	/*
+	 * ioctl is not a cancellation point, but we are cancelled
+	 * while switched out once the ping side is done.
+	 */
+	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+
+	p->pong_pid = syscall(SYS_gettid);
+	sem_post(&p->ready);
+
+	do
+		err = ioctl(p->fd, RTTST_RTIOC_SWTEST_PEND, &p->pong);
+	while (err == -1 && errno == EINTR);
+
+	while (err == 0) {
+		err = ioctl(p->fd, RTTST_RTIOC_SWTEST_SWITCH_TO, &rtsw);
+		while (err == -1 && errno == EINTR)
+			err = ioctl(p->fd, RTTST_RTIOC_SWTEST_PEND, &p->pong);
+	}
+
+	p->status = err < 0 ? -errno : -EPROTO;
+
+	return NULL;
+}
+
+/*
+ * The driver can only hand over to a thread which is waiting in
+ * real-time mode already.
+ */
+static int wait_pong_pending(struct pair_context *p)
+{
+	struct timespec nap = { .tv_sec = 0, .tv_nsec = 100000 };
+	struct cobalt_threadstat stat;
+	int ret;
+
+	sem_wait(&p->ready);
+
+	for (;;) {
+		ret = cobalt_thread_stat(p->pong_pid, &stat);
+		if (ret)
+			return ret;
+		if (stat.status & XNPEND)
+			return 0;
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &nap, NULL);
+	}
+}
+
+static void *ping_thread(void *arg)
+{
+	struct pair_context *p = arg;
+	struct rttst_swtest_dir rtsw;
+	struct timespec t0, t1;
+	int n, ret;
+
+	rtsw.from = p->ping.index;
+	rtsw.to = p->pong.index;
+	rtsw.switch_mode = 0;
+
+	ret = wait_pong_pending(p);
+	if (ret) {
+		p->status = ret;
+		return NULL;
+	}
+
+	sem_wait(p->start);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < p->loops; n++) {
+		ret = ioctl(p->fd, RTTST_RTIOC_SWTEST_SWITCH_TO, &rtsw);
+		if (ret) {
+			p->status = ret < 0 ? -errno : -EPROTO;
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	p->elapsed_ns = diff_ns(&t0, &t1);
+
+	return NULL;
+}
+
+/* Set up a switchtest context with two user tasks on @p->cpu. */
+static int open_pair(struct pair_context *p)
+{
+	p->fd = open("/dev/rtdm/switchtest", O_RDWR);
+	if (p->fd < 0)
+		return -ENOSYS;
+
+	p->ping.flags = 0;
+	p->pong.flags = 0;
+	if (ioctl(p->fd, RTTST_RTIOC_SWTEST_SET_TASKS_COUNT, 2) ||
+	    ioctl(p->fd, RTTST_RTIOC_SWTEST_SET_CPU, p->cpu) ||
+	    ioctl(p->fd, RTTST_RTIOC_SWTEST_REGISTER_UTASK, &p->ping) ||
+	    ioctl(p->fd, RTTST_RTIOC_SWTEST_REGISTER_UTASK, &p->pong)) {
+		close(p->fd);
+		return -errno;
+	}
+
+	return 0;
+}
+
+static int create_thread(pthread_t *tid, int cpu, int prio,
+			 void *(*entry)(void *), void *arg)
+{
+	struct sched_param param;
+	pthread_attr_t attr;
+	cpu_set_t set;
+	int ret;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = prio;
+	pthread_attr_setschedparam(&attr, &param);
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	ret = pthread_create(tid, &attr, entry, arg);
+	pthread_attr_destroy(&attr);
+
+	return -ret;
+}
+
+static int run_pairs(int *cpus, int nrpairs, int loops,
+		     long long *rate)
+{
+	long long max_ns = 0, sum_ns = 0;
+	struct pair_context *ctx;
+	int n, nrstarted, ret = 0;
+	sem_t start;
+
+	ctx = calloc(nrpairs, sizeof(*ctx));
+	if (ctx == NULL)
+		return -ENOMEM;
+
+	sem_init(&start, 0, 0);
+
+	for (n = 0; n < nrpairs; n++) {
+		ctx[n].cpu = cpus[n];
+		ctx[n].loops = loops;
+		ctx[n].start = &start;
+		ret = open_pair(&ctx[n]);
+		if (ret)
+			break;
+		sem_init(&ctx[n].ready, 0, 0);
+		ret = create_thread(&ctx[n].pong_tid, cpus[n], 10,
+				    pong_thread, &ctx[n]);
+		if (ret) {
+			sem_destroy(&ctx[n].ready);
+			close(ctx[n].fd);
+			break;
+		}
+		ret = create_thread(&ctx[n].ping_tid, cpus[n], 10,
+				    ping_thread, &ctx[n]);
+		if (ret) {
+			pthread_cancel(ctx[n].pong_tid);
+			pthread_join(ctx[n].pong_tid, NULL);
+			sem_destroy(&ctx[n].ready);
+			close(ctx[n].fd);
+			break;
+		}
+	}
+
+	/* Release all pairs at once, the switch loops should overlap. */
+	nrstarted = n;
+	for (n = 0; n < nrstarted; n++)
+		sem_post(&start);
+
+	/* The pong side stays switched out after the last round-trip. */
+	for (n = 0; n < nrstarted; n++) {
+		pthread_join(ctx[n].ping_tid, NULL);
+		pthread_cancel(ctx[n].pong_tid);
+		pthread_join(ctx[n].pong_tid, NULL);
+		sem_destroy(&ctx[n].ready);
+		close(ctx[n].fd);
+		if (ctx[n].status) {
+			ret = ctx[n].status;
+			continue;
+		}
+		sum_ns += ctx[n].elapsed_ns;
+		if (ctx[n].elapsed_ns > max_ns)
+			max_ns = ctx[n].elapsed_ns;
+	}
+
+	sem_destroy(&start);
+	free(ctx);
+
+	if (ret == 0 && max_ns > 0) {
+		/* Two context switches per round-trip. */
+		*rate = 2LL * nrpairs * loops * 1000000000LL / max_ns;
+		smokey_trace("%3d CPU(s): %6lld ns/switch, %10lld switches/s",
+			     nrpairs, sum_ns / (2LL * nrpairs * loops), *rate);
+	}
+
+	return ret;
+}
+
+static int run_sched_scale(struct smokey_test *t, int argc, char *const argv[])
+{
+	int loops = 100000, nrcpus = 0, cpu, n, ret = 0;
+	long long rate = 0, base = 0;
+	cpu_set_t online;
+	int *cpus;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(sched_scale, loops))
+		loops = SMOKEY_ARG_INT(sched_scale, loops);
+
+	if (loops <= 0)
+		return -EINVAL;
+
+	if (sched_getaffinity(0, sizeof(online), &online))
+		return -errno;
+
+	cpus = malloc(CPU_COUNT(&online) * sizeof(*cpus));
+	if (cpus == NULL)
+		return -ENOMEM;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &online))
+			cpus[nrcpus++] = cpu;
+	}
+
+	for (n = 1; n <= nrcpus; n++) {
+		ret = run_pairs(cpus, n, loops, &rate);
+		if (ret == -ENOSYS) {
+			smokey_warning("/dev/rtdm/switchtest not available");
+			break;
+		}
+		if (ret) {
+			smokey_warning("switch run on %d CPU(s) failed: %s",
+				       n, strerror(-ret));
+			break;
+		}
+		if (n == 1)
+			base = rate;
+		else if (base > 0)
+			smokey_trace("%3d CPU(s): scaling efficiency %lld%%",
+				     n, rate * 100 / (base * n));
+	}
+
+	free(cpus);
+
+	return ret;
+}
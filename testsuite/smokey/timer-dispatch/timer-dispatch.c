@@ -0,0 +1,176 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#ifdef CONFIG_XENO_COBALT
+#include <sys/cobalt.h>
+#endif
+#include <copperplate/clockobj.h>
+#include <copperplate/timerobj.h>
+#include <smokey/smokey.h>
+
+smokey_test_plugin(timer_dispatch,
+		   SMOKEY_ARGLIST(
+			   SMOKEY_INT(duration),
+		   ),
+		   "Measure the dispatch jitter of Copperplate timers with\n"
+		   "\t10, 1k and 10k outstanding periodic timers. Each timer\n"
+		   "\tneeds a core timer, runs beyond CONFIG_XENO_OPT_NRTIMERS\n"
+		   "\tare not performed.\n"
+		   "\tduration=<ms>\tlength of each run"
+);
+
+static const int nrtimers[] = { 10, 1000, 10000 };
+
+struct test_timer {
+	struct timerobj tmobj;
+	long long max_ns;
+	long long sum_ns;
+	unsigned long shots;
+};
+
+static long long diff_ns(const struct timespec *t0, const struct timespec *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000LL +
+		t1->tv_nsec - t0->tv_nsec;
+}
+
+static void timer_handler(struct timerobj *tmobj)
+{
+	struct test_timer *t = container_of(tmobj, struct test_timer, tmobj);
+	struct timespec now, date;
+	long long late;
+
+	__RT(clock_gettime(CLOCK_COPPERPLATE, &now));
+	/* it_value was reloaded before we got called. */
+	timespec_sub(&date, &tmobj->itspec.it_value,
+		     &tmobj->itspec.it_interval);
+	late = diff_ns(&date, &now);
+	if (late > t->max_ns)
+		t->max_ns = late;
+	t->sum_ns += late;
+	t->shots++;
+}
+
+static int run_timers(int count, int duration_ms)
+{
+	long long period_ns, max_ns = 0, sum_ns = 0, offset;
+	unsigned long shots = 0;
+	struct test_timer *timers;
+	struct itimerspec its;
+	struct timespec now;
+	int n, nrinit, ret = 0;
+
+	timers = calloc(count, sizeof(*timers));
+	if (timers == NULL)
+		return -ENOMEM;
+
+	for (nrinit = 0; nrinit < count; nrinit++) {
+		ret = timerobj_init(&timers[nrinit].tmobj);
+		if (ret)
+			goto out;
+	}
+
+	/* Keep the overall rate at ~100k shots per second. */
+	period_ns = 10000000LL * (count > 1000 ? count / 1000 : 1);
+	__RT(clock_gettime(CLOCK_COPPERPLATE, &now));
+
+	for (n = 0; n < count; n++) {
+		/* Spread the first shots evenly over a period. */
+		offset = 10000000LL + period_ns * n / count;
+		timespec_adds(&its.it_value, &now, offset);
+		its.it_interval.tv_sec = period_ns / 1000000000LL;
+		its.it_interval.tv_nsec = period_ns % 1000000000LL;
+		timerobj_lock(&timers[n].tmobj);
+		ret = timerobj_start(&timers[n].tmobj, timer_handler, &its);
+		if (ret) {
+			while (--n >= 0) {
+				timerobj_lock(&timers[n].tmobj);
+				timerobj_stop(&timers[n].tmobj);
+			}
+			goto out;
+		}
+	}
+
+	usleep(duration_ms * 1000);
+
+	for (n = 0; n < count; n++) {
+		timerobj_lock(&timers[n].tmobj);
+		timerobj_stop(&timers[n].tmobj);
+		if (timers[n].max_ns > max_ns)
+			max_ns = timers[n].max_ns;
+		sum_ns += timers[n].sum_ns;
+		shots += timers[n].shots;
+	}
+
+	if (!smokey_assert(shots > 0)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	smokey_trace("%5d timers: %8lu shots, jitter avg %6lld ns, max %8lld ns",
+		     count, shots, sum_ns / (long long)shots, max_ns);
+out:
+	for (n = 0; n < nrinit; n++) {
+		timerobj_lock(&timers[n].tmobj);
+		timerobj_destroy(&timers[n].tmobj);
+	}
+
+	free(timers);
+
+	return ret;
+}
+
+/* How many core timers a process may create. */
+static int get_max_timers(void)
+{
+#ifdef CONFIG_XENO_COBALT
+	int nrtimers;
+
+	if (cobalt_corectl(_CC_COBALT_GET_NR_TIMERS,
+			   &nrtimers, sizeof(nrtimers)) == 0)
+		return nrtimers;
+#endif
+	return INT_MAX;
+}
+
+static int run_timer_dispatch(struct smokey_test *t,
+			      int argc, char *const argv[])
+{
+	int duration_ms = 1000, maxtimers, ret = 0;
+	unsigned int n;
+
+	smokey_parse_args(t, argc, argv);
+
+	if (SMOKEY_ARG_ISSET(timer_dispatch, duration))
+		duration_ms = SMOKEY_ARG_INT(timer_dispatch, duration);
+
+	if (duration_ms <= 0)
+		return -EINVAL;
+
+	maxtimers = get_max_timers();
+
+	for (n = 0; n < sizeof(nrtimers) / sizeof(nrtimers[0]); n++) {
+		if (nrtimers[n] > maxtimers) {
+			smokey_note("timer_dispatch: %d timers need "
+				    "CONFIG_XENO_OPT_NRTIMERS >= %d (is %d), "
+				    "not run", nrtimers[n], nrtimers[n],
+				    maxtimers);
+			continue;
+		}
+		ret = run_timers(nrtimers[n], duration_ms);
+		if (ret) {
+			smokey_warning("%d timers: %s", nrtimers[n],
+				       strerror(-ret));
+			break;
+		}
+	}
+
+	return ret;
+}
@@ -25,6 +25,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
 #include <sys/timerfd.h>
 #include <smokey/smokey.h>
 
@@ -357,6 +358,69 @@ static int timerfd_unblock_check(void)
 	return smokey_check_errno(close(fd));
 }
 
+static int timerfd_slack_check(void)
+{
+	struct itimerspec its = { .it_interval = { 0, 0 } };
+	unsigned long long ticks;
+	struct timespec t0, t1;
+	int fd, sfd, ret;
+	long long late;
+
+	fd = smokey_check_errno(timerfd_create(CLOCK_MONOTONIC, 0));
+	if (fd < 0)
+		return fd;
+
+	sfd = smokey_check_errno(timerfd_create(CLOCK_MONOTONIC, 0));
+	if (sfd < 0) {
+		close(fd);
+		return sfd;
+	}
+
+	/*
+	 * The slack timer expires 2ms before the exact one, which is
+	 * within its coalescing window: it may fire from the shot of
+	 * the latter, but never before its own expiry date.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	its.it_value.tv_sec = 0;
+	its.it_value.tv_nsec = 10000000;
+	ret = smokey_check_errno(timerfd_settime(fd, 0, &its, NULL));
+	if (ret)
+		goto out;
+
+	its.it_value.tv_nsec = 8000000;
+	ret = smokey_check_errno(timerfd_settime(sfd, TFD_TIMER_SLACK(5000),
+						 &its, NULL));
+	if (ret)
+		goto out;
+
+	ret = smokey_check_errno(read(sfd, &ticks, sizeof(ticks)));
+	if (ret < 0)
+		goto out;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	late = (t1.tv_sec - t0.tv_sec) * 1000000000LL +
+		t1.tv_nsec - t0.tv_nsec - 8000000;
+	smokey_trace("slack timer fired %Ld us late", late / 1000);
+	if (!smokey_assert(ticks == 1) || !smokey_assert(late >= 0)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = smokey_check_errno(read(fd, &ticks, sizeof(ticks)));
+	if (ret < 0)
+		goto out;
+
+	ret = 0;
+	if (!smokey_assert(ticks == 1))
+		ret = -EINVAL;
+out:
+	close(sfd);
+	close(fd);
+
+	return ret;
+}
+
 static int run_timerfd(struct smokey_test *t, int argc, char *const argv[])
 {
 	int ret;
@@ -385,5 +449,9 @@ static int run_timerfd(struct smokey_test *t, int argc, char *const argv[])
 	if (ret)
 		return ret;
 
+	ret = timerfd_slack_check();
+	if (ret)
+		return ret;
+
 	return timerfd_unblock_check();
 }
@@ -0,0 +1,242 @@
+/*
+ * Xenomai is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xenomai is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Xenomai; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <copperplate/registry-snapshot.h>
+
+/*
+ * Decode the binary snapshots exported by the registry as
+ * "<file>.bin", e.g.
+ *
+ * regsnap /var/run/xenomai/root/anon/<pid>/alchemy/queues/<name>.bin
+ */
+
+#define SNAPSHOT_MAX	(1024 * 1024)
+
+static const struct option options[] = {
+	{
+#define help_opt	0
+		.name = "help",
+		.has_arg = no_argument,
+	},
+	{ /* Sentinel */ }
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: regsnap <snapshot-file>...\n");
+	fprintf(stderr, "--help				print this help\n");
+}
+
+static void dump_sem(const void *p)
+{
+	const struct regsnap_alchemy_sem *state = p;
+
+	printf("semaphore value=%d\n", state->value);
+}
+
+static void dump_event(const void *p)
+{
+	const struct regsnap_alchemy_event *state = p;
+
+	printf("event value=%#x\n", state->value);
+}
+
+static void dump_queue(const void *p)
+{
+	const struct regsnap_alchemy_queue *state = p;
+
+	printf("queue mode=%#x totalmem=%llu usedmem=%llu limit=%llu mcount=%u\n",
+	       state->mode,
+	       (unsigned long long)state->totalmem,
+	       (unsigned long long)state->usedmem,
+	       (unsigned long long)state->limit,
+	       state->mcount);
+}
+
+static void dump_heap(const void *p)
+{
+	const struct regsnap_alchemy_heap *state = p;
+
+	printf("heap mode=%#x totalmem=%llu usedmem=%llu\n",
+	       state->mode,
+	       (unsigned long long)state->totalmem,
+	       (unsigned long long)state->usedmem);
+}
+
+static void dump_buffer(const void *p)
+{
+	const struct regsnap_alchemy_buffer *state = p;
+
+	printf("buffer mode=%#x bufsz=%llu fillsz=%llu\n",
+	       state->mode,
+	       (unsigned long long)state->bufsz,
+	       (unsigned long long)state->fillsz);
+}
+
+static const struct {
+	void (*dump)(const void *state);
+	size_t size;
+} classes[] = {
+	[REGSNAP_ALCHEMY_SEM] = {
+		dump_sem, sizeof(struct regsnap_alchemy_sem)
+	},
+	[REGSNAP_ALCHEMY_EVENT] = {
+		dump_event, sizeof(struct regsnap_alchemy_event)
+	},
+	[REGSNAP_ALCHEMY_QUEUE] = {
+		dump_queue, sizeof(struct regsnap_alchemy_queue)
+	},
+	[REGSNAP_ALCHEMY_HEAP] = {
+		dump_heap, sizeof(struct regsnap_alchemy_heap)
+	},
+	[REGSNAP_ALCHEMY_BUFFER] = {
+		dump_buffer, sizeof(struct regsnap_alchemy_buffer)
+	},
+};
+
+static int dump_snapshot(const char *path, const void *buf, size_t len)
+{
+	const struct regsnap_header *hdr = buf;
+	const struct regsnap_waiter *w;
+	uint32_t n;
+
+	if (len < sizeof(*hdr) || hdr->magic != REGSNAP_MAGIC) {
+		error(0, 0, "%s: not a registry snapshot", path);
+		return -EINVAL;
+	}
+
+	if (hdr->version != REGSNAP_VERSION) {
+		error(0, 0, "%s: unsupported snapshot version %u",
+		      path, hdr->version);
+		return -EINVAL;
+	}
+
+	/* Compare against what is left, sums might wrap. */
+	if (hdr->size > len ||
+	    hdr->state_offset > hdr->size ||
+	    hdr->state_size > hdr->size - hdr->state_offset ||
+	    hdr->waiter_offset > hdr->size ||
+	    hdr->waiter_size < sizeof(*w) ||
+	    hdr->nwaiters > (hdr->size - hdr->waiter_offset) /
+	    hdr->waiter_size) {
+		error(0, 0, "%s: truncated snapshot", path);
+		return -EINVAL;
+	}
+
+	printf("%s: ", path);
+
+	if (hdr->class >= sizeof(classes) / sizeof(classes[0]) ||
+	    classes[hdr->class].dump == NULL ||
+	    hdr->state_size < classes[hdr->class].size)
+		printf("class %u\n", hdr->class);
+	else
+		classes[hdr->class].dump(buf + hdr->state_offset);
+
+	printf("  date=%llu.%09llu\n",
+	       (unsigned long long)(hdr->date / 1000000000ULL),
+	       (unsigned long long)(hdr->date % 1000000000ULL));
+
+	for (n = 0; n < hdr->nwaiters; n++) {
+		w = buf + hdr->waiter_offset + (size_t)n * hdr->waiter_size;
+		printf("  waiter %.*s pid=%d prio=%d%s",
+		       REGSNAP_NAME_LEN, w->name, w->pid, w->prio,
+		       w->flags & REGSNAP_WAIT_DRAIN ? " drain" : "");
+		if (hdr->class == REGSNAP_ALCHEMY_HEAP)
+			printf(" reqsz=%llu", (unsigned long long)w->reqsz);
+		putchar('\n');
+	}
+
+	return 0;
+}
+
+static int read_snapshot(const char *path)
+{
+	ssize_t len = 0, ret;
+	void *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		error(0, errno, "%s", path);
+		return -errno;
+	}
+
+	buf = malloc(SNAPSHOT_MAX);
+	if (buf == NULL) {
+		close(fd);
+		return -ENOMEM;
+	}
+
+	/* The snapshot was taken at open time, read it entirely. */
+	while (len < SNAPSHOT_MAX) {
+		ret = read(fd, buf + len, SNAPSHOT_MAX - len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			error(0, errno, "%s", path);
+			ret = -errno;
+			goto out;
+		}
+		if (ret == 0)
+			break;
+		len += ret;
+	}
+
+	ret = dump_snapshot(path, buf, len);
+out:
+	free(buf);
+	close(fd);
+
+	return ret;
+}
+
+int main(int argc, char *const argv[])
+{
+	int lindex, c, n, ret = 0;
+
+	for (;;) {
+		c = getopt_long_only(argc, argv, "", options, &lindex);
+		if (c == EOF)
+			break;
+		if (c == '?') {
+			usage();
+			return 2;
+		}
+		if (lindex == help_opt) {
+			usage();
+			return 0;
+		}
+	}
+
+	if (optind >= argc) {
+		usage();
+		return 2;
+	}
+
+	for (n = optind; n < argc; n++)
+		if (read_snapshot(argv[n]))
+			ret = 1;
+
+	return ret;
+}